@@ -0,0 +1,129 @@
+/**
+ * @file autotune.h
+ * @author PL
+ * @brief Relay feedback auto-tuning of the PID loops
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup AUTOTUNE
+ *
+ * The PID of the loop is suspended and a relay drives the actuator: bias + amplitude while the process
+ * value is below the setpoint, bias - amplitude above it (Astrom-Hagglund). The loop settles into a limit
+ * cycle at its ultimate period Pu. From the amplitude a of the oscillation the ultimate gain is
+ * Ku = 4 * amplitude / (pi * sqrt(a^2 - hysteresis^2)). The first cycle is dropped (transient), the result
+ * is taken when AUTOTUNE_CYCLES cycles agree within AUTOTUNE_MAX_SPREAD_PCT. The gains are written to the
+ * config store:
+ * - Ziegler-Nichols : Kp = 0.6 Ku,   Ti = Pu / 2,   Td = Pu / 8   (fast, ~25% overshoot)
+ * - Tyreus-Luyben   : Kp = Ku / 2.2, Ti = 2.2 Pu,   Td = Pu / 6.3 (robust, for dosing and heating)
+ *
+ * Safety: the relay outputs must be within the output limits of the loop, the experiment is aborted when
+ * the process value leaves setpoint +- max_excursion or after the timeout. At the end the actuator is set
+ * to its lowest output (off) and the PID is enabled again if it was enabled before.
+ * A negative amplitude tunes a reverse acting loop (more output lowers the process value, e.g. pH down).
+ *
+ * Only a registered loop can be tuned (see pid_register()), today only the simulated plant PID_LOOP_SIM.
+ * Components/Test/test_autotune.c runs the experiment on it and checks Ku and Pu against the analytic
+ * values and the step response with the tuned gains.
+ *
+ * \addtogroup AUTOTUNE
+ * @{
+ */
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "pid.h"
+
+#define AUTOTUNE_CYCLES         4u  /* Oscillation cycles used for the result */
+#define AUTOTUNE_MAX_SPREAD_PCT 10u /* Maximum spread of the periods and amplitudes of these cycles [%] */
+
+/**
+ * @brief State of the experiment
+ */
+typedef enum
+{
+    AUTOTUNE_IDLE = 0u, /**< Never started */
+    AUTOTUNE_RUNNING,   /**< Relay experiment running */
+    AUTOTUNE_DONE,      /**< Gains written to the config store */
+    AUTOTUNE_EXCURSION, /**< Aborted, the process value left the allowed band */
+    AUTOTUNE_TIMEOUT,   /**< Aborted, no stable oscillation within the timeout */
+    AUTOTUNE_STOPPED,   /**< Aborted by autotune_stop() */
+    AUTOTUNE_SAVE_FAIL, /**< Gains computed but the config store could not be written */
+} AUTOTUNE_STATE;
+
+/**
+ * @brief Tuning rule
+ */
+typedef enum
+{
+    AUTOTUNE_RULE_ZN = 0u, /**< Ziegler-Nichols */
+    AUTOTUNE_RULE_TL,      /**< Tyreus-Luyben */
+} AUTOTUNE_RULE;
+
+/**
+ * @brief Parameters of the experiment
+ */
+typedef struct
+{
+    float setpoint;      /**< Process value the relay switches around */
+    float bias;          /**< Output in the middle of the relay */
+    float amplitude;     /**< Relay step, negative for a reverse acting loop */
+    float hysteresis;    /**< Switching hysteresis against noise on the process value */
+    float max_excursion; /**< Abort when the process value leaves setpoint +- max_excursion */
+    uint32_t timeout_ms; /**< Abort when there is no result within this time [ms] */
+    AUTOTUNE_RULE rule;  /**< Tuning rule */
+} AUTOTUNE_CONFIG;
+
+/**
+ * @brief Result of the experiment
+ */
+typedef struct
+{
+    float ku;        /**< Ultimate gain */
+    float pu;        /**< Ultimate period [s] */
+    PID_GAINS gains; /**< Gains of the tuning rule */
+} AUTOTUNE_RESULT;
+
+/***************************************************
+ * @brief Start the relay experiment on a loop, runs in a coroutine
+ * @param loop Loop to tune, must be registered
+ * @param config Parameters, copied
+ * @return false if an experiment is running, the loop is not registered or the relay exceeds the output limits
+ ***************************************************/
+bool autotune_start(PID_LOOP loop, const AUTOTUNE_CONFIG* config) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Abort a running experiment
+ ***************************************************/
+void autotune_stop(void);
+
+/***************************************************
+ * @brief Get the state of the experiment
+ * @return State
+ ***************************************************/
+AUTOTUNE_STATE autotune_get_state(void);
+
+/***************************************************
+ * @brief Get the result of the last successful experiment
+ * @param result Result output
+ * @return true if a result is available
+ ***************************************************/
+bool autotune_get_result(AUTOTUNE_RESULT* result) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Compute the PID gains from the ultimate gain and period
+ * @param ku Ultimate gain
+ * @param pu Ultimate period [s]
+ * @param rule Tuning rule
+ * @param gains Gains output
+ ***************************************************/
+void autotune_gains(float ku, float pu, AUTOTUNE_RULE rule, PID_GAINS* gains) __attribute__((__nonnull__(4)));
+
+/***************************************************
+ * @brief Print the state and the result of the experiment
+ ***************************************************/
+void autotune_print(void);
+
+#endif /* AUTOTUNE_H */
+/** @}*/
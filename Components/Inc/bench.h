@@ -0,0 +1,56 @@
+/**
+ * @file bench.h
+ * @author PL
+ * @brief Cycle accurate benchmarks with the DWT cycle counter
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup BENCH
+ *
+ * The FPU context is enabled in FreeRTOS (configENABLE_FPU) with lazy stacking (FPCCR.LSPEN).
+ * A task which never executed an FP instruction switches like an integer only task,
+ * a task using floats additionally saves/restores s16-s31 in the context switch and s0-s15 + FPSCR
+ * in the exception frame (only when the handler itself uses the FPU, due to lazy stacking).
+ * Run the "bench" command to see the cost on the target:
+ * - "ctx int"  : push/pop of r4-r11, the register part of the context save/restore
+ * - "ctx fpu"  : push/pop of r4-r11 + vpush/vpop of s16-s31, the same for a task using floats
+ * - "mac"      : multiply-accumulate loop in float and in Q15 fixed point
+ * - "div"      : division in float and in integer
+ *
+ * The scheduler isn't started in this firmware (main() runs a superloop), so the "ctx" numbers are
+ * only the extra instructions of the FP context in a switch, not a measured PendSV switch with its
+ * exception entry, task selection and lazy stacking. They show the difference between the two kinds
+ * of tasks, not the switch time. Measure real switches before a task layout depends on them.
+ *
+ * Guideline for the superloop: control and conversion code (filters, PID, sensor scaling) may use
+ * float, "mac" and "div" show no cost against fixed point. Interrupt handlers should stay integer,
+ * so they don't trigger the lazy stacking of the exception frame.
+ *
+ * \addtogroup BENCH
+ * @{
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#include "define.h"
+
+#define BENCH_LOOPS 64u /* Number of iterations of a benchmark loop */
+
+/***************************************************
+ * @brief Enable the DWT cycle counter
+ ***************************************************/
+void bench_init(void);
+
+/***************************************************
+ * @brief Get the CPU cycle counter
+ * @return Cycles since bench_init(), wraps around
+ ***************************************************/
+uint32_t bench_get_cycles(void);
+
+/***************************************************
+ * @brief Run all benchmarks and print the results
+ ***************************************************/
+void bench_run(void);
+
+#endif /* BENCH_H */
+/** @}*/
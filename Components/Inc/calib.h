@@ -0,0 +1,174 @@
+/**
+ * @file calib.h
+ * @author PL
+ * @brief Calibration manager: multi-point sensor calibration and cached ADC self-calibration
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup CALIB
+ *
+ * Each sensor has a linear coefficient set (value = gain * raw + offset) in the config store with the
+ * time of the calibration and a version number, the set before the last calibration is kept for a
+ * rollback. The drivers convert with calib_apply(), which reads the set in RAM at every call: a new
+ * set applies at once, without a reboot ("config save" keeps it).
+ *
+ * Console workflow: "calib <sensor> start", one "calib <sensor> point <reference> [raw]" per buffer
+ * solution or reference reading, then "calib <sensor> apply". One point corrects the offset, more
+ * points fit gain and offset (least squares). The raw value is read from the driver registered with
+ * calib_register(), or given on the command line.
+ *
+ * ADC self-calibration: calib_adc() runs HAL_ADCEx_Calibration_Start() only when the config store has
+ * no factor of this chip, the factor is read back and cached. Later boots write the cached factor,
+ * which takes microseconds instead of the calibration routine. calib_commit() writes a new factor to
+ * flash once after all ADCs are initialized.
+ *
+ * \addtogroup CALIB
+ * @{
+ */
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "stm32_hal.h"
+
+#define CALIB_MAX_POINTS 5u   /* Points of a calibration */
+#define CALIB_GAIN_MIN   0.2f /* Lowest plausible gain, the drivers deliver raw values in the unit of the sensor */
+#define CALIB_GAIN_MAX   5.0f /* Highest plausible gain */
+
+/**
+ * @brief Calibrated sensors
+ */
+typedef enum
+{
+    CALIB_PH = 0u, /**< pH probe [pH] */
+    CALIB_EC,      /**< EC probe [mS/cm] */
+    CALIB_TEMP,    /**< Reservoir temperature [degC] */
+    CALIB_SENSORS, /**< Number of sensors */
+} CALIB_SENSOR;
+
+/**
+ * @brief ADCs with a cached self-calibration factor
+ */
+typedef enum
+{
+    CALIB_ADC1 = 0u, /**< ADC1, pump monitor */
+    CALIB_ADC4,      /**< ADC4, scope */
+    CALIB_ADCS,      /**< Number of ADCs */
+} CALIB_ADC;
+
+/**
+ * @brief Coefficient set of a sensor, the default set is gain 1 and offset 0
+ */
+typedef struct
+{
+    float gain;       /**< Gain [unit / raw] */
+    float offset;     /**< Offset [unit] */
+    uint32_t time;    /**< Time of the calibration [s since 2000], 0 for the default set */
+    uint16_t version; /**< Number of the calibration, 0 for the default set */
+    uint16_t points;  /**< Points of the calibration */
+} CALIB_SET;
+
+/**
+ * @brief Calibration data, stored in the config store
+ */
+typedef struct
+{
+    CALIB_SET sets[CALIB_SENSORS];     /**< Active coefficient sets */
+    CALIB_SET previous[CALIB_SENSORS]; /**< Sets before the last calibration, for a rollback */
+    uint32_t adc_factor[CALIB_ADCS];   /**< Cached self-calibration factors */
+    uint32_t adc_valid;                /**< Valid cached factors, bit n is CALIB_ADC n */
+    uint32_t adc_chip;                 /**< Chip of the cached factors (hash of the unique ID) */
+} CALIB_DATA;
+
+/***************************************************
+ * @brief Register the raw reading of a sensor for the console workflow
+ * @param sensor Sensor
+ * @param read_raw Read the uncalibrated value
+ ***************************************************/
+void calib_register(CALIB_SENSOR sensor, float (*read_raw)(void)) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Convert a raw reading with the active set
+ * @param sensor Sensor
+ * @param raw Uncalibrated value
+ * @return Calibrated value, raw if the sensor doesn't exist
+ ***************************************************/
+float calib_apply(CALIB_SENSOR sensor, float raw);
+
+/***************************************************
+ * @brief Start a calibration, the collected points are dropped
+ * @param sensor Sensor
+ * @return false if the sensor doesn't exist
+ ***************************************************/
+bool calib_start(CALIB_SENSOR sensor);
+
+/***************************************************
+ * @brief Drop the running calibration, the set is not changed
+ ***************************************************/
+void calib_cancel(void);
+
+/***************************************************
+ * @brief Add a point to the running calibration
+ * @param sensor Sensor
+ * @param reference Reference value [unit]
+ * @param raw Uncalibrated value
+ * @return false if no calibration of this sensor runs or all points are taken
+ ***************************************************/
+bool calib_point(CALIB_SENSOR sensor, float reference, float raw);
+
+/***************************************************
+ * @brief Read the raw value of a sensor from its registered driver
+ * @param sensor Sensor
+ * @param raw Uncalibrated value
+ * @return false if no driver is registered
+ ***************************************************/
+bool calib_read_raw(CALIB_SENSOR sensor, float* raw) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Fit the points of the running calibration and activate the new set
+ * @param sensor Sensor
+ * @return false if there are no points, the points don't fit or the gain is implausible, the set is not changed
+ ***************************************************/
+bool calib_finish(CALIB_SENSOR sensor);
+
+/***************************************************
+ * @brief Swap the active set with the set before the last calibration
+ * @param sensor Sensor
+ * @return false if the sensor doesn't exist
+ ***************************************************/
+bool calib_rollback(CALIB_SENSOR sensor);
+
+/***************************************************
+ * @brief Calibrate an ADC or write its cached factor, call before the ADC is enabled
+ * @param adc ADC
+ * @param hadc Initialized ADC
+ * @return false if the calibration fails
+ ***************************************************/
+bool calib_adc(CALIB_ADC adc, ADC_HandleTypeDef* hadc) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Drop the cached ADC factors, the ADCs are calibrated at the next boot
+ ***************************************************/
+void calib_adc_invalidate(void);
+
+/***************************************************
+ * @brief Write new cached ADC factors to flash
+ * @return false if the config store can't be written, true if written or nothing new
+ ***************************************************/
+bool calib_commit(void);
+
+/***************************************************
+ * @brief Print the coefficient sets, the running calibration and the ADC factors
+ ***************************************************/
+void calib_print(void);
+
+/***************************************************
+ * @brief Get the number of a sensor from its name
+ * @param name "ph", "ec" or "temp"
+ * @return Sensor, CALIB_SENSORS if the name is unknown
+ ***************************************************/
+CALIB_SENSOR calib_find(const char* name) __attribute__((__nonnull__(1)));
+
+#endif /* CALIB_H */
+/** @}*/
@@ -0,0 +1,77 @@
+/**
+ * @file config.h
+ * @author PL
+ * @brief Configuration store in the internal flash
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup CONFIG
+ *
+ * The configuration lives in RAM (config_get()) and is written to flash with config_save().
+ * Two flash pages are used alternately: a save erases and programs the page which doesn't hold
+ * the newest record, so a reset during a save keeps the previous configuration. Each record has
+ * a sequence number and a CRC, the valid record with the highest sequence number is loaded.
+ *
+ * CONFIG_DATA only grows at the end. A record of an older version is loaded over the defaults,
+ * so fields added later keep their default values. Increment CONFIG_VERSION when adding fields.
+ *
+ * \addtogroup CONFIG
+ * @{
+ */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "calib.h"
+#include "define.h"
+#include "dli.h"
+#include "dose.h"
+#include "irrigation.h"
+#include "pid.h"
+
+#define CONFIG_VERSION 7u /* Version of CONFIG_DATA */
+
+/**
+ * @brief Configuration
+ */
+typedef struct
+{
+    PID_GAINS pid[PID_MAX_LOOPS];                       /**< Gains of the control loops */
+    PID_GAINS fan;                                      /**< Gains of the fan speed loops [% / rpm], since version 2 */
+    IRRIGATION_CONFIG irrigation[IRRIGATION_MAX_ZONES]; /**< Timing of the irrigation zones, since version 3 */
+    DOSE_CONFIG dose;                                   /**< Reservoir and stock solutions of the dose planner, since version 4 */
+    CALIB_DATA calib;                                   /**< Sensor coefficient sets and cached ADC factors, since version 5 */
+    DLI_CONFIG dli;                                     /**< Target and light period of the daily light integral, since version 6 */
+    float irrigation_fill_ml_min[IRRIGATION_MAX_ZONES]; /**< Flow of the fill pumps from the reservoir [mL/min], 0 if unknown, since version 7 */
+} CONFIG_DATA;
+
+/***************************************************
+ * @brief Load the newest valid configuration from flash, or the defaults
+ * @return true if a configuration was loaded from flash
+ ***************************************************/
+bool config_init(void);
+
+/***************************************************
+ * @brief Get the configuration in RAM, changes are written to flash by config_save()
+ * @return Configuration
+ ***************************************************/
+CONFIG_DATA* config_get(void);
+
+/***************************************************
+ * @brief Load the default configuration in RAM, the flash is not changed
+ ***************************************************/
+void config_set_default(void);
+
+/***************************************************
+ * @brief Write the configuration to flash
+ * @return true if written and verified
+ ***************************************************/
+bool config_save(void);
+
+/***************************************************
+ * @brief Print the state of the configuration store
+ ***************************************************/
+void config_print(void);
+
+#endif /* CONFIG_H */
+/** @}*/
@@ -0,0 +1,77 @@
+/**
+ * @file config_blob.h
+ * @author PL
+ * @brief Binary export and import of the configuration, to clone the settings of a unit
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup CONFIG_BLOB
+ *
+ * The blob is a subset of CBOR (RFC 8949): unsigned and negative integers, float32, arrays and maps.
+ * @code
+ * [ CONFIG_VERSION, { field id: value or [ values ], ... }, CRC-16 ]
+ * @endcode
+ * The CRC-16 of crc_calc() covers all bytes in front of it. A field is a member of CONFIG_DATA, a
+ * member of an array of structs (the gains of all loops, the timing of all zones) is one field with
+ * an array value. Field ids are never reused, so a blob of an older firmware version can be imported:
+ * fields missing in the blob keep their current values. A blob of a newer version is rejected, the
+ * fields this firmware doesn't know would be dropped and the unit cloned only in part. Unknown field
+ * ids in a blob of the same version are skipped, surplus array elements are ignored. The cached ADC
+ * factors are specific to the chip and not exported.
+ *
+ * The parser is fed with any number of bytes at a time and needs no buffer for the blob: it writes
+ * the values to a copy of the configuration, which replaces the configuration in RAM at once when
+ * the CRC is valid and the values are plausible: calibration gains within CALIB_GAIN_MIN ..
+ * CALIB_GAIN_MAX, irrigation timeouts and dosing pump flows not 0, lights off within the day. A
+ * broken, incomplete or implausible blob doesn't change anything.
+ *
+ * \addtogroup CONFIG_BLOB
+ * @{
+ */
+#ifndef CONFIG_BLOB_H
+#define CONFIG_BLOB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define CONFIG_BLOB_MAX 768u /* Largest blob [bytes] */
+
+/**
+ * @brief State of an import
+ */
+typedef enum
+{
+    CONFIG_BLOB_IDLE = 0u, /**< No import started */
+    CONFIG_BLOB_BUSY,      /**< Waiting for more bytes */
+    CONFIG_BLOB_DONE,      /**< Complete, the configuration is replaced */
+    CONFIG_BLOB_ERROR,     /**< Invalid blob, the configuration is not changed */
+} CONFIG_BLOB_STATE;
+
+/***************************************************
+ * @brief Encode the configuration in RAM
+ * @param buf Output
+ * @param size Size of buf [bytes], CONFIG_BLOB_MAX is enough
+ * @return Length of the blob [bytes], 0 if buf is too small
+ ***************************************************/
+uint32_t config_blob_export(uint8_t* buf, uint32_t size) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Start an import, an unfinished import is dropped
+ ***************************************************/
+void config_blob_import_begin(void);
+
+/***************************************************
+ * @brief Feed bytes of the blob to the import, the first bytes after a finished import start a new one
+ * @param data Bytes
+ * @param len Number of bytes
+ * @return State after these bytes
+ ***************************************************/
+CONFIG_BLOB_STATE config_blob_import(const uint8_t* data, uint32_t len) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Print the state and the counters of the last import
+ ***************************************************/
+void config_blob_print(void);
+
+#endif /* CONFIG_BLOB_H */
+/** @}*/
@@ -17,6 +17,7 @@
 #include "uart.h"
 
 #define CONSOLE_RX_BUF_LEN 320u  /* Length of UART receive buffer */
+#define CONSOLE_LINE_LEN   160u  /* Length of a command line, including the terminator */
 #define CONSOLE_TX_BUF_LEN 1024u /* Length of UART transmit buffer */
 #define CONSOLE_TIMEOUT    10u   /* maximum time to send a string in ms */
 
@@ -56,10 +57,25 @@ void console_enable_silent_printf(bool enable);
 
 /***************************************************
  * @brief Read line (CR+LF) in console
- * @param buf pointer of buffer to store the received line
- * @param max_len maximum length of the buffer
+ *
+ * The line is edited in the only line buffer of the console and handed out in place. The caller
+ * may modify it (tokenize) and must give it back with console_release_line(), no new characters
+ * are taken from the receive buffer until then.
+ *
+ * @return Complete line, 0 terminated, NULL if no line is complete yet
+ ***************************************************/
+char* console_read_line(void);
+
+/***************************************************
+ * @brief Give the line of console_read_line() back, the next line is edited in the buffer
+ ***************************************************/
+void console_release_line(void);
+
+/***************************************************
+ * @brief Check if a complete line waits in the receive buffer
+ * @return true if a CR was received and not read yet
  ***************************************************/
-bool console_read_line(char* buf, uint16_t max_len);
+bool console_line_pending(void);
 
 /***************************************************
  * @brief Print buffered data until timeout.
@@ -0,0 +1,219 @@
+/**
+ * @file coroutine.h
+ * @author PL
+ * @brief Stackless coroutines (protothreads) for non-blocking driver state machines
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup COROUTINE
+ *
+ * A coroutine is a function which resumes at the line it returned from the last time,
+ * implemented with a switch statement on a line number (Duff's device).
+ * The coroutine has no own stack, so local variables are NOT preserved over a yield or wait,
+ * keep the state in a struct which embeds the CORO control block as its first member.
+ * A switch statement can't be used inside the coroutine body around a yield or wait, and only one yield or wait fits on a line.
+ *
+ * Usage:
+ * @code
+ * static CORO_STATE sensor_coro(CORO* c)
+ * {
+ *     CORO_BEGIN(c);
+ *     start_conversion();
+ *     CORO_WAIT_EVENT(c, SENSOR_EV_DONE, 100u);
+ *     if (coro_take_events(c, SENSOR_EV_DONE) == 0u) { ... timeout ... }
+ *     CORO_SLEEP(c, 1000u);
+ *     CORO_END(c);
+ * }
+ * @endcode
+ *
+ * \addtogroup COROUTINE
+ * @{
+ */
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define CORO_WAIT_FOREVER 0xFFFFFFFFu /* Timeout value to wait for an event without timeout */
+
+#define CORO_FLAG_TIMED 0x0001u /* A deadline is armed */
+#define CORO_FLAG_POLL  0x0002u /* Call the coroutine every cycle while the deadline is armed */
+
+/**
+ * @brief Result of a coroutine call
+ */
+typedef enum
+{
+    CORO_WAITING = 0u, /**< Blocked on a condition, an event or a timeout */
+    CORO_YIELDED,      /**< Gave up the CPU, call again next cycle */
+    CORO_EXITED,       /**< Reached CORO_END, removed from the scheduler */
+} CORO_STATE;
+
+typedef struct CORO CORO;
+
+/**
+ * @brief Control block of a coroutine (20 bytes)
+ */
+struct CORO
+{
+    CORO_STATE (*func)(CORO* c); /**< Body of the coroutine */
+    CORO* next;                  /**< Next coroutine in the scheduler list */
+    uint32_t deadline;           /**< Tick when a sleep or event wait times out */
+    volatile uint16_t events;    /**< Pending events, set by coro_post_event() */
+    uint16_t wait_mask;          /**< Events the coroutine waits for, 0 if not waiting on events */
+    uint16_t lc;                 /**< Local continuation: line to resume at */
+    uint16_t flags;              /**< Internal flags */
+};
+
+/***************************************************
+ * @brief Start of the coroutine body
+ ***************************************************/
+#define CORO_BEGIN(c) \
+    switch ((c)->lc)  \
+    {                 \
+    case 0u:
+
+/***************************************************
+ * @brief End of the coroutine body, the coroutine exits
+ ***************************************************/
+#define CORO_END(c) \
+    }               \
+    (c)->lc = 0u;   \
+    return CORO_EXITED
+
+/***************************************************
+ * @brief Give up the CPU, resume next scheduler cycle
+ ***************************************************/
+#define CORO_YIELD(c)                 \
+    do                                \
+    {                                 \
+        (c)->lc = (uint16_t)__LINE__; \
+        return CORO_YIELDED;          \
+    case __LINE__:;                   \
+    } while (0)
+
+/***************************************************
+ * @brief Wait until a condition is true, condition is polled every scheduler cycle
+ ***************************************************/
+#define CORO_WAIT_UNTIL(c, cond)      \
+    do                                \
+    {                                 \
+        (c)->lc = (uint16_t)__LINE__; \
+    case __LINE__:                    \
+        if (!(cond))                  \
+        {                             \
+            return CORO_WAITING;      \
+        }                             \
+    } while (0)
+
+/***************************************************
+ * @brief Wait until a condition is true or a timeout, condition is polled every scheduler cycle
+ * Use coro_timed_out() afterwards to see if the wait timed out.
+ ***************************************************/
+#define CORO_WAIT_UNTIL_TIMEOUT(c, cond, ms)               \
+    do                                                     \
+    {                                                      \
+        coro_arm_wait((c), 0u, (ms));                      \
+        (c)->flags |= CORO_FLAG_POLL;                      \
+        CORO_WAIT_UNTIL((c), (cond) || coro_timed_out(c)); \
+        coro_disarm(c);                                    \
+    } while (0)
+
+/***************************************************
+ * @brief Sleep for a time, the coroutine is not called by the scheduler meanwhile
+ ***************************************************/
+#define CORO_SLEEP(c, ms)                        \
+    do                                           \
+    {                                            \
+        coro_arm_wait((c), 0u, (ms));            \
+        CORO_WAIT_UNTIL((c), coro_timed_out(c)); \
+        coro_disarm(c);                          \
+    } while (0)
+
+/***************************************************
+ * @brief Wait for any event in mask or a timeout
+ * The coroutine is only called when an event arrived or the timeout expired.
+ * Use coro_take_events() afterwards to see which events arrived (0 means timeout).
+ ***************************************************/
+#define CORO_WAIT_EVENT(c, mask, ms)                                                       \
+    do                                                                                     \
+    {                                                                                      \
+        coro_arm_wait((c), (mask), (ms));                                                  \
+        CORO_WAIT_UNTIL((c), (((c)->events & (c)->wait_mask) != 0u) || coro_timed_out(c)); \
+        coro_disarm(c);                                                                    \
+    } while (0)
+
+/***************************************************
+ * @brief Restart a coroutine from the beginning at the next call
+ ***************************************************/
+#define CORO_RESTART(c)      \
+    do                       \
+    {                        \
+        (c)->lc = 0u;        \
+        return CORO_YIELDED; \
+    } while (0)
+
+/***************************************************
+ * @brief Add a coroutine to the scheduler
+ * @param c Pointer to the control block, must stay valid while the coroutine runs
+ * @param func Body of the coroutine
+ ***************************************************/
+void coro_start(CORO* c, CORO_STATE (*func)(CORO* c)) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Remove a coroutine from the scheduler
+ * @param c Pointer to the control block
+ ***************************************************/
+void coro_stop(CORO* c) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Post events to a coroutine, can be called from an interrupt
+ * @param c Pointer to the control block
+ * @param events Event bits to set
+ ***************************************************/
+void coro_post_event(CORO* c, uint16_t events) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Read and clear events
+ * @param c Pointer to the control block
+ * @param mask Events to read
+ * @return Events in mask which were pending
+ ***************************************************/
+uint16_t coro_take_events(CORO* c, uint16_t mask) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Prepare a wait with timeout, used by CORO_SLEEP and CORO_WAIT_EVENT
+ * @param c Pointer to the control block
+ * @param mask Events to wait for, 0 to wait for the timeout only
+ * @param timeout_ms Timeout [ms], CORO_WAIT_FOREVER for no timeout
+ ***************************************************/
+void coro_arm_wait(CORO* c, uint16_t mask, uint32_t timeout_ms) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Finish a wait, used by CORO_SLEEP and CORO_WAIT_EVENT
+ * @param c Pointer to the control block
+ ***************************************************/
+void coro_disarm(CORO* c) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Check if the timeout of the current wait expired
+ * @param c Pointer to the control block
+ * @return true if the timeout expired
+ ***************************************************/
+bool coro_timed_out(const CORO* c) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Run all ready coroutines once, call this from the main loop
+ * @return Number of coroutines which were called
+ ***************************************************/
+uint32_t coro_proc(void);
+
+/***************************************************
+ * @brief Get the number of coroutines in the scheduler
+ * @return Number of coroutines
+ ***************************************************/
+uint32_t coro_get_count(void);
+
+#endif /* COROUTINE_H */
+/** @}*/
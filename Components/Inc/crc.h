@@ -0,0 +1,74 @@
+/**************************************************
+ * @file crc.h
+ * @date 3-5-2016
+ * @author JWA, PL
+ * @brief CRC 16 calculation
+ * @copyright (c) Copyright Cleantron 2016
+ * @ingroup CRC
+ *
+ * \addtogroup CRC
+ * @{
+ ****************************************************/
+#ifndef CRC_H
+#define CRC_H
+
+#include "stm32_hal.h"
+#include <stdint.h>
+
+#define CRC32_INIT 0xFFFFFFFFu /* Initial state of crc32_hw_update() */
+
+/**************************************************
+ * @brief Store the handle of the CRC peripheral and check the CRC table
+ * @param hcrc Handle of the CRC peripheral
+ ****************************************************/
+void crc_init(CRC_HandleTypeDef* hcrc);
+
+/**************************************************
+ * @brief Calculate the CRC-16 (polynomial 0xA001, initial value 0) with the table
+ * @param buf Data
+ * @param length Number of bytes
+ * @return CRC-16
+ ****************************************************/
+uint16_t crc_calc(const void* buf, const uint32_t length);
+
+/**************************************************
+ * @brief Continue a CRC-16 of crc_calc() over more data, crc_calc(buf, n) equals crc_update(0, buf, n)
+ * @param crc CRC of the previous data, 0 for the start
+ * @param buf Data
+ * @param length Number of bytes
+ * @return CRC-16 of the previous data and buf
+ ****************************************************/
+uint16_t crc_update(uint16_t crc, const void* buf, const uint32_t length);
+
+/**************************************************
+ * @brief Calculate a CRC-16 with the CRC peripheral
+ * @param buf Data
+ * @param length Number of bytes
+ * @param polynom Polynomial
+ * @return CRC-16, 0 if the peripheral can't be configured
+ ****************************************************/
+uint16_t crc_hw_calc(const void* buf, const uint32_t length, const uint16_t polynom);
+
+/**************************************************
+ * @brief Continue a CRC-32 (IEEE 802.3, as zlib crc32()) over words with the CRC peripheral
+ *
+ * The calculation can be split over several calls, the configuration of the peripheral is
+ * restored after every call so crc_hw_calc() can be used in between.
+ *
+ * @param state CRC32_INIT for the first call, then the return value of the previous call
+ * @param buf Data, word aligned
+ * @param num_words Number of words
+ * @return New state, crc32_hw_final() gives the CRC-32
+ ****************************************************/
+uint32_t crc32_hw_update(uint32_t state, const uint32_t* buf, const uint32_t num_words);
+
+/**************************************************
+ * @brief Get the CRC-32 of a state of crc32_hw_update()
+ * @param state State
+ * @return CRC-32
+ ****************************************************/
+uint32_t crc32_hw_final(uint32_t state);
+
+/** @}*/
+
+#endif //CRC_H
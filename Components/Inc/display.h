@@ -0,0 +1,116 @@
+/**
+ * @file display.h
+ * @author PL
+ * @brief Local status display: ST7735 TFT on SPI1 with dirty tile tracking and DMA partial updates
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup DISPLAY
+ *
+ * The drawing functions write into a framebuffer in RAM (RGB565, byte order of the panel) and mark
+ * the tiles of DISPLAY_TILE_W x DISPLAY_TILE_H pixels they changed; pixels written with their old
+ * value don't mark a tile, so redrawing an unchanged page sends nothing. A coroutine calls the page
+ * callback every DISPLAY_PERIOD and flushes the dirty tiles as windows: adjacent dirty tiles of a tile
+ * row form one window, complete tile rows are merged and sent straight from the framebuffer. The rows
+ * of a partial window are gathered by the memory DMA into one of two staging buffers, so the next
+ * window is prepared while the SPI DMA sends the current one.
+ *
+ * Text uses a 5x7 font in flash. Rendered glyphs (scale 1) are kept in a small cache by character and
+ * colors, a cached character is copied row by row instead of being expanded pixel by pixel.
+ *
+ * The draw time, the CPU time and the duration of the flush are measured every frame against the
+ * budget of DISPLAY_PERIOD, see display_print().
+ *
+ * \addtogroup DISPLAY
+ * @{
+ */
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "stm32_hal.h"
+
+#define DISPLAY_WIDTH       160u                              /* Landscape [px] */
+#define DISPLAY_HEIGHT      128u                              /* Landscape [px] */
+#define DISPLAY_TILE_W      32u                               /* Tile width [px] */
+#define DISPLAY_TILE_H      8u                                /* Tile height [px], a text line, at most MEMDMA_MAX_ITEMS */
+#define DISPLAY_TILE_COLS   (DISPLAY_WIDTH / DISPLAY_TILE_W)  /* Tiles per tile row */
+#define DISPLAY_TILE_ROWS   (DISPLAY_HEIGHT / DISPLAY_TILE_H) /* Tile rows */
+#define DISPLAY_FONT_W      6u                                /* Character cell width [px], 5 px glyph and spacing */
+#define DISPLAY_FONT_H      8u                                /* Character cell height [px], 7 px glyph and spacing */
+#define DISPLAY_GLYPH_CACHE 32u                               /* Rendered glyphs in RAM */
+#define DISPLAY_PERIOD      250u                              /* Frame period and budget [ms] */
+
+#define DISPLAY_RGB(r, g, b) ((uint16_t)((((uint32_t)(r) & 0xF8u) << 8) | (((uint32_t)(g) & 0xFCu) << 3) | ((uint32_t)(b) >> 3)))
+#define DISPLAY_BLACK  DISPLAY_RGB(0u, 0u, 0u)
+#define DISPLAY_WHITE  DISPLAY_RGB(255u, 255u, 255u)
+#define DISPLAY_GREY   DISPLAY_RGB(128u, 128u, 128u)
+#define DISPLAY_RED    DISPLAY_RGB(255u, 0u, 0u)
+#define DISPLAY_GREEN  DISPLAY_RGB(0u, 200u, 0u)
+#define DISPLAY_BLUE   DISPLAY_RGB(0u, 0u, 160u)
+#define DISPLAY_YELLOW DISPLAY_RGB(255u, 220u, 0u)
+
+/**
+ * @brief Hardware of the display
+ */
+typedef struct
+{
+    SPI_HandleTypeDef* hspi; /**< SPI with TX DMA, reconfigured to 8 bit frames */
+    GPIO_TypeDef* dc_port;   /**< Data/command output, port */
+    uint16_t dc_pin;         /**< Data/command output, pin */
+    GPIO_TypeDef* rst_port;  /**< Reset output, port */
+    uint16_t rst_pin;        /**< Reset output, pin */
+} DISPLAY_HW;
+
+/***************************************************
+ * @brief Configure the SPI and the pins, clear the framebuffer and start the coroutine, the panel is reset by it
+ * @param hw Hardware, must stay valid
+ * @param draw Page callback, draws the page every frame, NULL for none
+ * @return true if configured
+ ***************************************************/
+bool display_init(const DISPLAY_HW* hw, void (*draw)(void)) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Fill a rectangle, clipped to the screen
+ * @param x Left [px]
+ * @param y Top [px]
+ * @param w Width [px]
+ * @param h Height [px]
+ * @param color RGB565 color, DISPLAY_RGB()
+ ***************************************************/
+void display_fill_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color);
+
+/***************************************************
+ * @brief Draw a line of text, characters beyond the screen are not drawn
+ * @param x Left [px]
+ * @param y Top [px]
+ * @param text Text, ASCII 32 .. 126, other characters are drawn as '?'
+ * @param fg Text color
+ * @param bg Background color
+ * @param scale Magnification, 1 .. 4, only scale 1 uses the glyph cache
+ ***************************************************/
+void display_text(uint32_t x, uint32_t y, const char* text, uint16_t fg, uint16_t bg, uint32_t scale) __attribute__((__nonnull__(3)));
+
+/***************************************************
+ * @brief Draw a formatted line of text at scale 1
+ * @param x Left [px]
+ * @param y Top [px]
+ * @param fg Text color
+ * @param bg Background color
+ * @param format printf format
+ ***************************************************/
+void display_printf(uint32_t x, uint32_t y, uint16_t fg, uint16_t bg, const char* format, ...) __attribute__((__nonnull__(5), format(printf, 5, 6)));
+
+/***************************************************
+ * @brief Mark the whole screen dirty, the next frame sends all of it
+ ***************************************************/
+void display_invalidate(void);
+
+/***************************************************
+ * @brief Print the frame budget metrics and the glyph cache counters
+ ***************************************************/
+void display_print(void);
+
+#endif /* DISPLAY_H */
+/** @}*/
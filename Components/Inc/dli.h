@@ -0,0 +1,102 @@
+/**
+ * @file dli.h
+ * @author PL
+ * @brief Daily light integral (DLI) of the PAR sensor for lighting control
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup DLI
+ *
+ * The PAR samples [umol/m2/s] are integrated with the trapezoidal rule over the epoch seconds of the RTC
+ * in a 64 bit Q16.16 accumulator [umol/m2], each sample is O(1). At local midnight the integral of the day
+ * is closed, the interval over midnight is split between both days. The integral is stored in the RTC
+ * backup registers with every sample, so it survives a reset. Gaps longer than DLI_MAX_GAP_S (sensor or
+ * controller off) are not integrated, the light during a gap is unknown.
+ *
+ * The lighting engine uses dli_get_required_par() to set the intensity so the target is reached when the
+ * lights switch off, or dli_get_remaining_s() to know how long to keep the lights on at a given intensity.
+ * The target and the switch off time are part of the configuration (DLI_CONFIG in CONFIG_DATA).
+ *
+ * \addtogroup DLI
+ * @{
+ */
+#ifndef DLI_H
+#define DLI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "fixmath.h"
+
+#define DLI_SECONDS_PER_DAY   86400u             /* Length of a day [s] */
+#define DLI_MAX_GAP_S         300u               /* Longer intervals between samples are not integrated [s] */
+#define DLI_TARGET_DEFAULT    FIX16_FROM_INT(17) /* Default target [mol/m2/d] */
+#define DLI_LIGHT_END_DEFAULT (22u * 3600u)      /* Default time the lights switch off [s of the day] */
+
+/**
+ * @brief Configuration of the light integral
+ */
+typedef struct
+{
+    q16_t target;         /**< Target [mol/m2/d], not negative */
+    uint32_t light_end_s; /**< Time the lights switch off [s of the day] */
+} DLI_CONFIG;
+
+/***************************************************
+ * @brief Initialize the accumulator, the integral of today is restored from the RTC backup registers
+ * @param now_s Epoch seconds of the RTC (rtc_get_seconds())
+ ***************************************************/
+void dli_init(uint32_t now_s);
+
+/***************************************************
+ * @brief Add a PAR sample, O(1)
+ * @param now_s Epoch seconds of the RTC (rtc_get_seconds())
+ * @param par Photosynthetic photon flux density [umol/m2/s], negative values count as 0
+ ***************************************************/
+void dli_add_sample(uint32_t now_s, q16_t par);
+
+/***************************************************
+ * @brief Set the target of the daily light integral in the configuration in RAM
+ * @param target Target [mol/m2/d], negative values count as 0
+ ***************************************************/
+void dli_set_target(q16_t target);
+
+/***************************************************
+ * @brief Set the time the lights switch off in the configuration in RAM
+ * @param second_of_day Seconds since midnight
+ ***************************************************/
+void dli_set_light_end(uint32_t second_of_day);
+
+/***************************************************
+ * @brief Get the light integral of today
+ * @return Light integral [mol/m2]
+ ***************************************************/
+q16_t dli_get_today(void);
+
+/***************************************************
+ * @brief Get the light integral of yesterday
+ * @return Light integral [mol/m2], 0 if unknown
+ ***************************************************/
+q16_t dli_get_yesterday(void);
+
+/***************************************************
+ * @brief Predict the lighting time still needed to reach the target at a given intensity
+ * @param par Expected PAR with the lights on [umol/m2/s]
+ * @return Remaining lighting time [s], 0 if the target is reached, UINT32_MAX if par <= 0
+ ***************************************************/
+uint32_t dli_get_remaining_s(q16_t par);
+
+/***************************************************
+ * @brief PAR needed from now until the lights switch off to reach the target
+ * @param now_s Epoch seconds of the RTC (rtc_get_seconds())
+ * @return Required PAR [umol/m2/s], 0 if the target is reached, FIX16_MAX if the light period is over
+ ***************************************************/
+q16_t dli_get_required_par(uint32_t now_s);
+
+/***************************************************
+ * @brief Print the light integral of today and yesterday and the prediction
+ * @param now_s Epoch seconds of the RTC (rtc_get_seconds())
+ ***************************************************/
+void dli_print(uint32_t now_s);
+
+#endif /* DLI_H */
+/** @}*/
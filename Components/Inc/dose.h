@@ -0,0 +1,125 @@
+/**
+ * @file dose.h
+ * @author PL
+ * @brief Dose planner: reservoir volume estimate and feed-forward of the EC and pH dosing loops
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup DOSE
+ *
+ * The PID loops alone overshoot after a top-up: the same error needs a dose proportional to the
+ * reservoir volume. The planner estimates the volume and computes the dose which reaches the
+ * setpoint with a model of the stock solutions, the dose is spread over DOSE_CONFIG.horizon_s and
+ * given to the loop as feed-forward. The PID only corrects the model error.
+ *
+ * Volume: an alpha-beta filter of the level readings (dose_level()), the known flows (dose_flow(): the
+ * fill and drain of the irrigation zones, top-ups with the "dose flow" command) and the delivered doses
+ * move the estimate at once, the rate term learns the evaporation and the uptake of the plants.
+ *
+ * Stock models, V reservoir volume, v dose volume:
+ * - EC: mixing, EC' = (V * EC + v * EC_stock) / (V + v), so v = V * (EC_sp - EC) / (EC_stock - EC_sp).
+ * - pH down: linear titration around the setpoint, v = V * (pH - pH_sp) * slope [mL / L / pH].
+ * A dose is only seen by the sensor after the mixing time, the dose in flight (decaying with the mixing
+ * time constant) is added to the measurement, so the planner doesn't dose twice.
+ *
+ * The dosing pumps are the actuators of the loops with output 0 .. 100 % of their flow
+ * (DOSE_CONFIG.pump_ml_min). Every update is O(1). A channel only plans while its loop is registered
+ * and enabled, the EC and pH loops are registered by the drivers of their sensor and pump (see pid.h),
+ * until then the feed-forward is 0. Components/Test/test_dose.c runs the planner on a simulated
+ * reservoir registered as PID_LOOP_EC.
+ *
+ * \addtogroup DOSE
+ * @{
+ */
+#ifndef DOSE_H
+#define DOSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define DOSE_PERIOD      1000u /* Update period of the planner [ms] */
+#define DOSE_LEVEL_ALPHA 0.2f  /* Weight of a level reading in the volume estimate */
+#define DOSE_LEVEL_BETA  0.01f /* Weight of a level reading in the rate estimate */
+
+/**
+ * @brief Dosing channels, each feeds one PID loop
+ */
+typedef enum
+{
+    DOSE_EC = 0u,  /**< Nutrient stock, loop PID_LOOP_EC */
+    DOSE_PH,       /**< pH down stock, loop PID_LOOP_PH */
+    DOSE_CHANNELS, /**< Number of channels */
+} DOSE_CHANNEL;
+
+/**
+ * @brief Reservoir and stock solutions, stored in the config store
+ */
+typedef struct
+{
+    float area_cm2;                   /**< Cross section of the reservoir [cm2] */
+    float ec_stock;                   /**< EC of the nutrient stock [mS/cm] */
+    float ph_slope;                   /**< pH down stock to lower 1 L by one pH unit [mL] */
+    float pump_ml_min[DOSE_CHANNELS]; /**< Flow of the dosing pumps at 100 % [mL/min] */
+    float mix_s;                      /**< Mixing time constant of the reservoir [s] */
+    float horizon_s;                  /**< Time over which a planned dose is spread [s] */
+} DOSE_CONFIG;
+
+/**
+ * @brief State of the planner handed over a warm reboot
+ */
+typedef struct
+{
+    bool valid;                    /**< The volume is known */
+    float volume;                  /**< Estimated volume [mL] */
+    float rate;                    /**< Estimated rate of the volume [mL/s] */
+    float inflight[DOSE_CHANNELS]; /**< Doses in flight [mL] */
+} DOSE_HANDOFF;
+
+/***************************************************
+ * @brief Start the planner coroutine, there is no feed-forward before the first level reading
+ *        unless the volume estimate is handed over by a warm reboot
+ ***************************************************/
+void dose_init(void);
+
+/***************************************************
+ * @brief Save the state of the planner for a warm reboot
+ * @param h State
+ ***************************************************/
+void dose_handoff_save(DOSE_HANDOFF* h) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Enter a level reading of the reservoir
+ * @param level_mm Water level above the bottom [mm]
+ ***************************************************/
+void dose_level(float level_mm);
+
+/***************************************************
+ * @brief Enter a known flow into or out of the reservoir
+ * @param ml Volume [mL], positive for a top-up, negative for a drain or the irrigation
+ ***************************************************/
+void dose_flow(float ml);
+
+/***************************************************
+ * @brief Get the estimated reservoir volume
+ * @return Volume [mL], 0 before the first level reading
+ ***************************************************/
+float dose_get_volume(void);
+
+/***************************************************
+ * @brief Compute the dose which moves the reservoir to the setpoint
+ * @param channel Channel
+ * @param cfg Reservoir and stock solutions
+ * @param volume_ml Reservoir volume [mL]
+ * @param pv Process value (EC [mS/cm] or pH)
+ * @param setpoint Setpoint
+ * @return Dose [mL], 0 if the process value is at or beyond the setpoint
+ ***************************************************/
+float dose_plan(DOSE_CHANNEL channel, const DOSE_CONFIG* cfg, float volume_ml, float pv, float setpoint) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Print the volume estimate and the plans of the channels
+ ***************************************************/
+void dose_print(void);
+
+#endif /* DOSE_H */
+/** @}*/
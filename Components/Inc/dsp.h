@@ -0,0 +1,254 @@
+/**
+ * @file dsp.h
+ * @author PL
+ * @brief Fixed point block processing kernels (FIR, biquad, decimation, dot product, RMS)
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup DSP
+ *
+ * The Q15 kernels use the dual 16 bit multiply-accumulate (SMLALD) of the Cortex-M33 DSP extension
+ * when __ARM_FEATURE_DSP is set, otherwise the portable reference version is used.
+ * All sums are accumulated in 64 bit, so the fast and the reference versions are bit exact. The host
+ * tests (Components/Test/test_dsp.c) check this with emulated DSP instructions, dsp_check() checks it
+ * on the target and prints the cycles per sample.
+ *
+ * FIR coefficients are stored in time reversed order: coeffs[0] multiplies the oldest sample.
+ * Biquad coefficients are {b0, b1, b2, a1, a2} per stage with a1 and a2 negated,
+ * so y[n] = b0*x[n] + b1*x[n-1] + b2*x[n-2] + a1*y[n-1] + a2*y[n-2].
+ * The Goertzel filter calculates a single DFT bin sample by sample, so it can run in an interrupt.
+ *
+ * \addtogroup DSP
+ * @{
+ */
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define DSP_BIQUAD_COEFFS 5u /* Number of coefficients per biquad stage */
+#define DSP_BIQUAD_STATE  4u /* Number of state values per biquad stage */
+
+typedef int16_t q15_t; /* Fixed point 1.15 */
+typedef int32_t q31_t; /* Fixed point 1.31 */
+
+/**
+ * @brief FIR filter instance, Q15
+ */
+typedef struct
+{
+    const q15_t* coeffs; /**< Coefficients in time reversed order, num_taps values */
+    q15_t* state;        /**< State buffer, num_taps + block_size - 1 values */
+    uint32_t num_taps;   /**< Number of taps */
+    uint32_t block_size; /**< Maximum number of samples processed at once */
+} DSP_FIR_Q15;
+
+/**
+ * @brief FIR filter instance, Q31
+ */
+typedef struct
+{
+    const q31_t* coeffs; /**< Coefficients in time reversed order, num_taps values */
+    q31_t* state;        /**< State buffer, num_taps + block_size - 1 values */
+    uint32_t num_taps;   /**< Number of taps */
+    uint32_t block_size; /**< Maximum number of samples processed at once */
+} DSP_FIR_Q31;
+
+/**
+ * @brief Biquad cascade instance (direct form 1), Q15 data with Q2.14 coefficients
+ */
+typedef struct
+{
+    const q15_t* coeffs; /**< DSP_BIQUAD_COEFFS coefficients per stage, Q2.14 */
+    q15_t* state;        /**< DSP_BIQUAD_STATE values per stage: x[n-1], x[n-2], y[n-1], y[n-2] */
+    uint32_t num_stages; /**< Number of second order stages */
+} DSP_BIQUAD_Q15;
+
+/**
+ * @brief Biquad cascade instance (direct form 1), Q31 data with Q2.30 coefficients
+ */
+typedef struct
+{
+    const q31_t* coeffs; /**< DSP_BIQUAD_COEFFS coefficients per stage, Q2.30 */
+    q31_t* state;        /**< DSP_BIQUAD_STATE values per stage: x[n-1], x[n-2], y[n-1], y[n-2] */
+    uint32_t num_stages; /**< Number of second order stages */
+} DSP_BIQUAD_Q31;
+
+/**
+ * @brief Goertzel filter instance for one frequency bin
+ */
+typedef struct
+{
+    int32_t coeff; /**< 2 * cos(2 * pi * f / fs) in Q2.29 */
+    int32_t s1;    /**< State s[n-1] */
+    int32_t s2;    /**< State s[n-2] */
+} DSP_GOERTZEL;
+
+/***************************************************
+ * @brief Initialize a Q15 FIR filter, the state is cleared
+ * @param f Filter instance
+ * @param coeffs Coefficients in time reversed order
+ * @param state State buffer of num_taps + block_size - 1 values
+ * @param num_taps Number of taps
+ * @param block_size Maximum number of samples processed at once
+ ***************************************************/
+void dsp_fir_init_q15(DSP_FIR_Q15* f, const q15_t* coeffs, q15_t* state, uint32_t num_taps, uint32_t block_size) __attribute__((__nonnull__(1, 2, 3)));
+
+/***************************************************
+ * @brief Q15 FIR filter
+ * @param f Filter instance
+ * @param in Input samples
+ * @param out Output samples, can be the same as in
+ * @param n Number of samples, any length
+ ***************************************************/
+void dsp_fir_q15(DSP_FIR_Q15* f, const q15_t* in, q15_t* out, uint32_t n) __attribute__((__nonnull__(1, 2, 3)));
+
+/***************************************************
+ * @brief Q15 FIR filter with decimation, only every factor-th output is calculated
+ * @param f Filter instance
+ * @param factor Decimation factor
+ * @param in Input samples
+ * @param out Output samples, n / factor values
+ * @param n Number of samples, multiple of factor
+ ***************************************************/
+void dsp_fir_decimate_q15(DSP_FIR_Q15* f, uint32_t factor, const q15_t* in, q15_t* out, uint32_t n) __attribute__((__nonnull__(1, 3, 4)));
+
+/***************************************************
+ * @brief Q15 biquad cascade
+ * @param f Filter instance, the state must be cleared before the first call
+ * @param in Input samples
+ * @param out Output samples, can be the same as in
+ * @param n Number of samples
+ ***************************************************/
+void dsp_biquad_q15(DSP_BIQUAD_Q15* f, const q15_t* in, q15_t* out, uint32_t n) __attribute__((__nonnull__(1, 2, 3)));
+
+/***************************************************
+ * @brief Dot product of two Q15 vectors
+ * @param a First vector
+ * @param b Second vector
+ * @param n Length of the vectors
+ * @return Sum of products in Q33.30
+ ***************************************************/
+int64_t dsp_dot_q15(const q15_t* a, const q15_t* b, uint32_t n) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Root mean square of a Q15 vector
+ * @param in Samples
+ * @param n Number of samples, > 0
+ * @return RMS value, saturated to 0x7FFF
+ ***************************************************/
+q15_t dsp_rms_q15(const q15_t* in, uint32_t n) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Initialize a Q31 FIR filter, the state is cleared
+ * @param f Filter instance
+ * @param coeffs Coefficients in time reversed order
+ * @param state State buffer of num_taps + block_size - 1 values
+ * @param num_taps Number of taps
+ * @param block_size Maximum number of samples processed at once
+ ***************************************************/
+void dsp_fir_init_q31(DSP_FIR_Q31* f, const q31_t* coeffs, q31_t* state, uint32_t num_taps, uint32_t block_size) __attribute__((__nonnull__(1, 2, 3)));
+
+/***************************************************
+ * @brief Q31 FIR filter
+ * @param f Filter instance
+ * @param in Input samples
+ * @param out Output samples, can be the same as in
+ * @param n Number of samples, any length
+ ***************************************************/
+void dsp_fir_q31(DSP_FIR_Q31* f, const q31_t* in, q31_t* out, uint32_t n) __attribute__((__nonnull__(1, 2, 3)));
+
+/***************************************************
+ * @brief Q31 biquad cascade
+ * @param f Filter instance, the state must be cleared before the first call
+ * @param in Input samples
+ * @param out Output samples, can be the same as in
+ * @param n Number of samples
+ ***************************************************/
+void dsp_biquad_q31(DSP_BIQUAD_Q31* f, const q31_t* in, q31_t* out, uint32_t n) __attribute__((__nonnull__(1, 2, 3)));
+
+/***************************************************
+ * @brief Dot product of two Q31 vectors, the products are truncated to Q2.48 before the sum
+ * @param a First vector
+ * @param b Second vector
+ * @param n Length of the vectors
+ * @return Sum of products in Q16.48
+ ***************************************************/
+int64_t dsp_dot_q31(const q31_t* a, const q31_t* b, uint32_t n) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Initialize a Goertzel filter, the state is cleared
+ * @param g Filter instance
+ * @param freq_hz Frequency of the bin [Hz]
+ * @param fs_hz Sample frequency [Hz]
+ ***************************************************/
+void dsp_goertzel_init(DSP_GOERTZEL* g, uint32_t freq_hz, uint32_t fs_hz) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Clear the state of a Goertzel filter to start a new block
+ * @param g Filter instance
+ ***************************************************/
+void dsp_goertzel_reset(DSP_GOERTZEL* g) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Feed one sample to a Goertzel filter
+ * The state grows with N * amplitude / 2 for a tone on the bin, keep N * amplitude below 2^30.
+ * @param g Filter instance
+ * @param x Sample
+ ***************************************************/
+void dsp_goertzel_step(DSP_GOERTZEL* g, int32_t x) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Feed a block of samples to a Goertzel filter
+ * @param g Filter instance
+ * @param in Samples
+ * @param n Number of samples
+ ***************************************************/
+void dsp_goertzel_block_q15(DSP_GOERTZEL* g, const q15_t* in, uint32_t n) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Squared magnitude of the bin after a block, a tone of amplitude A gives (N * A / 2)^2
+ * @param coeff Coefficient of the filter
+ * @param s1 State s[n-1] at the end of the block
+ * @param s2 State s[n-2] at the end of the block
+ * @return |X(k)|^2
+ ***************************************************/
+uint64_t dsp_goertzel_power(int32_t coeff, int32_t s1, int32_t s2);
+
+/* Portable reference versions of the Q15 kernels -------------*/
+void dsp_fir_q15_ref(DSP_FIR_Q15* f, const q15_t* in, q15_t* out, uint32_t n) __attribute__((__nonnull__(1, 2, 3)));
+void dsp_fir_decimate_q15_ref(DSP_FIR_Q15* f, uint32_t factor, const q15_t* in, q15_t* out, uint32_t n) __attribute__((__nonnull__(1, 3, 4)));
+void dsp_biquad_q15_ref(DSP_BIQUAD_Q15* f, const q15_t* in, q15_t* out, uint32_t n) __attribute__((__nonnull__(1, 2, 3)));
+int64_t dsp_dot_q15_ref(const q15_t* a, const q15_t* b, uint32_t n) __attribute__((__nonnull__(1, 2)));
+q15_t dsp_rms_q15_ref(const q15_t* in, uint32_t n) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Saturate a 64 bit value to Q15
+ * @param val Value
+ * @return Saturated value
+ ***************************************************/
+q15_t dsp_sat_q15(int64_t val);
+
+/***************************************************
+ * @brief Saturate a 64 bit value to Q31
+ * @param val Value
+ * @return Saturated value
+ ***************************************************/
+q31_t dsp_sat_q31(int64_t val);
+
+/***************************************************
+ * @brief Integer square root
+ * @param val Value
+ * @return floor(sqrt(val))
+ ***************************************************/
+uint32_t dsp_isqrt(uint32_t val);
+
+/***************************************************
+ * @brief Compare the fast kernels with the reference versions and print the cycles per sample
+ * @return true if all kernels are bit exact
+ ***************************************************/
+bool dsp_check(void);
+
+#endif /* DSP_H */
+/** @}*/
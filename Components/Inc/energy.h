@@ -0,0 +1,99 @@
+/**
+ * @file energy.h
+ * @author PL
+ * @brief Energy metering of the supply rails with attribution to the actuators
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup ENERGY
+ *
+ * Voltage and current of each rail are converted in adjacent ranks of one regular ADC1 scan, so the
+ * two samples of a rail are taken a few microseconds apart. A basic timer (TRGO) triggers the scans
+ * at ENERGY_SAMPLE_HZ, the DMA writes them into a circular buffer of two halves. The half and full
+ * transfer interrupts integrate V * I of a half buffer (ENERGY_BLOCK_SCANS scans) into 64-bit
+ * microjoule accumulators, the remainder of the integer division is carried to the next block so no
+ * energy is lost. The injected conversions of the pump monitor preempt the scans, they stay
+ * synchronized.
+ *
+ * A coroutine reads the accumulators through a snapshot store and attributes the energy of every
+ * block to the actuators active in it. Actuators on the same rail share the energy equally; without an
+ * active actuator the energy counts as idle energy of the rail. The coroutine prints an energy log
+ * line every ENERGY_LOG_PERIOD.
+ *
+ * The pins must stay in analog mode (reset state). ADC1 is calibrated and enabled by the pump monitor,
+ * energy_init() must be called before pump_monitor_init(): the regular group can't be configured while
+ * injected conversions are running. The sampling starts at the first run of the coroutine.
+ *
+ * \addtogroup ENERGY
+ * @{
+ */
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "stm32_hal.h"
+
+#define ENERGY_MAX_RAILS     4u       /* Rails, two ADC channels each */
+#define ENERGY_MAX_ACTUATORS 8u       /* Actuators */
+#define ENERGY_SAMPLE_HZ     2000u    /* Scan rate [Hz] */
+#define ENERGY_BLOCK_SCANS   100u     /* Scans per half buffer, 50 ms */
+#define ENERGY_LOG_PERIOD    3600000u /* Period of the energy log line [ms] */
+
+/**
+ * @brief Supply rail
+ */
+typedef struct
+{
+    const char* name;      /**< Name of the rail */
+    uint32_t v_channel;    /**< ADC1 channel of the voltage divider */
+    uint32_t i_channel;    /**< ADC1 channel of the current sense amplifier */
+    uint32_t uv_per_count; /**< Rail voltage of one ADC count [uV] */
+    uint32_t ua_per_count; /**< Rail current of one ADC count [uA] */
+} ENERGY_RAIL;
+
+/**
+ * @brief Actuator supplied by a rail
+ */
+typedef struct
+{
+    const char* name;        /**< Name of the actuator */
+    uint32_t rail;           /**< Index of the rail */
+    bool (*is_active)(void); /**< Actuator is on, NULL if always on */
+} ENERGY_ACTUATOR;
+
+/***************************************************
+ * @brief Configure the sampling timer, the regular ADC scan and the DMA, start the coroutine
+ * @param hadc ADC1 handle, the injected group is not touched
+ * @param htim TIM6 handle, the timer clock must be enabled
+ * @param rails Rails, must stay valid
+ * @param num_rails Number of rails, 1 .. ENERGY_MAX_RAILS
+ * @param actuators Actuators, must stay valid
+ * @param num_actuators Number of actuators, up to ENERGY_MAX_ACTUATORS
+ * @return true if configured
+ ***************************************************/
+bool energy_init(ADC_HandleTypeDef* hadc, TIM_HandleTypeDef* htim, const ENERGY_RAIL* rails, uint32_t num_rails, const ENERGY_ACTUATOR* actuators, uint32_t num_actuators)
+    __attribute__((__nonnull__(1, 2, 3)));
+
+/***************************************************
+ * @brief Restart the energy counters of the rails and the actuators
+ ***************************************************/
+void energy_reset(void);
+
+/***************************************************
+ * @brief Overrun interrupt of the regular group, call from ADC1_IRQHandler
+ ***************************************************/
+void energy_adc_irq(void);
+
+/***************************************************
+ * @brief Half and full transfer interrupt, call from the interrupt handler of the DMA channel
+ ***************************************************/
+void energy_dma_irq(void);
+
+/***************************************************
+ * @brief Print the power of the rails, the energy of the rails and the actuators and the metrics
+ ***************************************************/
+void energy_print(void);
+
+#endif /* ENERGY_H */
+/** @}*/
@@ -0,0 +1,116 @@
+/**
+ * @file fan.h
+ * @author PL
+ * @brief Ventilation fans with 25 kHz PWM and tachometer speed control
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup FAN
+ *
+ * Each fan has a PWM output (timer_pwm_*, several fans can share a PWM timer) and a tachometer
+ * input on channel 1 or 2 of its own timer. The tachometer timer runs in slave reset mode: every
+ * tachometer edge captures the counter into CCRx and restarts the counter, so CCRx always holds the
+ * period of the last pulse and CNT the time since the last pulse. A coroutine reads these registers
+ * every FAN_PERIOD ms: there is no interrupt and no DMA per pulse, the CPU cost doesn't depend on
+ * the speed or the number of pulses.
+ *
+ * A fan is started with full duty for FAN_SPINUP_MS (a fan may not start at a low duty), then runs
+ * at a fixed duty (open loop) or at a speed setpoint (PI loop, gains in the config store). A fan
+ * without tachometer pulses for FAN_STALL_MS while driven is stalled: it is switched off and
+ * restarted after FAN_RETRY_MS, after FAN_RETRIES restarts it stays off with a fault.
+ *
+ * \addtogroup FAN
+ * @{
+ */
+#ifndef FAN_H
+#define FAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "stm32_hal.h"
+
+#define FAN_MAX            4u      /* Number of fans */
+#define FAN_PWM_HZ         25000u  /* PWM frequency of 4-wire fans */
+#define FAN_TACH_HZ        100000u /* Highest counter clock of the tachometer timers */
+#define FAN_PULSES_PER_REV 2u      /* Tachometer pulses per revolution */
+#define FAN_PERIOD         100u    /* Control period [ms] */
+#define FAN_SPINUP_MS      2000u   /* Full duty after a start [ms] */
+#define FAN_STALL_MS       1000u   /* No tachometer pulse for this time: stalled [ms] */
+#define FAN_RETRY_MS       5000u   /* Off time after a stall before a restart [ms] */
+#define FAN_RETRIES        3u      /* Restarts after a stall before the fault */
+#define FAN_STABLE_MS      60000u  /* Running time after which the restarts are forgotten [ms] */
+#define FAN_MIN_DUTY       20u     /* Lowest duty of the speed loop [%] */
+
+/**
+ * @brief State of a fan
+ */
+typedef enum
+{
+    FAN_OFF = 0u, /**< Not driven */
+    FAN_SPINUP,   /**< Full duty after a start */
+    FAN_RUNNING,  /**< Running at its duty or speed setpoint */
+    FAN_STALLED,  /**< No tachometer pulses, off until the restart */
+    FAN_FAULT,    /**< Stalled after all restarts, off until it is set again */
+} FAN_STATE;
+
+/**
+ * @brief Hardware of a fan
+ */
+typedef struct
+{
+    const char* name;             /**< Name of the fan */
+    TIM_HandleTypeDef* pwm_htim;  /**< PWM timer, initialized to FAN_PWM_HZ by the first fan on it */
+    uint32_t pwm_channel;         /**< PWM timer channel */
+    GPIO_TypeDef* pwm_port;       /**< PWM output port */
+    uint16_t pwm_pin;             /**< PWM output pin */
+    uint8_t pwm_af;               /**< Alternate function of the PWM output */
+    TIM_HandleTypeDef* tach_htim; /**< Tachometer timer, not initialized, one per fan, needs a slave mode controller */
+    uint32_t tach_channel;        /**< TIM_CHANNEL_1 or TIM_CHANNEL_2 */
+    GPIO_TypeDef* tach_port;      /**< Tachometer input port */
+    uint16_t tach_pin;            /**< Tachometer input pin */
+    uint8_t tach_af;              /**< Alternate function of the tachometer input */
+} FAN_HW;
+
+/***************************************************
+ * @brief Initialize the timers of a fan, the fan is off
+ * @param fan Fan, 0 .. FAN_MAX - 1
+ * @param hw Hardware of the fan, must stay valid. The timer clocks must be enabled.
+ * @return false if the fan doesn't exist or a timer can't be configured
+ ***************************************************/
+bool fan_init(uint32_t fan, const FAN_HW* hw) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Run a fan at a fixed duty (open loop)
+ * @param fan Fan
+ * @param duty Duty [%], 0 switches the fan off
+ ***************************************************/
+void fan_set_duty(uint32_t fan, uint8_t duty);
+
+/***************************************************
+ * @brief Run a fan at a speed setpoint (closed loop)
+ * @param fan Fan
+ * @param rpm Speed setpoint [rpm], 0 switches the fan off
+ ***************************************************/
+void fan_set_rpm(uint32_t fan, uint32_t rpm);
+
+/***************************************************
+ * @brief Get the measured speed of a fan
+ * @param fan Fan
+ * @return Filtered speed [rpm], 0 when stalled or not initialized
+ ***************************************************/
+uint32_t fan_get_rpm(uint32_t fan);
+
+/***************************************************
+ * @brief Get the state of a fan
+ * @param fan Fan
+ * @return State, FAN_OFF when not initialized
+ ***************************************************/
+FAN_STATE fan_get_state(uint32_t fan);
+
+/***************************************************
+ * @brief Print the state, duty and speed of the fans
+ ***************************************************/
+void fan_print(void);
+
+#endif /* FAN_H */
+/** @}*/
@@ -0,0 +1,172 @@
+/**
+ * @file fixmath.h
+ * @author PL
+ * @brief Saturating fixed point math in Q16.16 and Q1.31 for sensor conversions
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup FIXMATH
+ *
+ * All operations saturate instead of wrapping around. Error bounds, verified against the double
+ * precision functions of the host by Components/Test/test_fixmath.c (1 LSB = 2^-16):
+ * - fix16_mul, fix16_div : exact, rounded to nearest
+ * - fix16_recip          : <= 1 LSB
+ * - fix16_sqrt           : < 1 LSB, rounded down
+ * - fix16_log2           : <= 4 LSB (65 entry table, linear interpolation)
+ * - fix16_exp2           : <= 2e-5 relative + 1 LSB (65 entry table, linear interpolation)
+ * - fix16_ln             : <= 5 LSB, log2 scaled by FIX16_LN2
+ * - fix16_exp            : <= 6e-5 relative + 1 LSB, exp2 of the exponent scaled by FIX16_LOG2E
+ *
+ * Run the "fixmath" command to see the cost per operation against soft-float (__aeabi_f*)
+ * and hard-float on the target, so each conversion path can pick the fastest correct option.
+ *
+ * \addtogroup FIXMATH
+ * @{
+ */
+#ifndef FIXMATH_H
+#define FIXMATH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "dsp.h"
+
+typedef int32_t q16_t; /* Fixed point 16.16 */
+
+#define FIX16_ONE   ((q16_t)0x00010000) /* 1.0 */
+#define FIX16_MAX   ((q16_t)INT32_MAX)  /* Largest value, 32767.99998 */
+#define FIX16_MIN   ((q16_t)INT32_MIN)  /* Smallest value, -32768.0 */
+#define FIX16_LN2   ((q16_t)45426)      /* ln(2) */
+#define FIX16_LOG2E ((q16_t)94548)      /* log2(e) */
+
+#define Q31_ONE ((q31_t)INT32_MAX) /* Largest value, 1.0 - 2^-31 */
+
+/***************************************************
+ * @brief Q16.16 constant from a float or integer literal, evaluated by the compiler
+ ***************************************************/
+#define FIX16_C(x) ((q16_t)(((x) * 65536.0) + (((x) >= 0) ? 0.5 : -0.5)))
+
+/***************************************************
+ * @brief Q16.16 from an integer, the integer must be in range
+ ***************************************************/
+#define FIX16_FROM_INT(x) ((q16_t)((x) * FIX16_ONE))
+
+/***************************************************
+ * @brief Saturate a 64 bit value to Q16.16
+ * @param val Value
+ * @return Saturated value
+ ***************************************************/
+q16_t fix16_sat(int64_t val);
+
+/***************************************************
+ * @brief Saturating addition
+ * @param a First operand
+ * @param b Second operand
+ * @return a + b
+ ***************************************************/
+q16_t fix16_add(q16_t a, q16_t b);
+
+/***************************************************
+ * @brief Saturating subtraction
+ * @param a First operand
+ * @param b Second operand
+ * @return a - b
+ ***************************************************/
+q16_t fix16_sub(q16_t a, q16_t b);
+
+/***************************************************
+ * @brief Saturating multiplication, rounded to nearest
+ * @param a First operand
+ * @param b Second operand
+ * @return a * b
+ ***************************************************/
+q16_t fix16_mul(q16_t a, q16_t b);
+
+/***************************************************
+ * @brief Saturating division, rounded to nearest
+ * @param a Dividend
+ * @param b Divisor, 0 saturates to FIX16_MAX or FIX16_MIN depending on the sign of a
+ * @return a / b
+ ***************************************************/
+q16_t fix16_div(q16_t a, q16_t b);
+
+/***************************************************
+ * @brief Reciprocal with Newton-Raphson iterations, faster than fix16_div(FIX16_ONE, a)
+ * @param a Value, 0 saturates to FIX16_MAX
+ * @return 1 / a
+ ***************************************************/
+q16_t fix16_recip(q16_t a);
+
+/***************************************************
+ * @brief Square root
+ * @param a Value, negative values return 0
+ * @return sqrt(a)
+ ***************************************************/
+q16_t fix16_sqrt(q16_t a);
+
+/***************************************************
+ * @brief Logarithm base 2
+ * @param a Value, values <= 0 return FIX16_MIN
+ * @return log2(a)
+ ***************************************************/
+q16_t fix16_log2(q16_t a);
+
+/***************************************************
+ * @brief Power of 2
+ * @param a Exponent, saturates to FIX16_MAX for a >= 15
+ * @return 2^a
+ ***************************************************/
+q16_t fix16_exp2(q16_t a);
+
+/***************************************************
+ * @brief Natural logarithm
+ * @param a Value, values <= 0 return FIX16_MIN
+ * @return ln(a)
+ ***************************************************/
+q16_t fix16_ln(q16_t a);
+
+/***************************************************
+ * @brief Exponential function
+ * @param a Exponent
+ * @return e^a
+ ***************************************************/
+q16_t fix16_exp(q16_t a);
+
+/***************************************************
+ * @brief Saturating Q1.31 addition
+ * @param a First operand
+ * @param b Second operand
+ * @return a + b
+ ***************************************************/
+q31_t q31_add(q31_t a, q31_t b);
+
+/***************************************************
+ * @brief Saturating Q1.31 subtraction
+ * @param a First operand
+ * @param b Second operand
+ * @return a - b
+ ***************************************************/
+q31_t q31_sub(q31_t a, q31_t b);
+
+/***************************************************
+ * @brief Saturating Q1.31 multiplication, rounded to nearest
+ * @param a First operand
+ * @param b Second operand
+ * @return a * b
+ ***************************************************/
+q31_t q31_mul(q31_t a, q31_t b);
+
+/***************************************************
+ * @brief Q16.16 value scaled by a Q1.31 factor, e.g. a calibration gain
+ * @param a Value
+ * @param k Factor
+ * @return a * k
+ ***************************************************/
+q16_t fix16_mul_q31(q16_t a, q31_t k);
+
+/***************************************************
+ * @brief Print the cycles per operation against soft-float and hard-float
+ ***************************************************/
+void fixmath_bench(void);
+
+#endif /* FIXMATH_H */
+/** @}*/
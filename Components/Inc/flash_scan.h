@@ -0,0 +1,63 @@
+/**
+ * @file flash_scan.h
+ * @author PL
+ * @brief Background integrity scan of the firmware image in flash
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup FLASH_SCAN
+ *
+ * The image from the start of the flash to the symbol __image_end of the linker script is CRC-32'd
+ * with the CRC peripheral in slices: a coroutine continues the CRC every FLASH_SCAN_PERIOD for at
+ * most FLASH_SCAN_BUDGET_US (plus one chunk), so the scan never delays the control loops. At the
+ * end of a pass the CRC is compared with the reference word which the linker script places behind
+ * the image, and the next pass starts.
+ *
+ * The reference is patched into the ELF file after the link (MK_ENV/image_crc.py, run by the
+ * Makefile). The gaps between the sections are filled with 0xFF in the binary, as in erased flash.
+ * An image which is not patched (reference 0xFFFFFFFF) is scanned as well, the status is then
+ * FLASH_SCAN_NO_REFERENCE and flash_scan_print() shows the calculated CRC.
+ *
+ * \addtogroup FLASH_SCAN
+ * @{
+ */
+#ifndef FLASH_SCAN_H
+#define FLASH_SCAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define FLASH_SCAN_PERIOD    10u         /* Time between two slices [ms] */
+#define FLASH_SCAN_BUDGET_US 50u         /* CPU time of a slice [us] */
+#define FLASH_SCAN_CHUNK     256u        /* Bytes per call of the CRC, the granularity of the budget */
+#define FLASH_SCAN_NO_CRC    0xFFFFFFFFu /* Reference of an image which is not patched */
+
+/**
+ * @brief Result of the last complete pass
+ */
+typedef enum
+{
+    FLASH_SCAN_PENDING = 0u, /**< No pass completed yet */
+    FLASH_SCAN_OK,           /**< CRC equals the reference */
+    FLASH_SCAN_MISMATCH,     /**< CRC differs from the reference, the image is corrupted */
+    FLASH_SCAN_NO_REFERENCE, /**< The image is not patched with its CRC */
+} FLASH_SCAN_STATUS;
+
+/***************************************************
+ * @brief Start the scan, call after crc_init() and bench_init()
+ ***************************************************/
+void flash_scan_init(void);
+
+/***************************************************
+ * @brief Get the result of the last complete pass
+ * @return Status
+ ***************************************************/
+FLASH_SCAN_STATUS flash_scan_get_status(void);
+
+/***************************************************
+ * @brief Print the image, the progress of the pass, the results and the slice times
+ ***************************************************/
+void flash_scan_print(void);
+
+#endif /* FLASH_SCAN_H */
+/** @}*/
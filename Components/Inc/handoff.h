@@ -0,0 +1,73 @@
+/**
+ * @file handoff.h
+ * @author PL
+ * @brief Warm reboot: state handed from the firmware before a reset to the firmware after it, in SRAM4
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup HANDOFF
+ *
+ * nvic_safe_system_reset() calls handoff_write() just before the reset: the state which takes minutes
+ * to rebuild (volume estimate, learned nominal pump current, ADC self-calibration factors) and the
+ * state which must survive a reset (interlock latch) is collected in a block in SRAM4. SRAM4 is not
+ * initialized by the startup code and keeps its content over a system reset.
+ *
+ * At boot handoff_init() checks the magic, the version and the CRC of the block, copies it and erases
+ * the block, so the block is consumed exactly once: a later reset without handoff_write() (watchdog,
+ * hard fault, power loss) is a cold boot. The modules take their part with handoff_get() in their
+ * init functions and skip the slow start (ADC calibration, waiting for level readings).
+ *
+ * Versioning like the config store: fields are only appended and HANDOFF_VERSION is incremented, a block
+ * of an older firmware is shorter, the fields added later stay at their cold boot values. A block of a
+ * newer firmware (a downgrade) is rejected, even if it is not longer: the meaning of its fields is unknown.
+ *
+ * \addtogroup HANDOFF
+ * @{
+ */
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "calib.h"
+#include "define.h"
+#include "dose.h"
+
+#define HANDOFF_VERSION 1u /* Version of HANDOFF_DATA */
+
+/**
+ * @brief State handed over to the next boot
+ */
+typedef struct
+{
+    uint32_t warm_boots;             /**< Warm boots in a row */
+    DOSE_HANDOFF dose;               /**< Dose planner volume estimate and doses in flight */
+    uint32_t pump_nominal;           /**< Learned nominal current of the pump monitor [ADC counts] */
+    uint32_t interlock_tripped;      /**< Tripped interlock inputs, bit n is input n */
+    uint32_t adc_factor[CALIB_ADCS]; /**< ADC self-calibration factors */
+    uint32_t adc_valid;              /**< Valid ADC factors, bit n is CALIB_ADC n */
+} HANDOFF_DATA;
+
+/***************************************************
+ * @brief Check and consume the handoff block, call once at boot after crc_init() and before the modules
+ * @return true if this is a warm boot with a valid block
+ ***************************************************/
+bool handoff_init(void);
+
+/***************************************************
+ * @brief Get the state of the firmware before the reset
+ * @return State, NULL at a cold boot
+ ***************************************************/
+const HANDOFF_DATA* handoff_get(void);
+
+/***************************************************
+ * @brief Collect the state of the modules and seal the handoff block, call just before a reset
+ ***************************************************/
+void handoff_write(void);
+
+/***************************************************
+ * @brief Print the kind of the boot and the handed over state
+ ***************************************************/
+void handoff_print(void);
+
+#endif /* HANDOFF_H */
+/** @}*/
@@ -0,0 +1,116 @@
+/**
+ * @file interlock.h
+ * @author PL
+ * @brief Safety interlocks: leak detectors and overflow switches force the actuators off within microseconds
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup INTERLOCK
+ *
+ * Two paths switch the actuators off without waiting for the main loop:
+ * - GPIO forcing: each input has its own EXTI line at the highest interrupt priority. The interrupt
+ *   resets the actuator outputs and switches their pins to input mode with the internal pull-down, so a
+ *   later write of the output data register or a running PWM has no effect and the driver input of the
+ *   actuator (e.g. PB4, PB12, PB14 of the pump driver) doesn't float. The latency is the interrupt
+ *   entry plus a few register writes (below 1 us), delayed only by code which masks all interrupts.
+ * - Timer break: the input is also wired to the BKIN pin of an advanced timer (TIM1, TIM8, TIM15 .. TIM17).
+ *   The break clears MOE in hardware, the outputs go to their off state without any software.
+ *   The automatic output is disabled, so the outputs stay off until interlock_reset().
+ *
+ * A trip is latched: the outputs stay forced until interlock_reset() is called with all inputs inactive.
+ * The interrupt posts an event to a coroutine which reports the trip. interlock_test() trips an input by
+ * software (EXTI software interrupt, timer break generation) and measures the trip-to-output latency with
+ * the DWT cycle counter.
+ *
+ * \addtogroup INTERLOCK
+ * @{
+ */
+#ifndef INTERLOCK_H
+#define INTERLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "stm32_hal.h"
+
+#define INTERLOCK_MAX_INPUTS  4u /* Number of inputs */
+#define INTERLOCK_MAX_OUTPUTS 8u /* Number of forced outputs */
+#define INTERLOCK_MAX_BREAKS  2u /* Number of timers with a break input */
+
+/**
+ * @brief Actuator output forced off by a trip
+ */
+typedef struct
+{
+    GPIO_TypeDef* port; /**< Port */
+    uint16_t pin;       /**< Pin */
+} INTERLOCK_OUTPUT;
+
+/**
+ * @brief Interlock input
+ */
+typedef struct
+{
+    const char* name;         /**< Name of the input */
+    GPIO_TypeDef* port;       /**< Port */
+    uint16_t pin;             /**< Pin with its own EXTI line */
+    GPIO_PinState trip_level; /**< Level of the tripped input */
+    uint32_t outputs;         /**< Outputs forced by this input, bit n is output n of interlock_init() */
+} INTERLOCK_INPUT;
+
+/***************************************************
+ * @brief Initialize the inputs and start the reporting coroutine, an active input trips at once
+ * @param inputs Inputs, must stay valid
+ * @param num_inputs Number of inputs, up to INTERLOCK_MAX_INPUTS
+ * @param outputs Outputs, must stay valid
+ * @param num_outputs Number of outputs, up to INTERLOCK_MAX_OUTPUTS. The outputs must be initialized, bench_init() called.
+ * @return false if there are too many inputs or outputs or an EXTI line is used twice
+ ***************************************************/
+bool interlock_init(const INTERLOCK_INPUT* inputs, uint32_t num_inputs, const INTERLOCK_OUTPUT* outputs, uint32_t num_outputs) __attribute__((__nonnull__(1, 3)));
+
+/***************************************************
+ * @brief Enable the break input (BKIN, active low) of an advanced timer, the BKIN pin must be configured
+ * @param htim Initialized timer
+ * @return false if there are too many timers or the break can't be configured
+ ***************************************************/
+bool interlock_add_break(TIM_HandleTypeDef* htim) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Release the latch, the outputs return to their mode before the trip. GPIO outputs stay off until
+ * they are written again, alternate function outputs follow their peripheral at once.
+ * @return false if an input is still active, the latch stays
+ ***************************************************/
+bool interlock_reset(void);
+
+/***************************************************
+ * @brief Check the latch
+ * @return true if tripped and not reset
+ ***************************************************/
+bool interlock_is_tripped(void);
+
+/***************************************************
+ * @brief Get the tripped inputs
+ * @return Tripped inputs, bit n is input n
+ ***************************************************/
+uint32_t interlock_get_tripped(void);
+
+/***************************************************
+ * @brief Trip an input by software and measure the latency of the GPIO forcing and of the timer breaks,
+ * the interlock stays tripped until interlock_reset()
+ * @param input Input
+ * @return false if the input doesn't exist or the interlock is already tripped
+ ***************************************************/
+bool interlock_test(uint32_t input);
+
+/***************************************************
+ * @brief Interrupt of an EXTI line, call from the EXTIx_IRQHandler() of the inputs
+ * @param line EXTI line, 0 .. 15
+ ***************************************************/
+void interlock_exti_irq(uint32_t line);
+
+/***************************************************
+ * @brief Print the inputs, the latch and the measured latencies
+ ***************************************************/
+void interlock_print(void);
+
+#endif /* INTERLOCK_H */
+/** @}*/
@@ -0,0 +1,150 @@
+/**
+ * @file irrigation.h
+ * @author PL
+ * @brief Ebb and flow irrigation of the grow zones with float switch confirmation
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup IRRIGATION
+ *
+ * A cycle of a zone: wait for a pump slot, fill until the full switch confirms, hold, then open the
+ * drain until the empty switch confirms. Each zone is a coroutine which only runs on an event: a start
+ * (command or cycle interval), a stop, a free pump slot or a change of a float switch (EXTI interrupt).
+ * A switch is confirmed when it still reads the same IRRIGATION_CONFIRM_MS after the event.
+ *
+ * Faults and escalation:
+ * - Fill timeout: the cycle is aborted and the zone drained. After IRRIGATION_MAX_FAULTS cycles in a row
+ *   with a fault the zone is locked.
+ * - Drain timeout or implausible switches (full while the bottom is dry): the zone is locked at once, a
+ *   flooded zone or a wrong level must not be filled again. A zone which is still flooded at the start of a
+ *   cycle is only drained.
+ * - A locked zone stays off until irrigation_reset().
+ * A stop aborts filling and holding, the drain always runs to the end.
+ *
+ * The pump slots limit the pumps running at the same time (supply current, flow from the reservoir). The
+ * fill pumps take a slot, other pump users (dosing, top-up) share the same limit with
+ * irrigation_pump_claim() / irrigation_pump_release().
+ *
+ * \addtogroup IRRIGATION
+ * @{
+ */
+#ifndef IRRIGATION_H
+#define IRRIGATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "stm32_hal.h"
+
+#define IRRIGATION_MAX_ZONES  2u   /* Number of zones */
+#define IRRIGATION_PUMP_SLOTS 1u   /* Pumps allowed to run at the same time */
+#define IRRIGATION_CONFIRM_MS 500u /* Time a float switch must keep its level after a change [ms] */
+#define IRRIGATION_MAX_FAULTS 3u   /* Cycles in a row with a fault before the zone is locked */
+
+/**
+ * @brief Phase of a zone
+ */
+typedef enum
+{
+    IRRIGATION_IDLE = 0u, /**< Waiting for the next cycle */
+    IRRIGATION_WAIT_PUMP, /**< Waiting for a pump slot */
+    IRRIGATION_FILL,      /**< Fill pump on until the full switch confirms */
+    IRRIGATION_HOLD,      /**< Flooded */
+    IRRIGATION_DRAIN,     /**< Drain valve open until the empty switch confirms */
+    IRRIGATION_LOCKED,    /**< Off after a fault, until irrigation_reset() */
+} IRRIGATION_PHASE;
+
+/**
+ * @brief Fault of a cycle
+ */
+typedef enum
+{
+    IRRIGATION_FAULT_NONE = 0u,     /**< No fault */
+    IRRIGATION_FAULT_FILL_TIMEOUT,  /**< Not full within the fill timeout */
+    IRRIGATION_FAULT_DRAIN_TIMEOUT, /**< Not empty within the drain timeout */
+    IRRIGATION_FAULT_SENSOR,        /**< Implausible float switches */
+} IRRIGATION_FAULT;
+
+/**
+ * @brief Timing of a zone, stored in the config store
+ */
+typedef struct
+{
+    uint32_t interval_s;      /**< Time from the end of a cycle to the next start [s], 0 for manual starts only */
+    uint32_t hold_s;          /**< Flooded time [s] */
+    uint32_t fill_timeout_s;  /**< Longest fill time [s] */
+    uint32_t drain_timeout_s; /**< Longest drain time [s] */
+} IRRIGATION_CONFIG;
+
+/**
+ * @brief Hardware of a zone, the outputs are active high, the float switches close to ground when wet
+ */
+typedef struct
+{
+    const char* name;         /**< Name of the zone */
+    GPIO_TypeDef* fill_port;  /**< Fill pump output port */
+    uint16_t fill_pin;        /**< Fill pump output pin */
+    GPIO_TypeDef* drain_port; /**< Drain valve output port */
+    uint16_t drain_pin;       /**< Drain valve output pin */
+    GPIO_TypeDef* full_port;  /**< Float switch at the flood level, port */
+    uint16_t full_pin;        /**< Float switch at the flood level, pin with its own EXTI line */
+    GPIO_TypeDef* empty_port; /**< Float switch at the bottom, port */
+    uint16_t empty_pin;       /**< Float switch at the bottom, pin with its own EXTI line */
+} IRRIGATION_HW;
+
+/***************************************************
+ * @brief Initialize the outputs and the float switch interrupts of a zone and start its coroutine
+ * @param zone Zone, 0 .. IRRIGATION_MAX_ZONES - 1
+ * @param hw Hardware of the zone, must stay valid
+ * @return false if the zone doesn't exist
+ ***************************************************/
+bool irrigation_init(uint32_t zone, const IRRIGATION_HW* hw) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Start a cycle now, ignored when a cycle is running or the zone is locked
+ * @param zone Zone
+ ***************************************************/
+void irrigation_start(uint32_t zone);
+
+/***************************************************
+ * @brief Abort filling or holding, the zone is drained
+ * @param zone Zone
+ ***************************************************/
+void irrigation_stop(uint32_t zone);
+
+/***************************************************
+ * @brief Unlock a locked zone
+ * @param zone Zone
+ ***************************************************/
+void irrigation_reset(uint32_t zone);
+
+/***************************************************
+ * @brief Get the phase of a zone
+ * @param zone Zone
+ * @return Phase, IRRIGATION_IDLE when not initialized
+ ***************************************************/
+IRRIGATION_PHASE irrigation_get_phase(uint32_t zone);
+
+/***************************************************
+ * @brief Claim a pump slot, shared by all pumps
+ * @return true if claimed, release it with irrigation_pump_release()
+ ***************************************************/
+bool irrigation_pump_claim(void);
+
+/***************************************************
+ * @brief Release a pump slot, zones waiting for a slot are woken
+ ***************************************************/
+void irrigation_pump_release(void);
+
+/***************************************************
+ * @brief Interrupt of an EXTI line, call from the EXTIx_IRQHandler() of the float switches
+ * @param line EXTI line, 0 .. 15
+ ***************************************************/
+void irrigation_exti_irq(uint32_t line);
+
+/***************************************************
+ * @brief Print the phase, faults and timing of the zones
+ ***************************************************/
+void irrigation_print(void);
+
+#endif /* IRRIGATION_H */
+/** @}*/
@@ -0,0 +1,118 @@
+/**
+ * @file memdma.h
+ * @author PL
+ * @brief Asynchronous memory copy and fill on spare GPDMA channels
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup MEMDMA
+ *
+ * A transfer is a list of items (scatter/gather), each item is one linked-list item of the GPDMA
+ * channel, so the whole list runs without the CPU and ends with one interrupt, which calls the
+ * completion callback. The channel registers are written directly, a start takes about 100 cycles.
+ *
+ * The data width of an item follows the common alignment of its addresses and length: word aligned
+ * buffers are copied four times faster than byte aligned ones. Transfers shorter than the threshold,
+ * or started while all channels are busy, are done by the CPU before the function returns, the
+ * callback is then called in the context of the caller.
+ *
+ * memdma_calibrate() benchmarks memcpy() against the DMA (start to callback) for sizes up to
+ * MEMDMA_BENCH_MAX and sets the threshold to the smallest size where the DMA is at least as fast.
+ * The CPU is free while the DMA copies, so every transfer above the threshold also saves CPU time.
+ *
+ * The data cache is not enabled on this target, the buffers need no cache maintenance.
+ *
+ * \addtogroup MEMDMA
+ * @{
+ */
+#ifndef MEMDMA_H
+#define MEMDMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define MEMDMA_CHANNELS  2u     /* GPDMA1 channels 6 and 7 */
+#define MEMDMA_MAX_ITEMS 8u     /* Linked-list items of one transfer */
+#define MEMDMA_MAX_BLOCK 65532u /* Bytes of one linked-list item, a multiple of 4 */
+#define MEMDMA_BENCH_MAX 2048u  /* Largest size of the benchmark [bytes] */
+#define MEMDMA_BENCH_MIN 16u    /* Smallest size of the benchmark [bytes] */
+
+/**
+ * @brief Completion callback, called by the DMA interrupt or by the caller for a CPU transfer
+ * @param arg Argument given with the transfer
+ * @param ok false after a DMA error, the data is incomplete
+ */
+typedef void (*MEMDMA_CALLBACK)(void* arg, bool ok);
+
+/**
+ * @brief Item of a scatter/gather copy
+ */
+typedef struct
+{
+    void* dst;       /**< Destination */
+    const void* src; /**< Source, RAM or flash */
+    uint32_t len;    /**< Length [bytes] */
+} MEMDMA_ITEM;
+
+/***************************************************
+ * @brief Reset the channels, enable their interrupts and calibrate the threshold, call after bench_init()
+ ***************************************************/
+void memdma_init(void);
+
+/***************************************************
+ * @brief Copy memory, the regions must not overlap
+ * @param dst Destination
+ * @param src Source, RAM or flash
+ * @param len Length [bytes]
+ * @param cb Completion callback, NULL if not needed
+ * @param arg Argument of the callback
+ * @return false if the transfer needs more than MEMDMA_MAX_ITEMS items, nothing is copied then
+ ***************************************************/
+bool memdma_copy(void* dst, const void* src, uint32_t len, MEMDMA_CALLBACK cb, void* arg) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Fill memory with a byte
+ * @param dst Destination
+ * @param value Value
+ * @param len Length [bytes]
+ * @param cb Completion callback, NULL if not needed
+ * @param arg Argument of the callback
+ * @return false if the transfer needs more than MEMDMA_MAX_ITEMS items, nothing is filled then
+ ***************************************************/
+bool memdma_fill(void* dst, uint8_t value, uint32_t len, MEMDMA_CALLBACK cb, void* arg) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Copy a list of regions in one transfer
+ * @param items Items, the list is read before the function returns
+ * @param num_items Number of items
+ * @param cb Completion callback, NULL if not needed
+ * @param arg Argument of the callback
+ * @return false if the transfer needs more than MEMDMA_MAX_ITEMS items, nothing is copied then
+ ***************************************************/
+bool memdma_gather(const MEMDMA_ITEM* items, uint32_t num_items, MEMDMA_CALLBACK cb, void* arg) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Benchmark the CPU against the DMA and set the threshold, all channels must be idle
+ * @return false if a channel is busy or the DMA failed, the threshold is not changed then
+ ***************************************************/
+bool memdma_calibrate(void);
+
+/***************************************************
+ * @brief Get the threshold
+ * @return Transfers shorter than this are done by the CPU [bytes]
+ ***************************************************/
+uint32_t memdma_get_threshold(void);
+
+/***************************************************
+ * @brief Transfer complete and error interrupt, call from the interrupt handler of the channel
+ * @param channel Channel, 0 .. MEMDMA_CHANNELS - 1
+ ***************************************************/
+void memdma_irq(uint32_t channel);
+
+/***************************************************
+ * @brief Print the benchmark, the threshold and the transfer counters
+ ***************************************************/
+void memdma_print(void);
+
+#endif /* MEMDMA_H */
+/** @}*/
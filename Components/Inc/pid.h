@@ -0,0 +1,178 @@
+/**
+ * @file pid.h
+ * @author PL
+ * @brief PID control loops for dosing and heating
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup PID
+ *
+ * A loop is registered with a PID_IO which reads the process value and writes the actuator output.
+ * Every enabled loop runs in its own coroutine at the sample period of its PID_IO. The gains are
+ * read from the config store at every sample, so new gains (e.g. from the auto-tune) apply immediately.
+ * The controller works in float (see bench.h): derivative on the measurement, no derivative kick on
+ * setpoint changes, and the integral is clamped so the output stays within the limits (anti-windup).
+ * A feed-forward (e.g. from the dose planner) is added to the controller output, the controller only
+ * corrects the error of the model, the anti-windup accounts for the feed-forward.
+ *
+ * The simulated loop PID_LOOP_SIM is a first order plus dead time plant, it is used to try the
+ * controller and the auto-tune without hardware.
+ * Only PID_LOOP_SIM has a PID_IO in this firmware. The EC, pH and heater loops are registered by the
+ * drivers of their sensor and actuator, which don't exist yet: until then these loops stay
+ * unregistered, they don't run and they can't be auto-tuned.
+ *
+ * \addtogroup PID
+ * @{
+ */
+#ifndef PID_H
+#define PID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define PID_SIM_MAX_DELAY 64u /* Dead time of the simulated plant [samples] */
+
+/**
+ * @brief Control loops
+ */
+typedef enum
+{
+    PID_LOOP_EC = 0u, /**< Nutrient dosing on the electrical conductivity */
+    PID_LOOP_PH,      /**< pH up/down dosing */
+    PID_LOOP_HEATER,  /**< Reservoir heater */
+    PID_LOOP_SIM,     /**< Simulated plant */
+    PID_MAX_LOOPS,    /**< Number of loops */
+} PID_LOOP;
+
+/**
+ * @brief Gains of a loop, stored in the config store
+ */
+typedef struct
+{
+    float kp; /**< Proportional gain */
+    float ki; /**< Integral gain [1/s] */
+    float kd; /**< Derivative gain [s] */
+} PID_GAINS;
+
+/**
+ * @brief Process value and actuator of a loop
+ */
+typedef struct
+{
+    const char* name;            /**< Name of the loop */
+    float (*read)(void);         /**< Read the process value */
+    void (*write)(float output); /**< Write the actuator output */
+    float out_min;               /**< Lowest actuator output */
+    float out_max;               /**< Highest actuator output */
+    uint32_t period_ms;          /**< Sample period [ms] */
+} PID_IO;
+
+/**
+ * @brief State of a PID controller
+ */
+typedef struct
+{
+    float integral; /**< Integral part of the output */
+    float prev_pv;  /**< Process value of the previous sample */
+    bool first;     /**< No previous sample, no derivative */
+} PID_STATE;
+
+/***************************************************
+ * @brief Reset a controller, the next sample has no derivative part
+ * @param s Controller state
+ ***************************************************/
+void pid_reset(PID_STATE* s) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Compute one sample of a PID controller
+ * @param s Controller state
+ * @param g Gains
+ * @param setpoint Setpoint
+ * @param pv Process value
+ * @param dt Sample period [s]
+ * @param out_min Lowest output
+ * @param out_max Highest output
+ * @return Output, within out_min .. out_max
+ ***************************************************/
+float pid_step(PID_STATE* s, const PID_GAINS* g, float setpoint, float pv, float dt, float out_min, float out_max) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Register the process value and the actuator of a loop and start its coroutine, the loop is disabled
+ * @param loop Loop
+ * @param io Process value and actuator, must stay valid
+ * @return false if the loop doesn't exist or the output limits or the period are invalid
+ ***************************************************/
+bool pid_register(PID_LOOP loop, const PID_IO* io) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Get the process value and the actuator of a loop
+ * @param loop Loop
+ * @return Process value and actuator, NULL if the loop is not registered
+ ***************************************************/
+const PID_IO* pid_get_io(PID_LOOP loop);
+
+/***************************************************
+ * @brief Set the setpoint of a loop
+ * @param loop Loop
+ * @param setpoint Setpoint
+ ***************************************************/
+void pid_set_setpoint(PID_LOOP loop, float setpoint);
+
+/***************************************************
+ * @brief Get the setpoint of a loop
+ * @param loop Loop
+ * @return Setpoint, 0 if the loop doesn't exist
+ ***************************************************/
+float pid_get_setpoint(PID_LOOP loop);
+
+/***************************************************
+ * @brief Set the feed-forward of a loop, added to the controller output from the next sample
+ * @param loop Loop
+ * @param feedforward Feed-forward in the unit of the actuator output
+ ***************************************************/
+void pid_set_feedforward(PID_LOOP loop, float feedforward);
+
+/***************************************************
+ * @brief Get the last actuator output of a loop
+ * @param loop Loop
+ * @return Output, 0 if the loop doesn't exist
+ ***************************************************/
+float pid_get_output(PID_LOOP loop);
+
+/***************************************************
+ * @brief Enable or disable a loop, a disabled loop doesn't write its actuator
+ * @param loop Loop
+ * @param enable true to enable, the controller restarts from the last output (bumpless)
+ * @return false if the loop is not registered
+ ***************************************************/
+bool pid_enable(PID_LOOP loop, bool enable);
+
+/***************************************************
+ * @brief Check if a loop is enabled
+ * @param loop Loop
+ * @return true if the controller writes the actuator
+ ***************************************************/
+bool pid_is_enabled(PID_LOOP loop);
+
+/***************************************************
+ * @brief Register the simulated first order plus dead time plant as PID_LOOP_SIM
+ * @param gain Static gain of the plant
+ * @param tau_s Time constant [s]
+ * @param dead_samples Dead time [samples of 100 ms], up to PID_SIM_MAX_DELAY
+ * @return false if the parameters are out of range
+ ***************************************************/
+bool pid_sim_init(float gain, float tau_s, uint32_t dead_samples);
+
+/***************************************************
+ * @brief Print the loops with their gains, setpoints and outputs
+ ***************************************************/
+void pid_print(void);
+
+/***************************************************
+ * @brief Print a float with 3 decimals, printf has no float support (nano.specs)
+ * @param val Value
+ ***************************************************/
+void pid_print_float(float val);
+
+#endif /* PID_H */
+/** @}*/
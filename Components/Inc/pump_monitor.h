@@ -0,0 +1,104 @@
+/**
+ * @file pump_monitor.h
+ * @author PL
+ * @brief Pump current signature analysis, detects a dry running or blocked pump
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup PUMP_MONITOR
+ *
+ * The pump is driven by PWM on a timer channel. Channel 4 of the same timer triggers an injected ADC
+ * conversion of the pump rail current in the middle of the on-time, once per PWM period.
+ * Every sample is fed to Goertzel filters in the ADC interrupt (no buffer, a few cycles per bin).
+ * After a block of PUMP_MON_BLOCK_LEN samples a coroutine classifies the block:
+ * - OFF     : mean current below PUMP_MON_OFF_LEVEL
+ * - BLOCKED : no commutation ripple (rotor stalled) or mean current above PUMP_MON_BLOCKED_PCT of nominal
+ * - DRY     : mean current below PUMP_MON_DRY_PCT of nominal (no hydraulic load)
+ * - RUNNING : otherwise
+ * The commutation ripple only counts when it is above the ripple of the supply harmonic bin.
+ * A state is accepted after PUMP_MON_DEBOUNCE equal blocks (0.5 s).
+ *
+ * The commutation frequency is rpm / 60 * commutator segments, adjust PUMP_MON_COMM_HZ for the pump used.
+ *
+ * \addtogroup PUMP_MONITOR
+ * @{
+ */
+#ifndef PUMP_MONITOR_H
+#define PUMP_MONITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "stm32_hal.h"
+
+#define PUMP_MON_PWM_HZ           4000u /* PWM and sample frequency [Hz] */
+#define PUMP_MON_BLOCK_LEN        400u  /* Samples per block, 100 ms, 10 Hz bin resolution */
+#define PUMP_MON_COMM_HZ          200u  /* Commutation frequency of the motor [Hz] */
+#define PUMP_MON_SUPPLY_HZ        100u  /* Supply ripple frequency (rectified mains) [Hz] */
+#define PUMP_MON_OFF_LEVEL        200u  /* Mean ADC counts below this: pump is off */
+#define PUMP_MON_NOMINAL_DEFAULT  4000u /* Mean ADC counts of a correctly running pump, until learned */
+#define PUMP_MON_DRY_PCT          70u   /* Mean current below this percentage of nominal: dry running */
+#define PUMP_MON_BLOCKED_PCT      130u  /* Mean current above this percentage of nominal: blocked */
+#define PUMP_MON_RIPPLE_MIN_PCT   2u    /* Minimum commutation ripple [% of mean] of a rotating motor */
+#define PUMP_MON_DEBOUNCE         5u    /* Equal blocks before a state is accepted */
+#define PUMP_MON_NO_DATA_TIMEOUT  500u  /* No block within this time [ms]: ADC trigger is missing */
+
+/**
+ * @brief State of the pump
+ */
+typedef enum
+{
+    PUMP_MON_UNKNOWN = 0u, /**< Not enough data yet */
+    PUMP_MON_OFF,          /**< Pump not powered */
+    PUMP_MON_RUNNING,      /**< Pump running with water */
+    PUMP_MON_DRY,          /**< Pump running without water */
+    PUMP_MON_BLOCKED,      /**< Pump clogged or stalled */
+    PUMP_MON_NO_DATA,      /**< No samples, ADC or timer not running */
+} PUMP_MON_STATE;
+
+/***************************************************
+ * @brief Initialize the PWM timer, the injected ADC conversion and start the monitoring
+ * The pin of the PWM channel must be configured as timer alternate function by the board setup.
+ * @param hadc ADC1 handle, the regular group is not touched
+ * @param adc_channel ADC channel of the current sense amplifier
+ * @param htim PWM timer handle (TIM1, TIM3 or TIM8), channel 4 is used as ADC trigger
+ * @param pwm_channel Timer channel driving the pump (TIM_CHANNEL_1..3)
+ * @return true if the monitoring is started
+ ***************************************************/
+bool pump_monitor_init(ADC_HandleTypeDef* hadc, uint32_t adc_channel, TIM_HandleTypeDef* htim, uint32_t pwm_channel);
+
+/***************************************************
+ * @brief Set the PWM duty cycle of the pump, the ADC trigger follows the middle of the on-time
+ * @param permille Duty cycle [0.1%], 0 switches the pump off
+ ***************************************************/
+void pump_monitor_set_pwm(uint32_t permille);
+
+/***************************************************
+ * @brief Get the debounced state of the pump
+ * @return State
+ ***************************************************/
+PUMP_MON_STATE pump_monitor_get_state(void);
+
+/***************************************************
+ * @brief Use the mean current of the last block as nominal current, call when the pump runs correctly
+ * @return true if learned, false if the pump is not running
+ ***************************************************/
+bool pump_monitor_learn(void);
+
+/***************************************************
+ * @brief Get the nominal current, learned or handed over by a warm reboot
+ * @return Mean ADC counts of a correctly running pump
+ ***************************************************/
+uint32_t pump_monitor_get_nominal(void);
+
+/***************************************************
+ * @brief Injected end of conversion interrupt, call from ADCx_IRQHandler
+ ***************************************************/
+void pump_monitor_adc_irq(void);
+
+/***************************************************
+ * @brief Print the state and the signature of the last block
+ ***************************************************/
+void pump_monitor_print(void);
+
+#endif /* PUMP_MONITOR_H */
+/** @}*/
@@ -23,6 +23,9 @@
 #define WD_FLAG 0x5Au /* just a value to mark this as a WD reset by the BMS application */
 #endif
 
+#define FAULT_FLAG 0xD1u /* just a value to mark a valid deadline fault record */
+#define DLI_FLAG   0xD7u /* just a value to mark a valid daily light integral record */
+
 #if (defined(STM32U5XX_MCU))
 #define RTC_CLK_ENABLE                  /* REC APB clock needs to be enabled */
 #define BKP_REG_PERIPHERAL    TAMP_BASE /* Backup register stored in TAMP */
@@ -59,6 +62,9 @@
 #define RTC_SERIAL_REG    2u /* register used for storing the serial number (in case BMS has no Flash) */
 #define RTC_WD_REG        0u
 #define RTC_RST_REG       3u /* Backup register to store reset cause */
+#define RTC_FAULT_REG     5u /* Backup register to store the last deadline fault record */
+#define RTC_DLI_REG       6u /* Backup register to store the light integral of the day */
+#define RTC_DLI_DAY_REG   7u /* Backup register to store the day of the light integral */
 
 /**
  * @brief Enumarated type for possible MCU reset cause
@@ -150,6 +156,35 @@ void rtc_set_wd_flag(uint32_t val);
  ***************************************************/
 bool rtc_get_wd_flag(uint32_t* pc) __attribute__((__nonnull__(1)));
 
+/***************************************************
+ * @brief RTC set the deadline fault record, it is retained over a reset
+ * @param val fault information, only the lower 24 bits are stored
+ ***************************************************/
+void rtc_set_fault_record(uint32_t val);
+
+/***************************************************
+ * @brief RTC get the deadline fault record and return true when set
+ * clear the record for next time
+ * @param val pointer for sending back the fault information
+ * @return true if a fault record is stored, otherwise false
+ ***************************************************/
+bool rtc_get_fault_record(uint32_t* val) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief RTC set the daily light integral record, it is retained over a reset
+ * @param day days since 01/01/2000, only the lower 16 bits are stored
+ * @param umol light integral of the day [umol/m2]
+ ***************************************************/
+void rtc_set_dli_record(uint32_t day, uint32_t umol);
+
+/***************************************************
+ * @brief RTC get the daily light integral record
+ * @param day pointer for sending back the day, days since 01/01/2000 (lower 16 bits)
+ * @param umol pointer for sending back the light integral of the day [umol/m2]
+ * @return true if a valid record is stored, otherwise false
+ ***************************************************/
+bool rtc_get_dli_record(uint32_t* day, uint32_t* umol) __attribute__((__nonnull__(1, 2)));
+
 /***************************************************
  * @brief RTC set bootloader Flag, so we can check it at next start_up
  ***************************************************/
@@ -0,0 +1,132 @@
+/**
+ * @file safe_var.h
+ * @author PL
+ * @brief Safety variables: blocks of variables with redundant storage, checked in the background
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup SAFE_VAR
+ *
+ * The safety related variables of a module are grouped in a struct of 32 bit words, the block. The
+ * block is protected by one of two kinds of redundancy:
+ * - SAFE_VAR_MIRROR: a second struct holds the inverted words, a write costs one extra store, for
+ *   variables written often (counters, the tick).
+ * - SAFE_VAR_CHECKSUM: a CRC-16 over the block, a write recalculates it, for variables written
+ *   rarely (limits, configuration) where a second copy costs too much RAM.
+ *
+ * Variables are written with safe_var_write32(), which keeps the redundancy up to date and may be
+ * called from interrupts. Hot paths read the variables directly from the struct, without any check.
+ * A coroutine checks one registered block every scrub period, so a corruption is detected within one
+ * pass over all blocks (the detection latency). Paths which must not act on a corrupted value use
+ * safe_var_read32() or safe_var_check(), which check before the value is used.
+ *
+ * A failed check calls the error callback of the block every time it is detected, the block is not
+ * repaired (the correct value is unknown). safe_var_inject() flips a bit of the redundancy of a block
+ * to measure the detection latency, the value of the variable is not changed. The check which detects
+ * an injected error flips the bit back and records the latency instead of calling the error callback.
+ *
+ * \addtogroup SAFE_VAR
+ * @{
+ */
+#ifndef SAFE_VAR_H
+#define SAFE_VAR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define SAFE_VAR_MAX_BLOCKS 8u   /* Registered blocks */
+#define SAFE_VAR_MAX_SIZE   256u /* Size of a block [bytes], bounds the time with interrupts disabled */
+#define SAFE_VAR_PERIOD     10u  /* Default time between two block checks [ms] */
+
+/**
+ * @brief Redundancy of a block
+ */
+typedef enum
+{
+    SAFE_VAR_MIRROR = 0u, /**< Inverted copy */
+    SAFE_VAR_CHECKSUM,    /**< CRC-16 */
+} SAFE_VAR_MODE;
+
+/**
+ * @brief Block of safety variables, define it static next to the struct it protects with SAFE_VAR_BLOCK_INIT()
+ */
+typedef struct
+{
+    const char* name;       /**< Name in the report */
+    uint32_t* data;         /**< Variables, 32 bit words */
+    uint32_t* mirror;       /**< Inverted copy, SAFE_VAR_MIRROR only */
+    uint32_t size;          /**< Size of the block [bytes], a multiple of 4 */
+    SAFE_VAR_MODE mode;     /**< Redundancy */
+    void (*on_error)(void); /**< Called when a check fails, NULL if not needed */
+    uint32_t checksum;      /**< CRC-16 of the block, SAFE_VAR_CHECKSUM only */
+    uint32_t checks;        /**< Checks done */
+    uint32_t errors;        /**< Failed checks */
+    uint32_t cycles_max;    /**< Longest check [cycles] */
+    uint32_t inject_word;   /**< Word of the injected error, the number of words for the checksum */
+    uint32_t inject_mask;   /**< Flipped bit of the injected error, 0 if none pending */
+    uint32_t inject_tick;   /**< Tick of the injected error */
+    uint32_t latency;       /**< Time from the last injected error to its detection [ms] */
+} SAFE_VAR_BLOCK;
+
+/***************************************************
+ * @brief Initializer of a block
+ * @param name Name in the report
+ * @param data Struct of 32 bit words
+ * @param mirror Struct of the same type for SAFE_VAR_MIRROR, NULL for SAFE_VAR_CHECKSUM
+ * @param mode Redundancy
+ * @param on_error Error callback, NULL if not needed
+ ***************************************************/
+#define SAFE_VAR_BLOCK_INIT(name, data, mirror, mode, on_error) {(name), (uint32_t*)(void*)(data), (uint32_t*)(void*)(mirror), sizeof(*(data)), (mode), (on_error), 0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u}
+
+/***************************************************
+ * @brief Seal the redundancy of a block from its current data and add it to the scrubber
+ * @param block Block, must stay valid
+ * @return false if the block is too large, not word sized, has no mirror or all blocks are used
+ ***************************************************/
+bool safe_var_register(SAFE_VAR_BLOCK* block) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Write a variable of a block and update the redundancy, interrupt safe
+ * @param block Block
+ * @param var Variable in the data of the block
+ * @param value Value
+ ***************************************************/
+void safe_var_write32(SAFE_VAR_BLOCK* block, volatile uint32_t* var, uint32_t value) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Read a variable of a block after checking it (SAFE_VAR_MIRROR) or the block (SAFE_VAR_CHECKSUM)
+ * @param block Block
+ * @param var Variable in the data of the block
+ * @param value Output, the value, also when the check failed
+ * @return false if the check failed, the error callback is called then
+ ***************************************************/
+bool safe_var_read32(SAFE_VAR_BLOCK* block, const volatile uint32_t* var, uint32_t* value) __attribute__((__nonnull__(1, 2, 3)));
+
+/***************************************************
+ * @brief Check a block
+ * @param block Block
+ * @return false if the check failed, the error callback is called then
+ ***************************************************/
+bool safe_var_check(SAFE_VAR_BLOCK* block) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Set the time between two block checks of the scrubber
+ * @param period Period [ms], 1 .. 60000
+ * @return false if out of range
+ ***************************************************/
+bool safe_var_set_period(uint32_t period);
+
+/***************************************************
+ * @brief Flip a bit of the redundancy of a registered block, to measure the detection latency
+ * @param index Index of the block in the report
+ * @return false if there is no such block or an injected error is not detected yet
+ ***************************************************/
+bool safe_var_inject(uint32_t index);
+
+/***************************************************
+ * @brief Print the blocks, the check counters and cycles and the scrubber pass time
+ ***************************************************/
+void safe_var_print(void);
+
+#endif /* SAFE_VAR_H */
+/** @}*/
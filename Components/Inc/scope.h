@@ -0,0 +1,126 @@
+/**
+ * @file scope.h
+ * @author PL
+ * @brief Triggered burst capture of raw ADC samples ("scope mode")
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup SCOPE
+ *
+ * A timer triggers a scan of up to SCOPE_MAX_CHANNELS ADC channels at a fixed rate, the DMA writes
+ * the samples to a circular buffer. The CPU is not involved while sampling: no interrupt per sample
+ * and no interrupt per buffer wrap, the DMA transfer complete interrupts are switched off.
+ *
+ * When armed, a trigger freezes the buffer after post_frames more scans, so the buffer holds
+ * the pre-trigger and the post-trigger window. A one-pulse timer (TIM5) started by the trigger stops
+ * the scans in its interrupt, the window cannot wrap around if the main loop is late. Trigger sources:
+ * - the analog watchdog of the ADC on one channel (hardware threshold, one interrupt)
+ * - scope_trigger() from firmware, e.g. a filtered value out of range
+ * - the "scope trig" command
+ * The frozen window is downloaded with the "scope dump" command as Intel HEX records, oldest scan first,
+ * each scan is num_channels little endian 16 bit samples in the order of the channel list.
+ *
+ * \addtogroup SCOPE
+ * @{
+ */
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "stm32_hal.h"
+
+#define SCOPE_MAX_CHANNELS 8u          /* Maximum number of channels in a scan (ADC4 sequencer ranks) */
+#define SCOPE_BUF_SAMPLES  2048u       /* Size of the capture buffer in samples, shared by all channels */
+#define SCOPE_POST_DEFAULT 0xFFFFFFFFu /* Post-trigger window of a quarter of the buffer */
+
+/**
+ * @brief Trigger source
+ */
+typedef enum
+{
+    SCOPE_TRIG_NONE = 0u, /**< Not triggered */
+    SCOPE_TRIG_AWD,       /**< Analog watchdog of the ADC */
+    SCOPE_TRIG_FW,        /**< scope_trigger() from firmware */
+    SCOPE_TRIG_CMD,       /**< Console command */
+} SCOPE_TRIG;
+
+/**
+ * @brief Configuration of a capture
+ */
+typedef struct
+{
+    uint32_t channels[SCOPE_MAX_CHANNELS]; /**< ADC channels, in scan order */
+    uint32_t num_channels;                 /**< Number of channels, 1 .. SCOPE_MAX_CHANNELS */
+    uint32_t rate_hz;                      /**< Scans per second */
+    uint32_t awd_index;                    /**< Index in channels watched by the analog watchdog */
+    uint32_t awd_low;                      /**< Analog watchdog low threshold [counts] */
+    uint32_t awd_high;                     /**< Analog watchdog high threshold [counts] */
+} SCOPE_CONFIG;
+
+/***************************************************
+ * @brief Configure the ADC, timer and DMA and start sampling, the capture is not armed
+ * Can be called again to change the configuration.
+ * @param hadc ADC4 handle
+ * @param htim Timer triggering the scans (TIM2)
+ * @param config Configuration, copied
+ * @return true if sampling is started
+ ***************************************************/
+bool scope_init(ADC_HandleTypeDef* hadc, TIM_HandleTypeDef* htim, const SCOPE_CONFIG* config) __attribute__((__nonnull__(1, 2, 3)));
+
+/***************************************************
+ * @brief Change the analog watchdog, sampling is restarted with the new configuration
+ * @param index Index in the channel list of the watched channel
+ * @param low Low threshold [counts]
+ * @param high High threshold [counts]
+ * @return true if sampling is restarted
+ ***************************************************/
+bool scope_set_awd(uint32_t index, uint32_t low, uint32_t high);
+
+/***************************************************
+ * @brief Arm the trigger, sampling restarts if the buffer was frozen
+ * @param post_frames Scans recorded after the trigger, the rest of the buffer is the pre-trigger window, or SCOPE_POST_DEFAULT
+ ***************************************************/
+void scope_arm(uint32_t post_frames);
+
+/***************************************************
+ * @brief Trigger the capture if it is armed, can be called from an interrupt
+ * @param source Trigger source
+ ***************************************************/
+void scope_trigger(SCOPE_TRIG source);
+
+/***************************************************
+ * @brief Check if a frozen capture is available
+ * @return true if the buffer is frozen
+ ***************************************************/
+bool scope_is_frozen(void);
+
+/***************************************************
+ * @brief Start the download of the frozen buffer as Intel HEX records over the console
+ * The records are printed in the background as long as there is space in the console buffer.
+ * @return true if the download is started, false if no frozen capture is available
+ ***************************************************/
+bool scope_dump(void);
+
+/***************************************************
+ * @brief Analog watchdog and overrun interrupt of the ADC, call from ADC4_IRQHandler
+ ***************************************************/
+void scope_adc_irq(void);
+
+/***************************************************
+ * @brief DMA error interrupt, call from the interrupt handler of the DMA channel
+ ***************************************************/
+void scope_dma_irq(void);
+
+/***************************************************
+ * @brief Update interrupt of the stop timer, call from TIM5_IRQHandler
+ ***************************************************/
+void scope_stop_irq(void);
+
+/***************************************************
+ * @brief Print the configuration and the state of the capture
+ ***************************************************/
+void scope_print(void);
+
+#endif /* SCOPE_H */
+/** @}*/
@@ -0,0 +1,91 @@
+/**
+ * @file snapshot.h
+ * @author PL
+ * @brief Lock-free snapshot store: one writer publishes whole frames, readers get consistent copies
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup SNAPSHOT
+ *
+ * A seqlock over a double buffer. The sequence counter is odd while the writer fills a frame, the
+ * writer always fills the buffer which is not published, and publishing is one increment of the
+ * counter. Neither the writer nor the readers mask interrupts: the writer (e.g. an interrupt) never
+ * waits, a reader copies the published buffer and checks the counter afterwards. The copy is only torn
+ * if the writer published a frame and started the next one during the copy, then the reader retries.
+ * The retries are counted as metrics of the store.
+ *
+ * Only one writer per store, readers may run at any priority below the writer. A reader which
+ * preempts the writer reads the last published frame.
+ *
+ * \addtogroup SNAPSHOT
+ * @{
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define SNAPSHOT_MAX_TRIES 4u /* Copies of a read before it fails */
+
+/**
+ * @brief Snapshot store
+ */
+typedef struct
+{
+    volatile uint32_t seq; /**< Sequence counter: frames published * 2, + 1 while a frame is written */
+    uint8_t* buf;          /**< Two frames */
+    size_t size;           /**< Size of a frame [bytes] */
+    uint32_t reads;        /**< Successful reads */
+    uint32_t retries;      /**< Copies repeated because the writer overtook the reader */
+    uint32_t max_retries;  /**< Most retries of one read */
+    uint32_t failures;     /**< Reads failed after SNAPSHOT_MAX_TRIES copies */
+} SNAPSHOT;
+
+/***************************************************
+ * @brief Initialize a store, no frame is published
+ * @param s Store
+ * @param buf Memory for two frames, must stay valid
+ * @param size Size of a frame [bytes]
+ ***************************************************/
+void snapshot_init(SNAPSHOT* s, void* buf, size_t size) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Start writing a frame, fill it and call snapshot_publish()
+ * @param s Store
+ * @return Frame to fill, the content is the frame before the last published one
+ ***************************************************/
+void* snapshot_begin(SNAPSHOT* s) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Publish the frame started with snapshot_begin()
+ * @param s Store
+ ***************************************************/
+void snapshot_publish(SNAPSHOT* s) __attribute__((__nonnull__(1)));
+
+/***************************************************
+ * @brief Copy and publish a whole frame
+ * @param s Store
+ * @param frame Frame of size bytes
+ ***************************************************/
+void snapshot_write(SNAPSHOT* s, const void* frame) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Copy the last published frame
+ * @param s Store
+ * @param frame Copy of size bytes
+ * @param seq Number of the copied frame, 1 for the first published frame, NULL if not needed
+ * @return false if no frame is published or the writer overtook every copy, frame is undefined then
+ ***************************************************/
+bool snapshot_read(SNAPSHOT* s, void* frame, uint32_t* seq) __attribute__((__nonnull__(1, 2)));
+
+/***************************************************
+ * @brief Print the metrics of a store
+ * @param s Store
+ * @param name Name of the store
+ ***************************************************/
+void snapshot_print(const SNAPSHOT* s, const char* name) __attribute__((__nonnull__(1, 2)));
+
+#endif /* SNAPSHOT_H */
+/** @}*/
@@ -5,6 +5,7 @@
  * @copyright (c) Copyright Nekoco 2024
  *
  * This file includes the proper HAL drivers based on defines. If no define is set, STM32U5XX is assumed, because that was the first.
+ * The host unit tests (TEST) get the replacement of Components/Test/support instead.
  *
  */
 
@@ -13,7 +14,9 @@
 
 #include "define.h"
 
-#if (defined(STM32U5XX_MCU))
+#if (defined(TEST))
+#include "stm32_hal_host.h" /* Host unit tests */
+#elif (defined(STM32U5XX_MCU))
 #include "stm32u5xx_hal.h"
 #else
 #include "stm32u5xx_hal.h" /* Default HAL drivers */
@@ -0,0 +1,81 @@
+/**
+ * @file supervisor.h
+ * @author PL
+ * @brief Deadline monitoring of jobs, feeding the independent watchdog
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup SUPERVISOR
+ *
+ * Every job declares its expected period and maximum execution budget. The IWDG is only
+ * refreshed when all registered jobs met their deadlines since the previous check.
+ * A deadline miss is stored with the job ID in the retained fault record (RTC backup register).
+ * A hang which stops the superloop is recorded by the early wakeup interrupt of the IWDG, as the
+ * hanging job or as job SUPERVISOR_JOB_NUM when all jobs were within their deadlines.
+ *
+ * \addtogroup SUPERVISOR
+ * @{
+ */
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define SUPERVISOR_IWDG_TIMEOUT 2000u /* IWDG timeout [ms], misses shorter than this only get recorded */
+
+/**
+ * @brief Jobs monitored by the supervisor
+ */
+typedef enum
+{
+    SUPERVISOR_JOB_COMMANDS = 0u, /**< Console command interpreter */
+    SUPERVISOR_JOB_CORO,          /**< Coroutine scheduler */
+    SUPERVISOR_JOB_NUM,           /**< Number of jobs, keep this last */
+} SUPERVISOR_JOB;
+
+/***************************************************
+ * @brief Initialize the supervisor and start the IWDG
+ * The retained fault record of the previous run is read (and cleared) here.
+ * @param timeout_ms IWDG timeout [ms], max 8190 ms
+ ***************************************************/
+void supervisor_init(uint32_t timeout_ms);
+
+/***************************************************
+ * @brief Register a job for deadline monitoring
+ * @param job Job ID
+ * @param period_ms Maximum time between two starts of the job [ms]
+ * @param budget_ms Maximum execution time of the job [ms]
+ ***************************************************/
+void supervisor_register(SUPERVISOR_JOB job, uint32_t period_ms, uint32_t budget_ms);
+
+/***************************************************
+ * @brief Check in: job starts its execution
+ * @param job Job ID
+ ***************************************************/
+void supervisor_job_start(SUPERVISOR_JOB job);
+
+/***************************************************
+ * @brief Check out: job finished its execution
+ * @param job Job ID
+ ***************************************************/
+void supervisor_job_end(SUPERVISOR_JOB job);
+
+/***************************************************
+ * @brief Verify the deadlines of all jobs and refresh the IWDG when none were missed
+ * @return true if the IWDG is refreshed, otherwise false
+ ***************************************************/
+bool supervisor_proc(void);
+
+/***************************************************
+ * @brief IWDG early wakeup interrupt, records the job which stops the superloop before the reset
+ ***************************************************/
+void supervisor_iwdg_irq(void);
+
+/***************************************************
+ * @brief Print the statistics of the monitored jobs
+ ***************************************************/
+void supervisor_print(void);
+
+#endif /* SUPERVISOR_H */
+/** @}*/
@@ -23,7 +23,12 @@
 #define TEMP_STEP_START  150u  /* Time offset to start reading */
 #define GAUGE_STEP_START 0u    /* Time offset to start reading */
 
-#define MAX_TIM_PERIPHERALS 10u /* Max amount of timer peripherals supported by this module */
+#define MAX_TIM_PERIPHERALS 10u                 /* Max amount of timer peripherals supported by this module */
+#define TIMER_PWM_INVALID   MAX_TIM_PERIPHERALS /* Handle of a pin without PWM configuration */
+
+#if defined(ENABLE_PWM_US_TIMER_PERIPHERALS) && !defined(ENABLE_PWM_TIMER_PERIPHERALS)
+#define ENABLE_PWM_TIMER_PERIPHERALS /* The PWM functions are part of the PWM and us timer functions */
+#endif
 
 /****************************************************************
  * @brief Errors of the timer module
@@ -59,7 +64,12 @@ uint32_t timer_get_elapsed_module_timer(uint32_t module_timer);
  ***************************************************/
 void timer_delay(uint32_t delay_ms);
 
-#ifdef ENABLE_PWM_US_TIMER_PERIPHERALS
+#ifdef ENABLE_PWM_TIMER_PERIPHERALS
+/****************************************************************
+ * @brief Handle of a PWM output, resolved once by timer_pwm_get_handle()
+ ***************************************************************/
+typedef uint32_t TIMER_PWM_HANDLE;
+
 /* PWM timer functions --------------------------------*/
 /***************************************************
  * @brief Associate a timer peripheral and channel with a pin on the microcontroller for PWMing
@@ -90,7 +100,7 @@ void timer_pwm_init_pin(GPIO_TypeDef* port, uint16_t pin, uint32_t gpio_speed);
  *
  * @param port GPIO port for PWM output
  * @param pin Pin for PWM output
- * @param duty_cycle duty cycle of PWN output
+ * @param duty_cycle duty cycle of PWN output [%], limited to 100
  ***************************************************/
 void timer_pwm_set_duty_cycle(const GPIO_TypeDef* port, uint16_t pin, uint8_t duty_cycle);
 
@@ -110,6 +120,61 @@ void timer_pwm_start(const GPIO_TypeDef* port, uint16_t pin);
  ***************************************************/
 void timer_pwm_stop(const GPIO_TypeDef* port, uint16_t pin);
 
+/***************************************************
+ * @brief Resolve the PWM output of a pin, the configuration is checked here once instead of on every call
+ *
+ * @param port GPIO port for PWM output
+ * @param pin Pin for PWM output
+ *
+ * @return Handle, TIMER_PWM_INVALID if the pin has no valid configuration
+ ***************************************************/
+TIMER_PWM_HANDLE timer_pwm_get_handle(const GPIO_TypeDef* port, uint16_t pin);
+
+/***************************************************
+ * @brief Set duty cycle of a PWM output by its handle, writes the compare register directly
+ *
+ * The compare register is preloaded, the new value takes effect at the next update event.
+ *
+ * @param pwm Handle of the PWM output
+ * @param duty_cycle duty cycle of PWN output [%], limited to 100
+ ***************************************************/
+void timer_pwm_set_duty(TIMER_PWM_HANDLE pwm, uint8_t duty_cycle);
+
+/***************************************************
+ * @brief Start PWM signal by its handle
+ *
+ * @param pwm Handle of the PWM output
+ ***************************************************/
+void timer_pwm_handle_start(TIMER_PWM_HANDLE pwm);
+
+/***************************************************
+ * @brief Stop PWM signal by its handle
+ *
+ * @param pwm Handle of the PWM output
+ ***************************************************/
+void timer_pwm_handle_stop(TIMER_PWM_HANDLE pwm);
+
+/***************************************************
+ * @brief Start a batch of compare updates on a timer: the update event is disabled (UDIS)
+ *
+ * The compare values written until timer_pwm_batch_commit() stay in the preload registers
+ * and are loaded together at the first update event after the commit, so all channels of
+ * the timer change in the same PWM period.
+ *
+ * @param htim Timer peripheral handle
+ ***************************************************/
+void timer_pwm_batch_begin(const TIM_HandleTypeDef* htim);
+
+/***************************************************
+ * @brief Commit a batch of compare updates: the update event is enabled again
+ *
+ * @param htim Timer peripheral handle
+ ***************************************************/
+void timer_pwm_batch_commit(const TIM_HandleTypeDef* htim);
+#endif /* ENABLE_PWM_TIMER_PERIPHERALS */
+
+#ifdef ENABLE_PWM_US_TIMER_PERIPHERALS
+
 /* Microsecond timer functions --------------------------------*/
 /***************************************************
  * @brief Set timer peripheral to be used for microsecond timer
@@ -0,0 +1,139 @@
+/**
+ * @file vpd.h
+ * @author PL
+ * @brief Vapor pressure deficit (VPD) of the grow zones and climate setpoints
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup VPD
+ *
+ * VPD = SVP(leaf temperature) - actual vapor pressure of the air, with the saturation vapor pressure
+ * SVP(T) = 610.78 Pa * exp(17.27 * T / (T + 237.3)) (Tetens). Instead of an exp() per sample the SVP
+ * is read from a table in 1 degC steps from VPD_TEMP_MIN to VPD_TEMP_MAX with linear interpolation,
+ * the error is below 4 Pa, largest near VPD_TEMP_MAX. vpd_calc() is integer only, a few dozen cycles,
+ * see the "vpd check" command.
+ *
+ * Each zone has up to VPD_MAX_SENSORS temperature/humidity sensors. The relative humidity of a sensor
+ * only holds at its own temperature, so the sensors are fused by averaging the temperature and the
+ * actual vapor pressure (the water content of the air), not the relative humidity.
+ * Sensors without an update within VPD_SENSOR_TIMEOUT are left out.
+ *
+ * Once per VPD_PERIOD the outputs of each zone are computed from its configuration:
+ * - humidifier   : on above target + band, off at the target (air too dry)
+ * - dehumidifier : on below target - band, off at the target (air too humid)
+ * - fan          : VPD_FAN_MIN, rising to full speed over VPD_FAN_SPAN below the target,
+ *                  full speed above the maximum temperature
+ * Without a valid sensor the humidifier and dehumidifier are off and the fan runs at VPD_FAN_MIN.
+ *
+ * \addtogroup VPD
+ * @{
+ */
+#ifndef VPD_H
+#define VPD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "fixmath.h"
+
+#define VPD_MAX_ZONES      4u     /* Number of grow zones */
+#define VPD_MAX_SENSORS    2u     /* Temperature/humidity sensors per zone */
+#define VPD_SENSOR_TIMEOUT 10000u /* A sensor without update within this time is left out [ms] */
+#define VPD_PERIOD         1000u  /* Evaluation period of the setpoints [ms] */
+#define VPD_TEMP_MIN       (-10)  /* Lowest temperature of the SVP table [degC] */
+#define VPD_TEMP_MAX       50     /* Highest temperature of the SVP table [degC] */
+#define VPD_FAN_MIN        200u   /* Minimum fan speed for air circulation [0.1%] */
+#define VPD_FAN_SPAN       400    /* VPD below the target where the fan reaches full speed [Pa] */
+
+/**
+ * @brief Climate configuration of a zone
+ */
+typedef struct
+{
+    int32_t target_pa; /**< VPD target [Pa] */
+    int32_t band_pa;   /**< Hysteresis around the target [Pa] */
+    q16_t leaf_offset; /**< Leaf temperature - air temperature [degC] */
+    q16_t temp_max;    /**< Fan at full speed above this air temperature [degC] */
+} VPD_CONFIG;
+
+/**
+ * @brief Computed state and setpoints of a zone
+ */
+typedef struct
+{
+    bool valid;            /**< At least one sensor of the zone is up to date */
+    q16_t temp;            /**< Fused air temperature [degC] */
+    int32_t avp_pa;        /**< Fused actual vapor pressure [Pa] */
+    int32_t vpd_pa;        /**< Vapor pressure deficit at the leaf [Pa] */
+    bool humidifier;       /**< Humidifier on */
+    bool dehumidifier;     /**< Dehumidifier on */
+    uint32_t fan_permille; /**< Fan speed [0.1%] */
+} VPD_OUTPUT;
+
+/***************************************************
+ * @brief Load the default configuration of all zones and start the evaluation
+ ***************************************************/
+void vpd_init(void);
+
+/***************************************************
+ * @brief Saturation vapor pressure of water, table with linear interpolation
+ * @param temp Temperature [degC], saturated to the table range
+ * @return SVP [Pa]
+ ***************************************************/
+int32_t vpd_svp(q16_t temp);
+
+/***************************************************
+ * @brief Vapor pressure deficit at the leaf
+ * @param temp Air temperature [degC]
+ * @param rh Relative humidity [%], saturated to 0..100
+ * @param leaf_offset Leaf temperature - air temperature [degC]
+ * @return VPD [Pa], negative if the leaf is below the dew point
+ ***************************************************/
+int32_t vpd_calc(q16_t temp, q16_t rh, q16_t leaf_offset);
+
+/***************************************************
+ * @brief Update a sensor of a zone
+ * @param zone Zone index
+ * @param sensor Sensor index within the zone
+ * @param temp Air temperature [degC]
+ * @param rh Relative humidity [%]
+ * @return false if the zone or the sensor doesn't exist
+ ***************************************************/
+bool vpd_set_sensor(uint32_t zone, uint32_t sensor, q16_t temp, q16_t rh);
+
+/***************************************************
+ * @brief Set the climate configuration of a zone
+ * @param zone Zone index
+ * @param config Configuration, copied
+ * @return false if the zone doesn't exist
+ ***************************************************/
+bool vpd_set_config(uint32_t zone, const VPD_CONFIG* config) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Get the climate configuration of a zone
+ * @param zone Zone index
+ * @param config Configuration output
+ * @return false if the zone doesn't exist
+ ***************************************************/
+bool vpd_get_config(uint32_t zone, VPD_CONFIG* config) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Get the state and the setpoints of a zone from the last evaluation
+ * @param zone Zone index
+ * @param out State and setpoints output
+ * @return true if the zone exists and its sensors are valid
+ ***************************************************/
+bool vpd_get_output(uint32_t zone, VPD_OUTPUT* out) __attribute__((__nonnull__(2)));
+
+/***************************************************
+ * @brief Print the state and the setpoints of all zones
+ ***************************************************/
+void vpd_print(void);
+
+/***************************************************
+ * @brief Verify the SVP table against exp() and print the cycles of vpd_calc() and of the float formula
+ * @return true if the error is within 4 Pa over the table range
+ ***************************************************/
+bool vpd_check(void);
+
+#endif /* VPD_H */
+/** @}*/
@@ -0,0 +1,297 @@
+/**
+ * @file autotune.c
+ * @author PL
+ * @brief Relay feedback auto-tuning of the PID loops
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup AUTOTUNE
+ *
+ * The time base is the sample count of the loop, so the experiment gives the same result
+ * in the simulation as on the target. A cycle is measured from one switch of the relay to high
+ * to the next one, the amplitude of a cycle is half of its peak to peak process value.
+ */
+#include "autotune.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "coroutine.h"
+
+#define AUTOTUNE_PI 3.14159265f /* pi */
+
+/**
+ * @brief Operational data of the auto-tune
+ */
+typedef struct
+{
+    CORO coro;                      /**< Experiment coroutine, first member */
+    AUTOTUNE_CONFIG config;         /**< Parameters */
+    PID_LOOP loop;                  /**< Loop under test */
+    const PID_IO* io;               /**< Process value and actuator of the loop */
+    bool was_enabled;               /**< The PID was enabled before the experiment */
+    volatile AUTOTUNE_STATE state;  /**< State */
+    bool relay_high;                /**< Relay output is bias + amplitude */
+    uint32_t samples;               /**< Samples since the start */
+    uint32_t last_switch;           /**< Sample of the last switch to high, 0 before the first */
+    float pv_max;                   /**< Highest process value of the running cycle */
+    float pv_min;                   /**< Lowest process value of the running cycle */
+    uint32_t cycles;                /**< Complete cycles, including the dropped first one */
+    float periods[AUTOTUNE_CYCLES]; /**< Period of the last cycles [samples] */
+    float amps[AUTOTUNE_CYCLES];    /**< Amplitude of the last cycles */
+    AUTOTUNE_RESULT result;         /**< Result of the last successful experiment */
+    bool has_result;                /**< result is valid */
+} AUTOTUNE_DATA;
+
+STATIC AUTOTUNE_DATA autotune = {.state = AUTOTUNE_IDLE};
+
+/***************************************************
+ * @brief Names of the states, in the same order as AUTOTUNE_STATE
+ ***************************************************/
+static const char* const autotune_state_names[] = {"idle", "running", "done", "aborted: excursion", "aborted: timeout", "stopped", "config save failed"};
+
+/***************************************************
+ * @brief Mean and relative spread of the last cycles
+ * @param val Values of the last AUTOTUNE_CYCLES cycles
+ * @param spread_pct Output: (max - min) / mean [%]
+ * @return Mean
+ ***************************************************/
+STATIC float autotune_mean(const float* val, float* spread_pct)
+{
+    float sum = 0.0f;
+    float max = val[0];
+    float min = val[0];
+
+    for (uint32_t i = 0u; i < AUTOTUNE_CYCLES; i++)
+    {
+        sum += val[i];
+        max = (val[i] > max) ? val[i] : max;
+        min = (val[i] < min) ? val[i] : min;
+    }
+    const float mean = sum / (float)AUTOTUNE_CYCLES;
+    *spread_pct = (mean > 0.0f) ? (((max - min) * 100.0f) / mean) : 100.0f;
+
+    return mean;
+}
+
+/***************************************************
+ * @brief End the experiment, the actuator is switched off and the PID restored
+ * @param state Final state
+ ***************************************************/
+STATIC void autotune_finish(AUTOTUNE_STATE state)
+{
+    autotune.io->write(autotune.io->out_min);
+    (void)pid_enable(autotune.loop, autotune.was_enabled);
+    autotune.state = state;
+    printf("Autotune loop %u %s\r\n", autotune.loop, autotune_state_names[state]);
+}
+
+/***************************************************
+ * @brief Evaluate the last cycles, write the gains when they agree
+ * @return true if the experiment is finished
+ ***************************************************/
+STATIC bool autotune_evaluate(void)
+{
+    float period_spread;
+    float amp_spread;
+    const float period = autotune_mean(autotune.periods, &period_spread);
+    const float amp = autotune_mean(autotune.amps, &amp_spread);
+    const bool stable = (autotune.cycles > AUTOTUNE_CYCLES) && (period_spread <= (float)AUTOTUNE_MAX_SPREAD_PCT) && (amp_spread <= (float)AUTOTUNE_MAX_SPREAD_PCT);
+
+    if (stable)
+    {
+        const float h = autotune.config.hysteresis;
+        const float a = (amp > h) ? sqrtf((amp * amp) - (h * h)) : amp;
+        AUTOTUNE_RESULT* res = &autotune.result;
+
+        res->ku = (4.0f * autotune.config.amplitude) / (AUTOTUNE_PI * a);
+        res->pu = (period * (float)autotune.io->period_ms) * 0.001f;
+        autotune_gains(res->ku, res->pu, autotune.config.rule, &res->gains);
+        autotune.has_result = true;
+
+        config_get()->pid[autotune.loop] = res->gains;
+        autotune_finish(config_save() ? AUTOTUNE_DONE : AUTOTUNE_SAVE_FAIL);
+    }
+
+    return stable;
+}
+
+/***************************************************
+ * @brief One sample of the relay experiment
+ * @return true if the experiment is finished
+ ***************************************************/
+STATIC bool autotune_sample(void)
+{
+    const AUTOTUNE_CONFIG* cfg = &autotune.config;
+    const float pv = autotune.io->read();
+    const bool reverse = (cfg->amplitude < 0.0f);
+    const float err = reverse ? (pv - cfg->setpoint) : (cfg->setpoint - pv); /* > 0: more output needed */
+    bool finished = false;
+
+    autotune.samples++;
+    autotune.pv_max = (pv > autotune.pv_max) ? pv : autotune.pv_max;
+    autotune.pv_min = (pv < autotune.pv_min) ? pv : autotune.pv_min;
+
+    if (fabsf(pv - cfg->setpoint) > cfg->max_excursion)
+    {
+        autotune_finish(AUTOTUNE_EXCURSION);
+        finished = true;
+    }
+    else if ((autotune.samples * autotune.io->period_ms) > cfg->timeout_ms)
+    {
+        autotune_finish(AUTOTUNE_TIMEOUT);
+        finished = true;
+    }
+    else if (autotune.relay_high && (err < -cfg->hysteresis))
+    {
+        autotune.relay_high = false;
+    }
+    else if (!autotune.relay_high && (err > cfg->hysteresis))
+    {
+        autotune.relay_high = true;
+        if (autotune.last_switch != 0u)
+        {
+            const uint32_t i = autotune.cycles % AUTOTUNE_CYCLES;
+            autotune.periods[i] = (float)(autotune.samples - autotune.last_switch);
+            autotune.amps[i] = (autotune.pv_max - autotune.pv_min) * 0.5f;
+            autotune.cycles++;
+            finished = autotune_evaluate();
+        }
+        autotune.last_switch = autotune.samples;
+        autotune.pv_max = pv;
+        autotune.pv_min = pv;
+    }
+    else
+    {
+        // Do nothing
+    }
+
+    if (!finished)
+    {
+        autotune.io->write(cfg->bias + (autotune.relay_high ? fabsf(cfg->amplitude) : -fabsf(cfg->amplitude)));
+    }
+
+    return finished;
+}
+
+/***************************************************
+ * @brief Experiment coroutine, one sample every period of the loop
+ * @param c Control block
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE autotune_coro(CORO* c)
+{
+    CORO_BEGIN(c);
+    while (autotune.state == AUTOTUNE_RUNNING)
+    {
+        CORO_SLEEP(c, autotune.io->period_ms);
+        if (autotune.state == AUTOTUNE_RUNNING)
+        {
+            (void)autotune_sample();
+        }
+    }
+    CORO_END(c);
+}
+
+bool autotune_start(PID_LOOP loop, const AUTOTUNE_CONFIG* config)
+{
+    const PID_IO* io = pid_get_io(loop);
+    const float high = config->bias + fabsf(config->amplitude);
+    const float low = config->bias - fabsf(config->amplitude);
+    const bool ok = (autotune.state != AUTOTUNE_RUNNING) && (io != NULL) && (config->amplitude != 0.0f) && (high <= io->out_max) && (low >= io->out_min) &&
+                    (config->max_excursion > config->hysteresis);
+
+    if (ok)
+    {
+        autotune.config = *config;
+        autotune.loop = loop;
+        autotune.io = io;
+        autotune.samples = 0u;
+        autotune.last_switch = 0u;
+        autotune.cycles = 0u;
+        autotune.relay_high = true;
+        autotune.pv_max = io->read();
+        autotune.pv_min = autotune.pv_max;
+        autotune.was_enabled = pid_is_enabled(loop);
+        (void)pid_enable(loop, false);
+        autotune.state = AUTOTUNE_RUNNING;
+        coro_start(&autotune.coro, autotune_coro);
+    }
+
+    return ok;
+}
+
+void autotune_stop(void)
+{
+    if (autotune.state == AUTOTUNE_RUNNING)
+    {
+        autotune_finish(AUTOTUNE_STOPPED);
+    }
+}
+
+AUTOTUNE_STATE autotune_get_state(void)
+{
+    return autotune.state;
+}
+
+bool autotune_get_result(AUTOTUNE_RESULT* result)
+{
+    if (autotune.has_result)
+    {
+        *result = autotune.result;
+    }
+
+    return autotune.has_result;
+}
+
+void autotune_gains(float ku, float pu, AUTOTUNE_RULE rule, PID_GAINS* gains)
+{
+    float kp;
+    float ti;
+    float td;
+
+    if (rule == AUTOTUNE_RULE_TL)
+    {
+        kp = ku / 2.2f;
+        ti = 2.2f * pu;
+        td = pu / 6.3f;
+    }
+    else
+    {
+        kp = 0.6f * ku;
+        ti = 0.5f * pu;
+        td = 0.125f * pu;
+    }
+
+    gains->kp = kp;
+    gains->ki = kp / ti;
+    gains->kd = kp * td;
+}
+
+void autotune_print(void)
+{
+    printf("Autotune %s", autotune_state_names[autotune.state]);
+    if (autotune.state == AUTOTUNE_RUNNING)
+    {
+        printf(", loop %u, %lu s, %lu cycles", autotune.loop, (autotune.samples * autotune.io->period_ms) / 1000u, autotune.cycles);
+    }
+    printf("\r\n");
+
+    if (autotune.has_result)
+    {
+        const AUTOTUNE_RESULT* res = &autotune.result;
+        printf("Ku ");
+        pid_print_float(res->ku);
+        printf(" Pu ");
+        pid_print_float(res->pu);
+        printf(" s: kp ");
+        pid_print_float(res->gains.kp);
+        printf(" ki ");
+        pid_print_float(res->gains.ki);
+        printf(" kd ");
+        pid_print_float(res->gains.kd);
+        printf("\r\n");
+    }
+}
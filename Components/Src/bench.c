@@ -0,0 +1,203 @@
+/**
+ * @file bench.c
+ * @author PL
+ * @brief Cycle accurate benchmarks with the DWT cycle counter
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup BENCH
+ *
+ * Every benchmark runs BENCH_LOOPS iterations with interrupts disabled,
+ * the cost of an empty loop is subtracted and the result is printed per iteration.
+ */
+#include "bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "stm32_hal.h"
+
+/***************************************************
+ * @brief Input data of the arithmetic benchmarks, volatile so the compiler can't fold the loops
+ ***************************************************/
+static volatile float bench_in_f[BENCH_LOOPS];
+static volatile int16_t bench_in_q[BENCH_LOOPS];
+
+/***************************************************
+ * @brief Output of the arithmetic benchmarks
+ ***************************************************/
+static volatile float bench_out_f;
+static volatile int32_t bench_out_q;
+
+/***************************************************
+ * @brief Cycles of an empty benchmark loop
+ ***************************************************/
+STATIC uint32_t bench_overhead = 0u;
+
+/***************************************************
+ * @brief Empty loop, reference for the loop overhead
+ * @return Cycles used
+ ***************************************************/
+STATIC uint32_t bench_empty(void)
+{
+    const uint32_t start = bench_get_cycles();
+    for (uint32_t i = 0u; i < BENCH_LOOPS; i++)
+    {
+        __ASM volatile("" ::: "memory");
+    }
+    return bench_get_cycles() - start;
+}
+
+/***************************************************
+ * @brief Save and restore of the integer context as done by the context switch
+ * @return Cycles used
+ ***************************************************/
+STATIC uint32_t bench_ctx_int(void)
+{
+    const uint32_t start = bench_get_cycles();
+    for (uint32_t i = 0u; i < BENCH_LOOPS; i++)
+    {
+        __ASM volatile("push {r4-r11}\n"
+                       "pop {r4-r11}\n" ::
+                           : "memory");
+    }
+    return bench_get_cycles() - start;
+}
+
+#if (__FPU_USED == 1U)
+/***************************************************
+ * @brief Save and restore of the integer and FP context as done by the context switch of a task using floats
+ * @return Cycles used
+ ***************************************************/
+STATIC uint32_t bench_ctx_fpu(void)
+{
+    const uint32_t start = bench_get_cycles();
+    for (uint32_t i = 0u; i < BENCH_LOOPS; i++)
+    {
+        __ASM volatile("push {r4-r11}\n"
+                       "vpush {s16-s31}\n"
+                       "vpop {s16-s31}\n"
+                       "pop {r4-r11}\n" ::
+                           : "memory");
+    }
+    return bench_get_cycles() - start;
+}
+#endif /* __FPU_USED */
+
+/***************************************************
+ * @brief Multiply-accumulate in float
+ * @return Cycles used
+ ***************************************************/
+STATIC uint32_t bench_mac_float(void)
+{
+    const uint32_t start = bench_get_cycles();
+    float acc = 0.0f;
+    for (uint32_t i = 0u; i < BENCH_LOOPS; i++)
+    {
+        acc += bench_in_f[i] * 0.70710678f;
+    }
+    bench_out_f = acc;
+    return bench_get_cycles() - start;
+}
+
+/***************************************************
+ * @brief Multiply-accumulate in Q15 with saturation of the result
+ * @return Cycles used
+ ***************************************************/
+STATIC uint32_t bench_mac_q15(void)
+{
+    const uint32_t start = bench_get_cycles();
+    int32_t acc = 0;
+    for (uint32_t i = 0u; i < BENCH_LOOPS; i++)
+    {
+        acc += ((int32_t)bench_in_q[i] * 23170) >> 15; /* 0.70710678 in Q15 */
+    }
+    bench_out_q = __SSAT(acc, 16u);
+    return bench_get_cycles() - start;
+}
+
+/***************************************************
+ * @brief Division in float
+ * @return Cycles used
+ ***************************************************/
+STATIC uint32_t bench_div_float(void)
+{
+    const uint32_t start = bench_get_cycles();
+    float acc = 0.0f;
+    for (uint32_t i = 0u; i < BENCH_LOOPS; i++)
+    {
+        acc += 1000.0f / (bench_in_f[i] + 1.0f);
+    }
+    bench_out_f = acc;
+    return bench_get_cycles() - start;
+}
+
+/***************************************************
+ * @brief Scaled division in fixed point
+ * @return Cycles used
+ ***************************************************/
+STATIC uint32_t bench_div_q15(void)
+{
+    const uint32_t start = bench_get_cycles();
+    int32_t acc = 0;
+    for (uint32_t i = 0u; i < BENCH_LOOPS; i++)
+    {
+        acc += (int32_t)((1000 << 15) / ((int32_t)bench_in_q[i] + 32768)); //lint !e9033 intended
+    }
+    bench_out_q = acc;
+    return bench_get_cycles() - start;
+}
+
+/***************************************************
+ * @brief Run one benchmark with interrupts disabled and print the cycles per iteration
+ * @param name Name of the benchmark
+ * @param func Benchmark function
+ ***************************************************/
+STATIC void bench_print(const char* name, uint32_t (*func)(void))
+{
+    const uint32_t old_primask = __get_PRIMASK();
+    (void)__disable_irq();
+    const uint32_t cycles = func();
+    __set_PRIMASK(old_primask);
+
+    const uint32_t net = (cycles > bench_overhead) ? (cycles - bench_overhead) : 0u;
+    printf("%-10s %6lu cycles (%lu.%02lu per iteration)\r\n", name, net, net / BENCH_LOOPS, ((net % BENCH_LOOPS) * 100u) / BENCH_LOOPS);
+}
+
+void bench_init(void)
+{
+    DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0u;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    for (uint32_t i = 0u; i < BENCH_LOOPS; i++)
+    {
+        bench_in_q[i] = (int16_t)((i * 977u) & 0x7FFFu);
+        bench_in_f[i] = (float)bench_in_q[i];
+    }
+}
+
+uint32_t bench_get_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+void bench_run(void)
+{
+    const uint32_t old_primask = __get_PRIMASK();
+    (void)__disable_irq();
+    bench_overhead = bench_empty();
+    __set_PRIMASK(old_primask);
+
+    printf("CPU %lu Hz, %lu iterations, loop overhead %lu cycles\r\n", SystemCoreClock, (uint32_t)BENCH_LOOPS, bench_overhead);
+#if (__FPU_USED == 1U)
+    const uint32_t fpccr = FPU->FPCCR;
+    printf("FPU lazy stacking %s, automatic state preservation %s\r\n", ((fpccr & FPU_FPCCR_LSPEN_Msk) != 0u) ? "on" : "off", ((fpccr & FPU_FPCCR_ASPEN_Msk) != 0u) ? "on" : "off");
+#endif
+    bench_print("ctx int", bench_ctx_int);
+#if (__FPU_USED == 1U)
+    bench_print("ctx fpu", bench_ctx_fpu);
+#endif
+    bench_print("mac float", bench_mac_float);
+    bench_print("mac q15", bench_mac_q15);
+    bench_print("div float", bench_div_float);
+    bench_print("div q15", bench_div_q15);
+}
@@ -0,0 +1,321 @@
+/**
+ * @file calib.c
+ * @author PL
+ * @brief Calibration manager: multi-point sensor calibration and cached ADC self-calibration
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup CALIB
+ *
+ * The coefficient sets live in the configuration in RAM (config_get()), the fit writes the new set
+ * in one place, so a driver never sees a half written set (drivers and console run in the main loop).
+ * The cached ADC factors belong to one chip: the hash of the unique device ID is stored with them,
+ * a config store moved to another board recalibrates.
+ */
+#include "calib.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "handoff.h"
+#include "pid.h"
+#include "rtc.h"
+
+#define CALIB_MIN_SPREAD 1e-6f /* Smallest spread of the raw values of a multi-point fit */
+
+/**
+ * @brief Running calibration
+ */
+typedef struct
+{
+    CALIB_SENSOR sensor;               /**< Calibrated sensor, CALIB_SENSORS if none */
+    uint32_t points;                   /**< Collected points */
+    float reference[CALIB_MAX_POINTS]; /**< Reference values */
+    float raw[CALIB_MAX_POINTS];       /**< Raw values */
+} CALIB_SESSION;
+
+/**
+ * @brief Operational data of the calibration manager
+ */
+typedef struct
+{
+    CALIB_SESSION session;                  /**< Running calibration */
+    float (*read_raw[CALIB_SENSORS])(void); /**< Raw readings of the drivers */
+    bool pending;                           /**< New ADC factors not yet in flash */
+    bool adc_cached[CALIB_ADCS];            /**< The ADC was set from the cache at this boot */
+} CALIB_MANAGER;
+
+STATIC CALIB_MANAGER calib = {.session = {.sensor = CALIB_SENSORS}};
+
+/***************************************************
+ * @brief Names of the sensors and ADCs, in the same order as the enums
+ ***************************************************/
+static const char* const calib_sensor_names[CALIB_SENSORS] = {"ph", "ec", "temp"};
+static const char* const calib_adc_names[CALIB_ADCS] = {"ADC1", "ADC4"};
+
+/***************************************************
+ * @brief Hash of the unique device ID
+ * @return Hash, never 0
+ ***************************************************/
+STATIC uint32_t calib_chip(void)
+{
+    const uint32_t* uid = (const uint32_t*)UID_BASE; //lint !e923 device ID address
+    const uint32_t hash = uid[0] ^ (uid[1] * 0x9E3779B1u) ^ (uid[2] * 0x85EBCA77u);
+
+    return (hash != 0u) ? hash : 1u;
+}
+
+void calib_register(CALIB_SENSOR sensor, float (*read_raw)(void))
+{
+    if (sensor < CALIB_SENSORS)
+    {
+        calib.read_raw[sensor] = read_raw;
+    }
+}
+
+float calib_apply(CALIB_SENSOR sensor, float raw)
+{
+    float val = raw;
+
+    if (sensor < CALIB_SENSORS)
+    {
+        const CALIB_SET* set = &config_get()->calib.sets[sensor];
+        val = (set->gain * raw) + set->offset;
+    }
+
+    return val;
+}
+
+bool calib_start(CALIB_SENSOR sensor)
+{
+    const bool ok = (sensor < CALIB_SENSORS);
+
+    if (ok)
+    {
+        calib.session.sensor = sensor;
+        calib.session.points = 0u;
+    }
+
+    return ok;
+}
+
+void calib_cancel(void)
+{
+    calib.session.sensor = CALIB_SENSORS;
+}
+
+bool calib_point(CALIB_SENSOR sensor, float reference, float raw)
+{
+    CALIB_SESSION* s = &calib.session;
+    const bool ok = (s->sensor == sensor) && (s->points < CALIB_MAX_POINTS);
+
+    if (ok)
+    {
+        s->reference[s->points] = reference;
+        s->raw[s->points] = raw;
+        s->points++;
+    }
+
+    return ok;
+}
+
+bool calib_read_raw(CALIB_SENSOR sensor, float* raw)
+{
+    const bool ok = (sensor < CALIB_SENSORS) && (calib.read_raw[sensor] != NULL);
+
+    if (ok)
+    {
+        *raw = calib.read_raw[sensor]();
+    }
+
+    return ok;
+}
+
+bool calib_finish(CALIB_SENSOR sensor)
+{
+    const CALIB_SESSION* s = &calib.session;
+    bool ok = (s->sensor == sensor) && (s->points > 0u);
+    CALIB_SET set = {0};
+
+    if (ok)
+    {
+        CALIB_DATA* data = &config_get()->calib;
+        set.gain = data->sets[sensor].gain;
+
+        if (s->points == 1u)
+        {
+            set.offset = s->reference[0] - (set.gain * s->raw[0]); /* one point: the offset, the gain stays */
+        }
+        else
+        {
+            const float n = (float)s->points;
+            float sx = 0.0f;
+            float sy = 0.0f;
+            float sxx = 0.0f;
+            float sxy = 0.0f;
+
+            for (uint32_t i = 0u; i < s->points; i++)
+            {
+                sx += s->raw[i];
+                sy += s->reference[i];
+                sxx += s->raw[i] * s->raw[i];
+                sxy += s->raw[i] * s->reference[i];
+            }
+
+            const float den = (n * sxx) - (sx * sx);
+            ok = (den > (CALIB_MIN_SPREAD * n * n)); /* the raw values must differ */
+            if (ok)
+            {
+                set.gain = ((n * sxy) - (sx * sy)) / den;
+                set.offset = (sy - (set.gain * sx)) / n;
+            }
+        }
+
+        ok = ok && (set.gain >= CALIB_GAIN_MIN) && (set.gain <= CALIB_GAIN_MAX);
+        if (ok)
+        {
+            float err = 0.0f;
+            for (uint32_t i = 0u; i < s->points; i++)
+            {
+                float e = (set.gain * s->raw[i]) + set.offset - s->reference[i];
+                e = (e < 0.0f) ? -e : e;
+                err = (e > err) ? e : err;
+            }
+
+            set.time = rtc_get_seconds();
+            set.version = data->sets[sensor].version + 1u;
+            set.points = (uint16_t)s->points;
+            data->previous[sensor] = data->sets[sensor];
+            data->sets[sensor] = set; /* active from the next conversion */
+            calib.session.sensor = CALIB_SENSORS;
+
+            printf("Calibration %s version %u: gain ", calib_sensor_names[sensor], set.version);
+            pid_print_float(set.gain);
+            printf(" offset ");
+            pid_print_float(set.offset);
+            printf(", largest error ");
+            pid_print_float(err);
+            printf("\r\n");
+        }
+    }
+
+    return ok;
+}
+
+bool calib_rollback(CALIB_SENSOR sensor)
+{
+    const bool ok = (sensor < CALIB_SENSORS);
+
+    if (ok)
+    {
+        CALIB_DATA* data = &config_get()->calib;
+        const CALIB_SET set = data->sets[sensor];
+        data->sets[sensor] = data->previous[sensor];
+        data->previous[sensor] = set;
+    }
+
+    return ok;
+}
+
+bool calib_adc(CALIB_ADC adc, ADC_HandleTypeDef* hadc)
+{
+    CALIB_DATA* data = &config_get()->calib;
+    const HANDOFF_DATA* h = handoff_get();
+    const uint32_t chip = calib_chip();
+    bool ok = (adc < CALIB_ADCS);
+
+    if (ok && (h != NULL) && ((h->adc_valid & (1u << adc)) != 0u) && !((data->adc_chip == chip) && ((data->adc_valid & (1u << adc)) != 0u)))
+    {
+        /* Not saved before the warm reboot, the factor is of this chip */
+        if (data->adc_chip != chip)
+        {
+            data->adc_chip = chip;
+            data->adc_valid = 0u;
+        }
+        data->adc_factor[adc] = h->adc_factor[adc];
+        data->adc_valid |= (1u << adc);
+        calib.pending = true;
+    }
+
+    if (ok)
+    {
+        const bool valid = (data->adc_chip == chip) && ((data->adc_valid & (1u << adc)) != 0u);
+        calib.adc_cached[adc] = valid && (HAL_ADCEx_Calibration_SetValue(hadc, ADC_SINGLE_ENDED, data->adc_factor[adc]) == HAL_OK);
+    }
+
+    if (ok && !calib.adc_cached[adc])
+    {
+        ok = (HAL_ADCEx_Calibration_Start(hadc, ADC_CALIB_OFFSET, ADC_SINGLE_ENDED) == HAL_OK);
+        if (ok)
+        {
+            if (data->adc_chip != chip)
+            {
+                data->adc_chip = chip;
+                data->adc_valid = 0u;
+            }
+            data->adc_factor[adc] = HAL_ADCEx_Calibration_GetValue(hadc, ADC_SINGLE_ENDED);
+            data->adc_valid |= (1u << adc);
+            calib.pending = true;
+        }
+    }
+
+    return ok;
+}
+
+void calib_adc_invalidate(void)
+{
+    config_get()->calib.adc_valid = 0u;
+}
+
+bool calib_commit(void)
+{
+    bool ok = true;
+
+    if (calib.pending)
+    {
+        ok = config_save();
+        calib.pending = !ok;
+    }
+
+    return ok;
+}
+
+void calib_print(void)
+{
+    const CALIB_DATA* data = &config_get()->calib;
+
+    for (uint32_t i = 0u; i < CALIB_SENSORS; i++)
+    {
+        const CALIB_SET* set = &data->sets[i];
+
+        printf("%s: version %u, %u points, time %lu s, gain ", calib_sensor_names[i], set->version, set->points, set->time);
+        pid_print_float(set->gain);
+        printf(" offset ");
+        pid_print_float(set->offset);
+        printf(", previous version %u%s\r\n", data->previous[i].version, (calib.read_raw[i] != NULL) ? "" : ", no driver");
+    }
+    if (calib.session.sensor < CALIB_SENSORS)
+    {
+        printf("Calibration of %s running, %lu of %u points\r\n", calib_sensor_names[calib.session.sensor], calib.session.points, CALIB_MAX_POINTS);
+    }
+    for (uint32_t i = 0u; i < CALIB_ADCS; i++)
+    {
+        const bool valid = (data->adc_chip == calib_chip()) && ((data->adc_valid & (1u << i)) != 0u);
+
+        printf("%s: factor 0x%lx, %s\r\n", calib_adc_names[i], data->adc_factor[i], !valid ? "not cached" : (calib.adc_cached[i] ? "from cache" : "calibrated at this boot"));
+    }
+}
+
+CALIB_SENSOR calib_find(const char* name)
+{
+    uint32_t i = 0u;
+
+    while ((i < CALIB_SENSORS) && (strcmp(name, calib_sensor_names[i]) != 0))
+    {
+        i++;
+    }
+
+    return (CALIB_SENSOR)i;
+}
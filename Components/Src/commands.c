@@ -17,11 +17,33 @@
 #include "bootloader.h"
 #include "property.h"
 #include "authentication.h"
+#include "autotune.h"
+#include "bench.h"
+#include "calib.h"
+#include "config.h"
+#include "config_blob.h"
 #include "console.h"
 #include "define.h"
+#include "display.h"
+#include "dli.h"
+#include "dose.h"
+#include "dsp.h"
+#include "energy.h"
+#include "fan.h"
+#include "flash_scan.h"
+#include "fixmath.h"
+#include "interlock.h"
+#include "irrigation.h"
+#include "memdma.h"
+#include "pump_monitor.h"
+#include "scope.h"
 #include "nvic.h"
+#include "pid.h"
 #include "rtc.h"
+#include "safe_var.h"
 #include "stm32_hal.h"
+#include "supervisor.h"
+#include "vpd.h"
 #include "timer.h"
 
 #ifndef DISABLE_TEMPERATURE
@@ -38,6 +60,9 @@
 
 #define COMMAND_SETUP_MODE_MAX   60u   /* command module can keep BMS in initialization mode for X (sec), max */
 #define COMMAND_SETUP_MODE_DELAY 2500u /* stay setting_mode for X(ms) after user input */
+#define COMMAND_MAX_ARGS         12u   /* Arguments of a command line, the command included */
+#define COMMAND_HISTORY_LEN      256u  /* Bytes of the history ring of "!" */
+#define COMMAND_BLOB_LINE        64u   /* Bytes of a configuration blob per "config import" line */
 
 /* Private function prototypes -------------------------------*/
 /* Basic commands BMS should support -------------------------*/
@@ -80,6 +105,134 @@ void cmd_clock(int32_t argc, const char* const* argv);
  **************************************************/
 void cmd_temp_status(int32_t argc, const char* const* argv);
 
+/**************************************************
+ * @brief Command: show deadline statistics of the supervised jobs
+ * @param argc Unused
+ * @param argv Unused
+ **************************************************/
+void cmd_supervisor(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: run the CPU benchmarks (context switch cost, float vs fixed point)
+ * @param argc Unused
+ * @param argv Unused
+ **************************************************/
+void cmd_bench(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: verify the DSP kernels against the reference versions and show the cycles per sample
+ * @param argc Unused
+ * @param argv Unused
+ **************************************************/
+void cmd_dsp(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the cycles per operation of the fixed point math
+ * @param argc Unused
+ * @param argv Unused
+ **************************************************/
+void cmd_fixmath(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the pump state, learn the nominal current or set the pump duty cycle
+ * @param argc 1 to show the state, 2 with an argument
+ * @param argv argv[1] "learn" or the duty cycle [0.1%]
+ **************************************************/
+void cmd_pump_mon(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: raw ADC capture, show the state, arm, trigger, download or set the analog watchdog
+ * @param argc 1 to show the state, otherwise a sub command with its arguments
+ * @param argv argv[1] "arm" [post-trigger scans], "trig", "dump" or "awd" <index> <low> <high>
+ **************************************************/
+void cmd_scope(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: daily light integral, show it or set the target and the time the lights switch off
+ * @param argc 1 to show the light integral, otherwise a sub command with its arguments
+ * @param argv argv[1] "target" <0.01 mol/m2/d> or "end" <hour> <minute>
+ **************************************************/
+void cmd_dli(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: vapor pressure deficit, show the zones, check the SVP table, feed a sensor or set the target of a zone
+ * @param argc 1 to show the zones, otherwise a sub command with its arguments
+ * @param argv argv[1] "check", "sensor" <zone> <sensor> <0.1 degC> <0.1 %RH> or "target" <zone> <Pa> <band Pa> <leaf offset 0.1 degC>
+ **************************************************/
+void cmd_vpd(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: configuration store, show the state, write to flash, load the defaults, export or import a blob
+ * @param argc 1 to show the state, 2 for a sub command, 3 for "import" with data
+ * @param argv argv[1] "save", "default", "export" or "import", argv[2] blob data in hex for "import"
+ **************************************************/
+void cmd_config(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: PID loops, show them, set a loop or start the simulated plant
+ * @param argc 1 to show the loops, otherwise a sub command with its arguments
+ * @param argv argv[1] loop number with "on", "off", "sp" <setpoint> or "gains" <kp> <ki> <kd>, or "sim" <gain> <tau s> <dead time 0.1 s>
+ **************************************************/
+void cmd_pid(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: relay auto-tune of a PID loop, show the result, start or stop
+ * @param argc 1 to show the result, 2 to stop, otherwise the parameters of the experiment
+ * @param argv argv[1] "stop" or loop <setpoint> <bias> <amplitude> <hysteresis> <max excursion> <timeout s> ["tl"]
+ **************************************************/
+void cmd_autotune(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the fans, set a duty or a speed, or the gains of the speed loop
+ * @param argc 1 to show the fans, otherwise a sub command with its arguments
+ * @param argv argv[1] fan number with "duty" <%>, "rpm" <rpm> or "off", or "gains" <kp> <ki> <kd>
+ **************************************************/
+void cmd_fan(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the irrigation zones, start, stop or unlock a zone, or set its timing or fill flow
+ * @param argc 1 to show the zones, otherwise a zone with a sub command
+ * @param argv argv[1] zone with "start", "stop", "reset", "set" <interval s> <hold s> <fill timeout s> <drain timeout s>
+ *             or "flow" <mL/min of the fill pump>
+ **************************************************/
+void cmd_irrigation(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the interlocks, release the latch or trip an input to measure the latency
+ * @param argc 1 to show the interlocks, otherwise a sub command
+ * @param argv argv[1] "reset" or "test" <input>
+ **************************************************/
+void cmd_interlock(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the dose planner, enter a level reading or a known flow of the reservoir
+ * @param argc 1 to show the planner, otherwise a sub command with its value
+ * @param argv argv[1] "level" <mm> or "flow" <mL, negative out of the reservoir>
+ **************************************************/
+void cmd_dose(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the calibrations, or run the calibration workflow of a sensor
+ * @param argc 1 to show the calibrations, otherwise a sensor with a sub command
+ * @param argv argv[1] sensor with "start", "point" <reference> [raw], "apply", "cancel" or "rollback", or "adc" "reset"
+ **************************************************/
+void cmd_calib(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the power and the energy of the rails and the actuators, or restart the counters
+ * @param argc 1 to show, 2 with "reset"
+ * @param argv argv[1] "reset"
+ **************************************************/
+void cmd_energy(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the memory DMA threshold and counters, or run the benchmark again
+ * @param argc 1 to show, 2 with "bench"
+ * @param argv argv[1] "bench"
+ **************************************************/
+void cmd_memdma(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the frame budget of the display, or send the whole screen again
+ * @param argc 1 to show, 2 with "redraw"
+ * @param argv argv[1] "redraw"
+ **************************************************/
+void cmd_display(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the safety variable blocks and the scrubber, set the scrub period or inject an error
+ * @param argc 1 to show, 3 with "period" or "inject"
+ * @param argv argv[1] "period" or "inject", argv[2] period [ms] or block index
+ **************************************************/
+void cmd_safevar(int32_t argc, const char* const* argv);
+/**************************************************
+ * @brief Command: show the progress and the results of the flash image scan
+ * @param argc 1
+ * @param argv not used
+ **************************************************/
+void cmd_flashscan(int32_t argc, const char* const* argv);
+
 /* Basic commands to control BMS -----------------------------*/
 /**************************************************
  * @brief Command: password to unlock
@@ -151,7 +304,18 @@ STATIC uint32_t cmd_get_replay_count(void);
 /* Private variables ------------------------------------------*/
 static bool unlocked_flag = false; /* permitted to write parameters? */
 
-static char command_buffer[CONSOLE_RX_BUF_LEN]; /* storage of previous command */
+static bool line_held = false; /* line of the console in use by argv */
+
+/***************************************************
+ * @brief History of the command lines for "!": 0 terminated lines back to back in a ring, the oldest are dropped
+ ***************************************************/
+typedef struct
+{
+    char buf[COMMAND_HISTORY_LEN]; /**< Lines */
+    uint16_t head;                 /**< Next write position */
+    uint16_t used;                 /**< Bytes of the stored lines */
+} COMMAND_HISTORY;
+static COMMAND_HISTORY history;
 
 /***************************************************
  * @brief struct for parameters related to command replay
@@ -189,6 +353,27 @@ static const COMMAND_STRUCT command_table[] = {
     {"clock", cmd_clock, "Clock; year, month, day, hour, minute, sec"},
     /* STATUS command (not all parameters are available) */
     {"temp_stat", cmd_temp_status, "show temperature of sensors <replay period [ms], 0=stop replay>"},
+    {"supervisor", cmd_supervisor, "show job deadline statistics"},
+    {"bench", cmd_bench, "run CPU benchmarks"},
+    {"dsp", cmd_dsp, "check and benchmark the DSP kernels"},
+    {"fixmath", cmd_fixmath, "benchmark the fixed point math"},
+    {"pump_mon", cmd_pump_mon, "show the pump state <learn | duty [0.1%]>"},
+    {"scope", cmd_scope, "raw ADC capture <arm [post] | trig | dump | awd index low high>"},
+    {"dli", cmd_dli, "daily light integral <target 0.01mol | end hour minute>"},
+    {"vpd", cmd_vpd, "vapor pressure deficit <check | sensor zone idx 0.1C 0.1RH | target zone Pa band 0.1C>"},
+    {"config", cmd_config, "configuration store <save | default | export | import [hex]>"},
+    {"pid", cmd_pid, "PID loops <loop on | off | sp value | gains kp ki kd> <sim gain tau dead>"},
+    {"autotune", cmd_autotune, "relay auto-tune <stop | loop sp bias amp hyst excursion timeout [tl]>"},
+    {"fan", cmd_fan, "fans <fan duty % | fan rpm value | fan off> <gains kp ki kd>"},
+    {"irrigation", cmd_irrigation, "ebb and flow zones <zone start | stop | reset | set interval hold fill drain | flow ml_min>"},
+    {"interlock", cmd_interlock, "safety interlocks <reset | test input>"},
+    {"dose", cmd_dose, "dose planner <level mm | flow ml>"},
+    {"calib", cmd_calib, "calibration <ph | ec | temp> <start | point ref [raw] | apply | cancel | rollback> <adc reset>"},
+    {"energy", cmd_energy, "energy metering of the rails <reset>"},
+    {"memdma", cmd_memdma, "memory DMA benchmark and counters <bench>"},
+    {"display", cmd_display, "frame budget of the status display <redraw>"},
+    {"safevar", cmd_safevar, "safety variable scrubber <period ms | inject block>"},
+    {"flashscan", cmd_flashscan, "progress and result of the flash image CRC scan"},
     /* Basic commands to control the system */
     {"password", cmd_password, "password to unlock certain commands"},
     {"reset", cmd_reset, "Reset the CPU"},
@@ -235,6 +420,72 @@ STATIC uint32_t cmd_get_replay_count(void)
     return replay.count;
 }
 
+/***************************************************
+ * @brief Add a line to the history, the oldest lines are dropped to make room
+ * @param line Command line, shorter than CONSOLE_LINE_LEN
+ ***************************************************/
+STATIC void cmd_history_add(const char* line)
+{
+    const uint16_t len = (uint16_t)(strlen(line) + 1u);
+
+    while ((history.used + len) > COMMAND_HISTORY_LEN)
+    {
+        const uint16_t oldest = (uint16_t)((history.head + COMMAND_HISTORY_LEN - history.used) % COMMAND_HISTORY_LEN);
+        uint16_t n = 1u;
+        while (history.buf[(oldest + n - 1u) % COMMAND_HISTORY_LEN] != '\0')
+        {
+            n++;
+        }
+        history.used -= n;
+    }
+    for (uint16_t i = 0u; i < len; i++)
+    {
+        history.buf[history.head] = line[i];
+        history.head = (uint16_t)((history.head + 1u) % COMMAND_HISTORY_LEN);
+    }
+    history.used += len;
+}
+
+/***************************************************
+ * @brief Copy a line of the history
+ * @param n 1 for the last line, 2 for the one before, ...
+ * @param line Output, CONSOLE_LINE_LEN characters
+ * @return false if the history has less than n lines
+ ***************************************************/
+STATIC bool cmd_history_get(uint32_t n, char* line)
+{
+    uint16_t end = history.head; /* one past the terminator of the line */
+    uint16_t left = history.used;
+    uint16_t len = 0u;
+    bool found = false;
+
+    for (uint32_t k = 1u; (k <= n) && (left > 0u) && !found; k++)
+    {
+        len = 1u;
+        while ((len < left) && (history.buf[(end + COMMAND_HISTORY_LEN - len - 1u) % COMMAND_HISTORY_LEN] != '\0'))
+        {
+            len++;
+        }
+        found = (k == n);
+        if (!found)
+        {
+            end = (uint16_t)((end + COMMAND_HISTORY_LEN - len) % COMMAND_HISTORY_LEN);
+            left -= len;
+        }
+    }
+
+    if (found)
+    {
+        const uint16_t start = (uint16_t)((end + COMMAND_HISTORY_LEN - len) % COMMAND_HISTORY_LEN);
+        for (uint16_t i = 0u; i < len; i++)
+        {
+            line[i] = history.buf[(start + i) % COMMAND_HISTORY_LEN];
+        }
+    }
+
+    return found;
+}
+
 /**
  * Split command line by given divide character
  * @param in Reference to command line
@@ -312,42 +563,52 @@ void command_reinit(void)
 
 void command_init(void)
 {
-    (void)memset(command_buffer, 0, sizeof(command_buffer)); /* no command yet */
-    unlocked_flag = false;                                   /* unlock must be false at startup */
-    cmd_set_replay(0u);                                      /* No command replay by default */
+    history.head = 0u; /* no command yet */
+    history.used = 0u;
+    unlocked_flag = false; /* unlock must be false at startup */
+    cmd_set_replay(0u);    /* No command replay by default */
 
     printf("Hydroponics Controller Console\r\n# ");
 }
 
 void command_execute(void)
 {
-    char console_buffer[CONSOLE_RX_BUF_LEN];
     bool cmd_execute_flag = false; /* Will a command be executed */
+    char* line;
     static int32_t argc;
-    static char* argv[CONSOLE_RX_BUF_LEN / 2u]; /* Amount of arguments can never be more than roughly the command buffer length divided by two */
+    static char* argv[COMMAND_MAX_ARGS]; /* tokens in the line of the console, kept while the command replays */
+
+    if (line_held && ((replay.period == 0u) || console_line_pending()))
+    {
+        cmd_set_replay(0u); /* a new line stops the replay */
+        console_release_line();
+        line_held = false;
+    }
 
-    if (console_read_line(console_buffer, CONSOLE_RX_BUF_LEN)) /* is a complete line received? */
+    line = console_read_line();
+    if (line != NULL) /* is a complete line received? */
     {
         /* Yes, execute the command */
-        cmd_set_replay(0u);            /* Stop replaying any commands */
-        if (console_buffer[0u] == '!') /* repeat last command ?? */
+        line_held = true;
+        cmd_set_replay(0u); /* Stop replaying any commands */
+        if (line[0u] == '!') /* repeat last command ("!") or the n-th last command ("!n") */
         {
-            printf("#");
-            argc = nsplit(command_buffer, ' ', argv, CONSOLE_RX_BUF_LEN / 2u);
-
-            for (uint32_t i = 0u; i < (uint32_t)argc; i++)
+            const uint32_t n = (line[1u] == '\0') ? 1u : strtoul(&line[1u], NULL, 10);
+            if (!cmd_history_get(n, line))
             {
-                printf("%s ", argv[i]);
+                line[0u] = '\0';
             }
-
-            printf("\r\n"); /* print the last command for user convenience */
+            printf("#%s\r\n", line); /* print the command for user convenience */
+        }
+        else if (line[0u] != '\0')
+        {
+            cmd_history_add(line);
         }
         else
         {
-            (void)memset(argv, 0, sizeof(argv));                                  /* clear array */
-            (void)memcpy(command_buffer, console_buffer, sizeof(console_buffer)); /* Copy new command to command_buffer */
-            argc = nsplit(command_buffer, ' ', argv, sizeof(argv) / sizeof(argv[0]));
-        } /* received line is processed, clear flag for next line */
+            // Do nothing, empty line
+        }
+        argc = nsplit(line, ' ', argv, COMMAND_MAX_ARGS); /* tokenize in place */
         cmd_execute_flag = true;
     }
     else if (replay.period != 0u) /* Is a command set to replay ?*/
@@ -583,12 +844,613 @@ void cmd_temp_status(int32_t argc, const char* const* argv)
 #endif
 }
 
+void cmd_supervisor(int32_t argc, const char* const* argv)
+{
+    UNUSED(argc);
+    UNUSED(argv);
+    supervisor_print();
+}
+
+void cmd_bench(int32_t argc, const char* const* argv)
+{
+    UNUSED(argc);
+    UNUSED(argv);
+    bench_run();
+}
+
+void cmd_dsp(int32_t argc, const char* const* argv)
+{
+    UNUSED(argc);
+    UNUSED(argv);
+    if (!dsp_check())
+    {
+        printf("DSP check failed\r\n");
+    }
+}
+
+void cmd_fixmath(int32_t argc, const char* const* argv)
+{
+    UNUSED(argc);
+    UNUSED(argv);
+    fixmath_bench();
+}
+
+void cmd_pump_mon(int32_t argc, const char* const* argv)
+{
+    if (argc == 2)
+    {
+        if (strcmp(argv[1], "learn") == 0)
+        {
+            if (!pump_monitor_learn())
+            {
+                printf("Pump not running\r\n");
+            }
+        }
+        else
+        {
+            pump_monitor_set_pwm(strtoul(argv[1], NULL, 10));
+        }
+    }
+    pump_monitor_print();
+}
+
+void cmd_scope(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        scope_print();
+    }
+    else if (strcmp(argv[1], "arm") == 0)
+    {
+        scope_arm((argc == 3) ? strtoul(argv[2], NULL, 10) : SCOPE_POST_DEFAULT);
+    }
+    else if (strcmp(argv[1], "trig") == 0)
+    {
+        scope_trigger(SCOPE_TRIG_CMD);
+    }
+    else if (strcmp(argv[1], "dump") == 0)
+    {
+        if (!scope_dump())
+        {
+            printf("No capture\r\n");
+        }
+    }
+    else if ((strcmp(argv[1], "awd") == 0) && (argc == 5))
+    {
+        if (!scope_set_awd(strtoul(argv[2], NULL, 10), strtoul(argv[3], NULL, 10), strtoul(argv[4], NULL, 10)))
+        {
+            printf("Scope configuration failed\r\n");
+        }
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_dli(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        dli_print(rtc_get_seconds());
+    }
+    else if ((strcmp(argv[1], "target") == 0) && (argc == 3))
+    {
+        dli_set_target(fix16_div(FIX16_FROM_INT((int32_t)strtoul(argv[2], NULL, 10)), FIX16_FROM_INT(100)));
+        dli_print(rtc_get_seconds());
+        printf("Use \"config save\" to keep it\r\n");
+    }
+    else if ((strcmp(argv[1], "end") == 0) && (argc == 4))
+    {
+        dli_set_light_end((strtoul(argv[2], NULL, 10) * 3600u) + (strtoul(argv[3], NULL, 10) * 60u));
+        dli_print(rtc_get_seconds());
+        printf("Use \"config save\" to keep it\r\n");
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_vpd(int32_t argc, const char* const* argv)
+{
+    VPD_CONFIG config;
+
+    if (argc == 1)
+    {
+        vpd_print();
+    }
+    else if (strcmp(argv[1], "check") == 0)
+    {
+        printf("VPD check %s\r\n", vpd_check() ? "passed" : "FAILED");
+    }
+    else if ((strcmp(argv[1], "sensor") == 0) && (argc == 6))
+    {
+        const q16_t temp = fix16_div(FIX16_FROM_INT(strtol(argv[4], NULL, 10)), FIX16_FROM_INT(10));
+        const q16_t rh = fix16_div(FIX16_FROM_INT(strtol(argv[5], NULL, 10)), FIX16_FROM_INT(10));
+        if (!vpd_set_sensor(strtoul(argv[2], NULL, 10), strtoul(argv[3], NULL, 10), temp, rh))
+        {
+            printf("Unknown zone or sensor\r\n");
+        }
+    }
+    else if ((strcmp(argv[1], "target") == 0) && (argc == 6) && vpd_get_config(strtoul(argv[2], NULL, 10), &config))
+    {
+        config.target_pa = strtol(argv[3], NULL, 10);
+        config.band_pa = strtol(argv[4], NULL, 10);
+        config.leaf_offset = fix16_div(FIX16_FROM_INT(strtol(argv[5], NULL, 10)), FIX16_FROM_INT(10));
+        (void)vpd_set_config(strtoul(argv[2], NULL, 10), &config);
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+/***************************************************
+ * @brief Print the configuration as "config import" commands, to paste them into another unit
+ ***************************************************/
+STATIC void cmd_config_export(void)
+{
+    static uint8_t blob[CONFIG_BLOB_MAX];
+    const uint32_t len = config_blob_export(blob, sizeof(blob));
+
+    if (len == 0u)
+    {
+        printf("Configuration doesn't fit into %u bytes, increase CONFIG_BLOB_MAX\r\n", CONFIG_BLOB_MAX);
+    }
+    else
+    {
+        printf("config import\r\n");
+        for (uint32_t i = 0u; i < len; i += COMMAND_BLOB_LINE)
+        {
+            printf("config import ");
+            for (uint32_t j = i; (j < len) && (j < (i + COMMAND_BLOB_LINE)); j++)
+            {
+                printf("%02X", blob[j]);
+            }
+            printf("\r\n");
+        }
+    }
+}
+
+/***************************************************
+ * @brief Start an import or feed a line of the blob, a complete blob is saved
+ * @param hex Data in hex, NULL to start
+ ***************************************************/
+STATIC void cmd_config_import(const char* hex)
+{
+    uint8_t data[COMMAND_BLOB_LINE];
+    uint32_t len = 0u;
+    bool ok = true;
+
+    if (hex == NULL)
+    {
+        config_blob_import_begin();
+        printf("Import started\r\n");
+    }
+    else
+    {
+        while (ok && (hex[len * 2u] != '\0'))
+        {
+            const char byte[3] = {hex[len * 2u], hex[(len * 2u) + 1u], '\0'};
+            char* end = NULL;
+            const uint32_t value = strtoul(byte, &end, 16);
+            ok = (len < COMMAND_BLOB_LINE) && (byte[1] != '\0') && (*end == '\0');
+            if (ok)
+            {
+                data[len] = (uint8_t)value;
+                len++;
+            }
+        }
+        if (!ok)
+        {
+            printf("Invalid hex data\r\n");
+        }
+        else
+        {
+            const CONFIG_BLOB_STATE state = config_blob_import(data, len);
+            if (state == CONFIG_BLOB_DONE)
+            {
+                config_blob_print();
+                printf("Config save %s\r\n", config_save() ? "done" : "FAILED");
+            }
+            else if (state == CONFIG_BLOB_ERROR)
+            {
+                config_blob_print();
+            }
+            else
+            {
+                // Do nothing, more lines follow
+            }
+        }
+    }
+}
+
+void cmd_config(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        config_print();
+    }
+    else if (strcmp(argv[1], "save") == 0)
+    {
+        printf("Config save %s\r\n", config_save() ? "done" : "FAILED");
+    }
+    else if (strcmp(argv[1], "default") == 0)
+    {
+        config_set_default();
+        printf("Defaults loaded, use \"config save\" to keep them\r\n");
+    }
+    else if (strcmp(argv[1], "export") == 0)
+    {
+        cmd_config_export();
+    }
+    else if (strcmp(argv[1], "import") == 0)
+    {
+        cmd_config_import((argc == 3) ? argv[2] : NULL);
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_pid(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        pid_print();
+    }
+    else if ((strcmp(argv[1], "sim") == 0) && (argc == 5))
+    {
+        if (!pid_sim_init(strtof(argv[2], NULL), strtof(argv[3], NULL), strtoul(argv[4], NULL, 10)))
+        {
+            printf("Invalid plant\r\n");
+        }
+    }
+    else if (argc >= 3)
+    {
+        const PID_LOOP loop = (PID_LOOP)strtoul(argv[1], NULL, 10);
+        if (pid_get_io(loop) == NULL)
+        {
+            printf("Loop not registered\r\n");
+        }
+        else if (strcmp(argv[2], "on") == 0)
+        {
+            (void)pid_enable(loop, true);
+        }
+        else if (strcmp(argv[2], "off") == 0)
+        {
+            (void)pid_enable(loop, false);
+        }
+        else if ((strcmp(argv[2], "sp") == 0) && (argc == 4))
+        {
+            pid_set_setpoint(loop, strtof(argv[3], NULL));
+        }
+        else if ((strcmp(argv[2], "gains") == 0) && (argc == 6))
+        {
+            PID_GAINS* g = &config_get()->pid[loop];
+            g->kp = strtof(argv[3], NULL);
+            g->ki = strtof(argv[4], NULL);
+            g->kd = strtof(argv[5], NULL);
+        }
+        else
+        {
+            printf("Unknown argument\r\n");
+        }
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_autotune(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        autotune_print();
+    }
+    else if (strcmp(argv[1], "stop") == 0)
+    {
+        autotune_stop();
+    }
+    else if ((argc == 8) || (argc == 9))
+    {
+        AUTOTUNE_CONFIG config;
+        config.setpoint = strtof(argv[2], NULL);
+        config.bias = strtof(argv[3], NULL);
+        config.amplitude = strtof(argv[4], NULL);
+        config.hysteresis = strtof(argv[5], NULL);
+        config.max_excursion = strtof(argv[6], NULL);
+        config.timeout_ms = strtoul(argv[7], NULL, 10) * 1000u;
+        config.rule = ((argc == 9) && (strcmp(argv[8], "tl") == 0)) ? AUTOTUNE_RULE_TL : AUTOTUNE_RULE_ZN;
+        const PID_LOOP loop = (PID_LOOP)strtoul(argv[1], NULL, 10);
+        if (pid_get_io(loop) == NULL)
+        {
+            printf("Loop %lu not registered, only the simulation (loop %lu, \"pid sim\") has a plant\r\n", (uint32_t)loop, (uint32_t)PID_LOOP_SIM);
+        }
+        else if (!autotune_start(loop, &config))
+        {
+            printf("Autotune not started, check the output limits or stop the running one\r\n");
+        }
+        else
+        {
+            // Do nothing
+        }
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_fan(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        fan_print();
+    }
+    else if ((strcmp(argv[1], "gains") == 0) && (argc == 5))
+    {
+        PID_GAINS* g = &config_get()->fan;
+        g->kp = strtof(argv[2], NULL);
+        g->ki = strtof(argv[3], NULL);
+        g->kd = strtof(argv[4], NULL);
+    }
+    else if ((argc == 3) && (strcmp(argv[2], "off") == 0))
+    {
+        fan_set_duty(strtoul(argv[1], NULL, 10), 0u);
+    }
+    else if ((argc == 4) && (strcmp(argv[2], "duty") == 0))
+    {
+        const uint32_t duty = strtoul(argv[3], NULL, 10);
+        fan_set_duty(strtoul(argv[1], NULL, 10), (duty > 100u) ? 100u : (uint8_t)duty);
+    }
+    else if ((argc == 4) && (strcmp(argv[2], "rpm") == 0))
+    {
+        fan_set_rpm(strtoul(argv[1], NULL, 10), strtoul(argv[3], NULL, 10));
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_irrigation(int32_t argc, const char* const* argv)
+{
+    const uint32_t zone = (argc > 1) ? strtoul(argv[1], NULL, 10) : 0u;
+
+    if (argc == 1)
+    {
+        irrigation_print();
+    }
+    else if (zone >= IRRIGATION_MAX_ZONES)
+    {
+        printf("Unknown zone\r\n");
+    }
+    else if ((argc == 3) && (strcmp(argv[2], "start") == 0))
+    {
+        irrigation_start(zone);
+    }
+    else if ((argc == 3) && (strcmp(argv[2], "stop") == 0))
+    {
+        irrigation_stop(zone);
+    }
+    else if ((argc == 3) && (strcmp(argv[2], "reset") == 0))
+    {
+        irrigation_reset(zone);
+    }
+    else if ((argc == 7) && (strcmp(argv[2], "set") == 0))
+    {
+        IRRIGATION_CONFIG* cfg = &config_get()->irrigation[zone];
+        cfg->interval_s = strtoul(argv[3], NULL, 10);
+        cfg->hold_s = strtoul(argv[4], NULL, 10);
+        cfg->fill_timeout_s = strtoul(argv[5], NULL, 10);
+        cfg->drain_timeout_s = strtoul(argv[6], NULL, 10);
+        printf("Applies from the next cycle, use \"config save\" to keep it\r\n");
+    }
+    else if ((argc == 4) && (strcmp(argv[2], "flow") == 0))
+    {
+        config_get()->irrigation_fill_ml_min[zone] = strtof(argv[3], NULL);
+        printf("Use \"config save\" to keep it\r\n");
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_interlock(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        interlock_print();
+    }
+    else if ((argc == 2) && (strcmp(argv[1], "reset") == 0))
+    {
+        printf("%s\r\n", interlock_reset() ? "Released" : "An input is still active");
+    }
+    else if ((argc == 3) && (strcmp(argv[1], "test") == 0))
+    {
+        if (!interlock_test(strtoul(argv[2], NULL, 10)))
+        {
+            printf("Unknown input or already tripped\r\n");
+        }
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_dose(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        dose_print();
+    }
+    else if ((argc == 3) && (strcmp(argv[1], "level") == 0))
+    {
+        dose_level(strtof(argv[2], NULL));
+    }
+    else if ((argc == 3) && (strcmp(argv[1], "flow") == 0))
+    {
+        dose_flow(strtof(argv[2], NULL));
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_calib(int32_t argc, const char* const* argv)
+{
+    const CALIB_SENSOR sensor = (argc > 1) ? calib_find(argv[1]) : CALIB_SENSORS;
+    float raw = 0.0f;
+
+    if (argc == 1)
+    {
+        calib_print();
+    }
+    else if ((argc == 3) && (strcmp(argv[1], "adc") == 0) && (strcmp(argv[2], "reset") == 0))
+    {
+        calib_adc_invalidate();
+        printf("ADCs are calibrated at the next boot, use \"config save\"\r\n");
+    }
+    else if (sensor == CALIB_SENSORS)
+    {
+        printf("Unknown sensor\r\n");
+    }
+    else if ((argc == 3) && (strcmp(argv[2], "start") == 0))
+    {
+        (void)calib_start(sensor);
+    }
+    else if ((argc == 3) && (strcmp(argv[2], "cancel") == 0))
+    {
+        calib_cancel();
+    }
+    else if ((argc == 3) && (strcmp(argv[2], "apply") == 0))
+    {
+        printf("%s\r\n", calib_finish(sensor) ? "Active, use \"config save\" to keep it" : "Calibration failed, the set is not changed");
+    }
+    else if ((argc == 3) && (strcmp(argv[2], "rollback") == 0))
+    {
+        (void)calib_rollback(sensor);
+        calib_print();
+    }
+    else if ((argc == 4) && (strcmp(argv[2], "point") == 0) && !calib_read_raw(sensor, &raw))
+    {
+        printf("No driver, give the raw value\r\n");
+    }
+    else if (((argc == 4) || (argc == 5)) && (strcmp(argv[2], "point") == 0))
+    {
+        raw = (argc == 5) ? strtof(argv[4], NULL) : raw;
+        if (!calib_point(sensor, strtof(argv[3], NULL), raw))
+        {
+            printf("No calibration of this sensor running or all points taken\r\n");
+        }
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_energy(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        energy_print();
+    }
+    else if ((argc == 2) && (strcmp(argv[1], "reset") == 0))
+    {
+        energy_reset();
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_memdma(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        memdma_print();
+    }
+    else if ((argc == 2) && (strcmp(argv[1], "bench") == 0))
+    {
+        if (memdma_calibrate())
+        {
+            memdma_print();
+        }
+        else
+        {
+            printf("Memory DMA busy or failed\r\n");
+        }
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_display(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        display_print();
+    }
+    else if ((argc == 2) && (strcmp(argv[1], "redraw") == 0))
+    {
+        display_invalidate();
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_safevar(int32_t argc, const char* const* argv)
+{
+    if (argc == 1)
+    {
+        safe_var_print();
+    }
+    else if ((argc == 3) && (strcmp(argv[1], "period") == 0))
+    {
+        printf("%s\r\n", safe_var_set_period(strtoul(argv[2], NULL, 10)) ? "OK" : "Period out of range");
+    }
+    else if ((argc == 3) && (strcmp(argv[1], "inject") == 0))
+    {
+        printf("%s\r\n", safe_var_inject(strtoul(argv[2], NULL, 10)) ? "OK, see safevar for the detection" : "No such block or error pending");
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
+void cmd_flashscan(int32_t argc, const char* const* argv)
+{
+    UNUSED(argv);
+    if (argc == 1)
+    {
+        flash_scan_print();
+    }
+    else
+    {
+        printf("Unknown argument\r\n");
+    }
+}
+
 void cmd_reset(int32_t argc, const char* const* argv)
 {
     UNUSED(argv);
     if ((argc == 1) && unlocked_flag)
     {
-        // TODO
+        nvic_safe_system_reset();
     }
     else
     {
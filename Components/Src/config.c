@@ -0,0 +1,210 @@
+/**
+ * @file config.c
+ * @author PL
+ * @brief Configuration store in the internal flash
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup CONFIG
+ *
+ * The store uses the last two pages of bank 2, which are removed from the FLASH region in the linker
+ * script. The code runs from bank 1, so it keeps running while bank 2 is erased and programmed.
+ * A record is a 16 byte header followed by CONFIG_DATA, padded to quad-words (the programming unit).
+ */
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "crc.h"
+#include "stm32_hal.h"
+
+#define CONFIG_FLASH_ADDR  0x0807C000u /* Address of the first page, the CONFIG region of the linker script */
+#define CONFIG_FLASH_PAGE  30u         /* Page number of CONFIG_FLASH_ADDR in bank 2 */
+#define CONFIG_PAGES       2u          /* Pages used alternately */
+#define CONFIG_NO_PAGE     0xFFu       /* No valid record in flash */
+#define CONFIG_MAGIC       0x47464E43u /* "CNFG" */
+#define CONFIG_QUADWORD    16u         /* Flash programming unit [bytes] */
+#define CONFIG_RECORD_SIZE ((((uint32_t)sizeof(CONFIG_HEADER) + (uint32_t)sizeof(CONFIG_DATA)) + (CONFIG_QUADWORD - 1u)) & ~(CONFIG_QUADWORD - 1u))
+
+/**
+ * @brief Header of a record, one quad-word
+ */
+typedef struct
+{
+    uint32_t magic;    /**< CONFIG_MAGIC */
+    uint32_t sequence; /**< Incremented by every save */
+    uint16_t version;  /**< CONFIG_VERSION of the data */
+    uint16_t length;   /**< Size of the data [bytes] */
+    uint16_t crc;      /**< CRC-16 of the data */
+    uint16_t reserved; /**< Padding to a quad-word */
+} CONFIG_HEADER;
+
+/**
+ * @brief Record as stored in flash
+ */
+typedef union
+{
+    struct
+    {
+        CONFIG_HEADER header; /**< Header */
+        CONFIG_DATA data;     /**< Configuration */
+    } rec;                                   /**< Record */
+    uint32_t words[CONFIG_RECORD_SIZE / 4u]; /**< Record as words for programming */
+} CONFIG_RECORD;
+
+_Static_assert(CONFIG_RECORD_SIZE <= FLASH_PAGE_SIZE, "configuration doesn't fit in a flash page");
+
+/**
+ * @brief Operational data of the configuration store
+ */
+typedef struct
+{
+    CONFIG_DATA data;        /**< Configuration in RAM */
+    CONFIG_RECORD record;    /**< Buffer to program a record */
+    uint32_t sequence;       /**< Sequence number of the newest record */
+    uint8_t page;            /**< Page of the newest record, CONFIG_NO_PAGE if none */
+    uint16_t loaded_version; /**< Version of the loaded record */
+} CONFIG_STORE;
+
+STATIC CONFIG_STORE config;
+
+/***************************************************
+ * @brief Default configuration
+ ***************************************************/
+static const CONFIG_DATA config_default = {
+    .pid =
+        {
+            [PID_LOOP_EC] = {.kp = 1.0f, .ki = 0.0f, .kd = 0.0f},
+            [PID_LOOP_PH] = {.kp = 1.0f, .ki = 0.0f, .kd = 0.0f},
+            [PID_LOOP_HEATER] = {.kp = 1.0f, .ki = 0.0f, .kd = 0.0f},
+            [PID_LOOP_SIM] = {.kp = 0.5f, .ki = 0.05f, .kd = 0.0f},
+        },
+    .fan = {.kp = 0.01f, .ki = 0.02f, .kd = 0.0f},
+    .irrigation =
+        {
+            [0] = {.interval_s = 0u, .hold_s = 900u, .fill_timeout_s = 300u, .drain_timeout_s = 900u},
+            [1] = {.interval_s = 0u, .hold_s = 900u, .fill_timeout_s = 300u, .drain_timeout_s = 900u},
+        },
+    .dose = {.area_cm2 = 1500.0f, .ec_stock = 100.0f, .ph_slope = 0.1f, .pump_ml_min = {[DOSE_EC] = 60.0f, [DOSE_PH] = 60.0f}, .mix_s = 120.0f, .horizon_s = 60.0f},
+    .calib =
+        {
+            .sets = {[CALIB_PH] = {.gain = 1.0f}, [CALIB_EC] = {.gain = 1.0f}, [CALIB_TEMP] = {.gain = 1.0f}},
+            .previous = {[CALIB_PH] = {.gain = 1.0f}, [CALIB_EC] = {.gain = 1.0f}, [CALIB_TEMP] = {.gain = 1.0f}},
+        },
+    .dli = {.target = DLI_TARGET_DEFAULT, .light_end_s = DLI_LIGHT_END_DEFAULT},
+};
+
+/***************************************************
+ * @brief Get a record in flash
+ * @param page Page index, 0 .. CONFIG_PAGES - 1
+ * @return Record
+ ***************************************************/
+STATIC const CONFIG_RECORD* config_flash_record(uint32_t page)
+{
+    return (const CONFIG_RECORD*)(CONFIG_FLASH_ADDR + (page * FLASH_PAGE_SIZE)); //lint !e923 flash address
+}
+
+/***************************************************
+ * @brief Check a record in flash
+ * @param rec Record
+ * @return true if the magic, the length and the CRC are valid
+ ***************************************************/
+STATIC bool config_record_valid(const CONFIG_RECORD* rec)
+{
+    const CONFIG_HEADER* h = &rec->rec.header;
+
+    return (h->magic == CONFIG_MAGIC) && (h->length <= (FLASH_PAGE_SIZE - sizeof(CONFIG_HEADER))) && (crc_calc(&rec->rec.data, h->length) == h->crc);
+}
+
+bool config_init(void)
+{
+    config.page = CONFIG_NO_PAGE;
+    config.sequence = 0u;
+    config.loaded_version = 0u;
+    config_set_default();
+
+    for (uint32_t i = 0u; i < CONFIG_PAGES; i++)
+    {
+        const CONFIG_RECORD* rec = config_flash_record(i);
+        if (config_record_valid(rec) && ((config.page == CONFIG_NO_PAGE) || (rec->rec.header.sequence > config.sequence)))
+        {
+            config.page = (uint8_t)i;
+            config.sequence = rec->rec.header.sequence;
+        }
+    }
+
+    if (config.page != CONFIG_NO_PAGE)
+    {
+        /* Older records are shorter, the fields added later keep their defaults */
+        const CONFIG_RECORD* rec = config_flash_record(config.page);
+        const uint32_t length = (rec->rec.header.length < sizeof(CONFIG_DATA)) ? rec->rec.header.length : sizeof(CONFIG_DATA);
+        (void)memcpy(&config.data, &rec->rec.data, length);
+        config.loaded_version = rec->rec.header.version;
+    }
+
+    return (config.page != CONFIG_NO_PAGE);
+}
+
+CONFIG_DATA* config_get(void)
+{
+    return &config.data;
+}
+
+void config_set_default(void)
+{
+    config.data = config_default;
+}
+
+bool config_save(void)
+{
+    const uint32_t page = (config.page == 0u) ? 1u : 0u;
+    const uint32_t addr = (uint32_t)config_flash_record(page); //lint !e923 flash address
+    FLASH_EraseInitTypeDef erase = {0};
+    uint32_t page_error = 0u;
+
+    (void)memset(&config.record, 0, sizeof(config.record));
+    config.record.rec.data = config.data;
+    config.record.rec.header.magic = CONFIG_MAGIC;
+    config.record.rec.header.sequence = config.sequence + 1u;
+    config.record.rec.header.version = CONFIG_VERSION;
+    config.record.rec.header.length = (uint16_t)sizeof(CONFIG_DATA);
+    config.record.rec.header.crc = crc_calc(&config.record.rec.data, sizeof(CONFIG_DATA));
+
+    erase.TypeErase = FLASH_TYPEERASE_PAGES;
+    erase.Banks = FLASH_BANK_2;
+    erase.Page = CONFIG_FLASH_PAGE + page;
+    erase.NbPages = 1u;
+
+    bool ok = (HAL_FLASH_Unlock() == HAL_OK);
+    ok = ok && (HAL_FLASHEx_Erase(&erase, &page_error) == HAL_OK);
+    for (uint32_t i = 0u; ok && (i < CONFIG_RECORD_SIZE); i += CONFIG_QUADWORD)
+    {
+        ok = (HAL_FLASH_Program(FLASH_TYPEPROGRAM_QUADWORD, addr + i, (uint32_t)&config.record.words[i / 4u]) == HAL_OK);
+    }
+    (void)HAL_FLASH_Lock();
+    (void)HAL_ICACHE_Invalidate(); /* the cache may hold the old content of the page */
+
+    ok = ok && (memcmp(config_flash_record(page), &config.record, CONFIG_RECORD_SIZE) == 0);
+    if (ok)
+    {
+        config.page = (uint8_t)page;
+        config.sequence++;
+        config.loaded_version = CONFIG_VERSION;
+    }
+
+    return ok;
+}
+
+void config_print(void)
+{
+    if (config.page == CONFIG_NO_PAGE)
+    {
+        printf("Config: defaults, nothing stored\r\n");
+    }
+    else
+    {
+        printf("Config: page %u, sequence %lu, version %u (firmware %u), %lu bytes\r\n", config.page, config.sequence, config.loaded_version, CONFIG_VERSION,
+               (uint32_t)sizeof(CONFIG_DATA));
+    }
+}
@@ -0,0 +1,619 @@
+/**
+ * @file config_blob.c
+ * @author PL
+ * @brief Binary export and import of the configuration, to clone the settings of a unit
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup CONFIG_BLOB
+ *
+ * The parser handles one byte at a time: the head of a CBOR item (initial byte and up to 4 argument
+ * bytes) is collected, then the complete item moves the position in the blob. Arrays only appear as
+ * field values and hold scalars, so the position is enough and no stack is needed.
+ */
+#include "config_blob.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "crc.h"
+
+#define CBOR_UINT    0u    /* Major type: unsigned integer */
+#define CBOR_NEGINT  1u    /* Major type: negative integer, -1 - argument */
+#define CBOR_ARRAY   4u    /* Major type: array */
+#define CBOR_MAP     5u    /* Major type: map */
+#define CBOR_SIMPLE  7u    /* Major type: simple values and floats */
+#define CBOR_ARG8    24u   /* Additional information: 1 argument byte */
+#define CBOR_ARG16   25u   /* Additional information: 2 argument bytes */
+#define CBOR_ARG32   26u   /* Additional information: 4 argument bytes, float32 for CBOR_SIMPLE */
+#define CBOR_TOP_LEN 3u    /* Items of the top level array: version, fields, CRC */
+#define CBOR_FLOAT32 0xFAu /* Initial byte of a float32 */
+
+/**
+ * @brief Type of a field in CONFIG_DATA
+ */
+typedef enum
+{
+    CONFIG_BLOB_F32 = 0u, /**< float */
+    CONFIG_BLOB_U32,      /**< uint32_t */
+    CONFIG_BLOB_U16,      /**< uint16_t */
+} CONFIG_BLOB_TYPE;
+
+/**
+ * @brief Field of the blob
+ */
+typedef struct
+{
+    uint8_t id;            /**< Field id, never reused */
+    CONFIG_BLOB_TYPE type; /**< Type */
+    uint16_t offset;       /**< Offset of the first element in CONFIG_DATA */
+    uint8_t count;         /**< Number of elements, 1 for a scalar */
+    uint8_t stride;        /**< Distance of the elements [bytes] */
+} CONFIG_BLOB_FIELD;
+
+#define CONFIG_BLOB_SCALAR(id, type, member)              {(id), (type), (uint16_t)offsetof(CONFIG_DATA, member), 1u, 0u}
+#define CONFIG_BLOB_ARRAY(id, type, member, count, stride) {(id), (type), (uint16_t)offsetof(CONFIG_DATA, member), (uint8_t)(count), (uint8_t)(stride)}
+
+/***************************************************
+ * @brief Fields, in the order of the export
+ ***************************************************/
+static const CONFIG_BLOB_FIELD config_blob_fields[] = {
+    CONFIG_BLOB_ARRAY(1u, CONFIG_BLOB_F32, pid[0].kp, PID_MAX_LOOPS, sizeof(PID_GAINS)),
+    CONFIG_BLOB_ARRAY(2u, CONFIG_BLOB_F32, pid[0].ki, PID_MAX_LOOPS, sizeof(PID_GAINS)),
+    CONFIG_BLOB_ARRAY(3u, CONFIG_BLOB_F32, pid[0].kd, PID_MAX_LOOPS, sizeof(PID_GAINS)),
+    CONFIG_BLOB_SCALAR(4u, CONFIG_BLOB_F32, fan.kp),
+    CONFIG_BLOB_SCALAR(5u, CONFIG_BLOB_F32, fan.ki),
+    CONFIG_BLOB_SCALAR(6u, CONFIG_BLOB_F32, fan.kd),
+    CONFIG_BLOB_ARRAY(7u, CONFIG_BLOB_U32, irrigation[0].interval_s, IRRIGATION_MAX_ZONES, sizeof(IRRIGATION_CONFIG)),
+    CONFIG_BLOB_ARRAY(8u, CONFIG_BLOB_U32, irrigation[0].hold_s, IRRIGATION_MAX_ZONES, sizeof(IRRIGATION_CONFIG)),
+    CONFIG_BLOB_ARRAY(9u, CONFIG_BLOB_U32, irrigation[0].fill_timeout_s, IRRIGATION_MAX_ZONES, sizeof(IRRIGATION_CONFIG)),
+    CONFIG_BLOB_ARRAY(10u, CONFIG_BLOB_U32, irrigation[0].drain_timeout_s, IRRIGATION_MAX_ZONES, sizeof(IRRIGATION_CONFIG)),
+    CONFIG_BLOB_SCALAR(11u, CONFIG_BLOB_F32, dose.area_cm2),
+    CONFIG_BLOB_SCALAR(12u, CONFIG_BLOB_F32, dose.ec_stock),
+    CONFIG_BLOB_SCALAR(13u, CONFIG_BLOB_F32, dose.ph_slope),
+    CONFIG_BLOB_ARRAY(14u, CONFIG_BLOB_F32, dose.pump_ml_min[0], DOSE_CHANNELS, sizeof(float)),
+    CONFIG_BLOB_SCALAR(15u, CONFIG_BLOB_F32, dose.mix_s),
+    CONFIG_BLOB_SCALAR(16u, CONFIG_BLOB_F32, dose.horizon_s),
+    CONFIG_BLOB_ARRAY(17u, CONFIG_BLOB_F32, calib.sets[0].gain, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_ARRAY(18u, CONFIG_BLOB_F32, calib.sets[0].offset, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_ARRAY(19u, CONFIG_BLOB_U32, calib.sets[0].time, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_ARRAY(20u, CONFIG_BLOB_U16, calib.sets[0].version, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_ARRAY(21u, CONFIG_BLOB_U16, calib.sets[0].points, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_ARRAY(22u, CONFIG_BLOB_F32, calib.previous[0].gain, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_ARRAY(23u, CONFIG_BLOB_F32, calib.previous[0].offset, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_ARRAY(24u, CONFIG_BLOB_U32, calib.previous[0].time, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_ARRAY(25u, CONFIG_BLOB_U16, calib.previous[0].version, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_ARRAY(26u, CONFIG_BLOB_U16, calib.previous[0].points, CALIB_SENSORS, sizeof(CALIB_SET)),
+    CONFIG_BLOB_SCALAR(27u, CONFIG_BLOB_U32, dli.target), /* Q16.16, not negative */
+    CONFIG_BLOB_SCALAR(28u, CONFIG_BLOB_U32, dli.light_end_s),
+    CONFIG_BLOB_ARRAY(29u, CONFIG_BLOB_F32, irrigation_fill_ml_min[0], IRRIGATION_MAX_ZONES, sizeof(float)),
+};
+
+#define CONFIG_BLOB_NUM_FIELDS (sizeof(config_blob_fields) / sizeof(config_blob_fields[0]))
+
+/**
+ * @brief Position of the parser in the blob
+ */
+typedef enum
+{
+    CONFIG_BLOB_POS_TOP = 0u, /**< Top level array */
+    CONFIG_BLOB_POS_VERSION,  /**< Version */
+    CONFIG_BLOB_POS_FIELDS,   /**< Map of the fields */
+    CONFIG_BLOB_POS_KEY,      /**< Field id */
+    CONFIG_BLOB_POS_VALUE,    /**< Value or array of values */
+    CONFIG_BLOB_POS_ELEMENT,  /**< Element of an array value */
+    CONFIG_BLOB_POS_CRC,      /**< CRC */
+    CONFIG_BLOB_POS_END,      /**< Done, no more bytes */
+} CONFIG_BLOB_POS;
+
+/**
+ * @brief Encoder output
+ */
+typedef struct
+{
+    uint8_t* buf;  /**< Output */
+    uint32_t size; /**< Size of the output [bytes] */
+    uint32_t len;  /**< Bytes written */
+    bool ok;       /**< Everything fits */
+} CONFIG_BLOB_ENC;
+
+/**
+ * @brief Operational data of the import
+ */
+typedef struct
+{
+    CONFIG_DATA staging;            /**< Configuration being imported */
+    CONFIG_BLOB_STATE state;        /**< State */
+    CONFIG_BLOB_POS pos;            /**< Position in the blob */
+    const char* error;              /**< Reason of CONFIG_BLOB_ERROR */
+    const CONFIG_BLOB_FIELD* field; /**< Field of the current value, NULL if unknown */
+    uint8_t major;                  /**< Major type of the current item */
+    uint8_t info;                   /**< Additional information of the current item */
+    uint8_t head_left;              /**< Argument bytes still to receive */
+    uint32_t arg;                   /**< Argument of the current item */
+    uint32_t fields_left;           /**< Fields still to receive */
+    uint32_t elements_left;         /**< Elements of the array value still to receive */
+    uint32_t index;                 /**< Element of the current value */
+    uint16_t crc;                   /**< CRC of the received bytes */
+    uint32_t version;               /**< CONFIG_VERSION of the blob */
+    uint32_t bytes;                 /**< Received bytes */
+    uint32_t fields;                /**< Imported fields */
+    uint32_t skipped;               /**< Unknown fields */
+} CONFIG_BLOB_IMPORT;
+
+STATIC CONFIG_BLOB_IMPORT config_blob;
+
+/***************************************************
+ * @brief Write bytes to the encoder output
+ * @param e Encoder
+ * @param data Bytes
+ * @param len Number of bytes
+ ***************************************************/
+STATIC void config_blob_put(CONFIG_BLOB_ENC* e, const uint8_t* data, uint32_t len)
+{
+    if ((e->len + len) <= e->size)
+    {
+        (void)memcpy(&e->buf[e->len], data, len);
+        e->len += len;
+    }
+    else
+    {
+        e->ok = false;
+    }
+}
+
+/***************************************************
+ * @brief Write the head of an item, with the shortest argument
+ * @param e Encoder
+ * @param major Major type
+ * @param arg Argument
+ ***************************************************/
+STATIC void config_blob_put_head(CONFIG_BLOB_ENC* e, uint8_t major, uint32_t arg)
+{
+    uint8_t head[5];
+    uint32_t len;
+
+    if (arg < CBOR_ARG8)
+    {
+        head[0] = (uint8_t)((major << 5) | arg);
+        len = 1u;
+    }
+    else if (arg <= 0xFFu)
+    {
+        head[0] = (uint8_t)((major << 5) | CBOR_ARG8);
+        head[1] = (uint8_t)arg;
+        len = 2u;
+    }
+    else if (arg <= 0xFFFFu)
+    {
+        head[0] = (uint8_t)((major << 5) | CBOR_ARG16);
+        head[1] = (uint8_t)(arg >> 8);
+        head[2] = (uint8_t)arg;
+        len = 3u;
+    }
+    else
+    {
+        head[0] = (uint8_t)((major << 5) | CBOR_ARG32);
+        head[1] = (uint8_t)(arg >> 24);
+        head[2] = (uint8_t)(arg >> 16);
+        head[3] = (uint8_t)(arg >> 8);
+        head[4] = (uint8_t)arg;
+        len = 5u;
+    }
+    config_blob_put(e, head, len);
+}
+
+/***************************************************
+ * @brief Write an element of a field
+ * @param e Encoder
+ * @param data Configuration
+ * @param field Field
+ * @param index Element
+ ***************************************************/
+STATIC void config_blob_put_element(CONFIG_BLOB_ENC* e, const CONFIG_DATA* data, const CONFIG_BLOB_FIELD* field, uint32_t index)
+{
+    const uint8_t* src = (const uint8_t*)data + field->offset + (index * field->stride);
+
+    if (field->type == CONFIG_BLOB_F32)
+    {
+        uint32_t bits;
+        (void)memcpy(&bits, src, sizeof(bits));
+        const uint8_t item[5] = {CBOR_FLOAT32, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits};
+        config_blob_put(e, item, sizeof(item));
+    }
+    else if (field->type == CONFIG_BLOB_U32)
+    {
+        uint32_t value;
+        (void)memcpy(&value, src, sizeof(value));
+        config_blob_put_head(e, CBOR_UINT, value);
+    }
+    else
+    {
+        uint16_t value;
+        (void)memcpy(&value, src, sizeof(value));
+        config_blob_put_head(e, CBOR_UINT, value);
+    }
+}
+
+uint32_t config_blob_export(uint8_t* buf, uint32_t size)
+{
+    const CONFIG_DATA* data = config_get();
+    CONFIG_BLOB_ENC e = {buf, size, 0u, true};
+
+    config_blob_put_head(&e, CBOR_ARRAY, CBOR_TOP_LEN);
+    config_blob_put_head(&e, CBOR_UINT, CONFIG_VERSION);
+    config_blob_put_head(&e, CBOR_MAP, CONFIG_BLOB_NUM_FIELDS);
+    for (uint32_t i = 0u; e.ok && (i < CONFIG_BLOB_NUM_FIELDS); i++)
+    {
+        const CONFIG_BLOB_FIELD* field = &config_blob_fields[i];
+        config_blob_put_head(&e, CBOR_UINT, field->id);
+        if (field->count > 1u)
+        {
+            config_blob_put_head(&e, CBOR_ARRAY, field->count);
+        }
+        for (uint32_t j = 0u; e.ok && (j < field->count); j++)
+        {
+            config_blob_put_element(&e, data, field, j);
+        }
+    }
+    if (e.ok)
+    {
+        config_blob_put_head(&e, CBOR_UINT, crc_calc(buf, e.len));
+    }
+
+    return e.ok ? e.len : 0u;
+}
+
+/***************************************************
+ * @brief Stop the import with an error
+ * @param error Reason
+ ***************************************************/
+STATIC void config_blob_fail(const char* error)
+{
+    config_blob.state = CONFIG_BLOB_ERROR;
+    config_blob.error = error;
+}
+
+/***************************************************
+ * @brief Find a field
+ * @param id Field id
+ * @return Field, NULL if unknown
+ ***************************************************/
+STATIC const CONFIG_BLOB_FIELD* config_blob_find(uint32_t id)
+{
+    const CONFIG_BLOB_FIELD* field = NULL;
+
+    for (uint32_t i = 0u; (i < CONFIG_BLOB_NUM_FIELDS) && (field == NULL); i++)
+    {
+        if (config_blob_fields[i].id == id)
+        {
+            field = &config_blob_fields[i];
+        }
+    }
+
+    return field;
+}
+
+/***************************************************
+ * @brief Store the current scalar item in an element of the current field of the staging copy
+ ***************************************************/
+STATIC void config_blob_store(void)
+{
+    const CONFIG_BLOB_FIELD* field = config_blob.field;
+    const uint32_t arg = config_blob.arg;
+    const bool is_float = (config_blob.major == CBOR_SIMPLE) && (config_blob.info == CBOR_ARG32);
+
+    if ((config_blob.major != CBOR_UINT) && (config_blob.major != CBOR_NEGINT) && !is_float)
+    {
+        config_blob_fail("value is not a number");
+    }
+    else if ((field == NULL) || (config_blob.index >= field->count))
+    {
+        // Do nothing, unknown field or more elements than this firmware has
+    }
+    else
+    {
+        uint8_t* dst = (uint8_t*)&config_blob.staging + field->offset + (config_blob.index * field->stride);
+
+        if (field->type == CONFIG_BLOB_F32)
+        {
+            float value;
+            if (is_float)
+            {
+                (void)memcpy(&value, &arg, sizeof(value));
+            }
+            else if (config_blob.major == CBOR_UINT)
+            {
+                value = (float)arg;
+            }
+            else
+            {
+                value = -1.0f - (float)arg;
+            }
+            if (is_float && (((arg >> 23) & 0xFFu) == 0xFFu)) /* inf or NaN */
+            {
+                config_blob_fail("value is not finite");
+            }
+            else
+            {
+                (void)memcpy(dst, &value, sizeof(value));
+            }
+        }
+        else if (config_blob.major != CBOR_UINT)
+        {
+            config_blob_fail("integer field with a negative or float value");
+        }
+        else if (field->type == CONFIG_BLOB_U32)
+        {
+            (void)memcpy(dst, &arg, sizeof(arg));
+        }
+        else if (arg > 0xFFFFu)
+        {
+            config_blob_fail("value out of range");
+        }
+        else
+        {
+            const uint16_t value = (uint16_t)arg;
+            (void)memcpy(dst, &value, sizeof(value));
+        }
+    }
+}
+
+/***************************************************
+ * @brief A value is complete: go to the next field, or to the CRC after the last one
+ ***************************************************/
+STATIC void config_blob_value_done(void)
+{
+    if (config_blob.field != NULL)
+    {
+        config_blob.fields++;
+    }
+    else
+    {
+        config_blob.skipped++;
+    }
+    config_blob.fields_left--;
+    config_blob.pos = (config_blob.fields_left > 0u) ? CONFIG_BLOB_POS_KEY : CONFIG_BLOB_POS_CRC;
+}
+
+/***************************************************
+ * @brief Check the values of an imported configuration, the CRC only shows the blob arrived intact
+ * @param data Configuration
+ * @return Reason if a value is implausible, NULL if the configuration can be used
+ ***************************************************/
+STATIC const char* config_blob_check(const CONFIG_DATA* data)
+{
+    const char* error = NULL;
+
+    for (uint32_t i = 0u; (i < CALIB_SENSORS) && (error == NULL); i++)
+    {
+        const float gain = data->calib.sets[i].gain;
+        const float previous = data->calib.previous[i].gain;
+        if ((gain < CALIB_GAIN_MIN) || (gain > CALIB_GAIN_MAX) || (previous < CALIB_GAIN_MIN) || (previous > CALIB_GAIN_MAX)) /* like calib_finish() */
+        {
+            error = "calibration gain out of range";
+        }
+    }
+    for (uint32_t i = 0u; (i < IRRIGATION_MAX_ZONES) && (error == NULL); i++)
+    {
+        if ((data->irrigation[i].fill_timeout_s == 0u) || (data->irrigation[i].drain_timeout_s == 0u))
+        {
+            error = "irrigation timeout of 0";
+        }
+        else if (!(data->irrigation_fill_ml_min[i] >= 0.0f))
+        {
+            error = "negative fill flow"; /* 0 is allowed, the flow is unknown */
+        }
+        else
+        {
+            // Do nothing
+        }
+    }
+    for (uint32_t i = 0u; (i < DOSE_CHANNELS) && (error == NULL); i++)
+    {
+        if (!(data->dose.pump_ml_min[i] > 0.0f))
+        {
+            error = "dosing pump flow of 0";
+        }
+    }
+    if ((error == NULL) && (data->dli.light_end_s >= DLI_SECONDS_PER_DAY))
+    {
+        error = "lights off time after the end of the day";
+    }
+
+    return error;
+}
+
+/***************************************************
+ * @brief Handle a complete item at the current position
+ ***************************************************/
+STATIC void config_blob_item(void)
+{
+    const uint8_t major = config_blob.major;
+    const uint32_t arg = config_blob.arg;
+
+    switch (config_blob.pos)
+    {
+    case CONFIG_BLOB_POS_TOP:
+        if ((major != CBOR_ARRAY) || (arg != CBOR_TOP_LEN))
+        {
+            config_blob_fail("not a configuration blob");
+        }
+        config_blob.pos = CONFIG_BLOB_POS_VERSION;
+        break;
+    case CONFIG_BLOB_POS_VERSION:
+        if ((major != CBOR_UINT) || (arg == 0u))
+        {
+            config_blob_fail("no version");
+        }
+        else if (arg > CONFIG_VERSION)
+        {
+            config_blob_fail("blob of a newer firmware");
+        }
+        else
+        {
+            // Do nothing, an older blob lacks the later fields, they keep their values
+        }
+        config_blob.version = arg;
+        config_blob.pos = CONFIG_BLOB_POS_FIELDS;
+        break;
+    case CONFIG_BLOB_POS_FIELDS:
+        if (major != CBOR_MAP)
+        {
+            config_blob_fail("no fields");
+        }
+        config_blob.fields_left = arg;
+        config_blob.pos = (arg > 0u) ? CONFIG_BLOB_POS_KEY : CONFIG_BLOB_POS_CRC;
+        break;
+    case CONFIG_BLOB_POS_KEY:
+        if (major != CBOR_UINT)
+        {
+            config_blob_fail("field id is not an integer");
+        }
+        config_blob.field = config_blob_find(arg);
+        config_blob.index = 0u;
+        config_blob.pos = CONFIG_BLOB_POS_VALUE;
+        break;
+    case CONFIG_BLOB_POS_VALUE:
+        if (major == CBOR_ARRAY)
+        {
+            config_blob.elements_left = arg;
+            config_blob.pos = CONFIG_BLOB_POS_ELEMENT;
+            if (arg == 0u)
+            {
+                config_blob_value_done();
+            }
+        }
+        else
+        {
+            config_blob_store();
+            config_blob_value_done();
+        }
+        break;
+    case CONFIG_BLOB_POS_ELEMENT:
+        config_blob_store();
+        config_blob.index++;
+        config_blob.elements_left--;
+        if (config_blob.elements_left == 0u)
+        {
+            config_blob_value_done();
+        }
+        break;
+    case CONFIG_BLOB_POS_CRC:
+        if ((major != CBOR_UINT) || (arg != config_blob.crc))
+        {
+            config_blob_fail("CRC error");
+        }
+        else
+        {
+            const char* error = config_blob_check(&config_blob.staging);
+            if (error != NULL)
+            {
+                config_blob_fail(error);
+            }
+            else
+            {
+                *config_get() = config_blob.staging; /* the whole configuration at once */
+                config_blob.state = CONFIG_BLOB_DONE;
+            }
+        }
+        config_blob.pos = CONFIG_BLOB_POS_END;
+        break;
+    default:
+        config_blob_fail("data after the end");
+        break;
+    }
+}
+
+/***************************************************
+ * @brief Parse a byte of the blob
+ * @param b Byte
+ ***************************************************/
+STATIC void config_blob_byte(uint8_t b)
+{
+    bool complete = false;
+
+    config_blob.bytes++;
+    if (config_blob.pos < CONFIG_BLOB_POS_CRC)
+    {
+        config_blob.crc = crc_update(config_blob.crc, &b, 1u); /* the CRC item itself is not covered */
+    }
+
+    if (config_blob.pos == CONFIG_BLOB_POS_END)
+    {
+        config_blob_fail("data after the end");
+    }
+    else if (config_blob.head_left == 0u) /* initial byte of an item */
+    {
+        config_blob.major = (uint8_t)(b >> 5);
+        config_blob.info = (uint8_t)(b & 0x1Fu);
+        config_blob.arg = 0u;
+        if (config_blob.info < CBOR_ARG8)
+        {
+            config_blob.arg = config_blob.info;
+            complete = (config_blob.major != CBOR_SIMPLE); /* simple values (false, true, null) are not supported */
+            if (!complete)
+            {
+                config_blob_fail("unsupported item");
+            }
+        }
+        else if ((config_blob.info <= CBOR_ARG32) && ((config_blob.major != CBOR_SIMPLE) || (config_blob.info == CBOR_ARG32)))
+        {
+            config_blob.head_left = (uint8_t)(1u << (config_blob.info - CBOR_ARG8)); /* 1, 2 or 4 bytes */
+        }
+        else
+        {
+            config_blob_fail("unsupported item"); /* 64 bit, indefinite length, half and double floats */
+        }
+    }
+    else
+    {
+        config_blob.arg = (config_blob.arg << 8) | b;
+        config_blob.head_left--;
+        complete = (config_blob.head_left == 0u);
+    }
+
+    if (complete)
+    {
+        config_blob_item();
+    }
+}
+
+void config_blob_import_begin(void)
+{
+    (void)memset(&config_blob, 0, sizeof(config_blob));
+    config_blob.staging = *config_get(); /* fields missing in the blob keep their values */
+    config_blob.state = CONFIG_BLOB_BUSY;
+    config_blob.pos = CONFIG_BLOB_POS_TOP;
+}
+
+CONFIG_BLOB_STATE config_blob_import(const uint8_t* data, uint32_t len)
+{
+    if (config_blob.state != CONFIG_BLOB_BUSY)
+    {
+        config_blob_import_begin();
+    }
+    for (uint32_t i = 0u; (i < len) && (config_blob.state == CONFIG_BLOB_BUSY); i++)
+    {
+        config_blob_byte(data[i]);
+    }
+
+    return config_blob.state;
+}
+
+void config_blob_print(void)
+{
+    static const char* const state_names[] = {"none", "busy", "done", "error"};
+
+    printf("Import: %s, %lu bytes, version %lu (firmware %u), %lu fields, %lu unknown fields skipped", state_names[config_blob.state], config_blob.bytes, config_blob.version, CONFIG_VERSION,
+           config_blob.fields, config_blob.skipped);
+    if (config_blob.state == CONFIG_BLOB_ERROR)
+    {
+        printf(", %s", config_blob.error);
+    }
+    printf("\r\n");
+}
+
+/** @}*/
@@ -42,6 +42,17 @@ static CONSOLE_BUFFER rx_buffer = {rx_buf_inst, 0, 0, CONSOLE_RX_BUF_LEN};
 static char tx_buf_inst[CONSOLE_TX_BUF_LEN];
 static CONSOLE_BUFFER tx_buffer = {tx_buf_inst, 0, 0, CONSOLE_TX_BUF_LEN};
 
+/**
+ * @brief Line being edited, handed out complete until console_release_line()
+ */
+typedef struct
+{
+    char buf[CONSOLE_LINE_LEN]; /**< Characters of the line, 0 terminated when complete */
+    uint16_t index;             /**< Length of the line */
+    bool ready;                 /**< Complete line handed out */
+} CONSOLE_LINE;
+static CONSOLE_LINE console_line;
+
 static UART_HandleTypeDef* console; /* UART handler for the console port */
 STATIC uint8_t rx_data[4];          /* temporary receive buffer */
 
@@ -155,6 +166,7 @@ void console_init(UART_HandleTypeDef* huart)
     console_timers.console_disabled_timer = 0;
     console_timers.console_disabled_time = 0;
     console_init_buffer(&rx_buffer);
+    console_release_line();
 
     console_echo_delay(false);            /* default echo back immediately */
     console_enable_blocking_printf(true); /* default use blocking function */
@@ -196,14 +208,12 @@ void console_enable_silent_printf(bool enable)
     console_flags.silent_printf = enable;
 }
 
-bool console_read_line(char* buf, uint16_t max_len)
+char* console_read_line(void)
 {
     bool rx_line_flag;         /* true if receive a complete line. */
     uint16_t rx_index_in_copy; /* copy of rx_index_in */
     char chartemp;
-    static uint16_t read_line_index = 0;
-    static uint16_t rx_index_in_prev = 0;             /* rx_index in last bms cycle */
-    static char read_line_buffer[CONSOLE_RX_BUF_LEN]; /* uart_read_line buffer */
+    static uint16_t rx_index_in_prev = 0; /* rx_index in last bms cycle */
     uint32_t irq_cfgr;
 
     rx_line_flag = false;
@@ -211,22 +221,26 @@ bool console_read_line(char* buf, uint16_t max_len)
     rx_index_in_copy = rx_buffer.index_in; /* duplicate index pointers */
     nvic_enable_IRQs(irq_cfgr);            /* enable IRQ again */
 
-    if (rx_index_in_copy != rx_index_in_prev) /* busy receiving ?, do nothing yet (HAL_UART might be corrupted! */
+    if (console_line.ready) /* previous line still in use, new characters wait in the receive buffer */
+    {
+        // Do nothing
+    }
+    else if (rx_index_in_copy != rx_index_in_prev) /* busy receiving ?, do nothing yet (HAL_UART might be corrupted! */
     {
         rx_index_in_prev = rx_index_in_copy;
     }
     else
     {
-        while (console_deq_buffer(&rx_buffer, &chartemp) && (rx_line_flag == false)) /*  is new data in the buffer and previous line executed ? */
+        while ((rx_line_flag == false) && console_deq_buffer(&rx_buffer, &chartemp)) /*  is new data in the buffer and previous line executed ? */
         {
             if (chartemp != '\r') /* if not a CR, then */
             {
-                if (read_line_index < CONSOLE_RX_BUF_LEN) /* don't go past the buffer */
+                if (console_line.index < (CONSOLE_LINE_LEN - 1u)) /* don't go past the buffer, keep room for the terminator */
                 {
                     if ((chartemp >= ' ') && (chartemp <= '~'))
                     {
-                        read_line_buffer[read_line_index] = chartemp; /* add printable character to buffer */
-                        read_line_index++;
+                        console_line.buf[console_line.index] = chartemp; /* add printable character to buffer */
+                        console_line.index++;
                         if (console_flags.read_echo_delay == false)
                         {
                             printf("%c", chartemp);
@@ -234,10 +248,9 @@ bool console_read_line(char* buf, uint16_t max_len)
                     }
                     if ((chartemp == (char)0x7Fu) || (chartemp == '\b')) /* backspace or Del, so delete previous character */
                     {
-                        if (read_line_index > 0u)
+                        if (console_line.index > 0u)
                         {
-                            --read_line_index;
-                            read_line_buffer[read_line_index] = '\0'; /* remove previous character (if not last character) */
+                            --console_line.index;
                             if (console_flags.read_echo_delay == false)
                             {
                                 printf("%c", chartemp);
@@ -247,18 +260,14 @@ bool console_read_line(char* buf, uint16_t max_len)
                 }
                 else /* if buffer is full, do nothing */
                 {
-                    printf("Console buffer overrun %d\r\n", CONSOLE_RX_BUF_LEN);
-                    read_line_index = 0;
+                    printf("Console buffer overrun %d\r\n", CONSOLE_LINE_LEN);
+                    console_line.index = 0;
                 }
             }
             else /* it was a CR, execute the command */
             {
                 rx_line_flag = true;
-                if (read_line_index >= CONSOLE_RX_BUF_LEN)
-                {
-                    read_line_index = CONSOLE_RX_BUF_LEN - 1u;
-                }
-                read_line_buffer[read_line_index] = '\0'; /* last character is 0 */
+                console_line.buf[console_line.index] = '\0'; /* last character is 0 */
                 if (console_flags.read_echo_delay == false)
                 {
                     printf("\r\n");
@@ -271,20 +280,37 @@ bool console_read_line(char* buf, uint16_t max_len)
     {
         if (console_flags.read_echo_delay == true)
         {
-            printf("%s\r\n", read_line_buffer); /* echo complete line */
-        }
-        if (max_len > CONSOLE_RX_BUF_LEN) /* max_len can't be longer than read_line_buffer length */
-        {
-            (void)memcpy(buf, read_line_buffer, CONSOLE_RX_BUF_LEN);
-        }
-        else
-        {
-            (void)memcpy(buf, read_line_buffer, max_len);
+            printf("%s\r\n", console_line.buf); /* echo complete line */
         }
-        read_line_index = 0;
+        console_line.ready = true;
+    }
+
+    return rx_line_flag ? console_line.buf : NULL;
+}
+
+void console_release_line(void)
+{
+    console_line.index = 0;
+    console_line.ready = false;
+}
+
+bool console_line_pending(void)
+{
+    uint32_t irq_cfgr;
+    uint16_t in;
+    bool found = false;
+
+    irq_cfgr = nvic_disable_IRQs();
+    in = rx_buffer.index_in;
+    nvic_enable_IRQs(irq_cfgr);
+
+    /* characters between out and in are not changed by the receive interrupt */
+    for (uint16_t i = rx_buffer.index_out; (i != in) && !found; i++)
+    {
+        found = (rx_buffer.buffer[i % rx_buffer.length] == '\r');
     }
 
-    return (rx_line_flag);
+    return found;
 }
 
 bool console_background_print(uint32_t timeout)
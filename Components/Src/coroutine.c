@@ -0,0 +1,166 @@
+/**
+ * @file coroutine.c
+ * @author PL
+ * @brief Scheduler for stackless coroutines
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup COROUTINE
+ *
+ * The coroutines are kept in a single linked list, no memory is allocated.
+ * A coroutine waiting for events or sleeping is skipped until an event arrives or its deadline passes,
+ * so the cost of a blocked coroutine is a few compares per cycle.
+ */
+#include "coroutine.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stm32_hal.h"
+#include "timer.h"
+
+/***************************************************
+ * @brief Head of the scheduler list
+ ***************************************************/
+STATIC CORO* coro_list = NULL;
+
+/***************************************************
+ * @brief Check if a coroutine is blocked and can be skipped by the scheduler
+ * @param c Pointer to the control block
+ * @return true if the coroutine is waiting for an event or deadline which is not there yet
+ ***************************************************/
+STATIC bool coro_is_blocked(const CORO* c)
+{
+    bool blocked = false;
+
+    if (((c->events & c->wait_mask) == 0u) && ((c->flags & CORO_FLAG_POLL) == 0u))
+    {
+        if ((c->flags & CORO_FLAG_TIMED) != 0u)
+        {
+            blocked = !coro_timed_out(c);
+        }
+        else
+        {
+            blocked = (c->wait_mask != 0u); /* waiting for an event without timeout */
+        }
+    }
+
+    return blocked;
+}
+
+void coro_start(CORO* c, CORO_STATE (*func)(CORO* c))
+{
+    coro_stop(c); /* never link a control block twice */
+
+    c->func = func;
+    c->lc = 0u;
+    c->events = 0u;
+    c->wait_mask = 0u;
+    c->flags = 0u;
+    c->deadline = 0u;
+    c->next = coro_list;
+    coro_list = c;
+}
+
+void coro_stop(CORO* c)
+{
+    CORO** link = &coro_list;
+
+    while (*link != NULL)
+    {
+        if (*link == c)
+        {
+            *link = c->next;
+            c->next = NULL;
+            break;
+        }
+        link = &(*link)->next;
+    }
+}
+
+void coro_post_event(CORO* c, uint16_t events)
+{
+    const uint32_t old_primask = __get_PRIMASK(); /* events are posted from interrupts */
+    (void)__disable_irq();
+    c->events |= events;
+    __set_PRIMASK(old_primask);
+}
+
+uint16_t coro_take_events(CORO* c, uint16_t mask)
+{
+    const uint32_t old_primask = __get_PRIMASK();
+    (void)__disable_irq();
+    const uint16_t events = c->events & mask;
+    c->events &= (uint16_t)~mask;
+    __set_PRIMASK(old_primask);
+
+    return events;
+}
+
+void coro_arm_wait(CORO* c, uint16_t mask, uint32_t timeout_ms)
+{
+    c->wait_mask = mask;
+    if (timeout_ms == CORO_WAIT_FOREVER)
+    {
+        c->flags &= (uint16_t)~CORO_FLAG_TIMED;
+    }
+    else
+    {
+        timer_reset_module_timer(&c->deadline);
+        c->deadline += timeout_ms;
+        c->flags |= CORO_FLAG_TIMED;
+    }
+}
+
+void coro_disarm(CORO* c)
+{
+    c->wait_mask = 0u;
+    c->flags &= (uint16_t)~(CORO_FLAG_TIMED | CORO_FLAG_POLL);
+}
+
+bool coro_timed_out(const CORO* c)
+{
+    bool timed_out = false;
+
+    if ((c->flags & CORO_FLAG_TIMED) != 0u)
+    {
+        uint32_t now;
+        timer_reset_module_timer(&now);
+        timed_out = ((int32_t)(now - c->deadline)) >= 0; /*lint !e9033 wrap around intentional */
+    }
+
+    return timed_out;
+}
+
+uint32_t coro_proc(void)
+{
+    uint32_t called = 0u;
+    CORO* c = coro_list;
+
+    while (c != NULL)
+    {
+        CORO* const next = c->next; /* c can be removed from the list in the call */
+        if (!coro_is_blocked(c))
+        {
+            called++;
+            if (c->func(c) == CORO_EXITED)
+            {
+                coro_stop(c);
+            }
+        }
+        c = next;
+    }
+
+    return called;
+}
+
+uint32_t coro_get_count(void)
+{
+    uint32_t count = 0u;
+
+    for (const CORO* c = coro_list; c != NULL; c = c->next)
+    {
+        count++;
+    }
+
+    return count;
+}
@@ -9,6 +9,7 @@
  ****************************************************/
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "crc.h"
 #include "define.h"
@@ -22,6 +23,7 @@
 
 #define CRC16_POLYNOM      0xA001u
 #define CRC16_TABLE_LENGTH 256u
+#define CRC32_POLYNOM      0x04C11DB7u
 
 /**
  * @brief Struct to store a parameter for hardware CRC peripheral
@@ -85,7 +87,7 @@ static bool crc_check_table(void)
     if (crc_str != 0xBB3Du)
     {
 #ifndef DISABLE_CONSOLE
-        printf_("CRC table not correct %04X\r\n", crc_str);
+        printf("CRC table not correct %04X\r\n", crc_str);
 #endif // !DISABLE_CONSOLE
         retval = false;
     }
@@ -94,7 +96,7 @@ static bool crc_check_table(void)
     if (crc_tbl != 0x7205u)
     {
 #ifndef DISABLE_CONSOLE
-        printf_("CRC ROM table damaged %04X\r\n", crc_tbl);
+        printf("CRC ROM table damaged %04X\r\n", crc_tbl);
 #endif // !DISABLE_CONSOLE
         retval = false;
     }
@@ -127,10 +129,14 @@ void crc_init(CRC_HandleTypeDef* hcrc)
  * It's has great effects on the overall performance.
  */
 uint16_t crc_calc(const void* buf, const uint32_t length)
+{
+    return crc_update(0u, buf, length);
+}
+
+uint16_t crc_update(uint16_t crc, const void* buf, const uint32_t length)
 {
     const uint8_t* const src = (const uint8_t*)buf; //lint !e9079
 
-    uint16_t crc = 0;
     for (uint32_t i = 0u; i < length; ++i)
     {
         crc = (uint16_t)((crc >> 8) ^ crc16_table[(uint8_t)(crc ^ src[i])]);
@@ -149,7 +155,7 @@ uint16_t crc_hw_calc(const void* buf, const uint32_t length, const uint16_t poly
     ret = HAL_CRCEx_Polynomial_Set(hw_crc.handler, polynom, CRC_POLYLENGTH_16B);
     if (ret != HAL_OK)
     {
-        printf_("HW CRC-16 configuration failed.\r\n");
+        printf("HW CRC-16 configuration failed.\r\n");
     }
     else
     {
@@ -159,3 +165,33 @@ uint16_t crc_hw_calc(const void* buf, const uint32_t length, const uint16_t poly
 
     return crc;
 }
+
+uint32_t crc32_hw_update(uint32_t state, const uint32_t* buf, const uint32_t num_words)
+{
+    CRC_TypeDef* const crc = hw_crc.handler->Instance;
+    const uint32_t cr = crc->CR;
+    const uint32_t init = crc->INIT;
+    const uint32_t pol = crc->POL;
+
+    /* 32 bit polynomial, input reversed by word and output reversed: the reflected CRC-32 on little endian words */
+    crc->POL = CRC32_POLYNOM;
+    crc->CR = CRC_CR_REV_IN | CRC_CR_REV_OUT;
+    crc->INIT = state;
+    crc->CR |= CRC_CR_RESET;
+    for (uint32_t i = 0u; i < num_words; i++)
+    {
+        crc->DR = buf[i];
+    }
+    const uint32_t next = __RBIT(crc->DR); /* internal register, the output is reversed */
+
+    crc->POL = pol;
+    crc->INIT = init;
+    crc->CR = cr;
+
+    return next;
+}
+
+uint32_t crc32_hw_final(uint32_t state)
+{
+    return __RBIT(state) ^ 0xFFFFFFFFu;
+}
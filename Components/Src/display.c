@@ -0,0 +1,688 @@
+/**
+ * @file display.c
+ * @author PL
+ * @brief Local status display: ST7735 TFT on SPI1 with dirty tile tracking and DMA partial updates
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup DISPLAY
+ *
+ * A window is sent as CASET, RASET and RAMWR with blocking transfers (11 bytes), followed by the pixels
+ * with the SPI DMA. The panel takes the pixels big endian, the framebuffer keeps them byte swapped so
+ * it can be sent as it is. The SPI runs at SYSCLK / 16 = 10 MHz, a full frame (40 KB) takes 33 ms.
+ */
+#include "display.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "coroutine.h"
+#include "memdma.h"
+#include "timer.h"
+
+#define DISPLAY_SPI_PRESCALER SPI_BAUDRATEPRESCALER_16                                     /* 10 MHz at 160 MHz SYSCLK, ST7735 write cycle >= 66 ns */
+#define DISPLAY_SPI_TIMEOUT   10u                                                          /* Timeout of a blocking command [ms] */
+#define DISPLAY_DMA_TIMEOUT   100u                                                         /* Timeout of a staging or pixel transfer [ms] */
+#define DISPLAY_MADCTL        0x60u                                                        /* Row/column exchange and column mirror: landscape, RGB order */
+#define DISPLAY_TILE_ALL      ((1u << DISPLAY_TILE_COLS) - 1u)
+#define DISPLAY_STAGING       (DISPLAY_TILE_W * (DISPLAY_TILE_COLS - 1u) * DISPLAY_TILE_H) /* Pixels of the largest partial window */
+#define DISPLAY_FONT_FIRST    32u                                                          /* First character of the font */
+#define DISPLAY_FONT_LAST     126u                                                         /* Last character of the font */
+#define DISPLAY_EV_STAGED     0x0001u                                                      /* Rows of a window gathered */
+#define DISPLAY_EV_SENT       0x0002u                                                      /* Pixel transfer complete */
+
+#define DISPLAY_CMD_SLPOUT 0x11u /* Sleep out */
+#define DISPLAY_CMD_DISPON 0x29u /* Display on */
+#define DISPLAY_CMD_CASET  0x2Au /* Column address set */
+#define DISPLAY_CMD_RASET  0x2Bu /* Row address set */
+#define DISPLAY_CMD_RAMWR  0x2Cu /* Memory write */
+#define DISPLAY_CMD_MADCTL 0x36u /* Memory data access control */
+#define DISPLAY_CMD_COLMOD 0x3Au /* Interface pixel format */
+
+#define DISPLAY_SWAP(c) ((uint16_t)(((uint32_t)(c) >> 8) | (((uint32_t)(c) & 0xFFu) << 8)))
+
+/**
+ * @brief Rendered glyph
+ */
+typedef struct
+{
+    uint16_t px[DISPLAY_FONT_W * DISPLAY_FONT_H]; /**< Character cell, byte swapped */
+    uint16_t fg;                                  /**< Text color */
+    uint16_t bg;                                  /**< Background color */
+    char ch;                                      /**< Character, 0 if the entry is empty */
+} DISPLAY_GLYPH;
+
+/**
+ * @brief Window of the screen
+ */
+typedef struct
+{
+    uint32_t x;           /**< Left [px] */
+    uint32_t y;           /**< Top [px] */
+    uint32_t w;           /**< Width [px] */
+    uint32_t h;           /**< Height [px] */
+    const uint16_t* data; /**< Pixels, framebuffer or staging buffer */
+} DISPLAY_WINDOW;
+
+/**
+ * @brief Operational data of the display
+ */
+typedef struct
+{
+    CORO coro;                                 /**< Frame coroutine, first member */
+    const DISPLAY_HW* hw;                      /**< Hardware */
+    void (*draw)(void);                        /**< Page callback */
+    uint8_t dirty[DISPLAY_TILE_ROWS];          /**< Dirty tiles, one bit per tile column */
+    uint32_t cursor;                           /**< Tile row the flush continues at */
+    uint32_t buf;                              /**< Staging buffer of the next partial window */
+    DISPLAY_WINDOW win;                        /**< Window being prepared */
+    volatile bool staged_ok;                   /**< Result of the staging transfer */
+    volatile bool sent_ok;                     /**< Result of the pixel transfer */
+    bool sending;                              /**< Pixel transfer running */
+    bool running;                              /**< Panel initialized */
+    uint32_t frame_time;                       /**< Start of the frame */
+    uint32_t sleep_ms;                         /**< Rest of the frame period */
+    uint32_t flush_start;                      /**< Cycle counter at a step of the flush */
+    DISPLAY_GLYPH glyphs[DISPLAY_GLYPH_CACHE]; /**< Glyph cache, direct mapped */
+    uint32_t frames;                           /**< Frames */
+    uint32_t overruns;                         /**< Frames over the budget */
+    uint32_t draw_cycles;                      /**< Last frame: page callback */
+    uint32_t flush_cycles;                     /**< Last frame: CPU time of the flush */
+    uint32_t flush_ms;                         /**< Last frame: duration of the flush */
+    uint32_t max_flush_ms;                     /**< Longest flush */
+    uint32_t windows;                          /**< Last frame: windows sent */
+    uint32_t bytes;                            /**< Last frame: pixel bytes sent */
+    uint32_t glyph_hits;                       /**< Characters copied from the cache */
+    uint32_t glyph_misses;                     /**< Characters rendered from the font */
+    uint32_t errors;                           /**< Failed or timed out transfers */
+} DISPLAY_DATA;
+
+STATIC DISPLAY_DATA display;
+STATIC uint16_t display_fb[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+STATIC uint16_t display_staging[2][DISPLAY_STAGING];
+
+/***************************************************
+ * @brief 5x7 font, ASCII 32 .. 126, five columns per character, bit 0 is the top row
+ ***************************************************/
+static const uint8_t display_font[DISPLAY_FONT_LAST - DISPLAY_FONT_FIRST + 1u][5] = {
+    {0x00u, 0x00u, 0x00u, 0x00u, 0x00u}, /* ' ' */
+    {0x00u, 0x00u, 0x5Fu, 0x00u, 0x00u}, /* '!' */
+    {0x00u, 0x07u, 0x00u, 0x07u, 0x00u}, /* '"' */
+    {0x14u, 0x7Fu, 0x14u, 0x7Fu, 0x14u}, /* '#' */
+    {0x24u, 0x2Au, 0x7Fu, 0x2Au, 0x12u}, /* '$' */
+    {0x23u, 0x13u, 0x08u, 0x64u, 0x62u}, /* '%' */
+    {0x36u, 0x49u, 0x55u, 0x22u, 0x50u}, /* '&' */
+    {0x00u, 0x05u, 0x03u, 0x00u, 0x00u}, /* ''' */
+    {0x00u, 0x1Cu, 0x22u, 0x41u, 0x00u}, /* '(' */
+    {0x00u, 0x41u, 0x22u, 0x1Cu, 0x00u}, /* ')' */
+    {0x14u, 0x08u, 0x3Eu, 0x08u, 0x14u}, /* '*' */
+    {0x08u, 0x08u, 0x3Eu, 0x08u, 0x08u}, /* '+' */
+    {0x00u, 0x50u, 0x30u, 0x00u, 0x00u}, /* ',' */
+    {0x08u, 0x08u, 0x08u, 0x08u, 0x08u}, /* '-' */
+    {0x00u, 0x60u, 0x60u, 0x00u, 0x00u}, /* '.' */
+    {0x20u, 0x10u, 0x08u, 0x04u, 0x02u}, /* '/' */
+    {0x3Eu, 0x51u, 0x49u, 0x45u, 0x3Eu}, /* '0' */
+    {0x00u, 0x42u, 0x7Fu, 0x40u, 0x00u}, /* '1' */
+    {0x42u, 0x61u, 0x51u, 0x49u, 0x46u}, /* '2' */
+    {0x21u, 0x41u, 0x45u, 0x4Bu, 0x31u}, /* '3' */
+    {0x18u, 0x14u, 0x12u, 0x7Fu, 0x10u}, /* '4' */
+    {0x27u, 0x45u, 0x45u, 0x45u, 0x39u}, /* '5' */
+    {0x3Cu, 0x4Au, 0x49u, 0x49u, 0x30u}, /* '6' */
+    {0x01u, 0x71u, 0x09u, 0x05u, 0x03u}, /* '7' */
+    {0x36u, 0x49u, 0x49u, 0x49u, 0x36u}, /* '8' */
+    {0x06u, 0x49u, 0x49u, 0x29u, 0x1Eu}, /* '9' */
+    {0x00u, 0x36u, 0x36u, 0x00u, 0x00u}, /* ':' */
+    {0x00u, 0x56u, 0x36u, 0x00u, 0x00u}, /* ';' */
+    {0x08u, 0x14u, 0x22u, 0x41u, 0x00u}, /* '<' */
+    {0x14u, 0x14u, 0x14u, 0x14u, 0x14u}, /* '=' */
+    {0x00u, 0x41u, 0x22u, 0x14u, 0x08u}, /* '>' */
+    {0x02u, 0x01u, 0x51u, 0x09u, 0x06u}, /* '?' */
+    {0x32u, 0x49u, 0x79u, 0x41u, 0x3Eu}, /* '@' */
+    {0x7Eu, 0x11u, 0x11u, 0x11u, 0x7Eu}, /* 'A' */
+    {0x7Fu, 0x49u, 0x49u, 0x49u, 0x36u}, /* 'B' */
+    {0x3Eu, 0x41u, 0x41u, 0x41u, 0x22u}, /* 'C' */
+    {0x7Fu, 0x41u, 0x41u, 0x22u, 0x1Cu}, /* 'D' */
+    {0x7Fu, 0x49u, 0x49u, 0x49u, 0x41u}, /* 'E' */
+    {0x7Fu, 0x09u, 0x09u, 0x09u, 0x01u}, /* 'F' */
+    {0x3Eu, 0x41u, 0x49u, 0x49u, 0x7Au}, /* 'G' */
+    {0x7Fu, 0x08u, 0x08u, 0x08u, 0x7Fu}, /* 'H' */
+    {0x00u, 0x41u, 0x7Fu, 0x41u, 0x00u}, /* 'I' */
+    {0x20u, 0x40u, 0x41u, 0x3Fu, 0x01u}, /* 'J' */
+    {0x7Fu, 0x08u, 0x14u, 0x22u, 0x41u}, /* 'K' */
+    {0x7Fu, 0x40u, 0x40u, 0x40u, 0x40u}, /* 'L' */
+    {0x7Fu, 0x02u, 0x0Cu, 0x02u, 0x7Fu}, /* 'M' */
+    {0x7Fu, 0x04u, 0x08u, 0x10u, 0x7Fu}, /* 'N' */
+    {0x3Eu, 0x41u, 0x41u, 0x41u, 0x3Eu}, /* 'O' */
+    {0x7Fu, 0x09u, 0x09u, 0x09u, 0x06u}, /* 'P' */
+    {0x3Eu, 0x41u, 0x51u, 0x21u, 0x5Eu}, /* 'Q' */
+    {0x7Fu, 0x09u, 0x19u, 0x29u, 0x46u}, /* 'R' */
+    {0x46u, 0x49u, 0x49u, 0x49u, 0x31u}, /* 'S' */
+    {0x01u, 0x01u, 0x7Fu, 0x01u, 0x01u}, /* 'T' */
+    {0x3Fu, 0x40u, 0x40u, 0x40u, 0x3Fu}, /* 'U' */
+    {0x1Fu, 0x20u, 0x40u, 0x20u, 0x1Fu}, /* 'V' */
+    {0x3Fu, 0x40u, 0x38u, 0x40u, 0x3Fu}, /* 'W' */
+    {0x63u, 0x14u, 0x08u, 0x14u, 0x63u}, /* 'X' */
+    {0x07u, 0x08u, 0x70u, 0x08u, 0x07u}, /* 'Y' */
+    {0x61u, 0x51u, 0x49u, 0x45u, 0x43u}, /* 'Z' */
+    {0x00u, 0x7Fu, 0x41u, 0x41u, 0x00u}, /* '[' */
+    {0x02u, 0x04u, 0x08u, 0x10u, 0x20u}, /* '\' */
+    {0x00u, 0x41u, 0x41u, 0x7Fu, 0x00u}, /* ']' */
+    {0x04u, 0x02u, 0x01u, 0x02u, 0x04u}, /* '^' */
+    {0x40u, 0x40u, 0x40u, 0x40u, 0x40u}, /* '_' */
+    {0x00u, 0x01u, 0x02u, 0x04u, 0x00u}, /* '`' */
+    {0x20u, 0x54u, 0x54u, 0x54u, 0x78u}, /* 'a' */
+    {0x7Fu, 0x48u, 0x44u, 0x44u, 0x38u}, /* 'b' */
+    {0x38u, 0x44u, 0x44u, 0x44u, 0x20u}, /* 'c' */
+    {0x38u, 0x44u, 0x44u, 0x48u, 0x7Fu}, /* 'd' */
+    {0x38u, 0x54u, 0x54u, 0x54u, 0x18u}, /* 'e' */
+    {0x08u, 0x7Eu, 0x09u, 0x01u, 0x02u}, /* 'f' */
+    {0x0Cu, 0x52u, 0x52u, 0x52u, 0x3Eu}, /* 'g' */
+    {0x7Fu, 0x08u, 0x04u, 0x04u, 0x78u}, /* 'h' */
+    {0x00u, 0x44u, 0x7Du, 0x40u, 0x00u}, /* 'i' */
+    {0x20u, 0x40u, 0x44u, 0x3Du, 0x00u}, /* 'j' */
+    {0x7Fu, 0x10u, 0x28u, 0x44u, 0x00u}, /* 'k' */
+    {0x00u, 0x41u, 0x7Fu, 0x40u, 0x00u}, /* 'l' */
+    {0x7Cu, 0x04u, 0x18u, 0x04u, 0x78u}, /* 'm' */
+    {0x7Cu, 0x08u, 0x04u, 0x04u, 0x78u}, /* 'n' */
+    {0x38u, 0x44u, 0x44u, 0x44u, 0x38u}, /* 'o' */
+    {0x7Cu, 0x14u, 0x14u, 0x14u, 0x08u}, /* 'p' */
+    {0x08u, 0x14u, 0x14u, 0x18u, 0x7Cu}, /* 'q' */
+    {0x7Cu, 0x08u, 0x04u, 0x04u, 0x08u}, /* 'r' */
+    {0x48u, 0x54u, 0x54u, 0x54u, 0x20u}, /* 's' */
+    {0x04u, 0x3Fu, 0x44u, 0x40u, 0x20u}, /* 't' */
+    {0x3Cu, 0x40u, 0x40u, 0x20u, 0x7Cu}, /* 'u' */
+    {0x1Cu, 0x20u, 0x40u, 0x20u, 0x1Cu}, /* 'v' */
+    {0x3Cu, 0x40u, 0x30u, 0x40u, 0x3Cu}, /* 'w' */
+    {0x44u, 0x28u, 0x10u, 0x28u, 0x44u}, /* 'x' */
+    {0x0Cu, 0x50u, 0x50u, 0x50u, 0x3Cu}, /* 'y' */
+    {0x44u, 0x64u, 0x54u, 0x4Cu, 0x44u}, /* 'z' */
+    {0x00u, 0x08u, 0x36u, 0x41u, 0x00u}, /* '{' */
+    {0x00u, 0x00u, 0x7Fu, 0x00u, 0x00u}, /* '|' */
+    {0x00u, 0x41u, 0x36u, 0x08u, 0x00u}, /* '}' */
+    {0x08u, 0x04u, 0x08u, 0x10u, 0x08u}, /* '~' */
+};
+
+/***************************************************
+ * @brief Mark the tiles of a rectangle dirty, the rectangle is inside the screen
+ * @param x Left [px]
+ * @param y Top [px]
+ * @param w Width [px], > 0
+ * @param h Height [px], > 0
+ ***************************************************/
+STATIC void display_mark(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    const uint32_t col0 = x / DISPLAY_TILE_W;
+    const uint32_t col1 = (x + w - 1u) / DISPLAY_TILE_W;
+    const uint8_t bits = (uint8_t)(((1u << (col1 + 1u)) - 1u) & ~((1u << col0) - 1u));
+
+    for (uint32_t row = y / DISPLAY_TILE_H; row <= ((y + h - 1u) / DISPLAY_TILE_H); row++)
+    {
+        display.dirty[row] |= bits;
+    }
+}
+
+/***************************************************
+ * @brief Send a command with its parameters, blocking
+ * @param cmd Command
+ * @param data Parameters
+ * @param len Number of parameters
+ * @return true if sent
+ ***************************************************/
+STATIC bool display_command(uint8_t cmd, const uint8_t* data, uint16_t len)
+{
+    const DISPLAY_HW* hw = display.hw;
+    bool ok;
+
+    HAL_GPIO_WritePin(hw->dc_port, hw->dc_pin, GPIO_PIN_RESET);
+    ok = (HAL_SPI_Transmit(hw->hspi, &cmd, 1u, DISPLAY_SPI_TIMEOUT) == HAL_OK);
+    HAL_GPIO_WritePin(hw->dc_port, hw->dc_pin, GPIO_PIN_SET);
+    if (ok && (len > 0u))
+    {
+        ok = (HAL_SPI_Transmit(hw->hspi, data, len, DISPLAY_SPI_TIMEOUT) == HAL_OK);
+    }
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Completion callback of the staging transfer
+ * @param arg Not used
+ * @param ok Result of the transfer
+ ***************************************************/
+STATIC void display_staged(void* arg, bool ok)
+{
+    UNUSED(arg);
+    display.staged_ok = ok;
+    coro_post_event(&display.coro, DISPLAY_EV_STAGED);
+}
+
+/***************************************************
+ * @brief Take the next dirty window from the tile rows at the cursor and clear its tiles
+ * @return false if no tile is dirty
+ ***************************************************/
+STATIC bool display_next_window(void)
+{
+    DISPLAY_WINDOW* win = &display.win;
+
+    while ((display.cursor < DISPLAY_TILE_ROWS) && (display.dirty[display.cursor] == 0u))
+    {
+        display.cursor++;
+    }
+
+    const bool found = (display.cursor < DISPLAY_TILE_ROWS);
+    if (found && (display.dirty[display.cursor] == DISPLAY_TILE_ALL))
+    {
+        /* Complete tile rows are contiguous in the framebuffer */
+        const uint32_t first = display.cursor;
+        while ((display.cursor < DISPLAY_TILE_ROWS) && (display.dirty[display.cursor] == DISPLAY_TILE_ALL))
+        {
+            display.dirty[display.cursor] = 0u;
+            display.cursor++;
+        }
+        win->x = 0u;
+        win->y = first * DISPLAY_TILE_H;
+        win->w = DISPLAY_WIDTH;
+        win->h = (display.cursor - first) * DISPLAY_TILE_H;
+    }
+    else if (found)
+    {
+        const uint8_t bits = display.dirty[display.cursor];
+        uint32_t col0 = 0u;
+        uint32_t col1;
+
+        while ((bits & (1u << col0)) == 0u)
+        {
+            col0++;
+        }
+        col1 = col0;
+        while (((col1 + 1u) < DISPLAY_TILE_COLS) && ((bits & (1u << (col1 + 1u))) != 0u))
+        {
+            col1++;
+        }
+        display.dirty[display.cursor] &= (uint8_t)~(((1u << (col1 + 1u)) - 1u) & ~((1u << col0) - 1u));
+        win->x = col0 * DISPLAY_TILE_W;
+        win->y = display.cursor * DISPLAY_TILE_H;
+        win->w = (col1 - col0 + 1u) * DISPLAY_TILE_W;
+        win->h = DISPLAY_TILE_H;
+    }
+    else
+    {
+        // Do nothing, all tiles sent
+    }
+
+    return found;
+}
+
+/***************************************************
+ * @brief Prepare the pixels of the window, posts DISPLAY_EV_STAGED when they are ready
+ ***************************************************/
+STATIC void display_stage(void)
+{
+    DISPLAY_WINDOW* win = &display.win;
+
+    if (win->w == DISPLAY_WIDTH)
+    {
+        win->data = &display_fb[win->y * DISPLAY_WIDTH];
+        display_staged(NULL, true);
+    }
+    else
+    {
+        MEMDMA_ITEM items[DISPLAY_TILE_H];
+        uint16_t* staging = display_staging[display.buf];
+
+        for (uint32_t r = 0u; r < win->h; r++)
+        {
+            items[r].dst = &staging[r * win->w];
+            items[r].src = &display_fb[((win->y + r) * DISPLAY_WIDTH) + win->x];
+            items[r].len = win->w * sizeof(uint16_t);
+        }
+        win->data = staging;
+        display.buf ^= 1u;
+        if (!memdma_gather(items, win->h, display_staged, NULL))
+        {
+            display_staged(NULL, false);
+        }
+    }
+}
+
+/***************************************************
+ * @brief Set the address window of the panel and start the pixel transfer, posts DISPLAY_EV_SENT when done
+ * @return true if started
+ ***************************************************/
+STATIC bool display_send(void)
+{
+    const DISPLAY_WINDOW* win = &display.win;
+    const uint32_t x1 = win->x + win->w - 1u;
+    const uint32_t y1 = win->y + win->h - 1u;
+    const uint8_t caset[4] = {(uint8_t)(win->x >> 8), (uint8_t)win->x, (uint8_t)(x1 >> 8), (uint8_t)x1};
+    const uint8_t raset[4] = {(uint8_t)(win->y >> 8), (uint8_t)win->y, (uint8_t)(y1 >> 8), (uint8_t)y1};
+    const uint16_t len = (uint16_t)(win->w * win->h * sizeof(uint16_t));
+    bool ok;
+
+    ok = display_command(DISPLAY_CMD_CASET, caset, sizeof(caset)) && display_command(DISPLAY_CMD_RASET, raset, sizeof(raset)) && display_command(DISPLAY_CMD_RAMWR, NULL, 0u);
+    if (ok)
+    {
+        display.sent_ok = false;
+        ok = (HAL_SPI_Transmit_DMA(display.hw->hspi, (const uint8_t*)win->data, len) == HAL_OK);
+    }
+    if (ok)
+    {
+        display.sending = true;
+        display.windows++;
+        display.bytes += len;
+    }
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Abort a failed flush, the whole screen is sent again with the next frame
+ ***************************************************/
+STATIC void display_abort(void)
+{
+    (void)HAL_SPI_Abort(display.hw->hspi);
+    display.sending = false;
+    display.errors++;
+    display_invalidate();
+}
+
+/***************************************************
+ * @brief Frame coroutine: initializes the panel, then draws and flushes a frame every DISPLAY_PERIOD
+ * @param c Control block, first member of DISPLAY_DATA
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE display_coro(CORO* c)
+{
+    static const uint8_t colmod = 0x05u; /* 16 bit per pixel */
+    static const uint8_t madctl = DISPLAY_MADCTL;
+
+    CORO_BEGIN(c);
+    HAL_GPIO_WritePin(display.hw->rst_port, display.hw->rst_pin, GPIO_PIN_RESET);
+    CORO_SLEEP(c, 10u);
+    HAL_GPIO_WritePin(display.hw->rst_port, display.hw->rst_pin, GPIO_PIN_SET);
+    CORO_SLEEP(c, 120u);
+    display.running = display_command(DISPLAY_CMD_SLPOUT, NULL, 0u);
+    CORO_SLEEP(c, 120u);
+    display.running = display.running && display_command(DISPLAY_CMD_COLMOD, &colmod, 1u) && display_command(DISPLAY_CMD_MADCTL, &madctl, 1u) && display_command(DISPLAY_CMD_DISPON, NULL, 0u);
+    if (!display.running)
+    {
+        printf("Display not started, no answer on SPI\r\n");
+    }
+
+    while (display.running)
+    {
+        timer_reset_module_timer(&display.frame_time);
+        display.flush_start = bench_get_cycles();
+        if (display.draw != NULL)
+        {
+            display.draw();
+        }
+        display.draw_cycles = bench_get_cycles() - display.flush_start;
+        display.flush_cycles = 0u;
+        display.windows = 0u;
+        display.bytes = 0u;
+        display.cursor = 0u;
+
+        display.flush_start = bench_get_cycles();
+        while (display_next_window())
+        {
+            display_stage();
+            display.flush_cycles += bench_get_cycles() - display.flush_start;
+            CORO_WAIT_EVENT(c, DISPLAY_EV_STAGED, DISPLAY_DMA_TIMEOUT);
+            if ((coro_take_events(c, DISPLAY_EV_STAGED) == 0u) || !display.staged_ok)
+            {
+                display_abort();
+                break;
+            }
+            if (display.sending)
+            {
+                CORO_WAIT_EVENT(c, DISPLAY_EV_SENT, DISPLAY_DMA_TIMEOUT);
+                display.sending = false;
+                if ((coro_take_events(c, DISPLAY_EV_SENT) == 0u) || !display.sent_ok)
+                {
+                    display_abort();
+                    break;
+                }
+            }
+            display.flush_start = bench_get_cycles();
+            if (!display_send())
+            {
+                display_abort();
+                break;
+            }
+        }
+        display.flush_cycles += bench_get_cycles() - display.flush_start;
+        if (display.sending)
+        {
+            CORO_WAIT_EVENT(c, DISPLAY_EV_SENT, DISPLAY_DMA_TIMEOUT);
+            display.sending = false;
+            if ((coro_take_events(c, DISPLAY_EV_SENT) == 0u) || !display.sent_ok)
+            {
+                display_abort();
+            }
+        }
+
+        display.flush_ms = timer_get_elapsed_module_timer(display.frame_time);
+        display.max_flush_ms = (display.flush_ms > display.max_flush_ms) ? display.flush_ms : display.max_flush_ms;
+        display.overruns += (display.flush_ms > DISPLAY_PERIOD) ? 1u : 0u;
+        display.frames++;
+        display.sleep_ms = (display.flush_ms < DISPLAY_PERIOD) ? (DISPLAY_PERIOD - display.flush_ms) : 0u;
+        CORO_SLEEP(c, display.sleep_ms);
+    }
+    CORO_END(c);
+}
+
+/***************************************************
+ * @brief Render a glyph into a cache entry
+ * @param g Cache entry
+ * @param ch Character, DISPLAY_FONT_FIRST .. DISPLAY_FONT_LAST
+ * @param fg Text color, byte swapped
+ * @param bg Background color, byte swapped
+ ***************************************************/
+STATIC void display_render(DISPLAY_GLYPH* g, char ch, uint16_t fg, uint16_t bg)
+{
+    const uint8_t* cols = display_font[(uint8_t)ch - DISPLAY_FONT_FIRST];
+
+    for (uint32_t r = 0u; r < DISPLAY_FONT_H; r++)
+    {
+        for (uint32_t col = 0u; col < DISPLAY_FONT_W; col++)
+        {
+            const bool on = (col < 5u) && ((cols[col] & (1u << r)) != 0u);
+            g->px[(r * DISPLAY_FONT_W) + col] = on ? fg : bg;
+        }
+    }
+    g->ch = ch;
+    g->fg = fg;
+    g->bg = bg;
+}
+
+/***************************************************
+ * @brief Copy a glyph into the framebuffer, the cell is inside the screen
+ * @param x Left [px]
+ * @param y Top [px]
+ * @param ch Character, DISPLAY_FONT_FIRST .. DISPLAY_FONT_LAST
+ * @param fg Text color, byte swapped
+ * @param bg Background color, byte swapped
+ * @return true if a pixel changed
+ ***************************************************/
+STATIC bool display_glyph(uint32_t x, uint32_t y, char ch, uint16_t fg, uint16_t bg)
+{
+    DISPLAY_GLYPH* g = &display.glyphs[((uint32_t)(uint8_t)ch + fg + (3u * bg)) % DISPLAY_GLYPH_CACHE];
+    bool changed = false;
+
+    if ((g->ch == ch) && (g->fg == fg) && (g->bg == bg))
+    {
+        display.glyph_hits++;
+    }
+    else
+    {
+        display.glyph_misses++;
+        display_render(g, ch, fg, bg);
+    }
+
+    for (uint32_t r = 0u; r < DISPLAY_FONT_H; r++)
+    {
+        uint16_t* dst = &display_fb[((y + r) * DISPLAY_WIDTH) + x];
+        const uint16_t* src = &g->px[r * DISPLAY_FONT_W];
+
+        if (memcmp(dst, src, DISPLAY_FONT_W * sizeof(uint16_t)) != 0)
+        {
+            (void)memcpy(dst, src, DISPLAY_FONT_W * sizeof(uint16_t));
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool display_init(const DISPLAY_HW* hw, void (*draw)(void))
+{
+    GPIO_InitTypeDef gpio = {0};
+    SPI_HandleTypeDef* hspi = hw->hspi;
+    bool ok;
+
+    (void)memset(&display, 0, sizeof(display));
+    display.hw = hw;
+    display.draw = draw;
+    display.staged_ok = true;
+    display.sent_ok = true;
+
+    /* The panel takes 8 bit frames, CS stays low during a transfer */
+    hspi->Init.DataSize = SPI_DATASIZE_8BIT;
+    hspi->Init.BaudRatePrescaler = DISPLAY_SPI_PRESCALER;
+    hspi->Init.NSSPMode = SPI_NSS_PULSE_DISABLE;
+    ok = (HAL_SPI_Init(hspi) == HAL_OK);
+
+    if (ok)
+    {
+        HAL_GPIO_WritePin(hw->dc_port, hw->dc_pin, GPIO_PIN_SET);
+        HAL_GPIO_WritePin(hw->rst_port, hw->rst_pin, GPIO_PIN_SET);
+        gpio.Mode = GPIO_MODE_OUTPUT_PP;
+        gpio.Pull = GPIO_NOPULL;
+        gpio.Speed = GPIO_SPEED_FREQ_MEDIUM;
+        gpio.Pin = hw->dc_pin;
+        HAL_GPIO_Init(hw->dc_port, &gpio);
+        gpio.Pin = hw->rst_pin;
+        HAL_GPIO_Init(hw->rst_port, &gpio);
+
+        (void)memset(display_fb, 0, sizeof(display_fb));
+        display_invalidate();
+        coro_start(&display.coro, display_coro);
+    }
+
+    return ok;
+}
+
+void display_fill_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color)
+{
+    const uint16_t px = DISPLAY_SWAP(color);
+    bool changed = false;
+
+    if ((x < DISPLAY_WIDTH) && (y < DISPLAY_HEIGHT) && (w > 0u) && (h > 0u))
+    {
+        w = ((x + w) > DISPLAY_WIDTH) ? (DISPLAY_WIDTH - x) : w;
+        h = ((y + h) > DISPLAY_HEIGHT) ? (DISPLAY_HEIGHT - y) : h;
+        for (uint32_t r = y; r < (y + h); r++)
+        {
+            uint16_t* dst = &display_fb[(r * DISPLAY_WIDTH) + x];
+            for (uint32_t i = 0u; i < w; i++)
+            {
+                if (dst[i] != px)
+                {
+                    dst[i] = px;
+                    changed = true;
+                }
+            }
+        }
+        if (changed)
+        {
+            display_mark(x, y, w, h);
+        }
+    }
+}
+
+void display_text(uint32_t x, uint32_t y, const char* text, uint16_t fg, uint16_t bg, uint32_t scale)
+{
+    const uint32_t cell_w = DISPLAY_FONT_W * scale;
+    const uint32_t cell_h = DISPLAY_FONT_H * scale;
+
+    for (const char* p = text; (*p != '\0') && (scale >= 1u) && (scale <= 4u) && ((x + cell_w) <= DISPLAY_WIDTH) && ((y + cell_h) <= DISPLAY_HEIGHT); p++)
+    {
+        const char ch = (((uint8_t)*p >= DISPLAY_FONT_FIRST) && ((uint8_t)*p <= DISPLAY_FONT_LAST)) ? *p : '?';
+
+        if (scale == 1u)
+        {
+            if (display_glyph(x, y, ch, DISPLAY_SWAP(fg), DISPLAY_SWAP(bg)))
+            {
+                display_mark(x, y, cell_w, cell_h);
+            }
+        }
+        else
+        {
+            const uint8_t* cols = display_font[(uint8_t)ch - DISPLAY_FONT_FIRST];
+            for (uint32_t r = 0u; r < DISPLAY_FONT_H; r++)
+            {
+                for (uint32_t col = 0u; col < DISPLAY_FONT_W; col++)
+                {
+                    const bool on = (col < 5u) && ((cols[col] & (1u << r)) != 0u);
+                    display_fill_rect(x + (col * scale), y + (r * scale), scale, scale, on ? fg : bg);
+                }
+            }
+        }
+        x += cell_w;
+    }
+}
+
+void display_printf(uint32_t x, uint32_t y, uint16_t fg, uint16_t bg, const char* format, ...)
+{
+    char line[(DISPLAY_WIDTH / DISPLAY_FONT_W) + 1u];
+    va_list args;
+
+    va_start(args, format);
+    (void)vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    display_text(x, y, line, fg, bg, 1u);
+}
+
+void display_invalidate(void)
+{
+    (void)memset(display.dirty, (int)DISPLAY_TILE_ALL, sizeof(display.dirty));
+}
+
+void display_print(void)
+{
+    printf("Display: %lu frames, %lu over the budget of %lu ms, %lu errors%s\r\n", display.frames, display.overruns, (uint32_t)DISPLAY_PERIOD, display.errors,
+           display.running ? "" : ", not running");
+    printf("Last frame: draw %lu cycles, flush %lu cycles CPU, %lu ms (max %lu ms), %lu windows, %lu bytes\r\n", display.draw_cycles, display.flush_cycles, display.flush_ms,
+           display.max_flush_ms, display.windows, display.bytes);
+    printf("Glyph cache: %lu hits, %lu misses\r\n", display.glyph_hits, display.glyph_misses);
+}
+
+/***************************************************
+ * @brief SPI transmit complete callback of the HAL, end of a pixel transfer
+ * @param hspi SPI handle
+ ***************************************************/
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef* hspi)
+{
+    if ((display.hw != NULL) && (hspi == display.hw->hspi))
+    {
+        display.sent_ok = true;
+        coro_post_event(&display.coro, DISPLAY_EV_SENT);
+    }
+}
+
+/***************************************************
+ * @brief SPI error callback of the HAL, a pixel transfer failed
+ * @param hspi SPI handle
+ ***************************************************/
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi)
+{
+    if ((display.hw != NULL) && (hspi == display.hw->hspi))
+    {
+        display.sent_ok = false;
+        coro_post_event(&display.coro, DISPLAY_EV_SENT);
+    }
+}
@@ -0,0 +1,234 @@
+/**
+ * @file dli.c
+ * @author PL
+ * @brief Daily light integral (DLI) of the PAR sensor for lighting control
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup DLI
+ *
+ * A full day of 2000 umol/m2/s is 1.7e8 umol/m2, 1.1e13 in Q16.16, so the accumulator is 64 bit.
+ * The backup register holds the integral in whole umol/m2, a reset loses less than 1 umol/m2.
+ */
+#include "dli.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "rtc.h"
+
+#define DLI_UMOL_PER_MOL 1000000u /* umol in a mol */
+
+/**
+ * @brief Operational data of the light integral
+ */
+typedef struct
+{
+    uint64_t accum;          /**< Light integral of the day [umol/m2, Q16.16] */
+    uint32_t day;            /**< Day of the integral, days since 01/01/2000 */
+    uint32_t last_s;         /**< Epoch seconds of the last sample */
+    q16_t last_par;          /**< Last sample [umol/m2/s] */
+    bool has_last;           /**< last_s and last_par are valid */
+    uint32_t yesterday_umol; /**< Light integral of yesterday [umol/m2] */
+    uint32_t gaps;           /**< Intervals not integrated because they were too long */
+} DLI_DATA;
+
+STATIC DLI_DATA dli;
+
+/***************************************************
+ * @brief Light integral in whole umol/m2
+ * @param accum Light integral [umol/m2, Q16.16]
+ * @return Light integral [umol/m2], saturated to 32 bit
+ ***************************************************/
+STATIC uint32_t dli_to_umol(uint64_t accum)
+{
+    const uint64_t umol = accum >> 16u;
+
+    return (umol > UINT32_MAX) ? UINT32_MAX : (uint32_t)umol;
+}
+
+/***************************************************
+ * @brief Convert a light integral to mol/m2
+ * @param accum Light integral [umol/m2, Q16.16]
+ * @return Light integral [mol/m2]
+ ***************************************************/
+STATIC q16_t dli_to_mol(uint64_t accum)
+{
+    return (q16_t)(accum / DLI_UMOL_PER_MOL); /* < 32768 mol */
+}
+
+/***************************************************
+ * @brief Light integral still needed to reach the target
+ * @return Light integral [umol/m2, Q16.16], 0 if the target is reached
+ ***************************************************/
+STATIC uint64_t dli_missing(void)
+{
+    const q16_t t = config_get()->dli.target;
+    const uint64_t target = (uint64_t)((t > 0) ? t : 0) * DLI_UMOL_PER_MOL;
+
+    return (dli.accum < target) ? (target - dli.accum) : 0u;
+}
+
+/***************************************************
+ * @brief Integrate an interval with the mean of two samples
+ * @param par0 PAR at the start [umol/m2/s]
+ * @param par1 PAR at the end [umol/m2/s]
+ * @param dt Length of the interval [s]
+ ***************************************************/
+STATIC void dli_integrate(q16_t par0, q16_t par1, uint32_t dt)
+{
+    const uint64_t mean = ((uint64_t)(uint32_t)par0 + (uint32_t)par1) / 2u; /* both >= 0 */
+    dli.accum += mean * dt;
+}
+
+void dli_init(uint32_t now_s)
+{
+    const uint32_t today = now_s / DLI_SECONDS_PER_DAY;
+    uint32_t day;
+    uint32_t umol;
+
+    dli.day = today;
+    dli.accum = 0u;
+    dli.yesterday_umol = 0u;
+    dli.has_last = false;
+    dli.gaps = 0u;
+    if (rtc_get_dli_record(&day, &umol))
+    {
+        if (day == (today & 0xFFFFu))
+        {
+            dli.accum = (uint64_t)umol << 16u;
+        }
+        else if (day == ((today - 1u) & 0xFFFFu))
+        {
+            dli.yesterday_umol = umol;
+        }
+        else
+        {
+            // Do nothing
+        }
+    }
+}
+
+void dli_add_sample(uint32_t now_s, q16_t par)
+{
+    const q16_t p = (par > 0) ? par : 0;
+    const uint32_t today = now_s / DLI_SECONDS_PER_DAY;
+    const uint32_t dt = now_s - dli.last_s;
+    const bool integrate = dli.has_last && (now_s >= dli.last_s) && (dt <= DLI_MAX_GAP_S);
+
+    if (dli.has_last && !integrate)
+    {
+        dli.gaps++;
+    }
+
+    if (today != dli.day)
+    {
+        /* Close the day, the part of the interval before midnight belongs to it */
+        const uint32_t midnight = today * DLI_SECONDS_PER_DAY;
+        uint32_t dt_today = dt;
+        if (integrate && (dli.last_s < midnight))
+        {
+            dli_integrate(dli.last_par, p, midnight - dli.last_s);
+            dt_today = now_s - midnight;
+        }
+        dli.yesterday_umol = (today == (dli.day + 1u)) ? dli_to_umol(dli.accum) : 0u;
+        dli.accum = 0u;
+        dli.day = today;
+        if (integrate)
+        {
+            dli_integrate(dli.last_par, p, dt_today);
+        }
+    }
+    else if (integrate)
+    {
+        dli_integrate(dli.last_par, p, dt);
+    }
+    else
+    {
+        // Do nothing
+    }
+
+    dli.last_s = now_s;
+    dli.last_par = p;
+    dli.has_last = true;
+    rtc_set_dli_record(dli.day, dli_to_umol(dli.accum));
+}
+
+void dli_set_target(q16_t target)
+{
+    config_get()->dli.target = (target > 0) ? target : 0;
+}
+
+void dli_set_light_end(uint32_t second_of_day)
+{
+    config_get()->dli.light_end_s = second_of_day % DLI_SECONDS_PER_DAY;
+}
+
+q16_t dli_get_today(void)
+{
+    return dli_to_mol(dli.accum);
+}
+
+q16_t dli_get_yesterday(void)
+{
+    return dli_to_mol((uint64_t)dli.yesterday_umol << 16u);
+}
+
+uint32_t dli_get_remaining_s(q16_t par)
+{
+    const uint64_t missing = dli_missing();
+    uint32_t remaining;
+
+    if (missing == 0u)
+    {
+        remaining = 0u;
+    }
+    else if (par <= 0)
+    {
+        remaining = UINT32_MAX;
+    }
+    else
+    {
+        const uint64_t s = (missing + (uint32_t)par - 1u) / (uint32_t)par; /* rounded up */
+        remaining = (s > UINT32_MAX) ? UINT32_MAX : (uint32_t)s;
+    }
+
+    return remaining;
+}
+
+q16_t dli_get_required_par(uint32_t now_s)
+{
+    const uint64_t missing = dli_missing();
+    const uint32_t second_of_day = now_s % DLI_SECONDS_PER_DAY;
+    const uint32_t light_end_s = config_get()->dli.light_end_s;
+    q16_t required;
+
+    if (missing == 0u)
+    {
+        required = 0;
+    }
+    else if (second_of_day >= light_end_s)
+    {
+        required = FIX16_MAX;
+    }
+    else
+    {
+        const uint64_t par = missing / (light_end_s - second_of_day);
+        required = (par > (uint64_t)FIX16_MAX) ? FIX16_MAX : (q16_t)par;
+    }
+
+    return required;
+}
+
+void dli_print(uint32_t now_s)
+{
+    const q16_t today = dli_get_today();
+    const q16_t yesterday = dli_get_yesterday();
+    const q16_t required = dli_get_required_par(now_s);
+    const DLI_CONFIG* cfg = &config_get()->dli;
+
+    printf("DLI today %ld.%02ld mol/m2, target %ld.%02ld, yesterday %ld.%02ld\r\n", (int32_t)(today >> 16), (int32_t)(((today & 0xFFFF) * 100) >> 16),
+           (int32_t)(cfg->target >> 16), (int32_t)(((cfg->target & 0xFFFF) * 100) >> 16), (int32_t)(yesterday >> 16), (int32_t)(((yesterday & 0xFFFF) * 100) >> 16));
+    printf("Lights off at %02lu:%02lu, required PAR %ld umol/m2/s, gaps %lu\r\n", cfg->light_end_s / 3600u, (cfg->light_end_s / 60u) % 60u, (int32_t)(required >> 16),
+           dli.gaps);
+}
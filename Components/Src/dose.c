@@ -0,0 +1,255 @@
+/**
+ * @file dose.c
+ * @author PL
+ * @brief Dose planner: reservoir volume estimate and feed-forward of the EC and pH dosing loops
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup DOSE
+ *
+ * The delivered doses are taken from the outputs of the loops, so the planner needs no feedback from
+ * the pumps. Between the level readings the volume follows the learned rate.
+ */
+#include "dose.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "coroutine.h"
+#include "handoff.h"
+#include "pid.h"
+#include "timer.h"
+
+/**
+ * @brief Plan of a channel
+ */
+typedef struct
+{
+    float inflight; /**< Dosed stock not yet seen by the sensor [mL] */
+    float expected; /**< Process value after the dose in flight is mixed */
+    float dose;     /**< Planned dose [mL] */
+} DOSE_PLAN;
+
+/**
+ * @brief Operational data of the planner
+ */
+typedef struct
+{
+    CORO coro;                      /**< Planner coroutine, first member */
+    bool valid;                     /**< A level was read, the volume is known */
+    float volume;                   /**< Estimated volume [mL] */
+    float rate;                     /**< Estimated rate of the volume, evaporation and uptake [mL/s] */
+    uint32_t level_time;            /**< Time of the last level reading [ms] */
+    DOSE_PLAN plans[DOSE_CHANNELS]; /**< Plans of the channels */
+} DOSE_DATA;
+
+STATIC DOSE_DATA dose;
+
+/***************************************************
+ * @brief Loops fed by the channels
+ ***************************************************/
+static const PID_LOOP dose_loops[DOSE_CHANNELS] = {PID_LOOP_EC, PID_LOOP_PH};
+
+/***************************************************
+ * @brief Process value after the dose in flight is mixed
+ * @param channel Channel
+ * @param cfg Reservoir and stock solutions
+ * @param pv Measured process value
+ * @param inflight Dose in flight [mL]
+ * @return Expected process value
+ ***************************************************/
+STATIC float dose_expected(DOSE_CHANNEL channel, const DOSE_CONFIG* cfg, float pv, float inflight)
+{
+    float expected = pv;
+
+    if (channel == DOSE_EC)
+    {
+        expected += (inflight * (cfg->ec_stock - pv)) / (dose.volume + inflight);
+    }
+    else if (cfg->ph_slope > 0.0f)
+    {
+        expected -= inflight / ((dose.volume * 0.001f) * cfg->ph_slope);
+    }
+    else
+    {
+        // Do nothing
+    }
+
+    return expected;
+}
+
+/***************************************************
+ * @brief Update the plan and the feed-forward of a channel
+ * @param channel Channel
+ * @param cfg Reservoir and stock solutions
+ * @param dt Time since the last update [s]
+ ***************************************************/
+STATIC void dose_update(DOSE_CHANNEL channel, const DOSE_CONFIG* cfg, float dt)
+{
+    DOSE_PLAN* p = &dose.plans[channel];
+    const PID_LOOP loop = dose_loops[channel];
+    const PID_IO* io = pid_get_io(loop);
+    float ff = 0.0f;
+
+    p->inflight -= p->inflight * ((cfg->mix_s > dt) ? (dt / cfg->mix_s) : 1.0f);
+    p->dose = 0.0f;
+
+    if ((io != NULL) && pid_is_enabled(loop))
+    {
+        const float delivered = (pid_get_output(loop) * 0.01f) * (cfg->pump_ml_min[channel] / 60.0f) * dt;
+
+        p->inflight += delivered;
+        dose.volume += delivered;
+
+        if (dose.valid && (dose.volume > 0.0f) && (cfg->pump_ml_min[channel] > 0.0f) && (cfg->horizon_s > 0.0f))
+        {
+            p->expected = dose_expected(channel, cfg, io->read(), p->inflight);
+            p->dose = dose_plan(channel, cfg, dose.volume, p->expected, pid_get_setpoint(loop));
+            ff = ((p->dose / cfg->horizon_s) * 60.0f * 100.0f) / cfg->pump_ml_min[channel]; /* mL/s to % of the pump */
+        }
+    }
+
+    pid_set_feedforward(loop, ff);
+}
+
+/***************************************************
+ * @brief Planner coroutine, one update every DOSE_PERIOD
+ * @param c Control block, first member of DOSE_DATA
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE dose_coro(CORO* c)
+{
+    const DOSE_CONFIG* cfg = &config_get()->dose;
+    const float dt = (float)DOSE_PERIOD * 0.001f;
+
+    CORO_BEGIN(c);
+    CORO_SLEEP(c, DOSE_PERIOD);
+    if (dose.valid)
+    {
+        dose.volume += dose.rate * dt;
+        if (dose.volume < 0.0f)
+        {
+            dose.volume = 0.0f;
+        }
+    }
+    for (uint32_t i = 0u; i < DOSE_CHANNELS; i++)
+    {
+        dose_update((DOSE_CHANNEL)i, cfg, dt);
+    }
+    CORO_RESTART(c);
+    CORO_END(c);
+}
+
+void dose_init(void)
+{
+    const HANDOFF_DATA* h = handoff_get();
+
+    dose.valid = false;
+    dose.volume = 0.0f;
+    dose.rate = 0.0f;
+    if ((h != NULL) && h->dose.valid)
+    {
+        dose.valid = true;
+        dose.volume = h->dose.volume;
+        dose.rate = h->dose.rate;
+        for (uint32_t i = 0u; i < DOSE_CHANNELS; i++)
+        {
+            dose.plans[i].inflight = h->dose.inflight[i];
+        }
+        timer_reset_module_timer(&dose.level_time);
+    }
+    coro_start(&dose.coro, dose_coro);
+}
+
+void dose_handoff_save(DOSE_HANDOFF* h)
+{
+    h->valid = dose.valid;
+    h->volume = dose.volume;
+    h->rate = dose.rate;
+    for (uint32_t i = 0u; i < DOSE_CHANNELS; i++)
+    {
+        h->inflight[i] = dose.plans[i].inflight;
+    }
+}
+
+void dose_level(float level_mm)
+{
+    const float measured = (level_mm * config_get()->dose.area_cm2) * 0.1f; /* mm * cm2 = 0.1 mL */
+
+    if (dose.valid)
+    {
+        const float innovation = measured - dose.volume;
+        const float dt = (float)timer_get_elapsed_module_timer(dose.level_time) * 0.001f;
+
+        dose.volume += DOSE_LEVEL_ALPHA * innovation;
+        if (dt > 0.0f)
+        {
+            dose.rate += (DOSE_LEVEL_BETA * innovation) / dt;
+        }
+    }
+    else
+    {
+        dose.volume = measured;
+        dose.rate = 0.0f;
+        dose.valid = true;
+    }
+    timer_reset_module_timer(&dose.level_time);
+}
+
+void dose_flow(float ml)
+{
+    dose.volume += ml;
+    if (dose.volume < 0.0f)
+    {
+        dose.volume = 0.0f;
+    }
+}
+
+float dose_get_volume(void)
+{
+    return dose.valid ? dose.volume : 0.0f;
+}
+
+float dose_plan(DOSE_CHANNEL channel, const DOSE_CONFIG* cfg, float volume_ml, float pv, float setpoint)
+{
+    float ml = 0.0f;
+
+    if ((channel == DOSE_EC) && (pv < setpoint) && (cfg->ec_stock > setpoint))
+    {
+        ml = (volume_ml * (setpoint - pv)) / (cfg->ec_stock - setpoint);
+    }
+    else if ((channel == DOSE_PH) && (pv > setpoint))
+    {
+        ml = (volume_ml * 0.001f) * (pv - setpoint) * cfg->ph_slope;
+    }
+    else
+    {
+        // Do nothing
+    }
+
+    return ml;
+}
+
+void dose_print(void)
+{
+    static const char* const names[DOSE_CHANNELS] = {"EC", "pH"};
+
+    printf("Volume ");
+    pid_print_float(dose.volume * 0.001f);
+    printf(" L, rate ");
+    pid_print_float(dose.rate * 3.6f); /* mL/s to L/h */
+    printf(" L/h%s\r\n", dose.valid ? "" : ", no level reading");
+    for (uint32_t i = 0u; i < DOSE_CHANNELS; i++)
+    {
+        const DOSE_PLAN* p = &dose.plans[i];
+
+        printf("%s: in flight ", names[i]);
+        pid_print_float(p->inflight);
+        printf(" mL, expected ");
+        pid_print_float(p->expected);
+        printf(", planned ");
+        pid_print_float(p->dose);
+        printf(" mL\r\n");
+    }
+}
@@ -0,0 +1,587 @@
+/**
+ * @file dsp.c
+ * @author PL
+ * @brief Fixed point block processing kernels (FIR, biquad, decimation, dot product, RMS)
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup DSP
+ *
+ * Two Q15 values are loaded with one 32 bit access (unaligned access is allowed on the Cortex-M33)
+ * and multiplied-accumulated with one SMLALD.
+ */
+#include "dsp.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "stm32_hal.h"
+
+#if (defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1))
+#define DSP_USE_SIMD
+#endif
+
+#define DSP_CHECK_LEN      64u         /* Number of samples used by dsp_check() */
+#define DSP_CHECK_TAPS     32u         /* Number of FIR taps used by dsp_check() */
+#define DSP_CHECK_STAGES   2u          /* Number of biquad stages used by dsp_check() */
+#define DSP_CHECK_DECIM    4u          /* Decimation factor used by dsp_check() */
+#define DSP_CHECK_SEED     0x12345678u /* Seed of the test signal */
+#define DSP_BIQUAD_SHIFT   14u         /* Q2.14 coefficients */
+#define DSP_BIQUAD_SHIFT31 30u         /* Q2.30 coefficients */
+
+/***************************************************
+ * @brief Multiply-accumulate kernel used by the FIR filters
+ ***************************************************/
+typedef int64_t (*DSP_MAC_Q15)(const q15_t* a, const q15_t* b, uint32_t n);
+
+/***************************************************
+ * @brief Sum of products, portable version
+ * @param a First vector
+ * @param b Second vector
+ * @param n Length of the vectors
+ * @return Sum of products in Q33.30
+ ***************************************************/
+STATIC int64_t dsp_mac_q15_ref(const q15_t* a, const q15_t* b, uint32_t n)
+{
+    int64_t acc = 0;
+    for (uint32_t i = 0u; i < n; i++)
+    {
+        acc += (int32_t)a[i] * (int32_t)b[i];
+    }
+    return acc;
+}
+
+#ifdef DSP_USE_SIMD
+/***************************************************
+ * @brief Read two Q15 values with one (unaligned) access
+ * @param p Pointer to the first value
+ * @return p[0] in the low and p[1] in the high half word
+ ***************************************************/
+STATIC uint32_t dsp_read_q15x2(const q15_t* p)
+{
+    uint32_t val;
+    (void)memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+/***************************************************
+ * @brief Sum of products, dual 16 bit MAC, 4 samples per iteration
+ * @param a First vector
+ * @param b Second vector
+ * @param n Length of the vectors
+ * @return Sum of products in Q33.30
+ ***************************************************/
+STATIC int64_t dsp_mac_q15(const q15_t* a, const q15_t* b, uint32_t n)
+{
+    uint64_t acc = 0u;
+    uint32_t k = n >> 2u;
+
+    while (k > 0u)
+    {
+        acc = __SMLALD(dsp_read_q15x2(a), dsp_read_q15x2(b), acc);
+        acc = __SMLALD(dsp_read_q15x2(&a[2]), dsp_read_q15x2(&b[2]), acc);
+        a = &a[4];
+        b = &b[4];
+        k--;
+    }
+    k = n & 3u;
+    while (k > 0u)
+    {
+        acc += (uint64_t)(int64_t)((int32_t)*a * (int32_t)*b);
+        a++;
+        b++;
+        k--;
+    }
+
+    return (int64_t)acc;
+}
+#else
+#define dsp_mac_q15 dsp_mac_q15_ref
+#endif /* DSP_USE_SIMD */
+
+/***************************************************
+ * @brief Run a Q15 FIR filter, the input is processed in chunks of the block size
+ * @param f Filter instance
+ * @param factor Decimation factor, 1 for no decimation
+ * @param in Input samples
+ * @param out Output samples
+ * @param n Number of samples, multiple of factor
+ * @param mac Multiply-accumulate kernel
+ ***************************************************/
+STATIC void dsp_fir_run_q15(DSP_FIR_Q15* f, uint32_t factor, const q15_t* in, q15_t* out, uint32_t n, DSP_MAC_Q15 mac)
+{
+    const uint32_t hist = f->num_taps - 1u;
+    const uint32_t max_chunk = f->block_size - (f->block_size % factor); /* keep the decimation phase over the chunks */
+
+    while ((n > 0u) && (max_chunk > 0u))
+    {
+        const uint32_t chunk = (n < max_chunk) ? n : max_chunk;
+
+        (void)memcpy(&f->state[hist], in, chunk * sizeof(q15_t));
+        for (uint32_t i = factor - 1u; i < chunk; i += factor)
+        {
+            *out = dsp_sat_q15(mac(f->coeffs, &f->state[i], f->num_taps) >> 15u);
+            out++;
+        }
+        (void)memmove(f->state, &f->state[chunk], hist * sizeof(q15_t));
+
+        in = &in[chunk];
+        n -= chunk;
+    }
+}
+
+q15_t dsp_sat_q15(int64_t val)
+{
+    q15_t res;
+
+    if (val > INT16_MAX)
+    {
+        res = INT16_MAX;
+    }
+    else if (val < INT16_MIN)
+    {
+        res = INT16_MIN;
+    }
+    else
+    {
+        res = (q15_t)val;
+    }
+
+    return res;
+}
+
+q31_t dsp_sat_q31(int64_t val)
+{
+    q31_t res;
+
+    if (val > INT32_MAX)
+    {
+        res = INT32_MAX;
+    }
+    else if (val < INT32_MIN)
+    {
+        res = INT32_MIN;
+    }
+    else
+    {
+        res = (q31_t)val;
+    }
+
+    return res;
+}
+
+uint32_t dsp_isqrt(uint32_t val)
+{
+    uint32_t res = 0u;
+    uint32_t bit = 1u << 30u;
+
+    while (bit > val)
+    {
+        bit >>= 2u;
+    }
+    while (bit != 0u)
+    {
+        if (val >= (res + bit))
+        {
+            val -= res + bit;
+            res = (res >> 1u) + bit;
+        }
+        else
+        {
+            res >>= 1u;
+        }
+        bit >>= 2u;
+    }
+
+    return res;
+}
+
+void dsp_fir_init_q15(DSP_FIR_Q15* f, const q15_t* coeffs, q15_t* state, uint32_t num_taps, uint32_t block_size)
+{
+    f->coeffs = coeffs;
+    f->state = state;
+    f->num_taps = num_taps;
+    f->block_size = block_size;
+    (void)memset(state, 0, (num_taps + block_size - 1u) * sizeof(q15_t));
+}
+
+void dsp_fir_q15(DSP_FIR_Q15* f, const q15_t* in, q15_t* out, uint32_t n)
+{
+    dsp_fir_run_q15(f, 1u, in, out, n, dsp_mac_q15);
+}
+
+void dsp_fir_q15_ref(DSP_FIR_Q15* f, const q15_t* in, q15_t* out, uint32_t n)
+{
+    dsp_fir_run_q15(f, 1u, in, out, n, dsp_mac_q15_ref);
+}
+
+void dsp_fir_decimate_q15(DSP_FIR_Q15* f, uint32_t factor, const q15_t* in, q15_t* out, uint32_t n)
+{
+    if (factor > 0u)
+    {
+        dsp_fir_run_q15(f, factor, in, out, n, dsp_mac_q15);
+    }
+}
+
+void dsp_fir_decimate_q15_ref(DSP_FIR_Q15* f, uint32_t factor, const q15_t* in, q15_t* out, uint32_t n)
+{
+    if (factor > 0u)
+    {
+        dsp_fir_run_q15(f, factor, in, out, n, dsp_mac_q15_ref);
+    }
+}
+
+void dsp_biquad_q15(DSP_BIQUAD_Q15* f, const q15_t* in, q15_t* out, uint32_t n)
+{
+#ifdef DSP_USE_SIMD
+    const q15_t* src = in;
+
+    for (uint32_t s = 0u; s < f->num_stages; s++)
+    {
+        const q15_t* c = &f->coeffs[s * DSP_BIQUAD_COEFFS];
+        q15_t* st = &f->state[s * DSP_BIQUAD_STATE];
+        const int32_t b0 = c[0];
+        const uint32_t b12 = dsp_read_q15x2(&c[1]);
+        const uint32_t a12 = dsp_read_q15x2(&c[3]);
+        uint32_t x12 = dsp_read_q15x2(&st[0]); /* x[n-1] low, x[n-2] high */
+        uint32_t y12 = dsp_read_q15x2(&st[2]); /* y[n-1] low, y[n-2] high */
+
+        for (uint32_t i = 0u; i < n; i++)
+        {
+            const int32_t x0 = src[i];
+            uint64_t acc = (uint64_t)(int64_t)(b0 * x0);
+            acc = __SMLALD(b12, x12, acc);
+            acc = __SMLALD(a12, y12, acc);
+            const q15_t y0 = dsp_sat_q15((int64_t)acc >> DSP_BIQUAD_SHIFT);
+            x12 = __PKHBT((uint32_t)x0, x12, 16);
+            y12 = __PKHBT((uint32_t)(int32_t)y0, y12, 16);
+            out[i] = y0;
+        }
+        (void)memcpy(&st[0], &x12, sizeof(x12));
+        (void)memcpy(&st[2], &y12, sizeof(y12));
+        src = out; /* the next stage filters the output of this stage */
+    }
+#else
+    dsp_biquad_q15_ref(f, in, out, n);
+#endif /* DSP_USE_SIMD */
+}
+
+void dsp_biquad_q15_ref(DSP_BIQUAD_Q15* f, const q15_t* in, q15_t* out, uint32_t n)
+{
+    const q15_t* src = in;
+
+    for (uint32_t s = 0u; s < f->num_stages; s++)
+    {
+        const q15_t* c = &f->coeffs[s * DSP_BIQUAD_COEFFS];
+        q15_t* st = &f->state[s * DSP_BIQUAD_STATE];
+
+        for (uint32_t i = 0u; i < n; i++)
+        {
+            const q15_t x0 = src[i];
+            int64_t acc = (int32_t)c[0] * (int32_t)x0;
+            acc += (int32_t)c[1] * (int32_t)st[0];
+            acc += (int32_t)c[2] * (int32_t)st[1];
+            acc += (int32_t)c[3] * (int32_t)st[2];
+            acc += (int32_t)c[4] * (int32_t)st[3];
+            const q15_t y0 = dsp_sat_q15(acc >> DSP_BIQUAD_SHIFT);
+            st[1] = st[0];
+            st[0] = x0;
+            st[3] = st[2];
+            st[2] = y0;
+            out[i] = y0;
+        }
+        src = out;
+    }
+}
+
+int64_t dsp_dot_q15(const q15_t* a, const q15_t* b, uint32_t n)
+{
+    return dsp_mac_q15(a, b, n);
+}
+
+int64_t dsp_dot_q15_ref(const q15_t* a, const q15_t* b, uint32_t n)
+{
+    return dsp_mac_q15_ref(a, b, n);
+}
+
+q15_t dsp_rms_q15(const q15_t* in, uint32_t n)
+{
+    q15_t rms = 0;
+
+    if (n > 0u)
+    {
+        const uint64_t mean = (uint64_t)dsp_mac_q15(in, in, n) / n; /* Q30, at most 2^30 */
+        const uint32_t root = dsp_isqrt((uint32_t)mean);
+        rms = (root > (uint32_t)INT16_MAX) ? INT16_MAX : (q15_t)root;
+    }
+
+    return rms;
+}
+
+q15_t dsp_rms_q15_ref(const q15_t* in, uint32_t n)
+{
+    q15_t rms = 0;
+
+    if (n > 0u)
+    {
+        const uint64_t mean = (uint64_t)dsp_mac_q15_ref(in, in, n) / n;
+        const uint32_t root = dsp_isqrt((uint32_t)mean);
+        rms = (root > (uint32_t)INT16_MAX) ? INT16_MAX : (q15_t)root;
+    }
+
+    return rms;
+}
+
+void dsp_fir_init_q31(DSP_FIR_Q31* f, const q31_t* coeffs, q31_t* state, uint32_t num_taps, uint32_t block_size)
+{
+    f->coeffs = coeffs;
+    f->state = state;
+    f->num_taps = num_taps;
+    f->block_size = block_size;
+    (void)memset(state, 0, (num_taps + block_size - 1u) * sizeof(q31_t));
+}
+
+/* There is no SIMD for 32 bit data, the compiler generates SMLAL for the 64 bit accumulation */
+void dsp_fir_q31(DSP_FIR_Q31* f, const q31_t* in, q31_t* out, uint32_t n)
+{
+    const uint32_t hist = f->num_taps - 1u;
+
+    while ((n > 0u) && (f->block_size > 0u))
+    {
+        const uint32_t chunk = (n < f->block_size) ? n : f->block_size;
+
+        (void)memcpy(&f->state[hist], in, chunk * sizeof(q31_t));
+        for (uint32_t i = 0u; i < chunk; i++)
+        {
+            const q31_t* x = &f->state[i];
+            int64_t acc = 0; /* Q2.62, the sum of the absolute coefficients must be below 2 */
+            for (uint32_t k = 0u; k < f->num_taps; k++)
+            {
+                acc += (int64_t)f->coeffs[k] * x[k];
+            }
+            out[i] = dsp_sat_q31(acc >> 31u);
+        }
+        (void)memmove(f->state, &f->state[chunk], hist * sizeof(q31_t));
+
+        in = &in[chunk];
+        out = &out[chunk];
+        n -= chunk;
+    }
+}
+
+void dsp_biquad_q31(DSP_BIQUAD_Q31* f, const q31_t* in, q31_t* out, uint32_t n)
+{
+    const q31_t* src = in;
+
+    for (uint32_t s = 0u; s < f->num_stages; s++)
+    {
+        const q31_t* c = &f->coeffs[s * DSP_BIQUAD_COEFFS];
+        q31_t* st = &f->state[s * DSP_BIQUAD_STATE];
+        q31_t x1 = st[0];
+        q31_t x2 = st[1];
+        q31_t y1 = st[2];
+        q31_t y2 = st[3];
+
+        for (uint32_t i = 0u; i < n; i++)
+        {
+            const q31_t x0 = src[i];
+            int64_t acc = (int64_t)c[0] * x0; /* Q3.61, the input must be scaled to keep the sum below 4 */
+            acc += (int64_t)c[1] * x1;
+            acc += (int64_t)c[2] * x2;
+            acc += (int64_t)c[3] * y1;
+            acc += (int64_t)c[4] * y2;
+            const q31_t y0 = dsp_sat_q31(acc >> DSP_BIQUAD_SHIFT31);
+            x2 = x1;
+            x1 = x0;
+            y2 = y1;
+            y1 = y0;
+            out[i] = y0;
+        }
+        st[0] = x1;
+        st[1] = x2;
+        st[2] = y1;
+        st[3] = y2;
+        src = out;
+    }
+}
+
+int64_t dsp_dot_q31(const q31_t* a, const q31_t* b, uint32_t n)
+{
+    int64_t acc = 0;
+    for (uint32_t i = 0u; i < n; i++)
+    {
+        acc += ((int64_t)a[i] * b[i]) >> 14u;
+    }
+    return acc;
+}
+
+void dsp_goertzel_init(DSP_GOERTZEL* g, uint32_t freq_hz, uint32_t fs_hz)
+{
+    const float w = (6.2831853f * (float)freq_hz) / (float)fs_hz;
+    g->coeff = (int32_t)lrintf(2.0f * cosf(w) * 536870912.0f); /* Q2.29, calculated once with the FPU */
+    dsp_goertzel_reset(g);
+}
+
+void dsp_goertzel_reset(DSP_GOERTZEL* g)
+{
+    g->s1 = 0;
+    g->s2 = 0;
+}
+
+void dsp_goertzel_step(DSP_GOERTZEL* g, int32_t x)
+{
+    const int32_t s0 = x + (int32_t)(((int64_t)g->coeff * g->s1) >> 29u) - g->s2;
+    g->s2 = g->s1;
+    g->s1 = s0;
+}
+
+void dsp_goertzel_block_q15(DSP_GOERTZEL* g, const q15_t* in, uint32_t n)
+{
+    int32_t s1 = g->s1;
+    int32_t s2 = g->s2;
+
+    for (uint32_t i = 0u; i < n; i++)
+    {
+        const int32_t s0 = (int32_t)in[i] + (int32_t)(((int64_t)g->coeff * s1) >> 29u) - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+    g->s1 = s1;
+    g->s2 = s2;
+}
+
+uint64_t dsp_goertzel_power(int32_t coeff, int32_t s1, int32_t s2)
+{
+    /* |X|^2 = s1^2 + s2^2 - coeff * s1 * s2 */
+    const int64_t cross = (int64_t)(((int64_t)coeff * s1) >> 29u) * s2;
+    const int64_t power = ((int64_t)s1 * s1) + ((int64_t)s2 * s2) - cross;
+    return (power > 0) ? (uint64_t)power : 0u;
+}
+
+/***************************************************
+ * @brief Pseudo random test signal, includes full scale values to test the saturation
+ * @param buf Output buffer
+ * @param n Number of samples
+ ***************************************************/
+STATIC void dsp_check_signal(q15_t* buf, uint32_t n)
+{
+    uint32_t seed = DSP_CHECK_SEED;
+    for (uint32_t i = 0u; i < n; i++)
+    {
+        seed = (seed * 1664525u) + 1013904223u;
+        buf[i] = (q15_t)(int16_t)(seed >> 16u);
+    }
+    buf[0] = INT16_MIN;
+    buf[1] = INT16_MAX;
+}
+
+/***************************************************
+ * @brief Print the result of one kernel check
+ * @param name Name of the kernel
+ * @param cycles Cycles of the fast version
+ * @param ok Fast and reference result are equal
+ ***************************************************/
+STATIC void dsp_check_print(const char* name, uint32_t cycles, bool ok)
+{
+    printf("%-12s %4lu.%02lu cycles/sample %s\r\n", name, cycles / DSP_CHECK_LEN, ((cycles % DSP_CHECK_LEN) * 100u) / DSP_CHECK_LEN, ok ? "ok" : "MISMATCH");
+}
+
+bool dsp_check(void)
+{
+    static q15_t input[DSP_CHECK_LEN];
+    static q15_t out_fast[DSP_CHECK_LEN];
+    static q15_t out_ref[DSP_CHECK_LEN];
+    static q15_t fir_coeffs[DSP_CHECK_TAPS];
+    static q15_t state_fast[DSP_CHECK_TAPS + DSP_CHECK_LEN - 1u];
+    static q15_t state_ref[DSP_CHECK_TAPS + DSP_CHECK_LEN - 1u];
+    static const q15_t biquad_coeffs[DSP_CHECK_STAGES * DSP_BIQUAD_COEFFS] = {
+        1106, 2210, 1106, 18727, -6763, /* low pass fc = 0.1 fs */
+        1106, 2210, 1106, 18727, -6763,
+    };
+    static q15_t bq_state_fast[DSP_CHECK_STAGES * DSP_BIQUAD_STATE];
+    static q15_t bq_state_ref[DSP_CHECK_STAGES * DSP_BIQUAD_STATE];
+
+    DSP_FIR_Q15 fir_fast;
+    DSP_FIR_Q15 fir_ref;
+    bool all_ok = true;
+    bool ok;
+    uint32_t start;
+    uint32_t cycles;
+    const uint32_t old_primask = __get_PRIMASK();
+
+    dsp_check_signal(input, DSP_CHECK_LEN);
+    for (uint32_t k = 0u; k < DSP_CHECK_TAPS; k++)
+    {
+        const uint32_t tri = (k < (DSP_CHECK_TAPS / 2u)) ? (k + 1u) : (DSP_CHECK_TAPS - k);
+        fir_coeffs[k] = (q15_t)(tri * 120u); /* triangle, sum just below 1.0 */
+    }
+
+    (void)__disable_irq();
+
+    /* FIR */
+    dsp_fir_init_q15(&fir_fast, fir_coeffs, state_fast, DSP_CHECK_TAPS, DSP_CHECK_LEN);
+    dsp_fir_init_q15(&fir_ref, fir_coeffs, state_ref, DSP_CHECK_TAPS, DSP_CHECK_LEN);
+    start = bench_get_cycles();
+    dsp_fir_q15(&fir_fast, input, out_fast, DSP_CHECK_LEN);
+    cycles = bench_get_cycles() - start;
+    dsp_fir_q15_ref(&fir_ref, input, out_ref, DSP_CHECK_LEN);
+    ok = (memcmp(out_fast, out_ref, sizeof(out_fast)) == 0) && (memcmp(state_fast, state_ref, sizeof(state_fast)) == 0);
+    all_ok = all_ok && ok;
+    __set_PRIMASK(old_primask);
+    dsp_check_print("fir q15", cycles, ok);
+
+    /* FIR with decimation, cycles are per input sample */
+    (void)__disable_irq();
+    dsp_fir_init_q15(&fir_fast, fir_coeffs, state_fast, DSP_CHECK_TAPS, DSP_CHECK_LEN);
+    dsp_fir_init_q15(&fir_ref, fir_coeffs, state_ref, DSP_CHECK_TAPS, DSP_CHECK_LEN);
+    start = bench_get_cycles();
+    dsp_fir_decimate_q15(&fir_fast, DSP_CHECK_DECIM, input, out_fast, DSP_CHECK_LEN);
+    cycles = bench_get_cycles() - start;
+    dsp_fir_decimate_q15_ref(&fir_ref, DSP_CHECK_DECIM, input, out_ref, DSP_CHECK_LEN);
+    ok = memcmp(out_fast, out_ref, (DSP_CHECK_LEN / DSP_CHECK_DECIM) * sizeof(q15_t)) == 0;
+    all_ok = all_ok && ok;
+    __set_PRIMASK(old_primask);
+    dsp_check_print("decimate q15", cycles, ok);
+
+    /* Biquad */
+    DSP_BIQUAD_Q15 bq_fast = {biquad_coeffs, bq_state_fast, DSP_CHECK_STAGES};
+    DSP_BIQUAD_Q15 bq_ref = {biquad_coeffs, bq_state_ref, DSP_CHECK_STAGES};
+    (void)memset(bq_state_fast, 0, sizeof(bq_state_fast));
+    (void)memset(bq_state_ref, 0, sizeof(bq_state_ref));
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    dsp_biquad_q15(&bq_fast, input, out_fast, DSP_CHECK_LEN);
+    cycles = bench_get_cycles() - start;
+    dsp_biquad_q15_ref(&bq_ref, input, out_ref, DSP_CHECK_LEN);
+    ok = (memcmp(out_fast, out_ref, sizeof(out_fast)) == 0) && (memcmp(bq_state_fast, bq_state_ref, sizeof(bq_state_fast)) == 0);
+    all_ok = all_ok && ok;
+    __set_PRIMASK(old_primask);
+    dsp_check_print("biquad q15", cycles, ok);
+
+    /* Dot product */
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    const int64_t dot = dsp_dot_q15(input, out_ref, DSP_CHECK_LEN);
+    cycles = bench_get_cycles() - start;
+    ok = dot == dsp_dot_q15_ref(input, out_ref, DSP_CHECK_LEN);
+    all_ok = all_ok && ok;
+    __set_PRIMASK(old_primask);
+    dsp_check_print("dot q15", cycles, ok);
+
+    /* RMS */
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    const q15_t rms = dsp_rms_q15(input, DSP_CHECK_LEN);
+    cycles = bench_get_cycles() - start;
+    ok = rms == dsp_rms_q15_ref(input, DSP_CHECK_LEN);
+    all_ok = all_ok && ok;
+    __set_PRIMASK(old_primask);
+    dsp_check_print("rms q15", cycles, ok);
+
+#ifndef DSP_USE_SIMD
+    printf("No DSP extension, the reference versions are used\r\n");
+#endif
+    return all_ok;
+}
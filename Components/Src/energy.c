@@ -0,0 +1,523 @@
+/**
+ * @file energy.c
+ * @author PL
+ * @brief Energy metering of the supply rails with attribution to the actuators
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup ENERGY
+ *
+ * Fixed point: a block sums V * I in ADC counts (at most 35 bits), one count of the sum is
+ * uv_per_count * ua_per_count / ENERGY_SAMPLE_HZ picojoules. The interrupt multiplies the sum with
+ * the scale of the rail and divides by 10^6 * ENERGY_SAMPLE_HZ to microjoules, the scale is limited
+ * so the product fits in 64 bits. The interrupt takes about 10 cycles per rail and scan.
+ *
+ * An overrun or a DMA error shifts the channels in the buffer, the coroutine restarts the regular
+ * conversions and the DMA at the start of the buffer then.
+ */
+#include "energy.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "coroutine.h"
+#include "snapshot.h"
+#include "timer.h"
+
+#define ENERGY_DMA_CHANNEL     GPDMA1_Channel5      /* DMA channel writing the scan buffer */
+#define ENERGY_DMA_IRQn        GPDMA1_Channel5_IRQn /* Interrupt of the DMA channel */
+#define ENERGY_IRQ_PRIO        6u                   /* Priority of the DMA interrupt */
+#define ENERGY_TIM_HZ          1000000u             /* Counter clock of the sampling timer [Hz] */
+#define ENERGY_ADC_MAX         16383u               /* Full scale of the 14-bit ADC */
+#define ENERGY_EV_BLOCK        0x0001u              /* Coroutine event: a block is integrated */
+#define ENERGY_EV_RESYNC       0x0002u              /* Coroutine event: overrun or DMA error, restart the scans */
+#define ENERGY_NO_DATA_TIMEOUT 500u                 /* No block within this time [ms]: the scans stopped */
+#define ENERGY_UJ_PER_MWH      3600000u             /* Microjoules per milliwatt hour */
+#define ENERGY_DEN             ((uint64_t)1000000u * ENERGY_SAMPLE_HZ)
+#define ENERGY_SCALE_MAX       (UINT64_MAX / 2u / ((uint64_t)ENERGY_BLOCK_SCANS * ENERGY_ADC_MAX * ENERGY_ADC_MAX))
+#define ENERGY_BUF_SAMPLES     (2u * ENERGY_BLOCK_SCANS * 2u * ENERGY_MAX_RAILS)
+
+/**
+ * @brief Block of the interrupt, published through the snapshot store
+ */
+typedef struct
+{
+    uint64_t uj[ENERGY_MAX_RAILS];       /**< Energy since the start [uJ] */
+    uint32_t block_uj[ENERGY_MAX_RAILS]; /**< Energy of the block [uJ] */
+    uint32_t v_sum[ENERGY_MAX_RAILS];    /**< Sum of the voltage samples of the block [counts] */
+    uint32_t i_sum[ENERGY_MAX_RAILS];    /**< Sum of the current samples of the block [counts] */
+    uint32_t isr_cycles;                 /**< CPU cycles spent in the interrupt */
+} ENERGY_FRAME;
+
+/**
+ * @brief Operational data of the energy meter
+ */
+typedef struct
+{
+    CORO coro;                             /**< Attribution coroutine, first member */
+    ADC_HandleTypeDef* hadc;               /**< ADC scanning the rails */
+    TIM_HandleTypeDef* htim;               /**< Timer triggering the scans */
+    DMA_HandleTypeDef hdma;                /**< DMA channel writing the buffer */
+    DMA_QListTypeDef queue;                /**< Linked list queue of the DMA channel */
+    DMA_NodeTypeDef node;                  /**< Single node of the queue, circular */
+    const ENERGY_RAIL* rails;              /**< Rails */
+    uint32_t num_rails;                    /**< Number of rails */
+    const ENERGY_ACTUATOR* actuators;      /**< Actuators */
+    uint32_t num_actuators;                /**< Number of actuators */
+    uint64_t scale[ENERGY_MAX_RAILS];      /**< uv_per_count * ua_per_count of the rails */
+    uint64_t uj[ENERGY_MAX_RAILS];         /**< Energy since the start [uJ], used by the interrupt */
+    uint64_t rem[ENERGY_MAX_RAILS];        /**< Remainder of the conversion to uJ, used by the interrupt */
+    uint32_t isr_cycles;                   /**< Interrupt cycles of the running block */
+    SNAPSHOT frames;                       /**< Blocks, written by the interrupt */
+    ENERGY_FRAME frame_buf[2];             /**< Buffers of the snapshot store */
+    ENERGY_FRAME last;                     /**< Last block read by the coroutine */
+    uint64_t seen_uj[ENERGY_MAX_RAILS];    /**< Energy of the rails attributed so far [uJ] */
+    uint64_t base_uj[ENERGY_MAX_RAILS];    /**< Energy of the rails at the last reset [uJ] */
+    uint64_t idle_uj[ENERGY_MAX_RAILS];    /**< Energy of the rails without an active actuator [uJ] */
+    uint64_t act_uj[ENERGY_MAX_ACTUATORS]; /**< Energy of the actuators [uJ] */
+    uint32_t log_time;                     /**< Time of the last log line [ms] */
+    bool running;                          /**< Scans started */
+    uint32_t overruns;                     /**< ADC overruns */
+    uint32_t dma_errors;                   /**< DMA errors */
+    uint32_t restarts;                     /**< Restarts of the scans */
+    uint32_t timeouts;                     /**< Missing blocks */
+} ENERGY_DATA;
+
+STATIC ENERGY_DATA energy;
+STATIC uint16_t energy_buf[ENERGY_BUF_SAMPLES] __attribute__((aligned(4)));
+
+/***************************************************
+ * @brief Sequencer ranks of ADC1, the rank values are not consecutive
+ ***************************************************/
+static const uint32_t energy_ranks[2u * ENERGY_MAX_RAILS] = {ADC_REGULAR_RANK_1, ADC_REGULAR_RANK_2, ADC_REGULAR_RANK_3, ADC_REGULAR_RANK_4,
+                                                             ADC_REGULAR_RANK_5, ADC_REGULAR_RANK_6, ADC_REGULAR_RANK_7, ADC_REGULAR_RANK_8};
+
+/***************************************************
+ * @brief Integrate a half buffer, called by the DMA interrupt
+ * @param scans First scan of the half buffer
+ ***************************************************/
+STATIC void energy_block(const uint16_t* scans)
+{
+    const uint32_t scan_len = 2u * energy.num_rails;
+    ENERGY_FRAME* f = snapshot_begin(&energy.frames);
+
+    for (uint32_t r = 0u; r < energy.num_rails; r++)
+    {
+        const uint16_t* s = &scans[2u * r];
+        uint64_t vi = 0u;
+        uint32_t v_sum = 0u;
+        uint32_t i_sum = 0u;
+
+        for (uint32_t k = 0u; k < ENERGY_BLOCK_SCANS; k++)
+        {
+            const uint32_t v = s[0];
+            const uint32_t i = s[1];
+            vi += v * i;
+            v_sum += v;
+            i_sum += i;
+            s += scan_len;
+        }
+
+        const uint64_t num = (vi * energy.scale[r]) + energy.rem[r];
+        const uint64_t uj = num / ENERGY_DEN;
+        energy.rem[r] = num - (uj * ENERGY_DEN);
+        energy.uj[r] += uj;
+        f->uj[r] = energy.uj[r];
+        f->block_uj[r] = (uint32_t)uj;
+        f->v_sum[r] = v_sum;
+        f->i_sum[r] = i_sum;
+    }
+    f->isr_cycles = energy.isr_cycles;
+    snapshot_publish(&energy.frames);
+    coro_post_event(&energy.coro, ENERGY_EV_BLOCK);
+    energy.isr_cycles = 0u;
+}
+
+/***************************************************
+ * @brief Start the DMA and the regular conversions at the start of the buffer
+ * @return true if started, false if ADC1 is not enabled
+ ***************************************************/
+STATIC bool energy_start(void)
+{
+    ADC_TypeDef* adc = energy.hadc->Instance;
+    bool ok = (LL_ADC_IsEnabled(adc) != 0u);
+
+    ok = ok && (HAL_DMAEx_List_Start_IT(&energy.hdma) == HAL_OK);
+    if (ok)
+    {
+        __HAL_DMA_ENABLE_IT(&energy.hdma, DMA_IT_HT | DMA_IT_TC);
+        adc->ISR = ADC_ISR_OVR;
+        adc->IER |= ADC_IER_OVRIE;
+        LL_ADC_REG_StartConversion(adc);
+    }
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Stop the regular conversions and the DMA, restart at the start of the buffer
+ * The injected conversions of the pump monitor keep running.
+ ***************************************************/
+STATIC void energy_restart(void)
+{
+    ADC_TypeDef* adc = energy.hadc->Instance;
+
+    if (LL_ADC_REG_IsConversionOngoing(adc) != 0u)
+    {
+        LL_ADC_REG_StopConversion(adc);
+        while (LL_ADC_REG_IsStopConversionOngoing(adc) != 0u)
+        {
+            // Wait, at most one conversion
+        }
+    }
+    (void)HAL_DMA_Abort(&energy.hdma);
+    energy.running = energy_start();
+    energy.restarts++;
+}
+
+/***************************************************
+ * @brief Attribute the energy since the last block to the active actuators
+ * @param f Block
+ ***************************************************/
+STATIC void energy_attribute(const ENERGY_FRAME* f)
+{
+    for (uint32_t r = 0u; r < energy.num_rails; r++)
+    {
+        const uint64_t delta = f->uj[r] - energy.seen_uj[r];
+        uint32_t active = 0u;
+        uint32_t n = 0u;
+
+        energy.seen_uj[r] = f->uj[r];
+        for (uint32_t a = 0u; a < energy.num_actuators; a++)
+        {
+            const ENERGY_ACTUATOR* act = &energy.actuators[a];
+
+            if ((act->rail == r) && ((act->is_active == NULL) || act->is_active()))
+            {
+                active |= (1u << a);
+                n++;
+            }
+        }
+
+        if (n == 0u)
+        {
+            energy.idle_uj[r] += delta;
+        }
+        else
+        {
+            uint64_t rest = delta % n; /* to the first active actuator, the sum stays exact */
+
+            for (uint32_t a = 0u; a < energy.num_actuators; a++)
+            {
+                if ((active & (1u << a)) != 0u)
+                {
+                    energy.act_uj[a] += (delta / n) + rest;
+                    rest = 0u;
+                }
+            }
+        }
+    }
+}
+
+/***************************************************
+ * @brief Convert an energy to milliwatt hours
+ * @param uj Energy [uJ]
+ * @return Energy [mWh]
+ ***************************************************/
+STATIC uint32_t energy_to_mwh(uint64_t uj)
+{
+    return (uint32_t)(uj / ENERGY_UJ_PER_MWH);
+}
+
+/***************************************************
+ * @brief Print the energy log line: energy of the rails and the actuators since the last reset
+ ***************************************************/
+STATIC void energy_log(void)
+{
+    printf("Energy log:");
+    for (uint32_t r = 0u; r < energy.num_rails; r++)
+    {
+        const uint32_t mwh = energy_to_mwh(energy.seen_uj[r] - energy.base_uj[r]);
+        printf(" %s %lu.%03lu Wh", energy.rails[r].name, mwh / 1000u, mwh % 1000u);
+    }
+    for (uint32_t a = 0u; a < energy.num_actuators; a++)
+    {
+        const uint32_t mwh = energy_to_mwh(energy.act_uj[a]);
+        printf(", %s %lu.%03lu Wh", energy.actuators[a].name, mwh / 1000u, mwh % 1000u);
+    }
+    printf("\r\n");
+}
+
+/***************************************************
+ * @brief Attribution coroutine, waits for the blocks of the interrupt
+ * @param c Control block, first member of ENERGY_DATA
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE energy_coro(CORO* c)
+{
+    CORO_BEGIN(c);
+    /* The pump monitor has calibrated and enabled ADC1 by now */
+    energy.running = (HAL_TIM_Base_Start(energy.htim) == HAL_OK) && energy_start();
+    if (!energy.running)
+    {
+        printf("Energy meter not started, ADC1 is not enabled\r\n");
+    }
+    timer_reset_module_timer(&energy.log_time);
+    while (energy.running)
+    {
+        CORO_WAIT_EVENT(c, ENERGY_EV_BLOCK | ENERGY_EV_RESYNC, ENERGY_NO_DATA_TIMEOUT);
+
+        const uint16_t events = coro_take_events(c, ENERGY_EV_BLOCK | ENERGY_EV_RESYNC);
+        if ((events & ENERGY_EV_BLOCK) != 0u)
+        {
+            if (snapshot_read(&energy.frames, &energy.last, NULL))
+            {
+                energy_attribute(&energy.last);
+            }
+        }
+        if (((events & ENERGY_EV_RESYNC) != 0u) || (events == 0u))
+        {
+            energy.timeouts += (events == 0u) ? 1u : 0u;
+            energy_restart();
+            if (!energy.running)
+            {
+                printf("Energy meter stopped, scans not restarted\r\n");
+            }
+        }
+        if (timer_get_elapsed_module_timer(energy.log_time) >= ENERGY_LOG_PERIOD)
+        {
+            timer_reset_module_timer(&energy.log_time);
+            energy_log();
+        }
+    }
+    CORO_END(c);
+}
+
+/***************************************************
+ * @brief Configure the DMA channel as circular buffer with half and full transfer interrupts
+ * @return true if configured
+ ***************************************************/
+STATIC bool energy_dma_init(void)
+{
+    DMA_NodeConfTypeDef node_conf = {0};
+    bool ok;
+
+    (void)memset(&energy.queue, 0, sizeof(energy.queue));
+    (void)memset(&energy.node, 0, sizeof(energy.node));
+    energy.hdma.Instance = ENERGY_DMA_CHANNEL;
+    energy.hdma.InitLinkedList.Priority = DMA_LOW_PRIORITY_HIGH_WEIGHT;
+    energy.hdma.InitLinkedList.LinkStepMode = DMA_LSM_FULL_EXECUTION;
+    energy.hdma.InitLinkedList.LinkAllocatedPort = DMA_LINK_ALLOCATED_PORT0;
+    energy.hdma.InitLinkedList.TransferEventMode = DMA_TCEM_LAST_LL_ITEM_TRANSFER;
+    energy.hdma.InitLinkedList.LinkedListMode = DMA_LINKEDLIST_CIRCULAR;
+    ok = (HAL_DMAEx_List_Init(&energy.hdma) == HAL_OK);
+
+    node_conf.NodeType = DMA_GPDMA_LINEAR_NODE;
+    node_conf.Init.Request = GPDMA1_REQUEST_ADC1;
+    node_conf.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    node_conf.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    node_conf.Init.SrcInc = DMA_SINC_FIXED;
+    node_conf.Init.DestInc = DMA_DINC_INCREMENTED;
+    node_conf.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_HALFWORD;
+    node_conf.Init.DestDataWidth = DMA_DEST_DATAWIDTH_HALFWORD;
+    node_conf.Init.SrcBurstLength = 1u;
+    node_conf.Init.DestBurstLength = 1u;
+    node_conf.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT0;
+    node_conf.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    node_conf.TriggerConfig.TriggerPolarity = DMA_TRIG_POLARITY_MASKED;
+    node_conf.DataHandlingConfig.DataExchange = DMA_EXCHANGE_NONE;
+    node_conf.DataHandlingConfig.DataAlignment = DMA_DATA_RIGHTALIGN_ZEROPADDED;
+    node_conf.SrcAddress = (uint32_t)&energy.hadc->Instance->DR;
+    node_conf.DstAddress = (uint32_t)energy_buf;
+    node_conf.DataSize = 2u * ENERGY_BLOCK_SCANS * 2u * energy.num_rails * sizeof(uint16_t);
+    ok = ok && (HAL_DMAEx_List_BuildNode(&node_conf, &energy.node) == HAL_OK);
+    ok = ok && (HAL_DMAEx_List_InsertNode_Tail(&energy.queue, &energy.node) == HAL_OK);
+    ok = ok && (HAL_DMAEx_List_SetCircularMode(&energy.queue) == HAL_OK);
+    ok = ok && (HAL_DMAEx_List_LinkQ(&energy.hdma, &energy.queue) == HAL_OK);
+    ok = ok && (HAL_DMA_ConfigChannelAttributes(&energy.hdma, DMA_CHANNEL_NPRIV) == HAL_OK);
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Configure the regular scan of the rails, triggered by the timer, the DMA is circular
+ * @return true if configured
+ ***************************************************/
+STATIC bool energy_adc_init(void)
+{
+    ADC_HandleTypeDef* hadc = energy.hadc;
+    bool ok;
+
+    hadc->Init.ScanConvMode = ADC_SCAN_ENABLE;
+    hadc->Init.NbrOfConversion = 2u * energy.num_rails;
+    hadc->Init.EOCSelection = ADC_EOC_SEQ_CONV;
+    hadc->Init.ExternalTrigConv = ADC_EXTERNALTRIG_T6_TRGO;
+    hadc->Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+    hadc->Init.ContinuousConvMode = DISABLE;
+    hadc->Init.ConversionDataManagement = ADC_CONVERSIONDATA_DMA_CIRCULAR;
+    hadc->Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
+    ok = (HAL_ADC_Init(hadc) == HAL_OK);
+
+    ADC_ChannelConfTypeDef ch = {0};
+    ch.SamplingTime = ADC_SAMPLETIME_20CYCLES;
+    ch.SingleDiff = ADC_SINGLE_ENDED;
+    ch.OffsetNumber = ADC_OFFSET_NONE;
+    for (uint32_t r = 0u; r < energy.num_rails; r++)
+    {
+        ch.Channel = energy.rails[r].v_channel;
+        ch.Rank = energy_ranks[2u * r];
+        ok = ok && (HAL_ADC_ConfigChannel(hadc, &ch) == HAL_OK);
+        ch.Channel = energy.rails[r].i_channel; /* next rank: V and I of a rail are sampled back to back */
+        ch.Rank = energy_ranks[(2u * r) + 1u];
+        ok = ok && (HAL_ADC_ConfigChannel(hadc, &ch) == HAL_OK);
+    }
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Configure the timer to trigger the scans at ENERGY_SAMPLE_HZ
+ * @return true if configured
+ ***************************************************/
+STATIC bool energy_tim_init(void)
+{
+    TIM_HandleTypeDef* htim = energy.htim;
+    TIM_MasterConfigTypeDef master = {0};
+
+    /* The timer clock is twice PCLK1 when the APB1 prescaler is used */
+    uint32_t tim_clk = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR2 & RCC_CFGR2_PPRE1_2) != 0u)
+    {
+        tim_clk *= 2u;
+    }
+    htim->Init.Prescaler = (tim_clk / ENERGY_TIM_HZ) - 1u; /* 16-bit counter */
+    htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim->Init.Period = (ENERGY_TIM_HZ / ENERGY_SAMPLE_HZ) - 1u;
+    htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+    master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+    master.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+
+    return (HAL_TIM_Base_Init(htim) == HAL_OK) && (HAL_TIMEx_MasterConfigSynchronization(htim, &master) == HAL_OK);
+}
+
+bool energy_init(ADC_HandleTypeDef* hadc, TIM_HandleTypeDef* htim, const ENERGY_RAIL* rails, uint32_t num_rails, const ENERGY_ACTUATOR* actuators, uint32_t num_actuators)
+{
+    bool ok = (hadc->Instance == ADC1) && (htim->Instance == TIM6) && (num_rails > 0u) && (num_rails <= ENERGY_MAX_RAILS) && (num_actuators <= ENERGY_MAX_ACTUATORS);
+
+    for (uint32_t r = 0u; ok && (r < num_rails); r++)
+    {
+        ok = (((uint64_t)rails[r].uv_per_count * rails[r].ua_per_count) <= ENERGY_SCALE_MAX);
+    }
+    for (uint32_t a = 0u; ok && (a < num_actuators); a++)
+    {
+        ok = (actuators[a].rail < num_rails);
+    }
+
+    if (ok)
+    {
+        (void)memset(&energy, 0, sizeof(energy));
+        energy.hadc = hadc;
+        energy.htim = htim;
+        energy.rails = rails;
+        energy.num_rails = num_rails;
+        energy.actuators = actuators;
+        energy.num_actuators = num_actuators;
+        for (uint32_t r = 0u; r < num_rails; r++)
+        {
+            energy.scale[r] = (uint64_t)rails[r].uv_per_count * rails[r].ua_per_count;
+        }
+        snapshot_init(&energy.frames, energy.frame_buf, sizeof(ENERGY_FRAME));
+
+        ok = energy_tim_init() && energy_adc_init() && energy_dma_init();
+    }
+
+    if (ok)
+    {
+        HAL_NVIC_SetPriority(ENERGY_DMA_IRQn, ENERGY_IRQ_PRIO, 0u);
+        HAL_NVIC_EnableIRQ(ENERGY_DMA_IRQn);
+        coro_start(&energy.coro, energy_coro);
+    }
+
+    return ok;
+}
+
+void energy_reset(void)
+{
+    for (uint32_t r = 0u; r < energy.num_rails; r++)
+    {
+        energy.base_uj[r] = energy.seen_uj[r];
+        energy.idle_uj[r] = 0u;
+    }
+    for (uint32_t a = 0u; a < energy.num_actuators; a++)
+    {
+        energy.act_uj[a] = 0u;
+    }
+}
+
+void energy_adc_irq(void)
+{
+    ADC_TypeDef* adc = ADC1;
+
+    if (((adc->ISR & ADC_ISR_OVR) != 0u) && ((adc->IER & ADC_IER_OVRIE) != 0u))
+    {
+        adc->ISR = ADC_ISR_OVR; /* write 1 to clear */
+        energy.overruns++;
+        coro_post_event(&energy.coro, ENERGY_EV_RESYNC);
+    }
+}
+
+void energy_dma_irq(void)
+{
+    const uint32_t start = bench_get_cycles();
+    DMA_Channel_TypeDef* ch = energy.hdma.Instance;
+    const uint32_t half = ENERGY_BLOCK_SCANS * 2u * energy.num_rails;
+
+    if ((ch->CSR & DMA_FLAG_HT) != 0u)
+    {
+        ch->CFCR = DMA_FLAG_HT; /* write 1 to clear */
+        energy_block(&energy_buf[0]);
+    }
+    if ((ch->CSR & DMA_FLAG_TC) != 0u)
+    {
+        ch->CFCR = DMA_FLAG_TC;
+        energy_block(&energy_buf[half]);
+    }
+    if ((ch->CSR & (DMA_FLAG_DTE | DMA_FLAG_ULE | DMA_FLAG_USE)) != 0u)
+    {
+        energy.dma_errors++;
+        HAL_DMA_IRQHandler(&energy.hdma);
+        coro_post_event(&energy.coro, ENERGY_EV_RESYNC);
+    }
+
+    energy.isr_cycles += bench_get_cycles() - start;
+}
+
+void energy_print(void)
+{
+    const uint32_t load_ppm = (uint32_t)(((uint64_t)energy.last.isr_cycles * ENERGY_SAMPLE_HZ * 1000000u) / ((uint64_t)SystemCoreClock * ENERGY_BLOCK_SCANS));
+
+    printf("Energy meter %s, %lu Hz, CPU load %lu ppm\r\n", energy.running ? "running" : "stopped", (uint32_t)ENERGY_SAMPLE_HZ, load_ppm);
+    printf("Overruns %lu, DMA errors %lu, restarts %lu, missing blocks %lu\r\n", energy.overruns, energy.dma_errors, energy.restarts, energy.timeouts);
+    for (uint32_t r = 0u; r < energy.num_rails; r++)
+    {
+        const ENERGY_RAIL* rail = &energy.rails[r];
+        const uint32_t mv = (uint32_t)(((uint64_t)energy.last.v_sum[r] * rail->uv_per_count) / (ENERGY_BLOCK_SCANS * 1000u));
+        const uint32_t ma = (uint32_t)(((uint64_t)energy.last.i_sum[r] * rail->ua_per_count) / (ENERGY_BLOCK_SCANS * 1000u));
+        const uint32_t mw = (uint32_t)(((uint64_t)energy.last.block_uj[r] * ENERGY_SAMPLE_HZ) / (ENERGY_BLOCK_SCANS * 1000u));
+        const uint32_t mwh = energy_to_mwh(energy.seen_uj[r] - energy.base_uj[r]);
+        const uint32_t idle = energy_to_mwh(energy.idle_uj[r]);
+
+        printf("%s: %lu mV %lu mA %lu mW, %lu.%03lu Wh (idle %lu.%03lu Wh)\r\n", rail->name, mv, ma, mw, mwh / 1000u, mwh % 1000u, idle / 1000u, idle % 1000u);
+        for (uint32_t a = 0u; a < energy.num_actuators; a++)
+        {
+            if (energy.actuators[a].rail == r)
+            {
+                const uint32_t act = energy_to_mwh(energy.act_uj[a]);
+                printf("  %s: %lu.%03lu Wh\r\n", energy.actuators[a].name, act / 1000u, act % 1000u);
+            }
+        }
+    }
+    snapshot_print(&energy.frames, "energy blocks");
+}
@@ -0,0 +1,486 @@
+/**
+ * @file fan.c
+ * @author PL
+ * @brief Ventilation fans with 25 kHz PWM and tachometer speed control
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup FAN
+ *
+ * The tachometer counter clock is chosen so that FAN_STALL_MS fits in the counter (65 kHz for a
+ * 16 bit timer), which gives 650 counts per period at 3000 rpm. Only an overflow sets the update
+ * flag (URS), so a set update flag means there was no pulse for a full counter period. The first
+ * capture after an overflow measured the time since the overflow and is dropped.
+ */
+#include "fan.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "config.h"
+#include "coroutine.h"
+#include "pid.h"
+#include "timer.h"
+
+#define FAN_FULL_DUTY   100u /* Duty during the spin-up [%] */
+#define FAN_TACH_FILTER 0xFu /* Input filter of the tachometer against PWM crosstalk, 8 samples at fDTS / 32 */
+
+/**
+ * @brief Operational data of a fan
+ */
+typedef struct
+{
+    const FAN_HW* hw;     /**< Hardware, NULL if not initialized */
+    TIMER_PWM_HANDLE pwm; /**< PWM output */
+    FAN_STATE state;      /**< State */
+    bool closed_loop;     /**< Speed setpoint instead of a fixed duty */
+    uint8_t duty_set;     /**< Fixed duty [%] */
+    uint32_t target_rpm;  /**< Speed setpoint [rpm] */
+    uint8_t duty;         /**< Duty written to the PWM [%] */
+    float rpm;            /**< Filtered speed [rpm] */
+    PID_STATE pid;        /**< Speed controller */
+    uint32_t tach_hz;     /**< Counter clock of the tachometer timer [Hz] */
+    uint32_t stall_ticks; /**< Counter value of FAN_STALL_MS */
+    uint32_t timer;       /**< Start of the state [ms] */
+    uint32_t retries;     /**< Restarts since the fan was set or running stable */
+    uint32_t stalls;      /**< Stalls since the start */
+} FAN_DATA;
+
+/**
+ * @brief Operational data of the fan module
+ */
+typedef struct
+{
+    CORO coro;             /**< Control coroutine, first member */
+    FAN_DATA fan[FAN_MAX]; /**< Fans */
+    uint32_t cycles;       /**< CPU cycles of the last control pass of all fans */
+} FAN_MODULE;
+
+STATIC FAN_MODULE fans;
+
+/***************************************************
+ * @brief Names of the states, in the same order as FAN_STATE
+ ***************************************************/
+static const char* const fan_state_names[] = {"off", "spin-up", "running", "stalled", "fault"};
+
+/***************************************************
+ * @brief Get the counter clock of a timer, twice the APB clock when the APB prescaler is used
+ * @param tim Timer
+ * @return Clock [Hz]
+ ***************************************************/
+STATIC uint32_t fan_timer_clock(const TIM_TypeDef* tim)
+{
+    const bool apb2 = (tim == TIM1) || (tim == TIM8) || (tim == TIM15) || (tim == TIM16) || (tim == TIM17); //lint !e923 peripheral addresses
+    uint32_t clk = apb2 ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+
+    if ((RCC->CFGR2 & (apb2 ? RCC_CFGR2_PPRE2_2 : RCC_CFGR2_PPRE1_2)) != 0u)
+    {
+        clk *= 2u;
+    }
+
+    return clk;
+}
+
+/***************************************************
+ * @brief Initialize the PWM output, the timer is initialized by the first fan on it
+ * @param f Fan, hw is set
+ * @return true if configured
+ ***************************************************/
+STATIC bool fan_init_pwm(FAN_DATA* f)
+{
+    const FAN_HW* hw = f->hw;
+    TIM_HandleTypeDef* htim = hw->pwm_htim;
+    bool ok = true;
+
+    if (htim->State == HAL_TIM_STATE_RESET)
+    {
+        htim->Init.Prescaler = 0u;
+        htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+        htim->Init.Period = (fan_timer_clock(htim->Instance) / FAN_PWM_HZ) - 1u;
+        htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+        htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+        ok = (HAL_TIM_PWM_Init(htim) == HAL_OK);
+    }
+
+    TIM_OC_InitTypeDef oc = {0};
+    oc.OCMode = TIM_OCMODE_PWM1;
+    oc.Pulse = 0u; /* fan off */
+    oc.OCPolarity = TIM_OCPOLARITY_HIGH;
+    oc.OCFastMode = TIM_OCFAST_DISABLE;
+    ok = ok && (HAL_TIM_PWM_ConfigChannel(htim, &oc, hw->pwm_channel) == HAL_OK);
+
+    if (ok)
+    {
+        timer_pwm_set_pin(htim, hw->pwm_channel, hw->pwm_af, hw->pwm_port, hw->pwm_pin);
+        timer_pwm_init_pin(hw->pwm_port, hw->pwm_pin, GPIO_SPEED_FREQ_LOW);
+        f->pwm = timer_pwm_get_handle(hw->pwm_port, hw->pwm_pin);
+        timer_pwm_set_duty(f->pwm, 0u);
+        timer_pwm_handle_start(f->pwm);
+        ok = timer_get_status();
+    }
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Initialize the tachometer input: capture and counter reset on every falling edge
+ * @param f Fan
+ * @return true if configured
+ ***************************************************/
+STATIC bool fan_init_tach(FAN_DATA* f)
+{
+    const FAN_HW* hw = f->hw;
+    TIM_HandleTypeDef* htim = hw->tach_htim;
+    const uint32_t arr = IS_TIM_32B_COUNTER_INSTANCE(htim->Instance) ? 0xFFFFFFFFu : 0xFFFFu;
+    const uint32_t max_hz = (uint32_t)(((uint64_t)arr * 1000u) / FAN_STALL_MS);
+    const uint32_t clk = fan_timer_clock(htim->Instance);
+    const uint32_t tach_hz = (max_hz < FAN_TACH_HZ) ? max_hz : FAN_TACH_HZ;
+    const uint32_t prescaler = (clk + tach_hz - 1u) / tach_hz; /* rounded up, the clock stays below tach_hz */
+    bool ok = (htim->State == HAL_TIM_STATE_RESET) && ((hw->tach_channel == TIM_CHANNEL_1) || (hw->tach_channel == TIM_CHANNEL_2)) && (prescaler <= 0x10000u);
+
+    GPIO_InitTypeDef gpio = {0};
+    gpio.Pin = hw->tach_pin;
+    gpio.Mode = GPIO_MODE_AF_PP;
+    gpio.Pull = GPIO_PULLUP; /* open collector output of the fan */
+    gpio.Speed = GPIO_SPEED_FREQ_LOW;
+    gpio.Alternate = hw->tach_af;
+    HAL_GPIO_Init(hw->tach_port, &gpio);
+
+    if (ok)
+    {
+        htim->Init.Prescaler = prescaler - 1u;
+        htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+        htim->Init.Period = arr;
+        htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV4; /* slower filter sampling */
+        htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+        ok = (HAL_TIM_IC_Init(htim) == HAL_OK);
+    }
+
+    TIM_IC_InitTypeDef ic = {0};
+    ic.ICPolarity = TIM_INPUTCHANNELPOLARITY_FALLING;
+    ic.ICSelection = TIM_ICSELECTION_DIRECTTI;
+    ic.ICPrescaler = TIM_ICPSC_DIV1;
+    ic.ICFilter = FAN_TACH_FILTER;
+    ok = ok && (HAL_TIM_IC_ConfigChannel(htim, &ic, hw->tach_channel) == HAL_OK);
+
+    TIM_SlaveConfigTypeDef slave = {0};
+    slave.SlaveMode = TIM_SLAVEMODE_RESET;
+    slave.InputTrigger = (hw->tach_channel == TIM_CHANNEL_1) ? TIM_TS_TI1FP1 : TIM_TS_TI2FP2;
+    slave.TriggerPolarity = TIM_TRIGGERPOLARITY_FALLING;
+    slave.TriggerPrescaler = TIM_TRIGGERPRESCALER_DIV1;
+    slave.TriggerFilter = FAN_TACH_FILTER;
+    ok = ok && (HAL_TIM_SlaveConfigSynchro(htim, &slave) == HAL_OK);
+
+    if (ok)
+    {
+        __HAL_TIM_URS_ENABLE(htim); /* the reset by a pulse doesn't set the update flag, only an overflow does */
+        __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+        f->tach_hz = clk / prescaler;
+        f->stall_ticks = (uint32_t)(((uint64_t)f->tach_hz * FAN_STALL_MS) / 1000u);
+        ok = (HAL_TIM_IC_Start(htim, hw->tach_channel) == HAL_OK);
+    }
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Read the tachometer and update the filtered speed
+ * @param f Fan
+ * @return true if there was no pulse for FAN_STALL_MS
+ ***************************************************/
+STATIC bool fan_read_tach(FAN_DATA* f)
+{
+    TIM_HandleTypeDef* htim = f->hw->tach_htim;
+    const uint32_t cc_flag = (f->hw->tach_channel == TIM_CHANNEL_1) ? TIM_FLAG_CC1 : TIM_FLAG_CC2;
+    const bool overflow = (__HAL_TIM_GET_FLAG(htim, TIM_FLAG_UPDATE) != 0u);
+    const bool capture = (__HAL_TIM_GET_FLAG(htim, cc_flag) != 0u);
+    const uint32_t period = HAL_TIM_ReadCapturedValue(htim, f->hw->tach_channel); /* clears the capture flag */
+    bool silent;
+
+    if (overflow)
+    {
+        __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+        silent = !capture; /* a pulse after the overflow: restarting, the period is not valid */
+    }
+    else
+    {
+        silent = (__HAL_TIM_GET_COUNTER(htim) >= f->stall_ticks);
+        if (capture && (period > 0u))
+        {
+            const float rpm = (60.0f * (float)f->tach_hz) / ((float)period * (float)FAN_PULSES_PER_REV);
+            f->rpm += 0.25f * (rpm - f->rpm);
+        }
+    }
+
+    if (silent)
+    {
+        f->rpm = 0.0f;
+    }
+
+    return silent;
+}
+
+/***************************************************
+ * @brief Enter a state
+ * @param f Fan
+ * @param state New state
+ ***************************************************/
+STATIC void fan_set_state(FAN_DATA* f, FAN_STATE state)
+{
+    f->state = state;
+    timer_reset_module_timer(&f->timer);
+}
+
+/***************************************************
+ * @brief Handle a stall: off and restart later, or fault after FAN_RETRIES restarts
+ * @param f Fan
+ ***************************************************/
+STATIC void fan_stalled(FAN_DATA* f)
+{
+    f->stalls++;
+    f->retries++;
+    fan_set_state(f, (f->retries > FAN_RETRIES) ? FAN_FAULT : FAN_STALLED);
+    printf("Fan %s %s\r\n", f->hw->name, fan_state_names[f->state]);
+}
+
+/***************************************************
+ * @brief One control step of a fan
+ * @param f Fan
+ ***************************************************/
+STATIC void fan_control(FAN_DATA* f)
+{
+    const bool silent = fan_read_tach(f);
+    const uint32_t elapsed = timer_get_elapsed_module_timer(f->timer);
+    uint8_t duty = 0u;
+
+    switch (f->state)
+    {
+        case FAN_SPINUP:
+            duty = FAN_FULL_DUTY;
+            if (elapsed >= FAN_SPINUP_MS)
+            {
+                if (silent)
+                {
+                    fan_stalled(f);
+                    duty = 0u;
+                }
+                else
+                {
+                    /* Bumpless start of the speed loop from the duty of a linear fan, full speed now */
+                    const float estimate = (f->rpm > 0.0f) ? ((100.0f * (float)f->target_rpm) / f->rpm) : (float)FAN_FULL_DUTY;
+                    pid_reset(&f->pid);
+                    f->pid.integral = (estimate > (float)FAN_FULL_DUTY) ? (float)FAN_FULL_DUTY : estimate;
+                    fan_set_state(f, FAN_RUNNING);
+                }
+            }
+            break;
+
+        case FAN_RUNNING:
+            if (silent)
+            {
+                fan_stalled(f);
+            }
+            else if (f->closed_loop)
+            {
+                const float out = pid_step(&f->pid, &config_get()->fan, (float)f->target_rpm, f->rpm, (float)FAN_PERIOD * 0.001f, (float)FAN_MIN_DUTY, (float)FAN_FULL_DUTY);
+                duty = (uint8_t)(out + 0.5f);
+            }
+            else
+            {
+                duty = f->duty_set;
+            }
+            if (elapsed >= FAN_STABLE_MS)
+            {
+                f->retries = 0u;
+            }
+            break;
+
+        case FAN_STALLED:
+            if (elapsed >= FAN_RETRY_MS)
+            {
+                fan_set_state(f, FAN_SPINUP);
+                duty = FAN_FULL_DUTY;
+            }
+            break;
+
+        default:
+            // Do nothing, off or fault
+            break;
+    }
+
+    if (duty != f->duty)
+    {
+        f->duty = duty;
+        timer_pwm_set_duty(f->pwm, duty);
+    }
+}
+
+/***************************************************
+ * @brief Control coroutine, all fans every FAN_PERIOD
+ * @param c Control block
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE fan_coro(CORO* c)
+{
+    CORO_BEGIN(c);
+    CORO_SLEEP(c, FAN_PERIOD);
+    const uint32_t start = bench_get_cycles();
+    /* Fans on the same timer change their duty in the same PWM period */
+    for (uint32_t i = 0u; i < FAN_MAX; i++)
+    {
+        if (fans.fan[i].hw != NULL)
+        {
+            timer_pwm_batch_begin(fans.fan[i].hw->pwm_htim);
+        }
+    }
+    for (uint32_t i = 0u; i < FAN_MAX; i++)
+    {
+        if (fans.fan[i].hw != NULL)
+        {
+            fan_control(&fans.fan[i]);
+        }
+    }
+    for (uint32_t i = 0u; i < FAN_MAX; i++)
+    {
+        if (fans.fan[i].hw != NULL)
+        {
+            timer_pwm_batch_commit(fans.fan[i].hw->pwm_htim);
+        }
+    }
+    fans.cycles = bench_get_cycles() - start;
+    CORO_RESTART(c);
+    CORO_END(c);
+}
+
+/***************************************************
+ * @brief Start a fan, or keep it running when it is already running
+ * @param f Fan
+ ***************************************************/
+STATIC void fan_start(FAN_DATA* f)
+{
+    f->retries = 0u;
+    if (f->state != FAN_RUNNING)
+    {
+        fan_set_state(f, FAN_SPINUP);
+    }
+}
+
+/***************************************************
+ * @brief Get an initialized fan
+ * @param fan Fan
+ * @return Fan, NULL if it doesn't exist or is not initialized
+ ***************************************************/
+STATIC FAN_DATA* fan_get(uint32_t fan)
+{
+    return ((fan < FAN_MAX) && (fans.fan[fan].hw != NULL)) ? &fans.fan[fan] : NULL;
+}
+
+bool fan_init(uint32_t fan, const FAN_HW* hw)
+{
+    bool ok = (fan < FAN_MAX);
+
+    if (ok)
+    {
+        FAN_DATA* f = &fans.fan[fan];
+        f->state = FAN_OFF;
+        f->duty = 0u;
+        f->rpm = 0.0f;
+        f->stalls = 0u;
+        f->retries = 0u;
+
+        f->hw = hw;
+        ok = fan_init_pwm(f) && fan_init_tach(f);
+        if (!ok)
+        {
+            f->hw = NULL; /* not controlled */
+        }
+        coro_start(&fans.coro, fan_coro);
+    }
+
+    return ok;
+}
+
+void fan_set_duty(uint32_t fan, uint8_t duty)
+{
+    FAN_DATA* f = fan_get(fan);
+
+    if (f != NULL)
+    {
+        if (duty == 0u)
+        {
+            fan_set_state(f, FAN_OFF);
+        }
+        else
+        {
+            f->duty_set = (duty > FAN_FULL_DUTY) ? FAN_FULL_DUTY : duty;
+            f->closed_loop = false;
+            fan_start(f);
+        }
+    }
+}
+
+void fan_set_rpm(uint32_t fan, uint32_t rpm)
+{
+    FAN_DATA* f = fan_get(fan);
+
+    if (f != NULL)
+    {
+        if (rpm == 0u)
+        {
+            fan_set_state(f, FAN_OFF);
+        }
+        else
+        {
+            if (!f->closed_loop)
+            {
+                pid_reset(&f->pid);
+                f->pid.integral = (float)f->duty; /* bumpless from open loop */
+            }
+            f->target_rpm = rpm;
+            f->closed_loop = true;
+            fan_start(f);
+        }
+    }
+}
+
+uint32_t fan_get_rpm(uint32_t fan)
+{
+    const FAN_DATA* f = fan_get(fan);
+
+    return (f != NULL) ? (uint32_t)(f->rpm + 0.5f) : 0u;
+}
+
+FAN_STATE fan_get_state(uint32_t fan)
+{
+    const FAN_DATA* f = fan_get(fan);
+
+    return (f != NULL) ? f->state : FAN_OFF;
+}
+
+void fan_print(void)
+{
+    for (uint32_t i = 0u; i < FAN_MAX; i++)
+    {
+        const FAN_DATA* f = &fans.fan[i];
+
+        if (f->hw != NULL)
+        {
+            printf("Fan %lu %s: %s, duty %u %%, %lu rpm", i, f->hw->name, fan_state_names[f->state], f->duty, fan_get_rpm(i));
+            if (f->closed_loop)
+            {
+                printf(" (setpoint %lu rpm)", f->target_rpm);
+            }
+            else
+            {
+                printf(" (fixed %u %%)", f->duty_set);
+            }
+            printf(", %lu stalls, tach %lu Hz\r\n", f->stalls, f->tach_hz);
+        }
+        else
+        {
+            printf("Fan %lu: not initialized\r\n", i);
+        }
+    }
+    printf("Control pass: %lu cycles every %u ms\r\n", fans.cycles, FAN_PERIOD);
+}
@@ -0,0 +1,431 @@
+/**
+ * @file fixmath.c
+ * @author PL
+ * @brief Saturating fixed point math in Q16.16 and Q1.31 for sensor conversions
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup FIXMATH
+ */
+#include "fixmath.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "stm32_hal.h"
+
+#define FIXMATH_LUT_BITS  6u                              /* 64 table segments */
+#define FIXMATH_LUT_SIZE  ((1u << FIXMATH_LUT_BITS) + 1u) /* Table entries, including the end point */
+#define FIXMATH_RECIP_C1  3031741620u                     /* 48/17 in Q2.30, initial estimate of the reciprocal */
+#define FIXMATH_RECIP_C2  2021161080u                     /* 32/17 in Q2.30 */
+#define FIXMATH_RECIP_TWO 0x80000000u                     /* 2.0 in Q2.30 */
+#define FIXMATH_RECIP_NR  3u                              /* Newton-Raphson iterations, error 1/17 squared each step */
+#define FIXMATH_BENCH_N   64u                             /* Number of operations per benchmark */
+
+/***************************************************
+ * @brief log2(1 + i/64) in Q16.16
+ ***************************************************/
+static const uint32_t fixmath_log2_lut[FIXMATH_LUT_SIZE] = {
+    0u,     1466u,  2909u,  4331u,  5732u,  7112u,  8473u,  9814u,  11136u, 12440u, 13727u, 14996u, 16248u, 17484u, 18704u, 19909u, 21098u,
+    22272u, 23433u, 24579u, 25711u, 26830u, 27936u, 29029u, 30109u, 31178u, 32234u, 33279u, 34312u, 35334u, 36346u, 37346u, 38336u,
+    39316u, 40286u, 41246u, 42196u, 43137u, 44068u, 44990u, 45904u, 46809u, 47705u, 48593u, 49472u, 50344u, 51207u, 52063u, 52911u,
+    53751u, 54584u, 55410u, 56229u, 57040u, 57845u, 58643u, 59434u, 60219u, 60997u, 61769u, 62534u, 63294u, 64047u, 64794u, 65536u,
+};
+
+/***************************************************
+ * @brief 2^(i/64) in Q2.30
+ ***************************************************/
+static const uint32_t fixmath_exp2_lut[FIXMATH_LUT_SIZE] = {
+    1073741824u, 1085434106u, 1097253708u, 1109202018u, 1121280436u, 1133490379u, 1145833280u, 1158310587u, 1170923762u, 1183674286u, 1196563654u,
+    1209593378u, 1222764986u, 1236080024u, 1249540052u, 1263146652u, 1276901417u, 1290805962u, 1304861917u, 1319070932u, 1333434672u, 1347954824u,
+    1362633090u, 1377471191u, 1392470869u, 1407633882u, 1422962010u, 1438457051u, 1454120821u, 1469955159u, 1485961921u, 1502142985u, 1518500250u,
+    1535035634u, 1551751076u, 1568648537u, 1585730000u, 1602997467u, 1620452965u, 1638098541u, 1655936265u, 1673968228u, 1692196547u, 1710623359u,
+    1729250827u, 1748081133u, 1767116489u, 1786359126u, 1805811301u, 1825475297u, 1845353420u, 1865448001u, 1885761398u, 1906295993u, 1927054196u,
+    1948038440u, 1969251188u, 1990694927u, 2012372174u, 2034285470u, 2056437387u, 2078830522u, 2101467502u, 2124350982u, 2147483648u,
+};
+
+#if (__FPU_USED == 1U)
+/* Run time ABI soft-float routines of libgcc, they use the base procedure call standard (arguments in core registers) */
+extern float __aeabi_fmul(float a, float b) __attribute__((pcs("aapcs"))); //lint !e9143 !e683 reserved name of the run time ABI
+extern float __aeabi_fdiv(float a, float b) __attribute__((pcs("aapcs"))); //lint !e9143 !e683 reserved name of the run time ABI
+#endif
+
+/***************************************************
+ * @brief Operands of the benchmarks, volatile so the compiler can't fold the loops
+ ***************************************************/
+static volatile q16_t fixmath_bench_q[FIXMATH_BENCH_N];
+static volatile float fixmath_bench_f[FIXMATH_BENCH_N];
+static volatile q16_t fixmath_sink_q;
+static volatile float fixmath_sink_f;
+
+/***************************************************
+ * @brief Count leading zeros
+ * @param val Value, not 0
+ * @return Number of leading zero bits
+ ***************************************************/
+STATIC uint32_t fixmath_clz(uint32_t val)
+{
+    return (uint32_t)__builtin_clz(val);
+}
+
+q16_t fix16_sat(int64_t val)
+{
+    q16_t res;
+
+    if (val > INT32_MAX)
+    {
+        res = FIX16_MAX;
+    }
+    else if (val < INT32_MIN)
+    {
+        res = FIX16_MIN;
+    }
+    else
+    {
+        res = (q16_t)val;
+    }
+
+    return res;
+}
+
+q16_t fix16_add(q16_t a, q16_t b)
+{
+    return fix16_sat((int64_t)a + b);
+}
+
+q16_t fix16_sub(q16_t a, q16_t b)
+{
+    return fix16_sat((int64_t)a - b);
+}
+
+q16_t fix16_mul(q16_t a, q16_t b)
+{
+    const int64_t prod = ((int64_t)a * b) + 0x8000; /* round to nearest */
+    return fix16_sat(prod >> 16u);
+}
+
+q16_t fix16_div(q16_t a, q16_t b)
+{
+    q16_t res;
+
+    if (b == 0)
+    {
+        res = (a >= 0) ? FIX16_MAX : FIX16_MIN;
+    }
+    else
+    {
+        int64_t num = (int64_t)a * FIX16_ONE;
+        const int64_t half = (b > 0) ? ((int64_t)b / 2) : (-(int64_t)b / 2);
+        num += (num >= 0) ? half : -half; /* round half away from zero */
+        res = fix16_sat(num / b);
+    }
+
+    return res;
+}
+
+q16_t fix16_recip(q16_t a)
+{
+    q16_t res;
+
+    if (a == 0)
+    {
+        res = FIX16_MAX;
+    }
+    else
+    {
+        const bool neg = a < 0;
+        const uint32_t u = neg ? (0u - (uint32_t)a) : (uint32_t)a;
+        const uint32_t shift = fixmath_clz(u);
+        const uint32_t m = u << shift; /* mantissa in [0.5, 1) as Q0.32 */
+
+        uint32_t y = FIXMATH_RECIP_C1 - (uint32_t)(((uint64_t)FIXMATH_RECIP_C2 * m) >> 32u); /* 1/m in Q2.30 */
+        for (uint32_t i = 0u; i < FIXMATH_RECIP_NR; i++)
+        {
+            const uint32_t e = (uint32_t)(((uint64_t)m * y) >> 32u); /* m * y in Q2.30, close to 1.0 */
+            y = (uint32_t)(((uint64_t)y * (FIXMATH_RECIP_TWO - e)) >> 30u);
+        }
+
+        /* 1/a = y * 2^(shift - 30) in Q16.16 */
+        uint64_t r;
+        if (shift >= 30u)
+        {
+            r = (uint64_t)y << (shift - 30u);
+        }
+        else
+        {
+            r = ((uint64_t)y + (1ull << (29u - shift))) >> (30u - shift);
+        }
+        res = fix16_sat(neg ? -(int64_t)r : (int64_t)r);
+    }
+
+    return res;
+}
+
+q16_t fix16_sqrt(q16_t a)
+{
+    uint32_t res = 0u;
+
+    if (a > 0)
+    {
+        uint64_t val = (uint64_t)(uint32_t)a << 16u; /* sqrt(a * 2^16) = sqrt(a) in Q16.16 */
+        uint64_t bit = 1ull << (2u * ((63u - (uint32_t)__builtin_clzll(val)) / 2u));
+        uint64_t root = 0u;
+
+        while (bit != 0u)
+        {
+            if (val >= (root + bit))
+            {
+                val -= root + bit;
+                root = (root >> 1u) + bit;
+            }
+            else
+            {
+                root >>= 1u;
+            }
+            bit >>= 2u;
+        }
+        res = (uint32_t)root;
+    }
+
+    return (q16_t)res;
+}
+
+q16_t fix16_log2(q16_t a)
+{
+    q16_t res = FIX16_MIN;
+
+    if (a > 0)
+    {
+        const uint32_t msb = 31u - fixmath_clz((uint32_t)a);
+        const uint32_t frac = ((uint32_t)a << (31u - msb)) & 0x7FFFFFFFu; /* fraction of the mantissa in Q0.31 */
+        const uint32_t idx = frac >> (31u - FIXMATH_LUT_BITS);
+        const uint32_t rem = (frac >> (15u - FIXMATH_LUT_BITS)) & 0xFFFFu;
+        const uint32_t lo = fixmath_log2_lut[idx];
+        const uint32_t interp = lo + (((fixmath_log2_lut[idx + 1u] - lo) * rem) >> 16u);
+
+        res = (((q16_t)msb - 16) * FIX16_ONE) + (q16_t)interp;
+    }
+
+    return res;
+}
+
+q16_t fix16_exp2(q16_t a)
+{
+    q16_t res;
+    const int32_t ipart = a >> 16u; /* floor */
+
+    if (ipart >= 15)
+    {
+        res = FIX16_MAX;
+    }
+    else if (ipart < -17)
+    {
+        res = 0;
+    }
+    else
+    {
+        const uint32_t frac = (uint32_t)a & 0xFFFFu;
+        const uint32_t idx = frac >> (16u - FIXMATH_LUT_BITS);
+        const uint32_t rem = frac & ((1u << (16u - FIXMATH_LUT_BITS)) - 1u);
+        const uint32_t lo = fixmath_exp2_lut[idx];
+        const uint32_t v = lo + (uint32_t)(((uint64_t)(fixmath_exp2_lut[idx + 1u] - lo) * rem) >> (16u - FIXMATH_LUT_BITS)); /* Q2.30 */
+
+        /* 2^a = v * 2^(ipart - 14) in Q16.16 */
+        if (ipart >= 14)
+        {
+            res = fix16_sat((int64_t)v << (uint32_t)(ipart - 14));
+        }
+        else
+        {
+            const uint32_t shift = (uint32_t)(14 - ipart);
+            res = (q16_t)(uint32_t)(((uint64_t)v + (1ull << (shift - 1u))) >> shift);
+        }
+    }
+
+    return res;
+}
+
+q16_t fix16_ln(q16_t a)
+{
+    q16_t res = FIX16_MIN;
+
+    if (a > 0)
+    {
+        res = fix16_mul(fix16_log2(a), FIX16_LN2);
+    }
+
+    return res;
+}
+
+q16_t fix16_exp(q16_t a)
+{
+    return fix16_exp2(fix16_mul(a, FIX16_LOG2E));
+}
+
+q31_t q31_add(q31_t a, q31_t b)
+{
+    return dsp_sat_q31((int64_t)a + b);
+}
+
+q31_t q31_sub(q31_t a, q31_t b)
+{
+    return dsp_sat_q31((int64_t)a - b);
+}
+
+q31_t q31_mul(q31_t a, q31_t b)
+{
+    const int64_t prod = ((int64_t)a * b) + 0x40000000; /* round to nearest */
+    return dsp_sat_q31(prod >> 31u);                    /* only -1 * -1 saturates */
+}
+
+q16_t fix16_mul_q31(q16_t a, q31_t k)
+{
+    const int64_t prod = ((int64_t)a * k) + 0x40000000;
+    return fix16_sat(prod >> 31u);
+}
+
+/***************************************************
+ * @brief Print the result of one benchmark
+ * @param name Name of the operation
+ * @param cycles Cycles for FIXMATH_BENCH_N operations
+ ***************************************************/
+STATIC void fixmath_print_cycles(const char* name, uint32_t cycles)
+{
+    printf("%-12s %4lu.%02lu cycles/op\r\n", name, cycles / FIXMATH_BENCH_N, ((cycles % FIXMATH_BENCH_N) * 100u) / FIXMATH_BENCH_N);
+}
+
+void fixmath_bench(void)
+{
+    const uint32_t old_primask = __get_PRIMASK();
+    uint32_t start;
+    uint32_t cycles;
+
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_bench_q[i] = (q16_t)((i * 40503u) + FIX16_ONE);
+        fixmath_bench_f[i] = (float)fixmath_bench_q[i] / 65536.0f;
+    }
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_q = fix16_mul(fixmath_bench_q[i], FIX16_C(1.2345));
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("fix16 mul", cycles);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_q = fix16_div(FIX16_C(1000), fixmath_bench_q[i]);
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("fix16 div", cycles);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_q = fix16_recip(fixmath_bench_q[i]);
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("fix16 recip", cycles);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_q = fix16_sqrt(fixmath_bench_q[i]);
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("fix16 sqrt", cycles);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_q = fix16_log2(fixmath_bench_q[i]);
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("fix16 log2", cycles);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_q = fix16_exp2(fixmath_bench_q[i]);
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("fix16 exp2", cycles);
+
+#if (__FPU_USED == 1U)
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_f = __aeabi_fmul(fixmath_bench_f[i], 1.2345f);
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("soft mul", cycles);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_f = __aeabi_fdiv(1000.0f, fixmath_bench_f[i]);
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("soft div", cycles);
+#endif
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_f = fixmath_bench_f[i] * 1.2345f;
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("float mul", cycles);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_f = 1000.0f / fixmath_bench_f[i];
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("float div", cycles);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_f = sqrtf(fixmath_bench_f[i]);
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("float sqrt", cycles);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < FIXMATH_BENCH_N; i++)
+    {
+        fixmath_sink_f = log2f(fixmath_bench_f[i]);
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    fixmath_print_cycles("float log2", cycles);
+}
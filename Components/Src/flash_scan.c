@@ -0,0 +1,163 @@
+/**
+ * @file flash_scan.c
+ * @author PL
+ * @brief Background integrity scan of the firmware image in flash
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup FLASH_SCAN
+ *
+ * A chunk is FLASH_SCAN_CHUNK / 4 word writes to the CRC peripheral, the budget of a slice is checked
+ * after every chunk with the cycle counter.
+ */
+#include "flash_scan.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "coroutine.h"
+#include "crc.h"
+#include "stm32_hal.h"
+#include "timer.h"
+
+/* Symbols of the linker script */
+extern const uint32_t __image_start[]; /* First word of the image, the vector table */
+extern const uint32_t __image_end[];   /* Word behind the image, the reference */
+
+/* Reference, patched after the link, the linker script places it at __image_end */
+__attribute__((section(".image_crc"), used)) const volatile uint32_t flash_scan_reference = FLASH_SCAN_NO_CRC;
+
+/**
+ * @brief Operational data of the scan
+ */
+typedef struct
+{
+    CORO coro;                /**< Scan coroutine, first member */
+    const uint32_t* pos;      /**< Next word of the pass */
+    uint32_t state;           /**< CRC state of the pass */
+    FLASH_SCAN_STATUS status; /**< Result of the last pass */
+    uint32_t crc;             /**< CRC of the last pass */
+    uint32_t passes;          /**< Completed passes */
+    uint32_t mismatches;      /**< Passes with a CRC different from the reference */
+    uint32_t pass_start;      /**< Tick of the start of the pass */
+    uint32_t pass_time;       /**< Duration of the last pass [ms] */
+    uint32_t slices;          /**< Slices of the last pass */
+    uint32_t slice_count;     /**< Slices of the current pass */
+    uint32_t slice_max;       /**< Longest slice [cycles] */
+} FLASH_SCAN_DATA;
+
+STATIC FLASH_SCAN_DATA flash_scan;
+
+/***************************************************
+ * @brief Continue the CRC for the budget of a slice
+ * @return true if the end of the image is reached
+ ***************************************************/
+STATIC bool flash_scan_slice(void)
+{
+    const uint32_t budget = (SystemCoreClock / 1000000u) * FLASH_SCAN_BUDGET_US;
+    const uint32_t start = bench_get_cycles();
+    uint32_t cycles;
+
+    do
+    {
+        uint32_t num_words = (uint32_t)(__image_end - flash_scan.pos);
+        if (num_words > (FLASH_SCAN_CHUNK / 4u))
+        {
+            num_words = FLASH_SCAN_CHUNK / 4u;
+        }
+        flash_scan.state = crc32_hw_update(flash_scan.state, flash_scan.pos, num_words);
+        flash_scan.pos += num_words;
+        cycles = bench_get_cycles() - start;
+    } while ((flash_scan.pos < __image_end) && (cycles < budget));
+
+    if (cycles > flash_scan.slice_max)
+    {
+        flash_scan.slice_max = cycles;
+    }
+    flash_scan.slice_count++;
+
+    return (flash_scan.pos >= __image_end);
+}
+
+/***************************************************
+ * @brief Compare the CRC of the completed pass with the reference and start the next pass
+ ***************************************************/
+STATIC void flash_scan_complete(void)
+{
+    flash_scan.crc = crc32_hw_final(flash_scan.state);
+    if (flash_scan_reference == FLASH_SCAN_NO_CRC)
+    {
+        flash_scan.status = FLASH_SCAN_NO_REFERENCE;
+    }
+    else if (flash_scan.crc == flash_scan_reference)
+    {
+        flash_scan.status = FLASH_SCAN_OK;
+    }
+    else
+    {
+        if (flash_scan.mismatches == 0u)
+        {
+            printf("Flash image CRC %08lX, expected %08lX\r\n", flash_scan.crc, flash_scan_reference);
+        }
+        flash_scan.mismatches++;
+        flash_scan.status = FLASH_SCAN_MISMATCH;
+    }
+    flash_scan.passes++;
+    flash_scan.pass_time = timer_get_elapsed_module_timer(flash_scan.pass_start);
+    flash_scan.slices = flash_scan.slice_count;
+
+    flash_scan.slice_count = 0u;
+    flash_scan.pos = __image_start;
+    flash_scan.state = CRC32_INIT;
+    timer_reset_module_timer(&flash_scan.pass_start);
+}
+
+/***************************************************
+ * @brief Scan coroutine, one slice every FLASH_SCAN_PERIOD
+ * @param c Control block
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE flash_scan_coro(CORO* c)
+{
+    CORO_BEGIN(c);
+    CORO_SLEEP(c, FLASH_SCAN_PERIOD);
+    if (flash_scan_slice())
+    {
+        flash_scan_complete();
+    }
+    CORO_RESTART(c);
+    CORO_END(c);
+}
+
+void flash_scan_init(void)
+{
+    flash_scan.pos = __image_start;
+    flash_scan.state = CRC32_INIT;
+    flash_scan.status = FLASH_SCAN_PENDING;
+    flash_scan.passes = 0u;
+    flash_scan.mismatches = 0u;
+    flash_scan.slice_count = 0u;
+    flash_scan.slice_max = 0u;
+    timer_reset_module_timer(&flash_scan.pass_start);
+    coro_start(&flash_scan.coro, flash_scan_coro);
+}
+
+FLASH_SCAN_STATUS flash_scan_get_status(void)
+{
+    return flash_scan.status;
+}
+
+void flash_scan_print(void)
+{
+    static const char* const status_names[] = {"pending", "OK", "MISMATCH", "no reference"};
+    const uint32_t size = (uint32_t)(__image_end - __image_start) * 4u;
+    const uint32_t done = (uint32_t)(flash_scan.pos - __image_start) * 4u;
+
+    printf("Image %08lX .. %08lX, %lu bytes, reference %08lX\r\n", (uint32_t)__image_start, (uint32_t)__image_end, size, flash_scan_reference);
+    printf("Pass %lu: %lu of %lu bytes (%lu %%)\r\n", flash_scan.passes + 1u, done, size, (done * 100u) / size);
+    printf("Last pass: %s, CRC %08lX, %lu ms in %lu slices, %lu mismatches\r\n", status_names[flash_scan.status], flash_scan.crc, flash_scan.pass_time, flash_scan.slices, flash_scan.mismatches);
+    printf("Slice: max %lu us (%lu cycles), budget %lu us every %lu ms\r\n", (flash_scan.slice_max * 1000u) / (SystemCoreClock / 1000u), flash_scan.slice_max, (uint32_t)FLASH_SCAN_BUDGET_US,
+           (uint32_t)FLASH_SCAN_PERIOD);
+}
+
+/** @}*/
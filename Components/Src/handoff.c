@@ -0,0 +1,115 @@
+/**
+ * @file handoff.c
+ * @author PL
+ * @brief Warm reboot: state handed from the firmware before a reset to the firmware after it, in SRAM4
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup HANDOFF
+ *
+ * The block is placed in the .handoff section (NOLOAD, SRAM4) of the linker script. The CRC covers the
+ * data, the header fields are checked one by one. handoff_write() runs with the interrupts masked, the
+ * reset follows at once.
+ */
+#include "handoff.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "crc.h"
+#include "interlock.h"
+#include "pump_monitor.h"
+#include "stm32_hal.h"
+
+#define HANDOFF_MAGIC 0x48414E44u /* "HAND", a block was written */
+
+/**
+ * @brief Handoff block in SRAM4
+ */
+typedef struct
+{
+    uint32_t magic;    /**< HANDOFF_MAGIC */
+    uint16_t version;  /**< HANDOFF_VERSION of the data */
+    uint16_t length;   /**< Length of the data [bytes] */
+    uint16_t crc;      /**< CRC of the data */
+    uint16_t reserved; /**< 0 */
+    HANDOFF_DATA data; /**< State */
+} HANDOFF_BLOCK;
+
+/**
+ * @brief Operational data of the handoff
+ */
+typedef struct
+{
+    HANDOFF_DATA data; /**< State of the firmware before the reset */
+    bool warm;         /**< Warm boot, data is valid */
+    uint16_t version;  /**< Version of the consumed block */
+} HANDOFF_STATE;
+
+static HANDOFF_BLOCK handoff_block __attribute__((section(".handoff")));
+STATIC HANDOFF_STATE handoff;
+
+bool handoff_init(void)
+{
+    const HANDOFF_BLOCK* b = &handoff_block;
+
+    __HAL_RCC_SRAM4_CLK_ENABLE();
+    (void)memset(&handoff.data, 0, sizeof(handoff.data));
+    handoff.warm = (b->magic == HANDOFF_MAGIC) && (b->version <= HANDOFF_VERSION) && (b->length <= sizeof(HANDOFF_DATA)) && (crc_calc(&b->data, b->length) == b->crc);
+
+    if (handoff.warm)
+    {
+        /* Older blocks are shorter, the fields added later stay 0 */
+        (void)memcpy(&handoff.data, &b->data, b->length);
+        handoff.version = b->version;
+        handoff.data.warm_boots++;
+    }
+    (void)memset(&handoff_block, 0, sizeof(handoff_block)); /* consumed */
+
+    return handoff.warm;
+}
+
+const HANDOFF_DATA* handoff_get(void)
+{
+    return handoff.warm ? &handoff.data : NULL;
+}
+
+void handoff_write(void)
+{
+    HANDOFF_BLOCK* b = &handoff_block;
+    const CALIB_DATA* calib = &config_get()->calib;
+
+    __disable_irq();
+    (void)memset(b, 0, sizeof(*b));
+    b->data.warm_boots = handoff.data.warm_boots;
+    dose_handoff_save(&b->data.dose);
+    b->data.pump_nominal = pump_monitor_get_nominal();
+    b->data.interlock_tripped = interlock_get_tripped();
+    for (uint32_t i = 0u; i < CALIB_ADCS; i++)
+    {
+        b->data.adc_factor[i] = calib->adc_factor[i];
+    }
+    b->data.adc_valid = calib->adc_valid;
+
+    b->version = HANDOFF_VERSION;
+    b->length = (uint16_t)sizeof(HANDOFF_DATA);
+    b->crc = crc_calc(&b->data, sizeof(HANDOFF_DATA));
+    b->magic = HANDOFF_MAGIC;
+    __DSB();
+}
+
+void handoff_print(void)
+{
+    if (handoff.warm)
+    {
+        printf("Warm boot (%lu in a row), handoff version %u (firmware %u)\r\n", handoff.data.warm_boots, handoff.version, HANDOFF_VERSION);
+        printf("Volume %lu mL, pump nominal %lu counts, interlock 0x%02lx, ADC factors 0x%lx\r\n", (uint32_t)handoff.data.dose.volume, handoff.data.pump_nominal,
+               handoff.data.interlock_tripped, handoff.data.adc_valid);
+    }
+    else
+    {
+        printf("Cold boot\r\n");
+    }
+}
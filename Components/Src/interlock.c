@@ -0,0 +1,331 @@
+/**
+ * @file interlock.c
+ * @author PL
+ * @brief Safety interlocks: leak detectors and overflow switches force the actuators off within microseconds
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup INTERLOCK
+ *
+ * The interrupt writes the port registers directly: BRR resets the output, PUPDR pulls the pin down,
+ * MODER switches the pin to input. The input never floats, even if the driver of the actuator has no
+ * pull-down. The mode and pull bits before the trip are saved per output and restored by
+ * interlock_reset(). The interrupt has priority 0, only code with all interrupts masked delays it.
+ */
+#include "interlock.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "coroutine.h"
+#include "handoff.h"
+
+#define INTERLOCK_EV_TRIP      0x0001u /* Coroutine event: an input tripped */
+#define INTERLOCK_IRQ_PRIO     0u      /* Priority of the EXTI interrupts, above all other interrupts */
+#define INTERLOCK_BREAK_CYCLES 10000u  /* Longest wait for the break of a timer in the test [cycles] */
+
+/**
+ * @brief Operational data of the interlocks
+ */
+typedef struct
+{
+    CORO coro;                                       /**< Reporting coroutine, first member */
+    const INTERLOCK_INPUT* inputs;                   /**< Inputs */
+    uint32_t num_inputs;                             /**< Number of inputs */
+    const INTERLOCK_OUTPUT* outputs;                 /**< Outputs */
+    uint32_t num_outputs;                            /**< Number of outputs */
+    uint32_t moder[INTERLOCK_MAX_OUTPUTS];           /**< Mode bits of the outputs before the trip */
+    uint32_t pupdr[INTERLOCK_MAX_OUTPUTS];           /**< Pull bits of the outputs before the trip */
+    volatile uint32_t tripped;                       /**< Tripped inputs, bit n is input n */
+    volatile uint32_t forced;                        /**< Forced outputs, bit n is output n */
+    uint32_t reported;                               /**< Tripped inputs already reported */
+    volatile uint32_t trip_cycles;                   /**< Cycle counter after the forcing of the last trip */
+    uint32_t trips;                                  /**< Number of trips */
+    TIM_HandleTypeDef* breaks[INTERLOCK_MAX_BREAKS]; /**< Timers with a break input */
+    uint32_t num_breaks;                             /**< Number of timers with a break input */
+    uint32_t test_cycles;                            /**< Latency of the GPIO forcing in the last test [cycles] */
+    uint32_t break_cycles[INTERLOCK_MAX_BREAKS];     /**< Latency of the timer breaks in the last test [cycles] */
+} INTERLOCK_DATA;
+
+STATIC INTERLOCK_DATA interlock;
+
+/***************************************************
+ * @brief Check an input
+ * @param in Input
+ * @return true if the input is at its trip level
+ ***************************************************/
+STATIC bool interlock_is_active(const INTERLOCK_INPUT* in)
+{
+    return HAL_GPIO_ReadPin(in->port, in->pin) == in->trip_level;
+}
+
+/***************************************************
+ * @brief Force outputs off: reset the output, pull the pin down and switch it to input mode
+ * @param mask Outputs, bit n is output n
+ ***************************************************/
+STATIC void interlock_force(uint32_t mask)
+{
+    const uint32_t todo = mask & ~interlock.forced;
+
+    for (uint32_t i = 0u; i < interlock.num_outputs; i++)
+    {
+        if ((todo & (1u << i)) != 0u)
+        {
+            const INTERLOCK_OUTPUT* out = &interlock.outputs[i];
+            const uint32_t shift = 2u * (uint32_t)__builtin_ctz(out->pin);
+
+            out->port->BRR = out->pin;
+            interlock.pupdr[i] = out->port->PUPDR & (GPIO_PUPDR_PUPD0 << shift);
+            out->port->PUPDR = (out->port->PUPDR & ~(GPIO_PUPDR_PUPD0 << shift)) | (GPIO_PUPDR_PUPD0_1 << shift);
+            interlock.moder[i] = out->port->MODER & (GPIO_MODER_MODE0 << shift);
+            out->port->MODER &= ~(GPIO_MODER_MODE0 << shift);
+        }
+    }
+    interlock.forced |= todo;
+}
+
+/***************************************************
+ * @brief Trip an input, called in the interrupt or with the interrupts masked
+ * @param input Input
+ ***************************************************/
+STATIC void interlock_trip(uint32_t input)
+{
+    interlock_force(interlock.inputs[input].outputs);
+    interlock.trip_cycles = bench_get_cycles();
+    interlock.tripped |= (1u << input);
+    coro_post_event(&interlock.coro, INTERLOCK_EV_TRIP);
+}
+
+/***************************************************
+ * @brief Reporting coroutine, prints each trip once
+ * @param c Control block, first member of INTERLOCK_DATA
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE interlock_coro(CORO* c)
+{
+    CORO_BEGIN(c);
+    while (true)
+    {
+        CORO_WAIT_EVENT(c, INTERLOCK_EV_TRIP, CORO_WAIT_FOREVER);
+        (void)coro_take_events(c, INTERLOCK_EV_TRIP);
+
+        const uint32_t tripped = interlock.tripped;
+        for (uint32_t i = 0u; i < interlock.num_inputs; i++)
+        {
+            if (((tripped & ~interlock.reported) & (1u << i)) != 0u)
+            {
+                interlock.trips++;
+                printf("Interlock tripped by %s, outputs forced off, use \"interlock reset\"\r\n", interlock.inputs[i].name);
+            }
+        }
+        interlock.reported |= tripped;
+    }
+    CORO_END(c);
+}
+
+/***************************************************
+ * @brief Convert cycles of the core clock to nanoseconds
+ * @param cycles Cycles
+ * @return Time [ns]
+ ***************************************************/
+STATIC uint32_t interlock_cycles_to_ns(uint32_t cycles)
+{
+    return (uint32_t)(((uint64_t)cycles * 1000000000u) / SystemCoreClock);
+}
+
+bool interlock_init(const INTERLOCK_INPUT* inputs, uint32_t num_inputs, const INTERLOCK_OUTPUT* outputs, uint32_t num_outputs)
+{
+    const HANDOFF_DATA* h = handoff_get();
+    const uint32_t latched = (h != NULL) ? h->interlock_tripped : 0u; /* the latch survives a warm reboot */
+    uint32_t lines = 0u;
+    bool ok = (num_inputs <= INTERLOCK_MAX_INPUTS) && (num_outputs <= INTERLOCK_MAX_OUTPUTS);
+
+    for (uint32_t i = 0u; ok && (i < num_inputs); i++)
+    {
+        ok = ((lines & inputs[i].pin) == 0u);
+        lines |= inputs[i].pin;
+    }
+
+    if (ok)
+    {
+        GPIO_InitTypeDef gpio = {0};
+
+        interlock.inputs = inputs;
+        interlock.num_inputs = num_inputs;
+        interlock.outputs = outputs;
+        interlock.num_outputs = num_outputs;
+        coro_start(&interlock.coro, interlock_coro);
+
+        for (uint32_t i = 0u; i < num_inputs; i++)
+        {
+            const IRQn_Type irq = (IRQn_Type)((uint32_t)EXTI0_IRQn + (uint32_t)__builtin_ctz(inputs[i].pin)); /* one interrupt per line */
+
+            gpio.Mode = (inputs[i].trip_level == GPIO_PIN_RESET) ? GPIO_MODE_IT_FALLING : GPIO_MODE_IT_RISING;
+            gpio.Pull = (inputs[i].trip_level == GPIO_PIN_RESET) ? GPIO_PULLUP : GPIO_PULLDOWN; /* inactive when not connected */
+            gpio.Speed = GPIO_SPEED_FREQ_LOW;
+            gpio.Pin = inputs[i].pin;
+            HAL_GPIO_Init(inputs[i].port, &gpio);
+            HAL_NVIC_SetPriority(irq, INTERLOCK_IRQ_PRIO, 0u);
+            HAL_NVIC_EnableIRQ(irq);
+
+            __disable_irq();
+            if (interlock_is_active(&inputs[i]) || ((latched & (1u << i)) != 0u))
+            {
+                interlock_trip(i); /* no edge for an input which is already active */
+            }
+            __enable_irq();
+        }
+    }
+
+    return ok;
+}
+
+bool interlock_add_break(TIM_HandleTypeDef* htim)
+{
+    TIM_BreakDeadTimeConfigTypeDef bdtr = {0};
+    bool ok = (interlock.num_breaks < INTERLOCK_MAX_BREAKS) && IS_TIM_BREAK_INSTANCE(htim->Instance);
+
+    if (ok)
+    {
+        bdtr.OffStateRunMode = TIM_OSSR_ENABLE; /* outputs driven to their idle level, not floating */
+        bdtr.OffStateIDLEMode = TIM_OSSI_ENABLE;
+        bdtr.LockLevel = TIM_LOCKLEVEL_OFF;
+        bdtr.DeadTime = 0u;
+        bdtr.BreakState = TIM_BREAK_ENABLE;
+        bdtr.BreakPolarity = TIM_BREAKPOLARITY_LOW;
+        bdtr.BreakFilter = 0u; /* no filter, no latency */
+        bdtr.BreakAFMode = TIM_BREAK_AFMODE_INPUT;
+        bdtr.Break2State = TIM_BREAK2_DISABLE;
+        bdtr.Break2Polarity = TIM_BREAK2POLARITY_LOW;
+        bdtr.Break2Filter = 0u;
+        bdtr.Break2AFMode = TIM_BREAK_AFMODE_INPUT;
+        bdtr.AutomaticOutput = TIM_AUTOMATICOUTPUT_DISABLE; /* latched until interlock_reset() */
+        ok = (HAL_TIMEx_ConfigBreakDeadTime(htim, &bdtr) == HAL_OK);
+    }
+
+    if (ok)
+    {
+        interlock.breaks[interlock.num_breaks] = htim;
+        interlock.num_breaks++;
+    }
+
+    return ok;
+}
+
+bool interlock_reset(void)
+{
+    bool ok = true;
+
+    for (uint32_t i = 0u; ok && (i < interlock.num_inputs); i++)
+    {
+        ok = !interlock_is_active(&interlock.inputs[i]);
+    }
+
+    if (ok)
+    {
+        __disable_irq();
+        for (uint32_t i = 0u; i < interlock.num_outputs; i++)
+        {
+            if ((interlock.forced & (1u << i)) != 0u)
+            {
+                const INTERLOCK_OUTPUT* out = &interlock.outputs[i];
+                const uint32_t shift = 2u * (uint32_t)__builtin_ctz(out->pin);
+
+                out->port->MODER = (out->port->MODER & ~(GPIO_MODER_MODE0 << shift)) | interlock.moder[i];
+                out->port->PUPDR = (out->port->PUPDR & ~(GPIO_PUPDR_PUPD0 << shift)) | interlock.pupdr[i];
+            }
+        }
+        interlock.forced = 0u;
+        interlock.tripped = 0u;
+        interlock.reported = 0u;
+        __enable_irq();
+
+        for (uint32_t i = 0u; i < interlock.num_breaks; i++)
+        {
+            __HAL_TIM_CLEAR_FLAG(interlock.breaks[i], TIM_FLAG_BREAK);
+            __HAL_TIM_MOE_ENABLE(interlock.breaks[i]);
+        }
+    }
+
+    return ok;
+}
+
+bool interlock_is_tripped(void)
+{
+    return interlock.tripped != 0u;
+}
+
+uint32_t interlock_get_tripped(void)
+{
+    return interlock.tripped;
+}
+
+bool interlock_test(uint32_t input)
+{
+    const bool ok = (input < interlock.num_inputs) && (interlock.tripped == 0u);
+
+    if (ok)
+    {
+        const uint32_t start = bench_get_cycles();
+
+        EXTI->SWIER1 = interlock.inputs[input].pin; /* the interrupt preempts at once */
+        __DSB();
+        __ISB();
+        interlock.test_cycles = interlock.trip_cycles - start;
+        printf("Interlock %s: outputs forced after %lu cycles (%lu ns)\r\n", interlock.inputs[input].name, interlock.test_cycles,
+               interlock_cycles_to_ns(interlock.test_cycles));
+
+        for (uint32_t i = 0u; i < interlock.num_breaks; i++)
+        {
+            TIM_TypeDef* tim = interlock.breaks[i]->Instance;
+            const uint32_t break_start = bench_get_cycles();
+            uint32_t cycles = 0u;
+
+            tim->EGR = TIM_EGR_BG;
+            while (((tim->BDTR & TIM_BDTR_MOE) != 0u) && (cycles < INTERLOCK_BREAK_CYCLES))
+            {
+                cycles = bench_get_cycles() - break_start;
+            }
+            interlock.break_cycles[i] = cycles;
+            printf("Interlock break %lu: outputs off after %lu cycles (%lu ns)%s\r\n", i, cycles, interlock_cycles_to_ns(cycles),
+                   ((tim->BDTR & TIM_BDTR_MOE) != 0u) ? ", FAILED" : "");
+        }
+    }
+
+    return ok;
+}
+
+void interlock_exti_irq(uint32_t line)
+{
+    const uint16_t pin = (uint16_t)(1u << line);
+
+    __HAL_GPIO_EXTI_CLEAR_RISING_IT(pin);
+    __HAL_GPIO_EXTI_CLEAR_FALLING_IT(pin);
+    for (uint32_t i = 0u; i < interlock.num_inputs; i++)
+    {
+        if (interlock.inputs[i].pin == pin)
+        {
+            interlock_trip(i); /* also a short pulse trips, the latch holds it */
+        }
+    }
+}
+
+void interlock_print(void)
+{
+    printf("Interlock: %s, %lu trips\r\n", (interlock.tripped != 0u) ? "TRIPPED" : "ok", interlock.trips);
+    for (uint32_t i = 0u; i < interlock.num_inputs; i++)
+    {
+        const INTERLOCK_INPUT* in = &interlock.inputs[i];
+
+        printf("Input %lu %s: %s%s, outputs 0x%02lx\r\n", i, in->name, interlock_is_active(in) ? "active" : "inactive",
+               ((interlock.tripped & (1u << i)) != 0u) ? ", tripped" : "", in->outputs);
+    }
+    printf("Forced outputs: 0x%02lx of %lu\r\n", interlock.forced, interlock.num_outputs);
+    printf("Last test: GPIO forcing %lu cycles (%lu ns)", interlock.test_cycles, interlock_cycles_to_ns(interlock.test_cycles));
+    for (uint32_t i = 0u; i < interlock.num_breaks; i++)
+    {
+        printf(", break %lu %lu cycles (%lu ns)", i, interlock.break_cycles[i], interlock_cycles_to_ns(interlock.break_cycles[i]));
+    }
+    printf("\r\n");
+}
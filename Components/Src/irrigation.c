@@ -0,0 +1,472 @@
+/**
+ * @file irrigation.c
+ * @author PL
+ * @brief Ebb and flow irrigation of the grow zones with float switch confirmation
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup IRRIGATION
+ *
+ * The timeouts of a phase are measured from the start of the phase, a wait for a float switch is
+ * armed with the remaining time, so a bouncing switch doesn't extend the phase. The fill pump is
+ * switched off at the first contact of the full switch and on again when the level is not confirmed.
+ *
+ * The fill pumps draw from the reservoir and the drains return to it. The volume pumped into a zone
+ * (on time times the flow of the pump) is taken from the volume estimate of the dose planner when the
+ * pump stops, and given back when the drain confirms the empty zone.
+ */
+#include "irrigation.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "coroutine.h"
+#include "dose.h"
+#include "timer.h"
+
+#define IRRIGATION_EV_START 0x0001u /* Coroutine event: start a cycle */
+#define IRRIGATION_EV_STOP  0x0002u /* Coroutine event: abort filling or holding */
+#define IRRIGATION_EV_LEVEL 0x0004u /* Coroutine event: a float switch changed */
+#define IRRIGATION_EV_SLOT  0x0008u /* Coroutine event: a pump slot was released */
+#define IRRIGATION_EV_RESET 0x0010u /* Coroutine event: unlock the zone */
+#define IRRIGATION_EV_ALL   0x001Fu /* All events */
+#define IRRIGATION_IRQ_PRIO 6u      /* Priority of the EXTI interrupts */
+
+/**
+ * @brief Operational data of a zone
+ */
+typedef struct
+{
+    CORO coro;                    /**< Zone coroutine, first member */
+    const IRRIGATION_HW* hw;      /**< Hardware, NULL if not initialized */
+    IRRIGATION_PHASE phase;       /**< Phase */
+    uint32_t phase_start;         /**< Start of the phase [ms] */
+    bool filling;                 /**< The fill pump runs */
+    uint32_t fill_start;          /**< Start of the fill pump [ms] */
+    float flooded_ml;             /**< Volume pumped into the zone and not drained back yet [mL] */
+    bool aborted;                 /**< The running cycle was stopped */
+    bool confirmed;               /**< The float switch of the phase confirmed the level */
+    IRRIGATION_FAULT cycle_fault; /**< Fault of the running cycle */
+    IRRIGATION_FAULT last_fault;  /**< Last fault */
+    uint32_t faults;              /**< Cycles in a row with a fault */
+    uint32_t cycles;              /**< Completed cycles */
+} IRRIGATION_ZONE;
+
+/**
+ * @brief Operational data of the irrigation
+ */
+typedef struct
+{
+    IRRIGATION_ZONE zones[IRRIGATION_MAX_ZONES]; /**< Zones */
+    uint32_t pumps;                              /**< Claimed pump slots */
+} IRRIGATION_DATA;
+
+STATIC IRRIGATION_DATA irrigation;
+
+/***************************************************
+ * @brief Names of the phases and faults, in the same order as the enums
+ ***************************************************/
+static const char* const irrigation_phase_names[] = {"idle", "waiting for a pump", "filling", "holding", "draining", "locked"};
+static const char* const irrigation_fault_names[] = {"none", "fill timeout", "drain timeout", "float switches implausible"};
+
+/***************************************************
+ * @brief Check the full switch
+ * @param z Zone
+ * @return true if the water is at the flood level
+ ***************************************************/
+STATIC bool irrigation_is_full(const IRRIGATION_ZONE* z)
+{
+    return HAL_GPIO_ReadPin(z->hw->full_port, z->hw->full_pin) == GPIO_PIN_RESET;
+}
+
+/***************************************************
+ * @brief Check the empty switch
+ * @param z Zone
+ * @return true if the bottom is dry
+ ***************************************************/
+STATIC bool irrigation_is_empty(const IRRIGATION_ZONE* z)
+{
+    return HAL_GPIO_ReadPin(z->hw->empty_port, z->hw->empty_pin) == GPIO_PIN_SET;
+}
+
+/***************************************************
+ * @brief Switch the fill pump, the pumped volume leaves the reservoir when the pump stops
+ * @param z Zone
+ * @param on true to switch on
+ ***************************************************/
+STATIC void irrigation_fill(IRRIGATION_ZONE* z, bool on)
+{
+    if (on && !z->filling)
+    {
+        timer_reset_module_timer(&z->fill_start);
+    }
+    else if (!on && z->filling)
+    {
+        const float ml_min = config_get()->irrigation_fill_ml_min[z - irrigation.zones];
+        const float ml = (float)timer_get_elapsed_module_timer(z->fill_start) * (ml_min / 60000.0f);
+
+        z->flooded_ml += ml;
+        dose_flow(-ml);
+    }
+    else
+    {
+        // Do nothing
+    }
+    z->filling = on;
+    HAL_GPIO_WritePin(z->hw->fill_port, z->hw->fill_pin, on ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+/***************************************************
+ * @brief Switch the drain valve
+ * @param z Zone
+ * @param open true to open
+ ***************************************************/
+STATIC void irrigation_drain(const IRRIGATION_ZONE* z, bool open)
+{
+    HAL_GPIO_WritePin(z->hw->drain_port, z->hw->drain_pin, open ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+/***************************************************
+ * @brief Enter a phase
+ * @param z Zone
+ * @param phase New phase
+ ***************************************************/
+STATIC void irrigation_set_phase(IRRIGATION_ZONE* z, IRRIGATION_PHASE phase)
+{
+    z->phase = phase;
+    timer_reset_module_timer(&z->phase_start);
+}
+
+/***************************************************
+ * @brief Remaining time of the phase
+ * @param z Zone
+ * @param timeout_s Timeout of the phase [s]
+ * @return Remaining time [ms], 0 when timed out
+ ***************************************************/
+STATIC uint32_t irrigation_remaining(const IRRIGATION_ZONE* z, uint32_t timeout_s)
+{
+    const uint32_t elapsed = timer_get_elapsed_module_timer(z->phase_start);
+    const uint32_t timeout = timeout_s * 1000u;
+
+    return (elapsed < timeout) ? (timeout - elapsed) : 0u;
+}
+
+/***************************************************
+ * @brief Record a fault of the running cycle, only the first one counts
+ * @param z Zone
+ * @param fault Fault
+ ***************************************************/
+STATIC void irrigation_fault(IRRIGATION_ZONE* z, IRRIGATION_FAULT fault)
+{
+    if (z->cycle_fault == IRRIGATION_FAULT_NONE)
+    {
+        z->cycle_fault = fault;
+        z->last_fault = fault;
+        printf("Irrigation %s: %s\r\n", z->hw->name, irrigation_fault_names[fault]);
+    }
+}
+
+/***************************************************
+ * @brief Zone coroutine, one cycle per loop
+ * @param c Control block, first member of IRRIGATION_ZONE
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE irrigation_coro(CORO* c)
+{
+    IRRIGATION_ZONE* z = (IRRIGATION_ZONE*)c; //lint !e740 !e826 the control block is the first member
+    const IRRIGATION_CONFIG* cfg = &config_get()->irrigation[z - irrigation.zones];
+
+    CORO_BEGIN(c);
+    while (true)
+    {
+        /* Idle until a start or the next cycle */
+        irrigation_set_phase(z, IRRIGATION_IDLE);
+        (void)coro_take_events(c, IRRIGATION_EV_ALL); /* a start during the last cycle is ignored */
+        CORO_WAIT_EVENT(c, IRRIGATION_EV_START, (cfg->interval_s > 0u) ? (cfg->interval_s * 1000u) : CORO_WAIT_FOREVER);
+        (void)coro_take_events(c, IRRIGATION_EV_ALL); /* drop the events of the idle time */
+        z->aborted = false;
+        z->confirmed = false;
+        z->cycle_fault = IRRIGATION_FAULT_NONE;
+
+        /* Wait for a pump slot */
+        irrigation_set_phase(z, IRRIGATION_WAIT_PUMP);
+        while (!z->aborted && !irrigation_pump_claim())
+        {
+            CORO_WAIT_EVENT(c, IRRIGATION_EV_SLOT | IRRIGATION_EV_STOP, CORO_WAIT_FOREVER);
+            z->aborted = ((coro_take_events(c, IRRIGATION_EV_SLOT | IRRIGATION_EV_STOP) & IRRIGATION_EV_STOP) != 0u);
+        }
+
+        if (!z->aborted)
+        {
+            /* Fill until the full switch confirms */
+            irrigation_set_phase(z, IRRIGATION_FILL);
+            if (irrigation_is_full(z) && irrigation_is_empty(z))
+            {
+                irrigation_fault(z, IRRIGATION_FAULT_SENSOR); /* full while the bottom is dry: stuck switch */
+            }
+            else if (irrigation_is_full(z))
+            {
+                printf("Irrigation %s still flooded, draining\r\n", z->hw->name);
+                z->aborted = true;
+            }
+            else
+            {
+                // Do nothing
+            }
+            while ((z->cycle_fault == IRRIGATION_FAULT_NONE) && !z->confirmed && !z->aborted && (irrigation_remaining(z, cfg->fill_timeout_s) > 0u))
+            {
+                irrigation_fill(z, true);
+                CORO_WAIT_EVENT(c, IRRIGATION_EV_LEVEL | IRRIGATION_EV_STOP, irrigation_remaining(z, cfg->fill_timeout_s));
+                z->aborted = (coro_take_events(c, IRRIGATION_EV_STOP) != 0u);
+                if ((coro_take_events(c, IRRIGATION_EV_LEVEL) != 0u) && irrigation_is_full(z))
+                {
+                    irrigation_fill(z, false); /* stop at the first contact, confirm after the ripples */
+                    CORO_SLEEP(c, IRRIGATION_CONFIRM_MS);
+                    z->confirmed = irrigation_is_full(z);
+                }
+            }
+            irrigation_fill(z, false);
+            irrigation_pump_release();
+
+            if (z->confirmed && irrigation_is_empty(z))
+            {
+                irrigation_fault(z, IRRIGATION_FAULT_SENSOR); /* full while the bottom is dry */
+            }
+            else if (!z->confirmed && !z->aborted)
+            {
+                irrigation_fault(z, IRRIGATION_FAULT_FILL_TIMEOUT);
+            }
+            else
+            {
+                // Do nothing
+            }
+
+            /* Hold, a stop ends it early */
+            if ((z->cycle_fault == IRRIGATION_FAULT_NONE) && !z->aborted)
+            {
+                irrigation_set_phase(z, IRRIGATION_HOLD);
+                CORO_WAIT_EVENT(c, IRRIGATION_EV_STOP, cfg->hold_s * 1000u);
+                z->aborted = (coro_take_events(c, IRRIGATION_EV_STOP) != 0u);
+            }
+
+            /* Drain until the empty switch confirms, also after a fault or a stop */
+            irrigation_set_phase(z, IRRIGATION_DRAIN);
+            irrigation_drain(z, true);
+            z->confirmed = false;
+            while (!z->confirmed && (irrigation_remaining(z, cfg->drain_timeout_s) > 0u))
+            {
+                if (irrigation_is_empty(z))
+                {
+                    CORO_SLEEP(c, IRRIGATION_CONFIRM_MS);
+                    z->confirmed = irrigation_is_empty(z);
+                }
+                else
+                {
+                    CORO_WAIT_EVENT(c, IRRIGATION_EV_LEVEL, irrigation_remaining(z, cfg->drain_timeout_s));
+                    (void)coro_take_events(c, IRRIGATION_EV_LEVEL);
+                }
+            }
+            irrigation_drain(z, false);
+            if (z->confirmed)
+            {
+                dose_flow(z->flooded_ml); /* the zone is empty, its water is back in the reservoir */
+                z->flooded_ml = 0.0f;
+            }
+            else
+            {
+                irrigation_fault(z, IRRIGATION_FAULT_DRAIN_TIMEOUT);
+            }
+        }
+
+        /* Fault escalation */
+        if (z->cycle_fault != IRRIGATION_FAULT_NONE)
+        {
+            z->faults++;
+        }
+        else if (!z->aborted)
+        {
+            z->faults = 0u;
+            z->cycles++;
+        }
+        else
+        {
+            // Do nothing, a stopped cycle doesn't count
+        }
+
+        if ((z->cycle_fault == IRRIGATION_FAULT_DRAIN_TIMEOUT) || (z->cycle_fault == IRRIGATION_FAULT_SENSOR) || (z->faults >= IRRIGATION_MAX_FAULTS))
+        {
+            irrigation_set_phase(z, IRRIGATION_LOCKED);
+            printf("Irrigation %s locked, use \"irrigation %lu reset\"\r\n", z->hw->name, (uint32_t)(z - irrigation.zones));
+            CORO_WAIT_EVENT(c, IRRIGATION_EV_RESET, CORO_WAIT_FOREVER);
+            z->faults = 0u;
+            printf("Irrigation %s unlocked\r\n", z->hw->name);
+        }
+    }
+    CORO_END(c);
+}
+
+/***************************************************
+ * @brief Get an initialized zone
+ * @param zone Zone
+ * @return Zone, NULL if it doesn't exist or is not initialized
+ ***************************************************/
+STATIC IRRIGATION_ZONE* irrigation_get(uint32_t zone)
+{
+    return ((zone < IRRIGATION_MAX_ZONES) && (irrigation.zones[zone].hw != NULL)) ? &irrigation.zones[zone] : NULL;
+}
+
+/***************************************************
+ * @brief Enable the EXTI interrupt of a float switch pin
+ * @param pin Pin
+ ***************************************************/
+STATIC void irrigation_enable_exti(uint16_t pin)
+{
+    const IRQn_Type irq = (IRQn_Type)((uint32_t)EXTI0_IRQn + (uint32_t)__builtin_ctz(pin)); /* one interrupt per line */
+
+    HAL_NVIC_SetPriority(irq, IRRIGATION_IRQ_PRIO, 0u);
+    HAL_NVIC_EnableIRQ(irq);
+}
+
+bool irrigation_init(uint32_t zone, const IRRIGATION_HW* hw)
+{
+    const bool ok = (zone < IRRIGATION_MAX_ZONES);
+
+    if (ok)
+    {
+        IRRIGATION_ZONE* z = &irrigation.zones[zone];
+        GPIO_InitTypeDef gpio = {0};
+
+        z->hw = hw;
+        z->faults = 0u;
+        z->cycles = 0u;
+        z->last_fault = IRRIGATION_FAULT_NONE;
+        z->filling = false;
+        z->flooded_ml = 0.0f;
+        irrigation_fill(z, false);
+        irrigation_drain(z, false);
+
+        gpio.Mode = GPIO_MODE_OUTPUT_PP;
+        gpio.Pull = GPIO_NOPULL;
+        gpio.Speed = GPIO_SPEED_FREQ_LOW;
+        gpio.Pin = hw->fill_pin;
+        HAL_GPIO_Init(hw->fill_port, &gpio);
+        gpio.Pin = hw->drain_pin;
+        HAL_GPIO_Init(hw->drain_port, &gpio);
+
+        gpio.Mode = GPIO_MODE_IT_RISING_FALLING;
+        gpio.Pull = GPIO_PULLUP;
+        gpio.Pin = hw->full_pin;
+        HAL_GPIO_Init(hw->full_port, &gpio);
+        gpio.Pin = hw->empty_pin;
+        HAL_GPIO_Init(hw->empty_port, &gpio);
+        irrigation_enable_exti(hw->full_pin);
+        irrigation_enable_exti(hw->empty_pin);
+
+        coro_start(&z->coro, irrigation_coro);
+    }
+
+    return ok;
+}
+
+void irrigation_start(uint32_t zone)
+{
+    IRRIGATION_ZONE* z = irrigation_get(zone);
+
+    if (z != NULL)
+    {
+        coro_post_event(&z->coro, IRRIGATION_EV_START);
+    }
+}
+
+void irrigation_stop(uint32_t zone)
+{
+    IRRIGATION_ZONE* z = irrigation_get(zone);
+
+    if (z != NULL)
+    {
+        coro_post_event(&z->coro, IRRIGATION_EV_STOP);
+    }
+}
+
+void irrigation_reset(uint32_t zone)
+{
+    IRRIGATION_ZONE* z = irrigation_get(zone);
+
+    if (z != NULL)
+    {
+        coro_post_event(&z->coro, IRRIGATION_EV_RESET);
+    }
+}
+
+IRRIGATION_PHASE irrigation_get_phase(uint32_t zone)
+{
+    const IRRIGATION_ZONE* z = irrigation_get(zone);
+
+    return (z != NULL) ? z->phase : IRRIGATION_IDLE;
+}
+
+bool irrigation_pump_claim(void)
+{
+    const bool ok = (irrigation.pumps < IRRIGATION_PUMP_SLOTS);
+
+    if (ok)
+    {
+        irrigation.pumps++;
+    }
+
+    return ok;
+}
+
+void irrigation_pump_release(void)
+{
+    if (irrigation.pumps > 0u)
+    {
+        irrigation.pumps--;
+        for (uint32_t i = 0u; i < IRRIGATION_MAX_ZONES; i++)
+        {
+            if (irrigation.zones[i].hw != NULL)
+            {
+                coro_post_event(&irrigation.zones[i].coro, IRRIGATION_EV_SLOT);
+            }
+        }
+    }
+}
+
+void irrigation_exti_irq(uint32_t line)
+{
+    const uint16_t pin = (uint16_t)(1u << line);
+
+    __HAL_GPIO_EXTI_CLEAR_RISING_IT(pin);
+    __HAL_GPIO_EXTI_CLEAR_FALLING_IT(pin);
+    for (uint32_t i = 0u; i < IRRIGATION_MAX_ZONES; i++)
+    {
+        const IRRIGATION_HW* hw = irrigation.zones[i].hw;
+        if ((hw != NULL) && ((hw->full_pin == pin) || (hw->empty_pin == pin)))
+        {
+            coro_post_event(&irrigation.zones[i].coro, IRRIGATION_EV_LEVEL);
+        }
+    }
+}
+
+void irrigation_print(void)
+{
+    for (uint32_t i = 0u; i < IRRIGATION_MAX_ZONES; i++)
+    {
+        const IRRIGATION_ZONE* z = &irrigation.zones[i];
+        const IRRIGATION_CONFIG* cfg = &config_get()->irrigation[i];
+
+        if (z->hw != NULL)
+        {
+            printf("Zone %lu %s: %s for %lu s, %lu cycles, %lu faults in a row, last fault %s\r\n", i, z->hw->name, irrigation_phase_names[z->phase],
+                   timer_get_elapsed_module_timer(z->phase_start) / 1000u, z->cycles, z->faults, irrigation_fault_names[z->last_fault]);
+            printf("  interval %lu s, hold %lu s, fill timeout %lu s, drain timeout %lu s, switches: %s %s\r\n", cfg->interval_s, cfg->hold_s, cfg->fill_timeout_s,
+                   cfg->drain_timeout_s, irrigation_is_full(z) ? "full" : "-", irrigation_is_empty(z) ? "empty" : "wet");
+        }
+        else
+        {
+            printf("Zone %lu: not initialized\r\n", i);
+        }
+    }
+    printf("Pump slots: %lu of %u in use\r\n", irrigation.pumps, IRRIGATION_PUMP_SLOTS);
+}
@@ -0,0 +1,413 @@
+/**
+ * @file memdma.c
+ * @author PL
+ * @brief Asynchronous memory copy and fill on spare GPDMA channels
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup MEMDMA
+ *
+ * The first item of a transfer is written to the channel registers, the others are linked-list items
+ * in memory (CTR1, CBR1, CSAR, CDAR and CLLR are updated from each item, CTR2 stays: software request,
+ * transfer complete event after the last item). The items of a channel are in one array aligned to
+ * its size, so they never cross the 64 KB page of CLBAR. Single beats, no bursts: a burst must not
+ * cross a 1 KB boundary, which the free alignment of the buffers can't guarantee.
+ */
+#include "memdma.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "stm32_hal.h"
+
+#define MEMDMA_IRQ_PRIO      6u       /* Priority of the DMA interrupts */
+#define MEMDMA_BENCH_SIZES   8u       /* Sizes of the benchmark, MEMDMA_BENCH_MIN doubled up to MEMDMA_BENCH_MAX */
+#define MEMDMA_BENCH_TIMEOUT 1000000u /* Cycles to wait for a DMA transfer of the benchmark */
+#define MEMDMA_LLI_UPDATE    (DMA_CLLR_UT1 | DMA_CLLR_UB1 | DMA_CLLR_USA | DMA_CLLR_UDA | DMA_CLLR_ULL)
+#define MEMDMA_FLAGS         (DMA_CFCR_TCF | DMA_CFCR_HTF | DMA_CFCR_DTEF | DMA_CFCR_ULEF | DMA_CFCR_USEF | DMA_CFCR_SUSPF | DMA_CFCR_TOF)
+#define MEMDMA_ERRORS        (DMA_CSR_DTEF | DMA_CSR_ULEF | DMA_CSR_USEF)
+
+/**
+ * @brief Linked-list item, the registers in the order of the update bits of CLLR
+ */
+typedef struct
+{
+    uint32_t ctr1; /**< Data width and address increments */
+    uint32_t cbr1; /**< Length [bytes] */
+    uint32_t csar; /**< Source address */
+    uint32_t cdar; /**< Destination address */
+    uint32_t cllr; /**< Update bits and address of the next item, 0 for the last item */
+} MEMDMA_LLI;
+
+/**
+ * @brief Channel
+ */
+typedef struct
+{
+    DMA_Channel_TypeDef* ch; /**< Registers */
+    MEMDMA_LLI* lli;         /**< Linked-list items */
+    uint32_t pattern;        /**< Source of a fill */
+    MEMDMA_CALLBACK cb;      /**< Completion callback */
+    void* arg;               /**< Argument of the callback */
+    volatile bool busy;      /**< Transfer running */
+} MEMDMA_CHANNEL;
+
+/**
+ * @brief Operational data of the memory DMA
+ */
+typedef struct
+{
+    MEMDMA_CHANNEL channels[MEMDMA_CHANNELS]; /**< Channels */
+    uint32_t threshold;                       /**< Transfers shorter than this are done by the CPU [bytes] */
+    uint32_t cpu_cycles[MEMDMA_BENCH_SIZES];  /**< Benchmark: memcpy() */
+    uint32_t dma_cycles[MEMDMA_BENCH_SIZES];  /**< Benchmark: DMA start to callback */
+    uint32_t dma_transfers;                   /**< Transfers done by the DMA */
+    uint32_t cpu_transfers;                   /**< Transfers done by the CPU */
+    uint32_t busy_fallbacks;                  /**< CPU transfers above the threshold, all channels busy */
+    uint32_t errors;                          /**< DMA errors */
+} MEMDMA_DATA;
+
+/**
+ * @brief Result of a benchmark transfer
+ */
+typedef struct
+{
+    volatile bool done; /**< Callback called */
+    volatile bool ok;   /**< Result of the transfer */
+} MEMDMA_BENCH;
+
+STATIC MEMDMA_DATA memdma;
+STATIC MEMDMA_LLI memdma_lli[MEMDMA_CHANNELS][MEMDMA_MAX_ITEMS] __attribute__((aligned(512)));
+STATIC uint32_t memdma_bench_src[MEMDMA_BENCH_MAX / sizeof(uint32_t)];
+STATIC uint32_t memdma_bench_dst[MEMDMA_BENCH_MAX / sizeof(uint32_t)];
+
+/***************************************************
+ * @brief Registers of the channels
+ ***************************************************/
+static DMA_Channel_TypeDef* const memdma_instances[MEMDMA_CHANNELS] = {GPDMA1_Channel6, GPDMA1_Channel7};
+
+/***************************************************
+ * @brief Interrupts of the channels
+ ***************************************************/
+static const IRQn_Type memdma_irqs[MEMDMA_CHANNELS] = {GPDMA1_Channel6_IRQn, GPDMA1_Channel7_IRQn};
+
+/***************************************************
+ * @brief Claim an idle channel
+ * @return Channel, NULL if all channels are busy
+ ***************************************************/
+STATIC MEMDMA_CHANNEL* memdma_claim(void)
+{
+    MEMDMA_CHANNEL* c = NULL;
+    const uint32_t old_primask = __get_PRIMASK();
+
+    (void)__disable_irq();
+    for (uint32_t i = 0u; (c == NULL) && (i < MEMDMA_CHANNELS); i++)
+    {
+        if (!memdma.channels[i].busy)
+        {
+            c = &memdma.channels[i];
+            c->busy = true;
+        }
+    }
+    __set_PRIMASK(old_primask);
+
+    return c;
+}
+
+/***************************************************
+ * @brief Number of linked-list items of a region
+ * @param len Length [bytes]
+ * @return Items
+ ***************************************************/
+STATIC uint32_t memdma_items(uint32_t len)
+{
+    return (len + (MEMDMA_MAX_BLOCK - 1u)) / MEMDMA_MAX_BLOCK;
+}
+
+/***************************************************
+ * @brief Add the linked-list items of a region, the data width follows the common alignment
+ * @param c Channel
+ * @param n Items of the channel, incremented
+ * @param dst Destination address
+ * @param src Source address
+ * @param len Length [bytes]
+ * @param src_inc Increment the source, false for a fill
+ ***************************************************/
+STATIC void memdma_add(MEMDMA_CHANNEL* c, uint32_t* n, uint32_t dst, uint32_t src, uint32_t len, bool src_inc)
+{
+    const uint32_t align = dst | len | (src_inc ? src : 0u);
+    const uint32_t width = ((align & 3u) == 0u) ? 2u : (((align & 1u) == 0u) ? 1u : 0u); /* log2 of the data width */
+    const uint32_t ctr1 = (width << DMA_CTR1_SDW_LOG2_Pos) | (width << DMA_CTR1_DDW_LOG2_Pos) | DMA_CTR1_DINC | (src_inc ? DMA_CTR1_SINC : 0u);
+
+    while (len > 0u)
+    {
+        const uint32_t block = (len > MEMDMA_MAX_BLOCK) ? MEMDMA_MAX_BLOCK : len;
+        MEMDMA_LLI* lli = &c->lli[*n];
+
+        lli->ctr1 = ctr1;
+        lli->cbr1 = block;
+        lli->csar = src;
+        lli->cdar = dst;
+        lli->cllr = 0u;
+        if (*n > 0u)
+        {
+            c->lli[*n - 1u].cllr = MEMDMA_LLI_UPDATE | ((uint32_t)lli & DMA_CLLR_LA);
+        }
+        (*n)++;
+        dst += block;
+        src += src_inc ? block : 0u;
+        len -= block;
+    }
+}
+
+/***************************************************
+ * @brief Start the channel with the first item, the channel follows the links
+ * @param c Channel
+ ***************************************************/
+STATIC void memdma_start(MEMDMA_CHANNEL* c)
+{
+    DMA_Channel_TypeDef* ch = c->ch;
+    const MEMDMA_LLI* first = &c->lli[0];
+
+    ch->CFCR = MEMDMA_FLAGS;
+    ch->CTR1 = first->ctr1;
+    ch->CTR2 = DMA_CTR2_SWREQ | DMA_CTR2_TCEM; /* memory to memory, complete after the last item */
+    ch->CBR1 = first->cbr1;
+    ch->CSAR = first->csar;
+    ch->CDAR = first->cdar;
+    ch->CLLR = first->cllr;
+    ch->CCR = DMA_CCR_TCIE | DMA_CCR_DTEIE | DMA_CCR_ULEIE | DMA_CCR_USEIE;
+    ch->CCR |= DMA_CCR_EN;
+}
+
+/***************************************************
+ * @brief Run a transfer on a channel, or by the CPU if it is short or all channels are busy
+ * @param items Regions, src NULL to fill with the pattern
+ * @param num_items Number of regions
+ * @param pattern Byte of a fill, repeated in all bytes
+ * @param cb Completion callback, NULL if not needed
+ * @param arg Argument of the callback
+ * @param threshold Shortest transfer done by the DMA [bytes]
+ * @return false if the transfer needs more than MEMDMA_MAX_ITEMS items
+ ***************************************************/
+STATIC bool memdma_run(const MEMDMA_ITEM* items, uint32_t num_items, uint32_t pattern, MEMDMA_CALLBACK cb, void* arg, uint32_t threshold)
+{
+    uint32_t total = 0u;
+    uint32_t needed = 0u;
+
+    for (uint32_t i = 0u; i < num_items; i++)
+    {
+        total += items[i].len;
+        needed += memdma_items(items[i].len);
+    }
+
+    const bool ok = (needed <= MEMDMA_MAX_ITEMS);
+    MEMDMA_CHANNEL* c = (ok && (total > 0u) && (total >= threshold)) ? memdma_claim() : NULL;
+
+    if (c != NULL)
+    {
+        uint32_t n = 0u;
+
+        c->pattern = pattern;
+        c->cb = cb;
+        c->arg = arg;
+        for (uint32_t i = 0u; i < num_items; i++)
+        {
+            const bool fill = (items[i].src == NULL);
+            memdma_add(c, &n, (uint32_t)items[i].dst, fill ? (uint32_t)&c->pattern : (uint32_t)items[i].src, items[i].len, !fill);
+        }
+        memdma.dma_transfers++;
+        memdma_start(c);
+    }
+    else if (ok)
+    {
+        for (uint32_t i = 0u; i < num_items; i++)
+        {
+            if (items[i].src == NULL)
+            {
+                (void)memset(items[i].dst, (int)(pattern & 0xFFu), items[i].len);
+            }
+            else
+            {
+                (void)memcpy(items[i].dst, items[i].src, items[i].len);
+            }
+        }
+        memdma.cpu_transfers++;
+        memdma.busy_fallbacks += ((total > 0u) && (total >= threshold)) ? 1u : 0u;
+        if (cb != NULL)
+        {
+            cb(arg, true);
+        }
+    }
+    else
+    {
+        // Do nothing, too many items
+    }
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Completion callback of the benchmark
+ * @param arg Result, MEMDMA_BENCH
+ * @param ok Result of the transfer
+ ***************************************************/
+STATIC void memdma_bench_done(void* arg, bool ok)
+{
+    MEMDMA_BENCH* b = (MEMDMA_BENCH*)arg;
+
+    b->ok = ok;
+    b->done = true;
+}
+
+void memdma_init(void)
+{
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+    for (uint32_t i = 0u; i < MEMDMA_CHANNELS; i++)
+    {
+        MEMDMA_CHANNEL* c = &memdma.channels[i];
+
+        c->ch = memdma_instances[i];
+        c->lli = memdma_lli[i];
+        c->busy = false;
+        c->ch->CCR = DMA_CCR_RESET;
+        c->ch->CLBAR = (uint32_t)c->lli & DMA_CLBAR_LBA;
+        HAL_NVIC_SetPriority(memdma_irqs[i], MEMDMA_IRQ_PRIO, 0u);
+        HAL_NVIC_EnableIRQ(memdma_irqs[i]);
+    }
+    memdma.threshold = MEMDMA_BENCH_MAX;
+    (void)memdma_calibrate();
+}
+
+bool memdma_copy(void* dst, const void* src, uint32_t len, MEMDMA_CALLBACK cb, void* arg)
+{
+    const MEMDMA_ITEM item = {.dst = dst, .src = src, .len = len};
+
+    return memdma_run(&item, 1u, 0u, cb, arg, memdma.threshold);
+}
+
+bool memdma_fill(void* dst, uint8_t value, uint32_t len, MEMDMA_CALLBACK cb, void* arg)
+{
+    const MEMDMA_ITEM item = {.dst = dst, .src = NULL, .len = len};
+
+    return memdma_run(&item, 1u, (uint32_t)value * 0x01010101u, cb, arg, memdma.threshold);
+}
+
+bool memdma_gather(const MEMDMA_ITEM* items, uint32_t num_items, MEMDMA_CALLBACK cb, void* arg)
+{
+    bool ok = true;
+
+    for (uint32_t i = 0u; ok && (i < num_items); i++)
+    {
+        ok = (items[i].src != NULL);
+    }
+
+    return ok && memdma_run(items, num_items, 0u, cb, arg, memdma.threshold);
+}
+
+bool memdma_calibrate(void)
+{
+    static MEMDMA_BENCH bench;
+    uint32_t threshold = 0u;
+    uint32_t i = 0u;
+    bool ok = true;
+
+    for (uint32_t j = 0u; j < MEMDMA_CHANNELS; j++)
+    {
+        ok = ok && !memdma.channels[j].busy;
+    }
+
+    for (uint32_t size = MEMDMA_BENCH_MIN; ok && (size <= MEMDMA_BENCH_MAX); size *= 2u)
+    {
+        const MEMDMA_ITEM item = {.dst = memdma_bench_dst, .src = memdma_bench_src, .len = size};
+        uint32_t start = bench_get_cycles();
+
+        (void)memcpy(memdma_bench_dst, memdma_bench_src, size);
+        memdma.cpu_cycles[i] = bench_get_cycles() - start;
+
+        bench.done = false;
+        start = bench_get_cycles();
+        (void)memdma_run(&item, 1u, 0u, memdma_bench_done, &bench, 0u);
+        while (!bench.done && ((bench_get_cycles() - start) < MEMDMA_BENCH_TIMEOUT))
+        {
+            // Wait for the interrupt
+        }
+        memdma.dma_cycles[i] = bench_get_cycles() - start;
+        ok = bench.done && bench.ok;
+        if (ok && (threshold == 0u) && (memdma.dma_cycles[i] <= memdma.cpu_cycles[i]))
+        {
+            threshold = size;
+        }
+        i++;
+    }
+
+    if (ok)
+    {
+        memdma.threshold = (threshold != 0u) ? threshold : (2u * MEMDMA_BENCH_MAX); /* the DMA wins beyond the benchmark */
+        memdma.dma_transfers = 0u;
+        memdma.cpu_transfers = 0u;
+        memdma.busy_fallbacks = 0u;
+    }
+
+    return ok;
+}
+
+uint32_t memdma_get_threshold(void)
+{
+    return memdma.threshold;
+}
+
+void memdma_irq(uint32_t channel)
+{
+    MEMDMA_CHANNEL* c = &memdma.channels[channel];
+    DMA_Channel_TypeDef* ch = c->ch;
+    const uint32_t csr = ch->CSR;
+    bool done = false;
+    bool ok = false;
+
+    if ((csr & MEMDMA_ERRORS) != 0u)
+    {
+        ch->CFCR = MEMDMA_FLAGS;
+        ch->CCR = DMA_CCR_RESET; /* the channel is disabled by the error */
+        memdma.errors++;
+        done = true;
+    }
+    else if ((csr & DMA_CSR_TCF) != 0u)
+    {
+        ch->CFCR = MEMDMA_FLAGS;
+        done = true;
+        ok = true;
+    }
+    else
+    {
+        // Do nothing
+    }
+
+    if (done)
+    {
+        const MEMDMA_CALLBACK cb = c->cb;
+        void* const arg = c->arg;
+
+        c->busy = false; /* the callback may start the next transfer */
+        if (cb != NULL)
+        {
+            cb(arg, ok);
+        }
+    }
+}
+
+void memdma_print(void)
+{
+    uint32_t i = 0u;
+
+    printf("Memory DMA: threshold %lu bytes, %lu DMA and %lu CPU transfers, %lu CPU with all channels busy, %lu errors\r\n", memdma.threshold, memdma.dma_transfers, memdma.cpu_transfers,
+           memdma.busy_fallbacks, memdma.errors);
+    printf("Bytes  memcpy     DMA [cycles]\r\n");
+    for (uint32_t size = MEMDMA_BENCH_MIN; size <= MEMDMA_BENCH_MAX; size *= 2u)
+    {
+        printf("%5lu %7lu %7lu\r\n", size, memdma.cpu_cycles[i], memdma.dma_cycles[i]);
+        i++;
+    }
+}
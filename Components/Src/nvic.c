@@ -9,6 +9,7 @@
  */
 #include <stdbool.h>
 #include "stm32_hal.h"
+#include "handoff.h"
 #include "nvic.h"
 
 /**************************************************
@@ -41,5 +42,6 @@ void nvic_safe_system_reset(void)
     //         flash_wait_ready();
     //     }
     // #endif
-    //     HAL_NVIC_SystemReset();
+    handoff_write(); /* warm reboot, the next boot takes over the state */
+    HAL_NVIC_SystemReset();
 }
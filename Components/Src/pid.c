@@ -0,0 +1,293 @@
+/**
+ * @file pid.c
+ * @author PL
+ * @brief PID control loops for dosing and heating
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup PID
+ *
+ * The anti-windup is conditional integration: when the output is saturated, the integral doesn't
+ * move further into the saturation. This keeps the loop from overshooting after a long saturation,
+ * e.g. a heater at full power after a cold refill.
+ *
+ * The feed-forward is applied by shifting the output limits of the controller: the sum of the
+ * feed-forward and the controller output stays within the limits of the actuator, and the integral
+ * only holds the part the feed-forward doesn't cover.
+ */
+#include "pid.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "coroutine.h"
+
+#define PID_SIM_PERIOD 100u /* Sample period of the simulated plant [ms] */
+
+/**
+ * @brief Operational data of a loop
+ */
+typedef struct
+{
+    CORO coro;         /**< Loop coroutine, first member */
+    const PID_IO* io;  /**< Process value and actuator, NULL if not registered */
+    PID_STATE state;   /**< Controller state */
+    float setpoint;    /**< Setpoint */
+    float pv;          /**< Last process value */
+    float output;      /**< Last output */
+    float feedforward; /**< Feed-forward added to the controller output */
+    bool enabled;      /**< The controller writes the actuator */
+} PID_LOOP_DATA;
+
+/**
+ * @brief State of the simulated first order plus dead time plant
+ */
+typedef struct
+{
+    float gain;                     /**< Static gain */
+    float alpha;                    /**< Filter factor of the first order lag, dt / (tau + dt) */
+    float y;                        /**< Output of the plant */
+    float delay[PID_SIM_MAX_DELAY]; /**< Delay line of the input */
+    uint32_t dead;                  /**< Dead time [samples] */
+    uint32_t index;                 /**< Position in the delay line */
+} PID_SIM;
+
+STATIC PID_LOOP_DATA pid_loops[PID_MAX_LOOPS];
+STATIC PID_SIM pid_sim;
+
+/***************************************************
+ * @brief Process value of the simulated plant
+ * @return Output of the plant
+ ***************************************************/
+STATIC float pid_sim_read(void)
+{
+    return pid_sim.y;
+}
+
+/***************************************************
+ * @brief Input of the simulated plant, advances the plant by one sample
+ * @param output Input of the plant
+ ***************************************************/
+STATIC void pid_sim_write(float output)
+{
+    float u = output;
+
+    if (pid_sim.dead > 0u)
+    {
+        u = pid_sim.delay[pid_sim.index];
+        pid_sim.delay[pid_sim.index] = output;
+        pid_sim.index = (pid_sim.index + 1u) % pid_sim.dead;
+    }
+    pid_sim.y += pid_sim.alpha * ((pid_sim.gain * u) - pid_sim.y);
+}
+
+/***************************************************
+ * @brief Simulated plant, input 0 .. 100 %
+ ***************************************************/
+static const PID_IO pid_sim_io = {
+    .name = "sim",
+    .read = pid_sim_read,
+    .write = pid_sim_write,
+    .out_min = 0.0f,
+    .out_max = 100.0f,
+    .period_ms = PID_SIM_PERIOD,
+};
+
+/***************************************************
+ * @brief Loop coroutine, one sample every period of the loop
+ * @param c Control block, first member of PID_LOOP_DATA
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE pid_coro(CORO* c)
+{
+    PID_LOOP_DATA* l = (PID_LOOP_DATA*)c; //lint !e740 !e826 the control block is the first member
+
+    CORO_BEGIN(c);
+    CORO_SLEEP(c, l->io->period_ms);
+    l->pv = l->io->read();
+    if (l->enabled)
+    {
+        const uint32_t loop = (uint32_t)(l - pid_loops);
+        const float ff = l->feedforward;
+        l->output = ff + pid_step(&l->state, &config_get()->pid[loop], l->setpoint, l->pv, (float)l->io->period_ms * 0.001f, l->io->out_min - ff, l->io->out_max - ff);
+        l->io->write(l->output);
+    }
+    CORO_RESTART(c);
+    CORO_END(c);
+}
+
+void pid_reset(PID_STATE* s)
+{
+    s->integral = 0.0f;
+    s->prev_pv = 0.0f;
+    s->first = true;
+}
+
+float pid_step(PID_STATE* s, const PID_GAINS* g, float setpoint, float pv, float dt, float out_min, float out_max)
+{
+    const float err = setpoint - pv;
+    const float p = g->kp * err;
+    const float d = s->first ? 0.0f : ((-g->kd * (pv - s->prev_pv)) / dt); /* on the measurement, no kick on setpoint steps */
+    float integral = s->integral + (g->ki * err * dt);
+    float out = p + integral + d;
+
+    if (((out > out_max) && (err > 0.0f)) || ((out < out_min) && (err < 0.0f)))
+    {
+        integral = s->integral; /* saturated, don't integrate further into the saturation */
+        out = p + integral + d;
+    }
+
+    s->integral = integral;
+    s->prev_pv = pv;
+    s->first = false;
+
+    if (out > out_max)
+    {
+        out = out_max;
+    }
+    else if (out < out_min)
+    {
+        out = out_min;
+    }
+    else
+    {
+        // Do nothing
+    }
+
+    return out;
+}
+
+bool pid_register(PID_LOOP loop, const PID_IO* io)
+{
+    const bool ok = (loop < PID_MAX_LOOPS) && (io->read != NULL) && (io->write != NULL) && (io->out_max > io->out_min) && (io->period_ms > 0u);
+
+    if (ok)
+    {
+        PID_LOOP_DATA* l = &pid_loops[loop];
+        l->io = io;
+        l->enabled = false;
+        l->output = io->out_min;
+        l->feedforward = 0.0f;
+        l->pv = io->read();
+        l->setpoint = l->pv;
+        pid_reset(&l->state);
+        coro_start(&l->coro, pid_coro);
+    }
+
+    return ok;
+}
+
+const PID_IO* pid_get_io(PID_LOOP loop)
+{
+    return (loop < PID_MAX_LOOPS) ? pid_loops[loop].io : NULL;
+}
+
+void pid_set_setpoint(PID_LOOP loop, float setpoint)
+{
+    if (loop < PID_MAX_LOOPS)
+    {
+        pid_loops[loop].setpoint = setpoint;
+    }
+}
+
+float pid_get_setpoint(PID_LOOP loop)
+{
+    return (loop < PID_MAX_LOOPS) ? pid_loops[loop].setpoint : 0.0f;
+}
+
+void pid_set_feedforward(PID_LOOP loop, float feedforward)
+{
+    if (loop < PID_MAX_LOOPS)
+    {
+        pid_loops[loop].feedforward = feedforward;
+    }
+}
+
+float pid_get_output(PID_LOOP loop)
+{
+    return (loop < PID_MAX_LOOPS) ? pid_loops[loop].output : 0.0f;
+}
+
+bool pid_enable(PID_LOOP loop, bool enable)
+{
+    const bool ok = (pid_get_io(loop) != NULL);
+
+    if (ok)
+    {
+        PID_LOOP_DATA* l = &pid_loops[loop];
+        if (enable && !l->enabled)
+        {
+            pid_reset(&l->state);
+            l->state.integral = l->output - l->feedforward; /* bumpless, start from the last output */
+        }
+        l->enabled = enable;
+    }
+
+    return ok;
+}
+
+bool pid_is_enabled(PID_LOOP loop)
+{
+    return (loop < PID_MAX_LOOPS) && pid_loops[loop].enabled;
+}
+
+bool pid_sim_init(float gain, float tau_s, uint32_t dead_samples)
+{
+    const bool ok = (tau_s > 0.0f) && (dead_samples <= PID_SIM_MAX_DELAY);
+
+    if (ok)
+    {
+        const float dt = (float)PID_SIM_PERIOD * 0.001f;
+        pid_sim.gain = gain;
+        pid_sim.alpha = dt / (tau_s + dt);
+        pid_sim.y = 0.0f;
+        pid_sim.dead = dead_samples;
+        pid_sim.index = 0u;
+        for (uint32_t i = 0u; i < PID_SIM_MAX_DELAY; i++)
+        {
+            pid_sim.delay[i] = 0.0f;
+        }
+        (void)pid_register(PID_LOOP_SIM, &pid_sim_io);
+    }
+
+    return ok;
+}
+
+void pid_print_float(float val)
+{
+    const int32_t milli = (int32_t)((val * 1000.0f) + ((val >= 0.0f) ? 0.5f : -0.5f));
+    const uint32_t abs_milli = (milli < 0) ? (uint32_t)-milli : (uint32_t)milli;
+
+    printf("%s%lu.%03lu", (milli < 0) ? "-" : "", abs_milli / 1000u, abs_milli % 1000u);
+}
+
+void pid_print(void)
+{
+    for (uint32_t i = 0u; i < PID_MAX_LOOPS; i++)
+    {
+        const PID_LOOP_DATA* l = &pid_loops[i];
+        const PID_GAINS* g = &config_get()->pid[i];
+
+        printf("Loop %lu %s: ", i, (l->io != NULL) ? l->io->name : "not registered");
+        if (l->io != NULL)
+        {
+            printf("%s, sp ", l->enabled ? "on" : "off");
+            pid_print_float(l->setpoint);
+            printf(" pv ");
+            pid_print_float(l->pv);
+            printf(" out ");
+            pid_print_float(l->output);
+            printf(" ff ");
+            pid_print_float(l->feedforward);
+            printf(", ");
+        }
+        printf("kp ");
+        pid_print_float(g->kp);
+        printf(" ki ");
+        pid_print_float(g->ki);
+        printf(" kd ");
+        pid_print_float(g->kd);
+        printf("\r\n");
+    }
+}
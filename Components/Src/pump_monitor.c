@@ -0,0 +1,392 @@
+/**
+ * @file pump_monitor.c
+ * @author PL
+ * @brief Pump current signature analysis, detects a dry running or blocked pump
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup PUMP_MONITOR
+ *
+ * The interrupt only runs the Goertzel recursions and the sum, the 64 bit power calculation
+ * and the classification run in a coroutine once per block. The interrupt is handled on register
+ * level instead of HAL_ADC_IRQHandler() to keep the cost per sample low, its cycles are measured
+ * with the DWT counter and shown as CPU load by the "pump_mon" command.
+ * The interrupt publishes the blocks in a snapshot store, it never waits for the coroutine. A block
+ * the coroutine didn't get to is counted as overrun from the frame numbers.
+ */
+#include "pump_monitor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "calib.h"
+#include "coroutine.h"
+#include "dsp.h"
+#include "handoff.h"
+#include "snapshot.h"
+#include "timer.h"
+
+#define PUMP_MON_BINS       3u      /* Goertzel bins: commutation, 2nd commutation harmonic and supply */
+#define PUMP_MON_BIN_COMM   0u      /* Index of the commutation bin */
+#define PUMP_MON_BIN_COMM2  1u      /* Index of the 2nd commutation harmonic bin */
+#define PUMP_MON_BIN_SUPPLY 2u      /* Index of the supply harmonic bin */
+#define PUMP_MON_EV_BLOCK   0x0001u /* Coroutine event: a block is complete */
+#define PUMP_MON_IRQ_PRIO   5u      /* Priority of the ADC interrupt */
+#define PUMP_MON_PERMILLE   1000u   /* Full duty cycle */
+
+/**
+ * @brief Result of one block, written by the interrupt
+ */
+typedef struct
+{
+    int32_t s1[PUMP_MON_BINS]; /**< Goertzel state s[n-1] of each bin */
+    int32_t s2[PUMP_MON_BINS]; /**< Goertzel state s[n-2] of each bin */
+    uint32_t sum;              /**< Sum of all samples */
+    uint32_t isr_cycles;       /**< CPU cycles spent in the interrupt */
+} PUMP_MON_BLOCK;
+
+/**
+ * @brief Operational data of the pump monitor
+ */
+typedef struct
+{
+    CORO coro;                             /**< Classification coroutine, first member */
+    ADC_HandleTypeDef* hadc;               /**< ADC sampling the pump current */
+    TIM_HandleTypeDef* htim;               /**< PWM timer, channel 4 triggers the ADC */
+    uint32_t pwm_channel;                  /**< Timer channel driving the pump */
+    DSP_GOERTZEL bins[PUMP_MON_BINS];      /**< Goertzel filters, used by the interrupt */
+    uint32_t sum;                          /**< Running sum of the block, used by the interrupt */
+    uint32_t count;                        /**< Samples in the running block, used by the interrupt */
+    uint32_t isr_cycles;                   /**< Interrupt cycles of the running block */
+    SNAPSHOT blocks;                       /**< Complete blocks, written by the interrupt */
+    PUMP_MON_BLOCK block_buf[2];           /**< Buffers of the snapshot store */
+    uint32_t block_seq;                    /**< Number of the last classified block */
+    uint32_t overruns;                     /**< Blocks not classified because the coroutine was late */
+    uint32_t nominal;                      /**< Mean ADC counts of a correctly running pump */
+    uint32_t mean;                         /**< Mean ADC counts of the last block */
+    uint32_t ripple_pct;                   /**< Commutation ripple of the last block [% of mean] */
+    uint32_t supply_pct;                   /**< Supply harmonic ripple of the last block [% of mean] */
+    uint32_t load_permille;                /**< CPU load of the interrupt [0.1%] */
+    PUMP_MON_STATE raw;                    /**< Classification of the last block */
+    PUMP_MON_STATE state;                  /**< Debounced state */
+    uint32_t debounce;                     /**< Number of equal raw classifications */
+} PUMP_MON_DATA;
+
+STATIC PUMP_MON_DATA pump_mon;
+
+/***************************************************
+ * @brief Names of the states, in the same order as PUMP_MON_STATE
+ ***************************************************/
+static const char* const pump_mon_state_names[] = {"unknown", "off", "running", "dry", "blocked", "no data"};
+
+/***************************************************
+ * @brief Ripple of a bin as percentage of the mean
+ * ripple = 2 * |X| / (N * mean), so ripple^2 = 4 * |X|^2 / (N * mean)^2
+ * @param power Squared magnitude of the bin
+ * @param mean Mean of the block
+ * @return Ripple [%]
+ ***************************************************/
+STATIC uint32_t pump_monitor_ripple_pct(uint64_t power, uint32_t mean)
+{
+    uint32_t pct = 0u;
+
+    if (mean > 0u)
+    {
+        const uint64_t den = (uint64_t)PUMP_MON_BLOCK_LEN * mean;
+        const uint64_t sq = (power * 40000u) / (den * den); /* ripple^2 in %^2 */
+        pct = dsp_isqrt((sq > UINT32_MAX) ? UINT32_MAX : (uint32_t)sq);
+    }
+
+    return pct;
+}
+
+/***************************************************
+ * @brief Classify a block
+ * @param b Block
+ * @return Classification of the block
+ ***************************************************/
+STATIC PUMP_MON_STATE pump_monitor_classify(const PUMP_MON_BLOCK* b)
+{
+    PUMP_MON_STATE raw;
+    uint64_t power[PUMP_MON_BINS];
+
+    for (uint32_t i = 0u; i < PUMP_MON_BINS; i++)
+    {
+        power[i] = dsp_goertzel_power(pump_mon.bins[i].coeff, b->s1[i], b->s2[i]);
+    }
+    pump_mon.mean = b->sum / PUMP_MON_BLOCK_LEN;
+    pump_mon.ripple_pct = pump_monitor_ripple_pct(power[PUMP_MON_BIN_COMM] + power[PUMP_MON_BIN_COMM2], pump_mon.mean);
+    pump_mon.supply_pct = pump_monitor_ripple_pct(power[PUMP_MON_BIN_SUPPLY], pump_mon.mean);
+    pump_mon.load_permille = (uint32_t)(((uint64_t)b->isr_cycles * PUMP_MON_PWM_HZ * 1000u) / ((uint64_t)SystemCoreClock * PUMP_MON_BLOCK_LEN));
+
+    const bool rotating = (pump_mon.ripple_pct >= PUMP_MON_RIPPLE_MIN_PCT) && (pump_mon.ripple_pct > pump_mon.supply_pct);
+    if (pump_mon.mean < PUMP_MON_OFF_LEVEL)
+    {
+        raw = PUMP_MON_OFF;
+    }
+    else if (!rotating || ((pump_mon.mean * 100u) > (pump_mon.nominal * PUMP_MON_BLOCKED_PCT)))
+    {
+        raw = PUMP_MON_BLOCKED;
+    }
+    else if ((pump_mon.mean * 100u) < (pump_mon.nominal * PUMP_MON_DRY_PCT))
+    {
+        raw = PUMP_MON_DRY;
+    }
+    else
+    {
+        raw = PUMP_MON_RUNNING;
+    }
+
+    return raw;
+}
+
+/***************************************************
+ * @brief Accept a classification after PUMP_MON_DEBOUNCE equal results
+ * @param raw Classification of the last block
+ ***************************************************/
+STATIC void pump_monitor_debounce(PUMP_MON_STATE raw)
+{
+    if (raw == pump_mon.raw)
+    {
+        if (pump_mon.debounce < PUMP_MON_DEBOUNCE)
+        {
+            pump_mon.debounce++;
+        }
+    }
+    else
+    {
+        pump_mon.raw = raw;
+        pump_mon.debounce = 1u;
+    }
+
+    if ((pump_mon.debounce >= PUMP_MON_DEBOUNCE) && (pump_mon.state != raw))
+    {
+        pump_mon.state = raw;
+        printf("Pump %s\r\n", pump_mon_state_names[raw]);
+    }
+}
+
+/***************************************************
+ * @brief Classification coroutine, waits for the blocks of the interrupt
+ * @param c Control block
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE pump_monitor_coro(CORO* c)
+{
+    CORO_BEGIN(c);
+    CORO_WAIT_EVENT(c, PUMP_MON_EV_BLOCK, PUMP_MON_NO_DATA_TIMEOUT);
+    if (coro_take_events(c, PUMP_MON_EV_BLOCK) == 0u)
+    {
+        pump_mon.raw = PUMP_MON_NO_DATA;
+        pump_mon.state = PUMP_MON_NO_DATA; /* no debounce, there is nothing to debounce */
+    }
+    else
+    {
+        PUMP_MON_BLOCK block;
+        uint32_t seq = 0u;
+
+        if (snapshot_read(&pump_mon.blocks, &block, &seq))
+        {
+            pump_mon.overruns += (seq - pump_mon.block_seq) - 1u;
+            pump_mon.block_seq = seq;
+            pump_monitor_debounce(pump_monitor_classify(&block));
+        }
+    }
+    CORO_RESTART(c);
+    CORO_END(c);
+}
+
+/***************************************************
+ * @brief Injected trigger of the ADC for channel 4 of the PWM timer
+ * @param htim PWM timer handle
+ * @return Trigger source, 0 if the timer can't trigger injected conversions with channel 4
+ ***************************************************/
+STATIC uint32_t pump_monitor_adc_trigger(const TIM_HandleTypeDef* htim)
+{
+    uint32_t trigger = 0u;
+
+    if (htim->Instance == TIM1)
+    {
+        trigger = ADC_EXTERNALTRIGINJEC_T1_CC4;
+    }
+    else if (htim->Instance == TIM3)
+    {
+        trigger = ADC_EXTERNALTRIGINJEC_T3_CC4;
+    }
+    else if (htim->Instance == TIM8)
+    {
+        trigger = ADC_EXTERNALTRIGINJEC_T8_CC4;
+    }
+    else
+    {
+        // Do nothing
+    }
+
+    return trigger;
+}
+
+bool pump_monitor_init(ADC_HandleTypeDef* hadc, uint32_t adc_channel, TIM_HandleTypeDef* htim, uint32_t pwm_channel)
+{
+    const uint32_t trigger = pump_monitor_adc_trigger(htim);
+    const HANDOFF_DATA* h = handoff_get();
+    bool ok = (trigger != 0u) && (hadc->Instance == ADC1);
+
+    pump_mon.hadc = hadc;
+    pump_mon.htim = NULL; /* set when the timer is configured */
+    pump_mon.pwm_channel = pwm_channel;
+    pump_mon.nominal = ((h != NULL) && (h->pump_nominal >= PUMP_MON_OFF_LEVEL)) ? h->pump_nominal : PUMP_MON_NOMINAL_DEFAULT;
+    pump_mon.state = PUMP_MON_UNKNOWN;
+    pump_mon.raw = PUMP_MON_UNKNOWN;
+    pump_mon.debounce = 0u;
+    pump_mon.count = 0u;
+    pump_mon.sum = 0u;
+    pump_mon.block_seq = 0u;
+    snapshot_init(&pump_mon.blocks, pump_mon.block_buf, sizeof(PUMP_MON_BLOCK));
+    dsp_goertzel_init(&pump_mon.bins[PUMP_MON_BIN_COMM], PUMP_MON_COMM_HZ, PUMP_MON_PWM_HZ);
+    dsp_goertzel_init(&pump_mon.bins[PUMP_MON_BIN_COMM2], 2u * PUMP_MON_COMM_HZ, PUMP_MON_PWM_HZ);
+    dsp_goertzel_init(&pump_mon.bins[PUMP_MON_BIN_SUPPLY], PUMP_MON_SUPPLY_HZ, PUMP_MON_PWM_HZ);
+
+    /* PWM timer, the timer clock is twice PCLK1 when the APB1 prescaler is used */
+    uint32_t tim_clk = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR2 & RCC_CFGR2_PPRE1_2) != 0u)
+    {
+        tim_clk *= 2u;
+    }
+    htim->Init.Prescaler = 0u;
+    htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim->Init.Period = (tim_clk / PUMP_MON_PWM_HZ) - 1u;
+    htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+    ok = ok && (HAL_TIM_PWM_Init(htim) == HAL_OK);
+
+    TIM_OC_InitTypeDef oc = {0};
+    oc.OCMode = TIM_OCMODE_PWM1;
+    oc.Pulse = 0u; /* pump off */
+    oc.OCPolarity = TIM_OCPOLARITY_HIGH;
+    oc.OCFastMode = TIM_OCFAST_DISABLE;
+    ok = ok && (HAL_TIM_PWM_ConfigChannel(htim, &oc, pwm_channel) == HAL_OK);
+    oc.Pulse = 1u; /* ADC trigger, moved to the middle of the on-time by pump_monitor_set_pwm() */
+    ok = ok && (HAL_TIM_PWM_ConfigChannel(htim, &oc, TIM_CHANNEL_4) == HAL_OK);
+
+    /* Injected conversion triggered by channel 4 */
+    ADC_InjectionConfTypeDef inj = {0};
+    inj.InjectedChannel = adc_channel;
+    inj.InjectedRank = ADC_INJECTED_RANK_1;
+    inj.InjectedSamplingTime = ADC_SAMPLETIME_20CYCLES;
+    inj.InjectedSingleDiff = ADC_SINGLE_ENDED;
+    inj.InjectedOffsetNumber = ADC_OFFSET_NONE;
+    inj.InjectedOffset = 0u;
+    inj.InjectedNbrOfConversion = 1u;
+    inj.InjectedDiscontinuousConvMode = DISABLE;
+    inj.AutoInjectedConv = DISABLE;
+    inj.ExternalTrigInjecConv = trigger;
+    inj.ExternalTrigInjecConvEdge = ADC_EXTERNALTRIGINJECCONV_EDGE_RISING;
+    inj.InjecOversamplingMode = DISABLE;
+    ok = ok && (HAL_ADCEx_InjectedConfigChannel(hadc, &inj) == HAL_OK);
+    ok = ok && calib_adc(CALIB_ADC1, hadc);
+
+    if (ok)
+    {
+        HAL_NVIC_SetPriority(ADC1_IRQn, PUMP_MON_IRQ_PRIO, 0u);
+        HAL_NVIC_EnableIRQ(ADC1_IRQn);
+        ok = (HAL_ADCEx_InjectedStart_IT(hadc) == HAL_OK);
+        ok = ok && (HAL_TIM_PWM_Start(htim, TIM_CHANNEL_4) == HAL_OK);
+        ok = ok && (HAL_TIM_PWM_Start(htim, pwm_channel) == HAL_OK);
+        pump_mon.htim = htim;
+    }
+
+    coro_start(&pump_mon.coro, pump_monitor_coro); /* reports "no data" when the start failed */
+
+    return ok;
+}
+
+void pump_monitor_set_pwm(uint32_t permille)
+{
+    if (pump_mon.htim != NULL)
+    {
+        const uint32_t period = __HAL_TIM_GET_AUTORELOAD(pump_mon.htim) + 1u;
+        const uint32_t on = (permille >= PUMP_MON_PERMILLE) ? period : ((period * permille) / PUMP_MON_PERMILLE);
+        /* The on-time and the sample point change in the same period */
+        timer_pwm_batch_begin(pump_mon.htim);
+        __HAL_TIM_SET_COMPARE(pump_mon.htim, pump_mon.pwm_channel, on);
+        __HAL_TIM_SET_COMPARE(pump_mon.htim, TIM_CHANNEL_4, (on > 2u) ? (on / 2u) : 1u); /* sample in the middle of the on-time */
+        timer_pwm_batch_commit(pump_mon.htim);
+    }
+}
+
+PUMP_MON_STATE pump_monitor_get_state(void)
+{
+    return pump_mon.state;
+}
+
+bool pump_monitor_learn(void)
+{
+    const bool learned = (pump_mon.state == PUMP_MON_RUNNING) || (pump_mon.state == PUMP_MON_DRY) || (pump_mon.state == PUMP_MON_BLOCKED);
+
+    if (learned && (pump_mon.mean >= PUMP_MON_OFF_LEVEL))
+    {
+        pump_mon.nominal = pump_mon.mean;
+    }
+
+    return learned;
+}
+
+uint32_t pump_monitor_get_nominal(void)
+{
+    return pump_mon.nominal;
+}
+
+void pump_monitor_adc_irq(void)
+{
+    const uint32_t start = bench_get_cycles();
+    ADC_TypeDef* adc = pump_mon.hadc->Instance;
+
+    if ((adc->ISR & ADC_ISR_JEOC) != 0u)
+    {
+        adc->ISR = ADC_ISR_JEOC | ADC_ISR_JEOS; /* write 1 to clear */
+        const int32_t x = (int32_t)adc->JDR1;
+
+        for (uint32_t i = 0u; i < PUMP_MON_BINS; i++)
+        {
+            dsp_goertzel_step(&pump_mon.bins[i], x);
+        }
+        pump_mon.sum += (uint32_t)x;
+        pump_mon.count++;
+
+        if (pump_mon.count >= PUMP_MON_BLOCK_LEN)
+        {
+            PUMP_MON_BLOCK* b = snapshot_begin(&pump_mon.blocks);
+            for (uint32_t i = 0u; i < PUMP_MON_BINS; i++)
+            {
+                b->s1[i] = pump_mon.bins[i].s1;
+                b->s2[i] = pump_mon.bins[i].s2;
+            }
+            b->sum = pump_mon.sum;
+            b->isr_cycles = pump_mon.isr_cycles;
+            snapshot_publish(&pump_mon.blocks);
+            coro_post_event(&pump_mon.coro, PUMP_MON_EV_BLOCK);
+            for (uint32_t i = 0u; i < PUMP_MON_BINS; i++)
+            {
+                dsp_goertzel_reset(&pump_mon.bins[i]);
+            }
+            pump_mon.sum = 0u;
+            pump_mon.count = 0u;
+            pump_mon.isr_cycles = 0u;
+        }
+    }
+    else
+    {
+        // Do nothing
+    }
+
+    pump_mon.isr_cycles += bench_get_cycles() - start;
+}
+
+void pump_monitor_print(void)
+{
+    printf("Pump state %s (last block %s)\r\n", pump_mon_state_names[pump_mon.state], pump_mon_state_names[pump_mon.raw]);
+    printf("Mean %lu nominal %lu counts, ripple %lu%% supply %lu%%\r\n", pump_mon.mean, pump_mon.nominal, pump_mon.ripple_pct, pump_mon.supply_pct);
+    printf("CPU load %lu.%lu%%, overruns %lu\r\n", pump_mon.load_permille / 10u, pump_mon.load_permille % 10u, pump_mon.overruns);
+    snapshot_print(&pump_mon.blocks, "pump blocks");
+}
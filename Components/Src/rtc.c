@@ -200,6 +200,57 @@ bool rtc_get_wd_flag(uint32_t* pc)
     return false;
 }
 
+void rtc_set_fault_record(uint32_t val)
+{
+    const uint32_t fault_flag = ((uint32_t)FAULT_FLAG) << 24u;
+    HAL_RTCEx_BKUPWrite(rtc_hand, RTC_FAULT_REG, fault_flag | (val & 0x00FFFFFFu));
+}
+
+bool rtc_get_fault_record(uint32_t* val)
+{
+    const uint32_t ret = HAL_RTCEx_BKUPRead(rtc_hand, RTC_FAULT_REG);
+    const uint8_t flag = (uint8_t)(ret >> 24u);
+    if (flag == FAULT_FLAG)
+    {
+        HAL_RTCEx_BKUPWrite(rtc_hand, RTC_FAULT_REG, 0x0u);
+        *val = ret & 0x00FFFFFFu;
+        return true;
+    }
+    return false;
+}
+
+/***************************************************
+ * @brief Check byte of a daily light integral record
+ * @param day day of the record
+ * @param umol light integral of the record
+ * @return check byte
+ ***************************************************/
+static uint8_t rtc_dli_check(uint32_t day, uint32_t umol)
+{
+    return (uint8_t)(umol ^ (umol >> 8u) ^ (umol >> 16u) ^ (umol >> 24u) ^ day ^ (day >> 8u) ^ DLI_FLAG);
+}
+
+void rtc_set_dli_record(uint32_t day, uint32_t umol)
+{
+    const uint32_t dli_flag = ((uint32_t)DLI_FLAG) << 24u;
+    HAL_RTCEx_BKUPWrite(rtc_hand, RTC_DLI_REG, umol);
+    HAL_RTCEx_BKUPWrite(rtc_hand, RTC_DLI_DAY_REG, dli_flag | ((day & 0xFFFFu) << 8u) | rtc_dli_check(day & 0xFFFFu, umol));
+}
+
+bool rtc_get_dli_record(uint32_t* day, uint32_t* umol)
+{
+    const uint32_t ret = HAL_RTCEx_BKUPRead(rtc_hand, RTC_DLI_DAY_REG);
+    const uint32_t val = HAL_RTCEx_BKUPRead(rtc_hand, RTC_DLI_REG);
+    const uint32_t rec_day = (ret >> 8u) & 0xFFFFu;
+    if (((uint8_t)(ret >> 24u) == DLI_FLAG) && ((uint8_t)ret == rtc_dli_check(rec_day, val)))
+    {
+        *day = rec_day;
+        *umol = val;
+        return true;
+    }
+    return false;
+}
+
 void rtc_set_loader_flag(void)
 {
     HAL_RTCEx_BKUPWrite(rtc_hand, RTC_LD_REG, LD_FLAG);
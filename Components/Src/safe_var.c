@@ -0,0 +1,306 @@
+/**
+ * @file safe_var.c
+ * @author PL
+ * @brief Safety variables: blocks of variables with redundant storage, checked in the background
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup SAFE_VAR
+ *
+ * A check compares the whole block with interrupts disabled, a write from an interrupt can't be seen
+ * half done. SAFE_VAR_MAX_SIZE limits this to about 2 us for a mirror and 15 us for a checksum.
+ */
+#include "safe_var.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "coroutine.h"
+#include "crc.h"
+#include "stm32_hal.h"
+#include "timer.h"
+
+#define SAFE_VAR_PERIOD_MAX 60000u /* Longest scrub period [ms] */
+
+/**
+ * @brief Operational data of the scrubber
+ */
+typedef struct
+{
+    CORO coro;                                   /**< Scrubber coroutine, first member */
+    SAFE_VAR_BLOCK* blocks[SAFE_VAR_MAX_BLOCKS]; /**< Registered blocks */
+    uint32_t num_blocks;                         /**< Number of registered blocks */
+    uint32_t next;                               /**< Block of the next check */
+    uint32_t period;                             /**< Time between two block checks [ms] */
+    uint32_t passes;                             /**< Completed passes over all blocks */
+    uint32_t pass_start;                         /**< Tick of the start of the current pass */
+    uint32_t pass_time;                          /**< Duration of the last pass, the detection latency [ms] */
+    uint32_t pass_cycles;                        /**< CPU cycles of the checks of the last pass */
+    uint32_t cycles;                             /**< CPU cycles of the checks of the current pass */
+} SAFE_VAR_DATA;
+
+STATIC SAFE_VAR_DATA safe_var = {.period = SAFE_VAR_PERIOD};
+
+/***************************************************
+ * @brief Compare a block with its redundancy, call with interrupts disabled
+ * @param block Block
+ * @return true if consistent
+ ***************************************************/
+STATIC bool safe_var_verify(const SAFE_VAR_BLOCK* block)
+{
+    bool ok = true;
+
+    if (block->mode == SAFE_VAR_MIRROR)
+    {
+        for (uint32_t i = 0u; (i < (block->size / 4u)) && ok; i++)
+        {
+            ok = (block->data[i] == ~block->mirror[i]);
+        }
+    }
+    else
+    {
+        ok = ((uint32_t)crc_calc(block->data, block->size) == block->checksum);
+    }
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Flip the bit of the injected error in the redundancy, call with interrupts disabled
+ * @param block Block
+ ***************************************************/
+STATIC void safe_var_flip(SAFE_VAR_BLOCK* block)
+{
+    if (block->mode == SAFE_VAR_MIRROR)
+    {
+        block->mirror[block->inject_word] ^= block->inject_mask;
+    }
+    else
+    {
+        block->checksum ^= block->inject_mask;
+    }
+}
+
+/***************************************************
+ * @brief Count a failed check and call the error callback
+ * @param block Block
+ ***************************************************/
+STATIC void safe_var_error(SAFE_VAR_BLOCK* block)
+{
+    block->errors++;
+    if (block->on_error != NULL)
+    {
+        block->on_error();
+    }
+}
+
+/***************************************************
+ * @brief Scrubber coroutine, checks the next block every period
+ * @param c Control block
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE safe_var_coro(CORO* c)
+{
+    CORO_BEGIN(c);
+    CORO_SLEEP(c, safe_var.period);
+    if (safe_var.next >= safe_var.num_blocks) /* pass completed */
+    {
+        safe_var.next = 0u;
+        safe_var.pass_time = timer_get_elapsed_module_timer(safe_var.pass_start);
+        safe_var.pass_cycles = safe_var.cycles;
+        safe_var.cycles = 0u;
+        safe_var.passes++;
+        timer_reset_module_timer(&safe_var.pass_start);
+    }
+    const uint32_t start = bench_get_cycles();
+    (void)safe_var_check(safe_var.blocks[safe_var.next]);
+    safe_var.cycles += bench_get_cycles() - start;
+    safe_var.next++;
+    CORO_RESTART(c);
+    CORO_END(c);
+}
+
+bool safe_var_register(SAFE_VAR_BLOCK* block)
+{
+    bool ok = (safe_var.num_blocks < SAFE_VAR_MAX_BLOCKS) && (block->size > 0u) && (block->size <= SAFE_VAR_MAX_SIZE) && ((block->size % 4u) == 0u);
+    ok = ok && ((block->mode == SAFE_VAR_CHECKSUM) || (block->mirror != NULL));
+
+    if (ok)
+    {
+        const uint32_t old_primask = __get_PRIMASK();
+        (void)__disable_irq();
+        if (block->mode == SAFE_VAR_MIRROR)
+        {
+            for (uint32_t i = 0u; i < (block->size / 4u); i++)
+            {
+                block->mirror[i] = ~block->data[i];
+            }
+        }
+        else
+        {
+            block->checksum = (uint32_t)crc_calc(block->data, block->size);
+        }
+        block->inject_mask = 0u;
+        __set_PRIMASK(old_primask);
+
+        safe_var.blocks[safe_var.num_blocks] = block;
+        safe_var.num_blocks++;
+        if (safe_var.num_blocks == 1u)
+        {
+            timer_reset_module_timer(&safe_var.pass_start);
+            coro_start(&safe_var.coro, safe_var_coro);
+        }
+    }
+
+    return ok;
+}
+
+void safe_var_write32(SAFE_VAR_BLOCK* block, volatile uint32_t* var, uint32_t value)
+{
+    const uint32_t word = (uint32_t)(var - (volatile uint32_t*)block->data);
+    bool ok = true;
+
+    const uint32_t old_primask = __get_PRIMASK();
+    (void)__disable_irq();
+    if (block->mode == SAFE_VAR_MIRROR)
+    {
+        *var = value;
+        /* an injected error stays until it is detected */
+        block->mirror[word] = ~value ^ ((word == block->inject_word) ? block->inject_mask : 0u);
+    }
+    else
+    {
+        /* the new checksum would hide a corruption of the other variables, check the old one first */
+        ok = ((uint32_t)crc_calc(block->data, block->size) == (block->checksum ^ block->inject_mask));
+        *var = value;
+        block->checksum = (uint32_t)crc_calc(block->data, block->size) ^ block->inject_mask;
+    }
+    __set_PRIMASK(old_primask);
+
+    if (!ok)
+    {
+        safe_var_error(block);
+    }
+}
+
+bool safe_var_read32(SAFE_VAR_BLOCK* block, const volatile uint32_t* var, uint32_t* value)
+{
+    const uint32_t word = (uint32_t)(var - (const volatile uint32_t*)block->data);
+    bool ok;
+
+    const uint32_t old_primask = __get_PRIMASK();
+    (void)__disable_irq();
+    *value = *var;
+    ok = (block->mode == SAFE_VAR_MIRROR) && (*value == ~block->mirror[word]);
+    __set_PRIMASK(old_primask);
+
+    if (!ok)
+    {
+        ok = safe_var_check(block); /* checksum, or the mirror differs: check the block, handles an injected error */
+    }
+
+    return ok;
+}
+
+bool safe_var_check(SAFE_VAR_BLOCK* block)
+{
+    bool injected = false;
+    bool ok;
+
+    const uint32_t start = bench_get_cycles();
+    const uint32_t old_primask = __get_PRIMASK();
+    (void)__disable_irq();
+    ok = safe_var_verify(block);
+    if (!ok && (block->inject_mask != 0u))
+    {
+        safe_var_flip(block); /* undo the injected error, a real one remains */
+        block->inject_mask = 0u;
+        injected = true;
+        ok = safe_var_verify(block);
+    }
+    __set_PRIMASK(old_primask);
+    const uint32_t cycles = bench_get_cycles() - start;
+
+    block->checks++;
+    if (cycles > block->cycles_max)
+    {
+        block->cycles_max = cycles;
+    }
+    if (injected)
+    {
+        block->latency = timer_get_elapsed_module_timer(block->inject_tick);
+    }
+    if (!ok)
+    {
+        safe_var_error(block);
+    }
+
+    return ok;
+}
+
+bool safe_var_set_period(uint32_t period)
+{
+    const bool ok = (period > 0u) && (period <= SAFE_VAR_PERIOD_MAX);
+
+    if (ok)
+    {
+        safe_var.period = period;
+    }
+
+    return ok;
+}
+
+bool safe_var_inject(uint32_t index)
+{
+    bool ok = (index < safe_var.num_blocks);
+
+    if (ok)
+    {
+        SAFE_VAR_BLOCK* block = safe_var.blocks[index];
+        const uint32_t words = block->size / 4u;
+
+        const uint32_t old_primask = __get_PRIMASK();
+        (void)__disable_irq();
+        ok = (block->inject_mask == 0u);
+        if (ok)
+        {
+            /* walk over the words and bits with the number of checks */
+            block->inject_word = (block->mode == SAFE_VAR_MIRROR) ? (block->checks % words) : words;
+            block->inject_mask = 1u << (block->checks % 16u);
+            safe_var_flip(block);
+            timer_reset_module_timer(&block->inject_tick);
+        }
+        __set_PRIMASK(old_primask);
+    }
+
+    return ok;
+}
+
+void safe_var_print(void)
+{
+    static const char* const mode_names[] = {"mirror", "checksum"};
+
+    for (uint32_t i = 0u; i < safe_var.num_blocks; i++)
+    {
+        const SAFE_VAR_BLOCK* block = safe_var.blocks[i];
+
+        printf("%lu %-10s %-8s %3lu bytes, %lu checks, %lu errors, max %lu cycles", i, block->name, mode_names[block->mode], block->size, block->checks, block->errors, block->cycles_max);
+        if (block->inject_mask != 0u)
+        {
+            printf(", injected error pending");
+        }
+        else if (block->latency != 0u)
+        {
+            printf(", detected after %lu ms", block->latency);
+        }
+        else
+        {
+            // Do nothing
+        }
+        printf("\r\n");
+    }
+    printf("Scrubber: one block every %lu ms, %lu passes, last pass %lu ms (detection latency), %lu cycles\r\n", safe_var.period, safe_var.passes, safe_var.pass_time, safe_var.pass_cycles);
+}
+
+/** @}*/
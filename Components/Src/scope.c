@@ -0,0 +1,520 @@
+/**
+ * @file scope.c
+ * @author PL
+ * @brief Triggered burst capture of raw ADC samples ("scope mode")
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup SCOPE
+ *
+ * The DMA runs a single node linked list in circular mode, the write position is read back from the
+ * remaining byte count of the channel. Only the analog watchdog interrupt (once per capture) and the
+ * overrun interrupt are enabled.
+ *
+ * The trigger starts TIM5 in one-pulse mode for the post-trigger window. Its update interrupt stops
+ * the scan timer, so the freeze does not depend on the coroutine polling the DMA position in time.
+ * TIM5 runs from the same clock as TIM2, so post_frames scans are counted in timer ticks.
+ */
+#include "scope.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "calib.h"
+#include "console.h"
+#include "coroutine.h"
+
+#define SCOPE_DMA_CHANNEL GPDMA1_Channel4      /* DMA channel writing the capture buffer */
+#define SCOPE_DMA_IRQn    GPDMA1_Channel4_IRQn /* Interrupt of the DMA channel */
+#define SCOPE_IRQ_PRIO    5u                   /* Priority of the ADC, DMA and stop timer interrupts */
+#define SCOPE_STOP_TIM    TIM5                 /* One-pulse timer stopping the scans after the trigger */
+#define SCOPE_STOP_IRQn   TIM5_IRQn            /* Interrupt of the stop timer */
+#define SCOPE_EV_STOPPED  0x0001u              /* Coroutine event: the stop timer stopped the scans */
+#define SCOPE_HEX_BYTES   16u                  /* Data bytes per Intel HEX record */
+#define SCOPE_HEX_LINE    48u                  /* Console buffer space needed for one record */
+
+/**
+ * @brief State of the capture
+ */
+typedef enum
+{
+    SCOPE_OFF = 0u,  /**< Not configured or configuration failed */
+    SCOPE_RUNNING,   /**< Sampling, trigger not armed */
+    SCOPE_ARMED,     /**< Sampling, waiting for a trigger */
+    SCOPE_TRIGGERED, /**< Sampling the post-trigger window */
+    SCOPE_FROZEN,    /**< Sampling stopped, the buffer holds the capture */
+} SCOPE_STATE;
+
+/**
+ * @brief Operational data of the scope
+ */
+typedef struct
+{
+    CORO capture;               /**< Coroutine freezing the buffer after a trigger */
+    CORO dump;                  /**< Coroutine printing the buffer */
+    ADC_HandleTypeDef* hadc;    /**< ADC scanning the channels */
+    TIM_HandleTypeDef* htim;    /**< Timer triggering the scans */
+    DMA_HandleTypeDef hdma;     /**< DMA channel writing the buffer */
+    DMA_QListTypeDef queue;     /**< Linked list queue of the DMA channel */
+    DMA_NodeTypeDef node;       /**< Single node of the queue, circular */
+    SCOPE_CONFIG config;        /**< Configuration of the capture */
+    uint32_t frames;            /**< Scans in the buffer */
+    uint32_t scan_ticks;        /**< Timer clock cycles per scan */
+    uint32_t bytes;             /**< Used size of the buffer in bytes */
+    volatile SCOPE_STATE state; /**< State of the capture */
+    volatile bool filled;       /**< The buffer is filled once since sampling started */
+    SCOPE_TRIG source;          /**< Source of the last trigger */
+    uint32_t post_frames;       /**< Scans recorded after the trigger */
+    uint32_t trig_frame;        /**< Buffer position of the trigger [scans] */
+    uint32_t end_frame;         /**< Buffer position of the freeze, oldest scan [scans] */
+    uint32_t dump_offset;       /**< Next byte to print, oldest byte first */
+    uint32_t overruns;          /**< ADC overruns */
+    uint32_t dma_errors;        /**< DMA errors */
+} SCOPE_DATA;
+
+STATIC SCOPE_DATA scope;
+STATIC uint16_t scope_buf[SCOPE_BUF_SAMPLES] __attribute__((aligned(4)));
+
+/***************************************************
+ * @brief Sequencer ranks of ADC4, the rank values are not consecutive
+ ***************************************************/
+static const uint32_t scope_ranks[SCOPE_MAX_CHANNELS] = {ADC4_REGULAR_RANK_1, ADC4_REGULAR_RANK_2, ADC4_REGULAR_RANK_3, ADC4_REGULAR_RANK_4,
+                                                         ADC4_REGULAR_RANK_5, ADC4_REGULAR_RANK_6, ADC4_REGULAR_RANK_7, ADC4_REGULAR_RANK_8};
+
+/***************************************************
+ * @brief Names of the trigger sources, in the same order as SCOPE_TRIG
+ ***************************************************/
+static const char* const scope_trig_names[] = {"none", "analog watchdog", "firmware", "command"};
+
+/***************************************************
+ * @brief Names of the states, in the same order as SCOPE_STATE
+ ***************************************************/
+static const char* const scope_state_names[] = {"off", "running", "armed", "triggered", "frozen"};
+
+/***************************************************
+ * @brief Current write position of the DMA
+ * @return Scan being written [scans]
+ ***************************************************/
+STATIC uint32_t scope_position(void)
+{
+    const uint32_t remaining = scope.hdma.Instance->CBR1 & DMA_CBR1_BNDT;
+    const uint32_t written = (scope.bytes - remaining) / sizeof(uint16_t); /* remaining is reloaded from the node at the wrap */
+
+    return (written / scope.config.num_channels) % scope.frames;
+}
+
+/***************************************************
+ * @brief Enable the analog watchdog interrupt, the flag is set as long as the channel is out of the window
+ ***************************************************/
+STATIC void scope_enable_awd(void)
+{
+    __HAL_ADC_CLEAR_FLAG(scope.hadc, ADC_FLAG_AWD1);
+    __HAL_ADC_ENABLE_IT(scope.hadc, ADC_IT_AWD1);
+}
+
+/***************************************************
+ * @brief Start the timer triggering the scans
+ * @return true if started
+ ***************************************************/
+STATIC bool scope_start_sampling(void)
+{
+    scope.filled = false;
+    scope.state = SCOPE_RUNNING;
+
+    return (HAL_TIM_Base_Start(scope.htim) == HAL_OK);
+}
+
+/***************************************************
+ * @brief Start the stop timer, its update interrupt stops the scans after the post-trigger window
+ ***************************************************/
+STATIC void scope_start_stop_timer(void)
+{
+    const uint64_t ticks = (uint64_t)scope.post_frames * scope.scan_ticks;
+    const uint32_t psc = (uint32_t)(ticks >> 32u); /* only for slow rates, the error is below one scan */
+
+    SCOPE_STOP_TIM->CR1 &= ~TIM_CR1_CEN;
+    SCOPE_STOP_TIM->PSC = psc;
+    SCOPE_STOP_TIM->ARR = (uint32_t)(ticks / (psc + 1u)) - 1u;
+    SCOPE_STOP_TIM->EGR = TIM_EGR_UG; /* load the prescaler and clear the counter, URS keeps UIF clear */
+    SCOPE_STOP_TIM->SR = 0u;
+    SCOPE_STOP_TIM->CR1 |= TIM_CR1_CEN;
+}
+
+/***************************************************
+ * @brief Capture coroutine, waits for the stop timer and freezes the buffer after the post-trigger window
+ * @param c Control block
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE scope_capture_coro(CORO* c)
+{
+    uint32_t old_primask;
+
+    CORO_BEGIN(c);
+    /* Fill the buffer once, so the pre-trigger window only holds samples of this run */
+    CORO_SLEEP(c, ((scope.frames * 1000u) / scope.config.rate_hz) + 1u);
+    old_primask = __get_PRIMASK();
+    (void)__disable_irq();
+    scope.filled = true;
+    if (scope.state == SCOPE_ARMED)
+    {
+        scope_enable_awd();
+    }
+    __set_PRIMASK(old_primask);
+
+    CORO_WAIT_EVENT(c, SCOPE_EV_STOPPED, CORO_WAIT_FOREVER);
+    (void)coro_take_events(c, SCOPE_EV_STOPPED);
+    (void)HAL_TIM_Base_Stop(scope.htim); /* stopped by the interrupt, this resets the handle state for the restart */
+    CORO_YIELD(c); /* the last scan is converted by now */
+    scope.end_frame = scope_position();
+    scope.state = SCOPE_FROZEN;
+    printf("Scope triggered by %s\r\n", scope_trig_names[scope.source]);
+    CORO_END(c);
+}
+
+/***************************************************
+ * @brief Print one Intel HEX data record of the frozen buffer, oldest byte first
+ ***************************************************/
+STATIC void scope_print_record(void)
+{
+    const uint8_t* const buf = (const uint8_t*)scope_buf;
+    const uint32_t start = (scope.end_frame * scope.config.num_channels * sizeof(uint16_t)) + scope.dump_offset;
+    const uint32_t len = ((scope.bytes - scope.dump_offset) < SCOPE_HEX_BYTES) ? (scope.bytes - scope.dump_offset) : SCOPE_HEX_BYTES;
+    uint8_t sum = (uint8_t)(len + (scope.dump_offset >> 8) + scope.dump_offset);
+
+    printf(":%02lX%04lX00", len, scope.dump_offset);
+    for (uint32_t i = 0u; i < len; i++)
+    {
+        const uint8_t data = buf[(start + i) % scope.bytes];
+        sum += data;
+        printf("%02X", data);
+    }
+    printf("%02X\r\n", (uint8_t)(0x100u - sum));
+    scope.dump_offset += len;
+}
+
+/***************************************************
+ * @brief Dump coroutine, prints the frozen buffer as long as there is space in the console buffer
+ * @param c Control block
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE scope_dump_coro(CORO* c)
+{
+    CORO_BEGIN(c);
+    printf("Scope %lu channels, %lu scans at %lu Hz, trigger by %s at scan %lu\r\n", scope.config.num_channels, scope.frames, scope.config.rate_hz, scope_trig_names[scope.source],
+           ((scope.trig_frame + scope.frames) - scope.end_frame) % scope.frames);
+    scope.dump_offset = 0u;
+    while (scope.dump_offset < scope.bytes)
+    {
+        CORO_WAIT_UNTIL(c, console_get_print_buffer_space() >= SCOPE_HEX_LINE);
+        scope_print_record();
+    }
+    printf(":00000001FF\r\n");
+    CORO_END(c);
+}
+
+/***************************************************
+ * @brief Stop sampling and release the DMA channel
+ ***************************************************/
+STATIC void scope_stop(void)
+{
+    coro_stop(&scope.capture);
+    coro_stop(&scope.dump);
+    SCOPE_STOP_TIM->CR1 &= ~TIM_CR1_CEN;
+    (void)HAL_TIM_Base_Stop(scope.htim);
+    (void)HAL_ADC_Stop_DMA(scope.hadc);
+    (void)HAL_DMAEx_List_DeInit(&scope.hdma);
+    scope.state = SCOPE_OFF;
+}
+
+/***************************************************
+ * @brief Configure the DMA channel as circular buffer
+ * @return true if configured
+ ***************************************************/
+STATIC bool scope_dma_init(void)
+{
+    DMA_NodeConfTypeDef node_conf = {0};
+    bool ok;
+
+    (void)memset(&scope.queue, 0, sizeof(scope.queue));
+    (void)memset(&scope.node, 0, sizeof(scope.node));
+    scope.hdma.Instance = SCOPE_DMA_CHANNEL;
+    scope.hdma.InitLinkedList.Priority = DMA_LOW_PRIORITY_HIGH_WEIGHT;
+    scope.hdma.InitLinkedList.LinkStepMode = DMA_LSM_FULL_EXECUTION;
+    scope.hdma.InitLinkedList.LinkAllocatedPort = DMA_LINK_ALLOCATED_PORT0;
+    scope.hdma.InitLinkedList.TransferEventMode = DMA_TCEM_LAST_LL_ITEM_TRANSFER;
+    scope.hdma.InitLinkedList.LinkedListMode = DMA_LINKEDLIST_CIRCULAR;
+    ok = (HAL_DMAEx_List_Init(&scope.hdma) == HAL_OK);
+
+    node_conf.NodeType = DMA_GPDMA_LINEAR_NODE;
+    node_conf.Init.Request = GPDMA1_REQUEST_ADC4;
+    node_conf.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    node_conf.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    node_conf.Init.SrcInc = DMA_SINC_FIXED;
+    node_conf.Init.DestInc = DMA_DINC_INCREMENTED;
+    node_conf.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_HALFWORD;
+    node_conf.Init.DestDataWidth = DMA_DEST_DATAWIDTH_HALFWORD;
+    node_conf.Init.SrcBurstLength = 1u;
+    node_conf.Init.DestBurstLength = 1u;
+    node_conf.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT0;
+    node_conf.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    node_conf.TriggerConfig.TriggerPolarity = DMA_TRIG_POLARITY_MASKED;
+    node_conf.DataHandlingConfig.DataExchange = DMA_EXCHANGE_NONE;
+    node_conf.DataHandlingConfig.DataAlignment = DMA_DATA_RIGHTALIGN_ZEROPADDED;
+    node_conf.SrcAddress = (uint32_t)&scope.hadc->Instance->DR;
+    node_conf.DstAddress = (uint32_t)scope_buf;
+    node_conf.DataSize = scope.bytes;
+    ok = ok && (HAL_DMAEx_List_BuildNode(&node_conf, &scope.node) == HAL_OK);
+    ok = ok && (HAL_DMAEx_List_InsertNode_Tail(&scope.queue, &scope.node) == HAL_OK);
+    ok = ok && (HAL_DMAEx_List_SetCircularMode(&scope.queue) == HAL_OK);
+    ok = ok && (HAL_DMAEx_List_LinkQ(&scope.hdma, &scope.queue) == HAL_OK);
+    ok = ok && (HAL_DMA_ConfigChannelAttributes(&scope.hdma, DMA_CHANNEL_NPRIV) == HAL_OK);
+    __HAL_LINKDMA(scope.hadc, DMA_Handle, scope.hdma);
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Configure the ADC scan, triggered by the timer, with the analog watchdog on one channel
+ * @return true if configured
+ ***************************************************/
+STATIC bool scope_adc_init(void)
+{
+    ADC_HandleTypeDef* hadc = scope.hadc;
+    bool ok;
+
+    hadc->Init.ScanConvMode = ADC4_SCAN_ENABLE;
+    hadc->Init.NbrOfConversion = scope.config.num_channels;
+    hadc->Init.ExternalTrigConv = ADC4_EXTERNALTRIG_T2_TRGO;
+    hadc->Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+    hadc->Init.ContinuousConvMode = DISABLE;
+    hadc->Init.DMAContinuousRequests = ENABLE;
+    hadc->Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
+    hadc->Init.SamplingTimeCommon1 = ADC4_SAMPLETIME_79CYCLES_5; /* long enough for the internal channels */
+    ok = (HAL_ADC_Init(hadc) == HAL_OK);
+
+    ADC_ChannelConfTypeDef ch = {0};
+    ch.SamplingTime = ADC4_SAMPLINGTIME_COMMON_1;
+    ch.OffsetNumber = ADC_OFFSET_NONE;
+    for (uint32_t i = 0u; i < scope.config.num_channels; i++)
+    {
+        ch.Channel = scope.config.channels[i];
+        ch.Rank = scope_ranks[i];
+        ok = ok && (HAL_ADC_ConfigChannel(hadc, &ch) == HAL_OK);
+    }
+
+    ADC_AnalogWDGConfTypeDef awd = {0};
+    awd.WatchdogNumber = ADC_ANALOGWATCHDOG_1;
+    awd.WatchdogMode = ADC_ANALOGWATCHDOG_SINGLE_REG;
+    awd.Channel = scope.config.channels[scope.config.awd_index];
+    awd.ITMode = DISABLE; /* enabled by scope_arm() */
+    awd.HighThreshold = scope.config.awd_high;
+    awd.LowThreshold = scope.config.awd_low;
+    awd.FilteringConfig = ADC_AWD_FILTERING_NONE;
+    ok = ok && (HAL_ADC_AnalogWDGConfig(hadc, &awd) == HAL_OK);
+    ok = ok && calib_adc(CALIB_ADC4, hadc);
+
+    return ok;
+}
+
+/***************************************************
+ * @brief Configure the timer to trigger the scans at the configured rate and the stop timer
+ * @return true if configured
+ ***************************************************/
+STATIC bool scope_tim_init(void)
+{
+    TIM_HandleTypeDef* htim = scope.htim;
+    TIM_MasterConfigTypeDef master = {0};
+
+    /* The timer clock is twice PCLK1 when the APB1 prescaler is used */
+    uint32_t tim_clk = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR2 & RCC_CFGR2_PPRE1_2) != 0u)
+    {
+        tim_clk *= 2u;
+    }
+    htim->Init.Prescaler = 0u;
+    htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim->Init.Period = (tim_clk / scope.config.rate_hz) - 1u;
+    htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+    master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+    master.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+    scope.scan_ticks = htim->Init.Period + 1u;
+
+    /* Stop timer on the same APB1 clock, one pulse, only the overflow sets the update flag */
+    __HAL_RCC_TIM5_CLK_ENABLE();
+    SCOPE_STOP_TIM->CR1 = TIM_CR1_OPM | TIM_CR1_URS;
+    SCOPE_STOP_TIM->DIER = TIM_DIER_UIE;
+    SCOPE_STOP_TIM->SR = 0u;
+
+    return (HAL_TIM_Base_Init(htim) == HAL_OK) && (HAL_TIMEx_MasterConfigSynchronization(htim, &master) == HAL_OK);
+}
+
+bool scope_init(ADC_HandleTypeDef* hadc, TIM_HandleTypeDef* htim, const SCOPE_CONFIG* config)
+{
+    bool ok = (hadc->Instance == ADC4) && (htim->Instance == TIM2) && (config->num_channels > 0u) && (config->num_channels <= SCOPE_MAX_CHANNELS) &&
+              (config->awd_index < config->num_channels) && (config->rate_hz > 0u);
+
+    if (scope.state != SCOPE_OFF)
+    {
+        scope_stop();
+    }
+
+    if (ok)
+    {
+        scope.hadc = hadc;
+        scope.htim = htim;
+        scope.config = *config;
+        scope.frames = SCOPE_BUF_SAMPLES / config->num_channels;
+        scope.bytes = scope.frames * config->num_channels * sizeof(uint16_t);
+        scope.source = SCOPE_TRIG_NONE;
+        scope.post_frames = scope.frames / 4u;
+
+        ok = scope_tim_init() && scope_adc_init() && scope_dma_init();
+        ok = ok && (HAL_ADC_Start_DMA(hadc, (uint32_t*)scope_buf, scope.bytes / sizeof(uint16_t)) == HAL_OK);
+    }
+
+    if (ok)
+    {
+        /* No interrupt per buffer wrap, only the error interrupts of the DMA stay enabled */
+        __HAL_DMA_DISABLE_IT(&scope.hdma, DMA_IT_TC | DMA_IT_HT);
+        HAL_NVIC_SetPriority(ADC4_IRQn, SCOPE_IRQ_PRIO, 0u);
+        HAL_NVIC_EnableIRQ(ADC4_IRQn);
+        HAL_NVIC_SetPriority(SCOPE_DMA_IRQn, SCOPE_IRQ_PRIO, 0u);
+        HAL_NVIC_EnableIRQ(SCOPE_DMA_IRQn);
+        HAL_NVIC_SetPriority(SCOPE_STOP_IRQn, SCOPE_IRQ_PRIO, 0u);
+        HAL_NVIC_EnableIRQ(SCOPE_STOP_IRQn);
+        ok = scope_start_sampling();
+        coro_start(&scope.capture, scope_capture_coro);
+    }
+
+    if (!ok)
+    {
+        scope.state = SCOPE_OFF;
+    }
+
+    return ok;
+}
+
+bool scope_set_awd(uint32_t index, uint32_t low, uint32_t high)
+{
+    bool ok = false;
+
+    if (scope.hadc != NULL)
+    {
+        SCOPE_CONFIG config = scope.config;
+        config.awd_index = index;
+        config.awd_low = low;
+        config.awd_high = high;
+        ok = scope_init(scope.hadc, scope.htim, &config);
+    }
+
+    return ok;
+}
+
+void scope_arm(uint32_t post_frames)
+{
+    if (scope.state != SCOPE_OFF)
+    {
+        coro_stop(&scope.dump);
+        if (post_frames == SCOPE_POST_DEFAULT)
+        {
+            scope.post_frames = scope.frames / 4u;
+        }
+        else
+        {
+            scope.post_frames = (post_frames < scope.frames) ? post_frames : (scope.frames - 1u);
+            scope.post_frames = (scope.post_frames > 0u) ? scope.post_frames : 1u; /* the stop timer needs a period */
+        }
+        if (scope.state == SCOPE_FROZEN)
+        {
+            (void)scope_start_sampling();
+            coro_start(&scope.capture, scope_capture_coro);
+        }
+
+        const uint32_t old_primask = __get_PRIMASK();
+        (void)__disable_irq();
+        scope.source = SCOPE_TRIG_NONE;
+        scope.state = SCOPE_ARMED;
+        if (scope.filled)
+        {
+            scope_enable_awd();
+        }
+        __set_PRIMASK(old_primask);
+    }
+}
+
+void scope_trigger(SCOPE_TRIG source)
+{
+    const uint32_t old_primask = __get_PRIMASK(); /* called from the ADC interrupt and from the main loop */
+    (void)__disable_irq();
+    if ((scope.state == SCOPE_ARMED) && scope.filled)
+    {
+        __HAL_ADC_DISABLE_IT(scope.hadc, ADC_IT_AWD1);
+        scope_start_stop_timer();
+        scope.trig_frame = scope_position();
+        scope.source = source;
+        scope.state = SCOPE_TRIGGERED;
+    }
+    __set_PRIMASK(old_primask);
+}
+
+bool scope_is_frozen(void)
+{
+    return (scope.state == SCOPE_FROZEN);
+}
+
+bool scope_dump(void)
+{
+    const bool frozen = scope_is_frozen();
+
+    if (frozen)
+    {
+        coro_start(&scope.dump, scope_dump_coro);
+    }
+
+    return frozen;
+}
+
+void scope_adc_irq(void)
+{
+    ADC_TypeDef* adc = scope.hadc->Instance;
+    const uint32_t isr = adc->ISR;
+
+    if (((isr & ADC_ISR_AWD1) != 0u) && ((adc->IER & ADC_IER_AWD1IE) != 0u))
+    {
+        adc->ISR = ADC_ISR_AWD1; /* write 1 to clear */
+        scope_trigger(SCOPE_TRIG_AWD);
+    }
+    if ((isr & ADC_ISR_OVR) != 0u)
+    {
+        adc->ISR = ADC_ISR_OVR; /* the DMA requests are blocked until the flag is cleared */
+        scope.overruns++;
+    }
+}
+
+void scope_dma_irq(void)
+{
+    if (__HAL_DMA_GET_FLAG(&scope.hdma, DMA_FLAG_DTE | DMA_FLAG_ULE | DMA_FLAG_USE) != 0u)
+    {
+        scope.dma_errors++;
+    }
+    HAL_DMA_IRQHandler(&scope.hdma);
+}
+
+void scope_stop_irq(void)
+{
+    if ((SCOPE_STOP_TIM->SR & TIM_SR_UIF) != 0u)
+    {
+        SCOPE_STOP_TIM->SR = ~TIM_SR_UIF; /* write 0 to clear */
+        scope.htim->Instance->CR1 &= ~TIM_CR1_CEN;
+        coro_post_event(&scope.capture, SCOPE_EV_STOPPED);
+    }
+}
+
+void scope_print(void)
+{
+    printf("Scope %s, %lu channels, %lu scans at %lu Hz, post-trigger %lu scans\r\n", scope_state_names[scope.state], scope.config.num_channels, scope.frames, scope.config.rate_hz, scope.post_frames);
+    printf("Analog watchdog on channel %lu: %lu .. %lu counts\r\n", scope.config.awd_index, scope.config.awd_low, scope.config.awd_high);
+    printf("Last trigger %s, overruns %lu, DMA errors %lu\r\n", scope_trig_names[scope.source], scope.overruns, scope.dma_errors);
+}
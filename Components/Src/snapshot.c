@@ -0,0 +1,116 @@
+/**
+ * @file snapshot.c
+ * @author PL
+ * @brief Lock-free snapshot store: one writer publishes whole frames, readers get consistent copies
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup SNAPSHOT
+ *
+ * Frame n (n = seq / 2 after the publish) is in buffer n % 2. The writer of frame n + 1 fills buffer
+ * (n + 1) % 2 while buffer n % 2 stays published, so a reader which started at counter value c only
+ * has to retry when the counter reached (c | 1) + 2: the writer then started the frame after the next
+ * one, which goes to the buffer being copied. The barriers keep the compiler and the bus from
+ * reordering the counter and the frame accesses.
+ */
+#include "snapshot.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32_hal.h"
+
+/***************************************************
+ * @brief Buffer of a frame
+ * @param s Store
+ * @param frame Frame number
+ * @return Buffer
+ ***************************************************/
+STATIC uint8_t* snapshot_buffer(const SNAPSHOT* s, uint32_t frame)
+{
+    return &s->buf[(frame & 1u) * s->size];
+}
+
+void snapshot_init(SNAPSHOT* s, void* buf, size_t size)
+{
+    s->seq = 0u;
+    s->buf = (uint8_t*)buf;
+    s->size = size;
+    s->reads = 0u;
+    s->retries = 0u;
+    s->max_retries = 0u;
+    s->failures = 0u;
+}
+
+void* snapshot_begin(SNAPSHOT* s)
+{
+    const uint32_t seq = s->seq + 1u;
+
+    s->seq = seq; /* odd: writing frame seq / 2 + 1 */
+    __DMB();
+
+    return snapshot_buffer(s, (seq >> 1u) + 1u);
+}
+
+void snapshot_publish(SNAPSHOT* s)
+{
+    __DMB();
+    s->seq = s->seq + 1u; /* even: frame seq / 2 is published */
+}
+
+void snapshot_write(SNAPSHOT* s, const void* frame)
+{
+    (void)memcpy(snapshot_begin(s), frame, s->size);
+    snapshot_publish(s);
+}
+
+bool snapshot_read(SNAPSHOT* s, void* frame, uint32_t* seq)
+{
+    uint32_t tries = 0u;
+    bool ok = false;
+    uint32_t start = s->seq;
+
+    while (!ok && (start >= 2u) && (tries < SNAPSHOT_MAX_TRIES))
+    {
+        __DMB();
+        (void)memcpy(frame, snapshot_buffer(s, start >> 1u), s->size);
+        __DMB();
+
+        const uint32_t end = s->seq;
+        const uint32_t limit = ((start | 1u) + 2u) - start; /* increments until the copied buffer is written again */
+        ok = ((end - start) < limit);
+        tries++;
+        if (!ok)
+        {
+            start = end;
+        }
+    }
+
+    if (ok)
+    {
+        s->reads++;
+        s->retries += tries - 1u;
+        s->max_retries = ((tries - 1u) > s->max_retries) ? (tries - 1u) : s->max_retries;
+        if (seq != NULL)
+        {
+            *seq = start >> 1u;
+        }
+    }
+    else if (start >= 2u)
+    {
+        s->failures++;
+        s->retries += tries;
+    }
+    else
+    {
+        // Do nothing, no frame published yet
+    }
+
+    return ok;
+}
+
+void snapshot_print(const SNAPSHOT* s, const char* name)
+{
+    printf("Snapshot %s: %lu frames, %lu reads, %lu retries (max %lu), %lu failures\r\n", name, s->seq >> 1u, s->reads, s->retries, s->max_retries, s->failures);
+}
@@ -0,0 +1,283 @@
+/**
+ * @file supervisor.c
+ * @author PL
+ * @brief Deadline monitoring of jobs, feeding the independent watchdog
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup SUPERVISOR
+ *
+ * There is no HAL IWDG driver in this project, so the IWDG is accessed on register level.
+ *
+ * supervisor_proc() runs in the superloop with the jobs, it isn't reached any more when a job hangs.
+ * The early wakeup interrupt of the IWDG fires SUPERVISOR_EWI_MARGIN before the reset and writes the
+ * fault record in that case.
+ */
+#include "supervisor.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rtc.h"
+#include "stm32_hal.h"
+#include "timer.h"
+
+#define IWDG_KEY_RELOAD 0x0000AAAAu /* Refresh the counter */
+#define IWDG_KEY_ENABLE 0x0000CCCCu /* Start the watchdog */
+#define IWDG_KEY_ACCESS 0x00005555u /* Enable write access to PR, RLR and WINR */
+#define IWDG_TICK_MS    2u          /* LSI (32 kHz) / 64 = one count every 2 ms */
+#define IWDG_RLR_MAX    0x0FFFu     /* Maximum reload value */
+#define IWDG_SYNC_WAIT  100u        /* Maximum time to wait for register update [ms] */
+
+#define SUPERVISOR_EWI_MARGIN 50u /* Early wakeup interrupt this long before the reset [ms] */
+#define SUPERVISOR_IRQ_PRIO   1u  /* Priority of the early wakeup interrupt, only the interlocks are higher */
+
+#define SUPERVISOR_OVERRUN_MAX 0xFFFFu /* Overrun time stored in the fault record is saturated at this value */
+
+/***************************************************
+ * @brief Deadline data of a job
+ ***************************************************/
+typedef struct
+{
+    uint32_t period;     /**< Maximum time between two starts [ms] */
+    uint32_t budget;     /**< Maximum execution time [ms] */
+    uint32_t start_tick; /**< Tick of the last start */
+    uint32_t last_exec;  /**< Last execution time [ms] */
+    uint32_t max_exec;   /**< Longest execution time [ms] */
+    uint32_t misses;     /**< Number of deadline misses */
+    bool registered;     /**< Job is monitored */
+    bool running;        /**< Job is checked in */
+    bool missed;         /**< Miss is already recorded for the current period/run */
+} SUPERVISOR_JOB_DATA;
+
+/***************************************************
+ * @brief Operational data of the supervisor
+ ***************************************************/
+typedef struct
+{
+    SUPERVISOR_JOB_DATA jobs[SUPERVISOR_JOB_NUM]; /**< Deadline data of all jobs */
+    bool deadline_ok;                             /**< No deadline miss since the last supervisor_proc() */
+    bool iwdg_started;                            /**< IWDG is running */
+    bool prev_fault_valid;                        /**< Fault record of previous run is available */
+    uint32_t prev_fault;                          /**< Fault record of previous run */
+    uint32_t refresh_count;                       /**< Number of IWDG refreshes */
+    uint32_t skip_count;                          /**< Number of skipped IWDG refreshes */
+} SUPERVISOR_DATA;
+
+STATIC SUPERVISOR_DATA supervisor;
+
+/***************************************************
+ * @brief Names of the jobs, in the same order as SUPERVISOR_JOB
+ ***************************************************/
+static const char* const supervisor_job_names[SUPERVISOR_JOB_NUM] = {
+    "commands",
+    "coroutine",
+};
+
+/***************************************************
+ * @brief Record a deadline miss in the job data and the retained fault record
+ * @param job Job ID
+ * @param overrun Time the deadline is exceeded [ms]
+ ***************************************************/
+STATIC void supervisor_record_miss(SUPERVISOR_JOB job, uint32_t overrun)
+{
+    SUPERVISOR_JOB_DATA* data = &supervisor.jobs[job];
+
+    supervisor.deadline_ok = false;
+    if (!data->missed)
+    {
+        data->missed = true;
+        data->misses++;
+        const uint32_t ov = (overrun > SUPERVISOR_OVERRUN_MAX) ? SUPERVISOR_OVERRUN_MAX : overrun;
+        rtc_set_fault_record((((uint32_t)job & 0xFFu) << 16u) | ov);
+    }
+}
+
+/***************************************************
+ * @brief Start the IWDG with the given timeout
+ * @param timeout_ms timeout [ms]
+ ***************************************************/
+STATIC void supervisor_iwdg_start(uint32_t timeout_ms)
+{
+    uint32_t reload = timeout_ms / IWDG_TICK_MS;
+    if (reload > IWDG_RLR_MAX)
+    {
+        reload = IWDG_RLR_MAX;
+    }
+
+    DBGMCU->APB1FZR1 |= DBGMCU_APB1FZR1_DBG_IWDG_STOP; /* stop the watchdog when the core is halted by the debugger */
+
+    IWDG->KR = IWDG_KEY_ENABLE;
+    IWDG->KR = IWDG_KEY_ACCESS;
+    IWDG->PR = IWDG_PR_PR_2; /* divider 64 */
+    IWDG->RLR = reload;
+    IWDG->EWCR = IWDG_EWCR_EWIE | (SUPERVISOR_EWI_MARGIN / IWDG_TICK_MS); /* the counter counts down to 0 */
+
+    uint32_t wait_timer;
+    timer_reset_module_timer(&wait_timer);
+    while (((IWDG->SR & (IWDG_SR_PVU | IWDG_SR_RVU | IWDG_SR_EWU)) != 0u) && (timer_get_elapsed_module_timer(wait_timer) < IWDG_SYNC_WAIT))
+    {
+        /* wait until the registers are updated in the LSI domain */
+    }
+
+    IWDG->KR = IWDG_KEY_RELOAD;
+    supervisor.iwdg_started = true;
+
+    HAL_NVIC_SetPriority(IWDG_IRQn, SUPERVISOR_IRQ_PRIO, 0u);
+    HAL_NVIC_EnableIRQ(IWDG_IRQn);
+}
+
+/***************************************************
+ * @brief Check the deadlines of all jobs and record the first miss
+ * @return true if a miss is found
+ ***************************************************/
+STATIC bool supervisor_check_jobs(void)
+{
+    bool found = false;
+
+    for (uint32_t i = 0u; i < (uint32_t)SUPERVISOR_JOB_NUM; i++)
+    {
+        const SUPERVISOR_JOB_DATA* data = &supervisor.jobs[i];
+        if (data->registered)
+        {
+            const uint32_t elapsed = timer_get_elapsed_module_timer(data->start_tick);
+            if (data->running && (elapsed > data->budget))
+            {
+                supervisor_record_miss((SUPERVISOR_JOB)i, elapsed - data->budget); /* wedged in the job */
+                found = true;
+            }
+            else if (!data->running && (elapsed > data->period))
+            {
+                supervisor_record_miss((SUPERVISOR_JOB)i, elapsed - data->period); /* job is not scheduled any more */
+                found = true;
+            }
+            else
+            {
+                // Do nothing
+            }
+        }
+    }
+
+    return found;
+}
+
+void supervisor_init(uint32_t timeout_ms)
+{
+    for (uint32_t i = 0u; i < (uint32_t)SUPERVISOR_JOB_NUM; i++)
+    {
+        supervisor.jobs[i].registered = false;
+        supervisor.jobs[i].running = false;
+        supervisor.jobs[i].missed = false;
+        supervisor.jobs[i].misses = 0u;
+        supervisor.jobs[i].max_exec = 0u;
+        supervisor.jobs[i].last_exec = 0u;
+    }
+    supervisor.deadline_ok = true;
+    supervisor.refresh_count = 0u;
+    supervisor.skip_count = 0u;
+
+    supervisor.prev_fault_valid = rtc_get_fault_record(&supervisor.prev_fault);
+    if (supervisor.prev_fault_valid)
+    {
+        const uint32_t job = (supervisor.prev_fault >> 16u) & 0xFFu;
+        printf("Deadline miss in previous run: job %lu overrun %lu ms\r\n", job, supervisor.prev_fault & SUPERVISOR_OVERRUN_MAX);
+    }
+
+    supervisor_iwdg_start(timeout_ms);
+}
+
+void supervisor_register(SUPERVISOR_JOB job, uint32_t period_ms, uint32_t budget_ms)
+{
+    if (job < SUPERVISOR_JOB_NUM)
+    {
+        SUPERVISOR_JOB_DATA* data = &supervisor.jobs[job];
+        data->period = period_ms;
+        data->budget = budget_ms;
+        data->running = false;
+        data->missed = false;
+        timer_reset_module_timer(&data->start_tick); /* the first period starts now */
+        data->registered = true;
+    }
+}
+
+void supervisor_job_start(SUPERVISOR_JOB job)
+{
+    if (job < SUPERVISOR_JOB_NUM)
+    {
+        SUPERVISOR_JOB_DATA* data = &supervisor.jobs[job];
+        timer_reset_module_timer(&data->start_tick);
+        data->running = true;
+        data->missed = false;
+    }
+}
+
+void supervisor_job_end(SUPERVISOR_JOB job)
+{
+    if (job < SUPERVISOR_JOB_NUM)
+    {
+        SUPERVISOR_JOB_DATA* data = &supervisor.jobs[job];
+        const uint32_t exec = timer_get_elapsed_module_timer(data->start_tick);
+
+        data->running = false;
+        data->last_exec = exec;
+        if (exec > data->max_exec)
+        {
+            data->max_exec = exec;
+        }
+        if (data->registered && (exec > data->budget))
+        {
+            supervisor_record_miss(job, exec - data->budget);
+        }
+        data->missed = false;
+    }
+}
+
+bool supervisor_proc(void)
+{
+    (void)supervisor_check_jobs();
+
+    const bool refresh = supervisor.deadline_ok && supervisor.iwdg_started;
+    if (refresh)
+    {
+        IWDG->KR = IWDG_KEY_RELOAD;
+        supervisor.refresh_count++;
+    }
+    else
+    {
+        supervisor.skip_count++;
+    }
+    supervisor.deadline_ok = true;
+
+    return refresh;
+}
+
+void supervisor_iwdg_irq(void)
+{
+    if ((IWDG->SR & IWDG_SR_EWIF) != 0u)
+    {
+        if (!supervisor_check_jobs())
+        {
+            /* all jobs within their deadlines, the superloop hangs outside of them */
+            rtc_set_fault_record(((uint32_t)SUPERVISOR_JOB_NUM << 16u) | SUPERVISOR_OVERRUN_MAX);
+        }
+        IWDG->KR = IWDG_KEY_ACCESS;
+        IWDG->EWCR |= IWDG_EWCR_EWIC; /* the reset follows anyway, don't enter again */
+    }
+}
+
+void supervisor_print(void)
+{
+    printf("IWDG refresh %lu skip %lu\r\n", supervisor.refresh_count, supervisor.skip_count);
+    if (supervisor.prev_fault_valid)
+    {
+        printf("Previous run: job %lu overrun %lu ms\r\n", (supervisor.prev_fault >> 16u) & 0xFFu, supervisor.prev_fault & SUPERVISOR_OVERRUN_MAX);
+    }
+    printf("ID %-12s %6s %6s %6s %6s %6s\r\n", "job", "period", "budget", "last", "max", "misses");
+    for (uint32_t i = 0u; i < (uint32_t)SUPERVISOR_JOB_NUM; i++)
+    {
+        const SUPERVISOR_JOB_DATA* data = &supervisor.jobs[i];
+        if (data->registered)
+        {
+            printf("%2lu %-12s %6lu %6lu %6lu %6lu %6lu\r\n", i, supervisor_job_names[i], data->period, data->budget, data->last_exec, data->max_exec, data->misses);
+        }
+    }
+}
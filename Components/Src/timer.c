@@ -12,6 +12,7 @@
 /* Includes ---------------------------------------------------*/
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -20,10 +21,11 @@
 #include "timer.h"
 #include "define.h"
 #include "crc.h"
+#include "safe_var.h"
 
 #define SECOND 1000u /* 1 second = 1000 ms */
 
-#ifdef ENABLE_PWM_US_TIMER_PERIPHERALS
+#ifdef ENABLE_PWM_TIMER_PERIPHERALS
 /* TIM Peripheral data -----------------------------------------------------------*/
 /***************************************************
  * @brief PWM configuration
@@ -35,42 +37,17 @@ typedef struct
     GPIO_TypeDef* port;
     uint16_t pin;
     uint8_t af;
+    volatile uint32_t* ccr; /* Compare register of the channel */
     uint32_t hal_init_crc;
     uint32_t checksum; /* Checksum 4 bytes instead of 2 to force correct alignment and padding */
 } TIMER_PWM_CONFIG;
 
-typedef struct
-{
-    TIM_HandleTypeDef* htim; /* Handle of timer peripheral responsible for us timer */
-    uint32_t hal_init_crc;
-    uint32_t checksum; /* Checksum 4 bytes instead of 2 to force correct alignment and padding */
-} TIMER_US_CONFIG;
-
 /***************************************************
  * @brief PWM configuration instance
  *
  ***************************************************/
 STATIC TIMER_PWM_CONFIG pwm_config_inst[MAX_TIM_PERIPHERALS] = {0};
 
-/**
- * @brief US_TIMER configuration instance
- *
- */
-STATIC TIMER_US_CONFIG us_config_inst;
-
-/***************************************************
- * @brief Parameters of timer module
- ***************************************************/
-typedef struct
-{
-    TIMER_US_CONFIG* us_config;            /* Configuration of microsecond timer peripheral */
-    TIMER_PWM_CONFIG* pwm_config;          /* Associations between timer peripherals and GPIO pins */
-    TIM_HandleTypeDef* event_timer_handle; /* Handle of timer peripheral responsible for event timer */
-    void (*event_callback)(void);          /* Callback when event timer elapsed */
-} TIMER_PARAMS;
-
-STATIC TIMER_PARAMS timer_params = {&us_config_inst, pwm_config_inst, NULL, NULL};
-
 /***************************************************
  * @brief Finds index in pwm_config array of timer_params struct based on port and pin number
  *
@@ -81,6 +58,13 @@ STATIC TIMER_PARAMS timer_params = {&us_config_inst, pwm_config_inst, NULL, NULL
  ***************************************************/
 STATIC uint32_t timer_params_find_pwm_config_index(const GPIO_TypeDef* port, uint16_t pin);
 
+/***************************************************
+ * @brief Recalculate the checksum of a PWM configuration after a change
+ *
+ * @param i Index in the pwm_config array
+ ***************************************************/
+STATIC void timer_params_update_pwm_config_checksum(uint32_t i);
+
 /**********************************************************************************
  * Static setters for timer_params variables
  **********************************************************************************/
@@ -93,12 +77,44 @@ STATIC void timer_params_set_pwm_config_af(uint32_t i, uint8_t af);
 /**********************************************************************************
  * Static getters for timer_params variables
  **********************************************************************************/
-STATIC TIM_HandleTypeDef* timer_params_get_us_timer_handle(void);
 STATIC TIM_HandleTypeDef* timer_params_get_pwm_config_htim(uint32_t i);
 STATIC uint32_t timer_params_get_pwm_config_channel(uint32_t i);
 STATIC GPIO_TypeDef* timer_params_get_pwm_config_port(uint32_t i);
 STATIC uint16_t timer_params_get_pwm_config_pin(uint32_t i);
 STATIC uint8_t timer_params_get_pwm_config_af(uint32_t i);
+#endif /* ENABLE_PWM_TIMER_PERIPHERALS */
+
+#ifdef ENABLE_PWM_US_TIMER_PERIPHERALS
+typedef struct
+{
+    TIM_HandleTypeDef* htim; /* Handle of timer peripheral responsible for us timer */
+    uint32_t hal_init_crc;
+    uint32_t checksum; /* Checksum 4 bytes instead of 2 to force correct alignment and padding */
+} TIMER_US_CONFIG;
+
+/**
+ * @brief US_TIMER configuration instance
+ *
+ */
+STATIC TIMER_US_CONFIG us_config_inst;
+
+/***************************************************
+ * @brief Parameters of timer module
+ ***************************************************/
+typedef struct
+{
+    TIMER_US_CONFIG* us_config;            /* Configuration of microsecond timer peripheral */
+    TIMER_PWM_CONFIG* pwm_config;          /* Associations between timer peripherals and GPIO pins */
+    TIM_HandleTypeDef* event_timer_handle; /* Handle of timer peripheral responsible for event timer */
+    void (*event_callback)(void);          /* Callback when event timer elapsed */
+} TIMER_PARAMS;
+
+STATIC TIMER_PARAMS timer_params = {&us_config_inst, pwm_config_inst, NULL, NULL};
+
+/**********************************************************************************
+ * Static getters for timer_params variables
+ **********************************************************************************/
+STATIC TIM_HandleTypeDef* timer_params_get_us_timer_handle(void);
 #endif /*ENABLE_PWM_US_TIMER_PERIPHERALS*/
 
 /* General Timer module data -----------------------------------------------------*/
@@ -107,7 +123,7 @@ STATIC uint8_t timer_params_get_pwm_config_af(uint32_t i);
  ***************************************************/
 typedef struct
 {
-    bool status;                     /**< Timer status */
+    uint32_t status;                 /**< Timer status, 1 if ok */
     uint32_t error;                  /**< Timer error */
     uint32_t uptime;                 /**< Timer from the module is initialized */
     uint32_t sec_timer;              /**< Sub timer to measure 1 second */
@@ -118,9 +134,9 @@ typedef struct
 } TIMER_DATA;
 
 /* timer_data.tick should be initialized before timer_init() */
-STATIC TIMER_DATA timer_data = {true, 0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u, 0x00000001u};
+STATIC TIMER_DATA timer_data = {0x00000001u, 0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u, 0x00000001u};
 
-STATIC TIMER_DATA timer_data_red = {false, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xfffffffeu};
+STATIC TIMER_DATA timer_data_red = {0xfffffffeu, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xfffffffeu};
 
 /***************************************************
  * @brief Report timer error
@@ -129,6 +145,14 @@ STATIC TIMER_DATA timer_data_red = {false, 0xffffffffu, 0xffffffffu, 0xffffffffu
  *************************************** ************/
 STATIC void timer_error(TIMER_ERROR error);
 
+/***************************************************
+ * @brief Error callback of the safety variables: timer_data differs from timer_data_red
+ ***************************************************/
+STATIC void timer_mem_error(void);
+
+/* timer_data is written with safe_var_write32() only, the hot getters read it unchecked and the scrubber checks it */
+STATIC SAFE_VAR_BLOCK timer_safe = SAFE_VAR_BLOCK_INIT("timer", &timer_data, &timer_data_red, SAFE_VAR_MIRROR, timer_mem_error);
+
 /**********************************************************************************
  * Static setters for timer_data variables
  * This setters can be called from HAL_SYSTICK_Callback() or a critical section.
@@ -142,7 +166,7 @@ STATIC void timer_set_tick_freq(uint32_t tick_freq);
 
 /**********************************************************************************
  * Static getters for timer_data variables
- * The getters call __disable_irq() because the timer module variables can be changed in HAL_SYSTICK_Callback() and systick is non-maskable with nvic_disable_IRQs()
+ * The getters are called every tick and read the variables unchecked, they are checked by the safe_var scrubber
  **********************************************************************************/
 STATIC uint32_t timer_get_sec_timer(void);
 STATIC uint32_t timer_get_tick(void);
@@ -236,14 +260,21 @@ void timer_init(void)
 
     __set_PRIMASK(old_primask);
 
+    if (!safe_var_register(&timer_safe))
+    {
+        timer_error(TIMER_MEM_ERROR); /* not checked in the background */
+    }
+
 #ifdef ENABLE_PWM_US_TIMER_PERIPHERALS
     timer_set_us_timer_handle(NULL);
+#endif /* ENABLE_PWM_US_TIMER_PERIPHERALS*/
 
+#ifdef ENABLE_PWM_TIMER_PERIPHERALS
     for (uint32_t i = 0u; i < MAX_TIM_PERIPHERALS; i++)
     {
         timer_params_set_pwm_config_htim(i, NULL);
     }
-#endif /* ENABLE_PWM_US_TIMER_PERIPHERALS*/
+#endif /* ENABLE_PWM_TIMER_PERIPHERALS*/
 }
 
 void timer_reset_module_timer(uint32_t* module_timer)
@@ -263,13 +294,218 @@ void timer_delay(uint32_t delay_ms)
 
 STATIC void timer_error(TIMER_ERROR error)
 {
-    timer_data.status = false;
-    timer_data_red.status = !(timer_data.status);
+    safe_var_write32(&timer_safe, &timer_data.status, 0u);
+    safe_var_write32(&timer_safe, &timer_data.error, timer_data.error | (((uint32_t)0x1u) << ((uint32_t)error)));
+}
+
+STATIC void timer_mem_error(void)
+{
+    timer_error(TIMER_MEM_ERROR);
+}
+
+#ifdef ENABLE_PWM_TIMER_PERIPHERALS
+void timer_pwm_set_pin(TIM_HandleTypeDef* htim, uint32_t channel, uint8_t alt_function, GPIO_TypeDef* port, uint16_t pin)
+{
+    uint32_t i = timer_params_find_pwm_config_index(port, pin);
+
+    /* New pin: take the first free entry */
+    for (uint32_t j = 0u; (j < MAX_TIM_PERIPHERALS) && (i == MAX_TIM_PERIPHERALS); j++)
+    {
+        if (timer_params_get_pwm_config_htim(j) == NULL)
+        {
+            i = j;
+        }
+    }
+
+    /* CCR1 .. CCR4 are adjacent registers, the handles write them directly */
+    if ((i < MAX_TIM_PERIPHERALS) && (channel <= TIM_CHANNEL_4))
+    {
+        timer_params_set_pwm_config_htim(i, htim);
+        timer_params_set_pwm_config_channel(i, channel);
+        timer_params_set_pwm_config_port(i, port);
+        timer_params_set_pwm_config_pin(i, pin);
+        timer_params_set_pwm_config_af(i, alt_function);
+        pwm_config_inst[i].ccr = &htim->Instance->CCR1 + (channel / 4u);
+        __HAL_TIM_ENABLE_OCxPRELOAD(htim, channel);
+        pwm_config_inst[i].hal_init_crc = crc_calc(&htim->Init, sizeof(htim->Init)); /* the timer must be initialized before */
+        timer_params_update_pwm_config_checksum(i);
+    }
+    else
+    {
+        timer_error(TIMER_OOR_ERROR);
+    }
+}
+
+void timer_pwm_init_pin(GPIO_TypeDef* port, uint16_t pin, uint32_t gpio_speed)
+{
+    const uint32_t i = timer_params_find_pwm_config_index(port, pin);
+
+    if (i < MAX_TIM_PERIPHERALS)
+    {
+        GPIO_InitTypeDef gpio = {0};
+        gpio.Pin = pin;
+        gpio.Mode = GPIO_MODE_AF_PP;
+        gpio.Pull = GPIO_NOPULL;
+        gpio.Speed = gpio_speed;
+        gpio.Alternate = timer_params_get_pwm_config_af(i);
+        HAL_GPIO_Init(port, &gpio);
+    }
+    else
+    {
+        timer_error(TIMER_PWM_ERROR);
+    }
+}
+
+void timer_pwm_set_duty_cycle(const GPIO_TypeDef* port, uint16_t pin, uint8_t duty_cycle)
+{
+    timer_pwm_set_duty(timer_pwm_get_handle(port, pin), duty_cycle);
+}
+
+void timer_pwm_start(const GPIO_TypeDef* port, uint16_t pin)
+{
+    timer_pwm_handle_start(timer_pwm_get_handle(port, pin));
+}
+
+void timer_pwm_stop(const GPIO_TypeDef* port, uint16_t pin)
+{
+    timer_pwm_handle_stop(timer_pwm_get_handle(port, pin));
+}
+
+TIMER_PWM_HANDLE timer_pwm_get_handle(const GPIO_TypeDef* port, uint16_t pin)
+{
+    uint32_t i = timer_params_find_pwm_config_index(port, pin);
+    const TIM_HandleTypeDef* htim = (i < MAX_TIM_PERIPHERALS) ? timer_params_get_pwm_config_htim(i) : NULL;
+
+    /* The timer configuration must not have changed since timer_pwm_set_pin() */
+    if ((htim == NULL) || (pwm_config_inst[i].hal_init_crc != crc_calc(&htim->Init, sizeof(htim->Init))))
+    {
+        timer_error(TIMER_PWM_ERROR);
+        i = TIMER_PWM_INVALID;
+    }
+
+    return i;
+}
+
+void timer_pwm_set_duty(TIMER_PWM_HANDLE pwm, uint8_t duty_cycle)
+{
+    if (pwm < MAX_TIM_PERIPHERALS)
+    {
+        /* The compare value is scaled to the period, read at every write so a changed period is followed */
+        const TIMER_PWM_CONFIG* cfg = &pwm_config_inst[pwm];
+        const uint64_t period = (uint64_t)cfg->htim->Instance->ARR + 1u;
+        const uint64_t duty = (duty_cycle > 100u) ? 100u : duty_cycle;
+        *cfg->ccr = (uint32_t)((period * duty) / 100u);
+    }
+    else
+    {
+        timer_error(TIMER_PWM_ERROR);
+    }
+}
+
+void timer_pwm_handle_start(TIMER_PWM_HANDLE pwm)
+{
+    if ((pwm >= MAX_TIM_PERIPHERALS) || (HAL_TIM_PWM_Start(timer_params_get_pwm_config_htim(pwm), timer_params_get_pwm_config_channel(pwm)) != HAL_OK))
+    {
+        timer_error(TIMER_PWM_ERROR);
+    }
+}
+
+void timer_pwm_handle_stop(TIMER_PWM_HANDLE pwm)
+{
+    if ((pwm >= MAX_TIM_PERIPHERALS) || (HAL_TIM_PWM_Stop(timer_params_get_pwm_config_htim(pwm), timer_params_get_pwm_config_channel(pwm)) != HAL_OK))
+    {
+        timer_error(TIMER_PWM_ERROR);
+    }
+}
 
-    timer_data.error |= ((uint32_t)0x1u) << ((uint32_t)error);
-    timer_data_red.error &= ((((uint32_t)0x1u) << ((uint32_t)error)) ^ 0xFFFFFFFFU);
+void timer_pwm_batch_begin(const TIM_HandleTypeDef* htim)
+{
+    SET_BIT(htim->Instance->CR1, TIM_CR1_UDIS);
 }
 
+void timer_pwm_batch_commit(const TIM_HandleTypeDef* htim)
+{
+    CLEAR_BIT(htim->Instance->CR1, TIM_CR1_UDIS);
+}
+
+STATIC uint32_t timer_params_find_pwm_config_index(const GPIO_TypeDef* port, uint16_t pin)
+{
+    uint32_t index = MAX_TIM_PERIPHERALS;
+
+    for (uint32_t i = 0u; (i < MAX_TIM_PERIPHERALS) && (index == MAX_TIM_PERIPHERALS); i++)
+    {
+        if ((timer_params_get_pwm_config_htim(i) != NULL) && (timer_params_get_pwm_config_port(i) == port) && (timer_params_get_pwm_config_pin(i) == pin))
+        {
+            index = i;
+        }
+    }
+
+    /* (Defensive and not unit-tested) */
+    if ((index < MAX_TIM_PERIPHERALS) && (pwm_config_inst[index].checksum != crc_calc(&pwm_config_inst[index], offsetof(TIMER_PWM_CONFIG, checksum))))
+    {
+        timer_error(TIMER_MEM_ERROR);
+        index = MAX_TIM_PERIPHERALS;
+    }
+
+    return index;
+}
+
+STATIC void timer_params_update_pwm_config_checksum(uint32_t i)
+{
+    pwm_config_inst[i].checksum = crc_calc(&pwm_config_inst[i], offsetof(TIMER_PWM_CONFIG, checksum));
+}
+
+STATIC void timer_params_set_pwm_config_htim(uint32_t i, TIM_HandleTypeDef* handle)
+{
+    pwm_config_inst[i].htim = handle;
+}
+
+STATIC void timer_params_set_pwm_config_channel(uint32_t i, uint32_t channel)
+{
+    pwm_config_inst[i].channel = channel;
+}
+
+STATIC void timer_params_set_pwm_config_port(uint32_t i, GPIO_TypeDef* port)
+{
+    pwm_config_inst[i].port = port;
+}
+
+STATIC void timer_params_set_pwm_config_pin(uint32_t i, uint16_t pin)
+{
+    pwm_config_inst[i].pin = pin;
+}
+
+STATIC void timer_params_set_pwm_config_af(uint32_t i, uint8_t af)
+{
+    pwm_config_inst[i].af = af;
+}
+
+STATIC TIM_HandleTypeDef* timer_params_get_pwm_config_htim(uint32_t i)
+{
+    return pwm_config_inst[i].htim;
+}
+
+STATIC uint32_t timer_params_get_pwm_config_channel(uint32_t i)
+{
+    return pwm_config_inst[i].channel;
+}
+
+STATIC GPIO_TypeDef* timer_params_get_pwm_config_port(uint32_t i)
+{
+    return pwm_config_inst[i].port;
+}
+
+STATIC uint16_t timer_params_get_pwm_config_pin(uint32_t i)
+{
+    return pwm_config_inst[i].pin;
+}
+
+STATIC uint8_t timer_params_get_pwm_config_af(uint32_t i)
+{
+    return pwm_config_inst[i].af;
+}
+#endif /* ENABLE_PWM_TIMER_PERIPHERALS */
+
 #ifdef ENABLE_PWM_US_TIMER_PERIPHERALS
 uint16_t timer_get_elapsed_us_timer(uint16_t us_timer)
 {
@@ -375,68 +611,44 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim) //lint !e818 could b
 
 uint32_t timer_get_uptime(void)
 {
-    uint32_t old_primask;
     uint32_t t;
 
-    old_primask = __get_PRIMASK(); /* disable IRQ */
-    (void)__disable_irq();
-    if (timer_data.uptime != (timer_data_red.uptime ^ 0xFFFFFFFFU))
+    if (!safe_var_read32(&timer_safe, &timer_data.uptime, &t))
     {
-        timer_error(TIMER_MEM_ERROR);
         t = 0u;
     }
-    else
-    {
-        t = timer_data.uptime;
-    }
-
-    __set_PRIMASK(old_primask);
 
     return t;
 }
 
-STATIC uint32_t timer_get_sec_timer(void)
+bool timer_get_status(void)
 {
-    if (timer_data.sec_timer != (timer_data_red.sec_timer ^ 0xFFFFFFFFU))
-    {
-        timer_error(TIMER_MEM_ERROR);
-        return 0u;
-    }
+    uint32_t status;
 
-    return timer_data.sec_timer;
+    return safe_var_read32(&timer_safe, &timer_data.status, &status) && (status != 0u);
 }
 
-STATIC uint32_t timer_get_tick(void)
+uint32_t timer_get_error_code(void)
 {
-    uint32_t ret;
+    uint32_t error;
 
-    const uint32_t old_primask = __get_PRIMASK(); /* disable IRQ */
-    (void)__disable_irq();
-    const uint32_t tick = timer_data.tick;
-    const uint32_t tick_red = timer_data_red.tick;
-    if (tick != (tick_red ^ 0xFFFFFFFFU))
-    {
-        timer_error(TIMER_MEM_ERROR);
-        ret = 0;
-    }
-    else
-    {
-        ret = timer_data.tick;
-    }
+    (void)safe_var_read32(&timer_safe, &timer_data.error, &error);
 
-    __set_PRIMASK(old_primask);
+    return error;
+}
 
-    return ret;
+STATIC uint32_t timer_get_sec_timer(void)
+{
+    return timer_data.sec_timer;
 }
 
-STATIC uint32_t timer_get_tick_freq(void)
+STATIC uint32_t timer_get_tick(void)
 {
-    if (timer_data.tick_freq != (timer_data_red.tick_freq ^ 0xFFFFFFFFU))
-    {
-        timer_error(TIMER_MEM_ERROR);
-        return 0u;
-    }
+    return timer_data.tick;
+}
 
+STATIC uint32_t timer_get_tick_freq(void)
+{
     return timer_data.tick_freq;
 }
 
@@ -445,38 +657,32 @@ STATIC uint32_t timer_get_tick_freq(void)
  * ***************************************************/
 STATIC void timer_set_uptime(uint32_t uptime)
 {
-    timer_data.uptime = uptime;
-    timer_data_red.uptime = uptime ^ 0xFFFFFFFFU;
+    safe_var_write32(&timer_safe, &timer_data.uptime, uptime);
 }
 
 STATIC void timer_set_sec_timer(uint32_t sec_timer)
 {
-    timer_data.sec_timer = sec_timer;
-    timer_data_red.sec_timer = sec_timer ^ 0xFFFFFFFFU;
+    safe_var_write32(&timer_safe, &timer_data.sec_timer, sec_timer);
 }
 
 STATIC void timer_set_bms_timer(uint32_t bms_timer)
 {
-    timer_data.bms_timer = bms_timer;
-    timer_data_red.bms_timer = bms_timer ^ 0xFFFFFFFFU;
+    safe_var_write32(&timer_safe, &timer_data.bms_timer, bms_timer);
 }
 
 STATIC void timer_set_bms_time_flag(uint32_t bms_time_flag)
 {
-    timer_data.bms_time_flag = bms_time_flag;
-    timer_data_red.bms_time_flag = bms_time_flag ^ 0xFFFFFFFFU;
+    safe_var_write32(&timer_safe, &timer_data.bms_time_flag, bms_time_flag);
 }
 
 STATIC void timer_set_tick(uint32_t tick)
 {
-    timer_data.tick = tick;
-    timer_data_red.tick = tick ^ 0xFFFFFFFFU;
+    safe_var_write32(&timer_safe, &timer_data.tick, tick);
 }
 
 STATIC void timer_set_tick_freq(uint32_t tick_freq)
 {
-    timer_data.tick_freq = tick_freq;
-    timer_data_red.tick_freq = tick_freq ^ 0xFFFFFFFFU;
+    safe_var_write32(&timer_safe, &timer_data.tick_freq, tick_freq);
 }
 
 /** @}*/
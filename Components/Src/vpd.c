@@ -0,0 +1,399 @@
+/**
+ * @file vpd.c
+ * @author PL
+ * @brief Vapor pressure deficit (VPD) of the grow zones and climate setpoints
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup VPD
+ *
+ * The linear interpolation error of a 1 degC table is h^2/8 * SVP'' which is 3.2 Pa at 50 degC,
+ * far below the +-2% RH of the sensors (250 Pa at 30 degC). The relative humidity is scaled with
+ * a 32x32->64 bit multiplication and a division by a constant, so vpd_calc() needs no library call.
+ */
+#include "vpd.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "coroutine.h"
+#include "stm32_hal.h"
+#include "timer.h"
+
+#define VPD_SVP_SIZE        ((uint32_t)(VPD_TEMP_MAX - VPD_TEMP_MIN) + 1u) /* Table entries, 1 degC steps including both ends */
+#define VPD_RH_MAX          FIX16_FROM_INT(100)                            /* 100 %RH */
+#define VPD_PERMILLE        1000u                                          /* Full fan speed */
+#define VPD_CHECK_N         64u                                            /* Number of evaluations per benchmark */
+#define VPD_CHECK_MAX_ERROR 4u                                             /* Documented table error [Pa], 3.14 Pa at 49.5 degC */
+
+#define VPD_TARGET_DEFAULT      1000               /* Default VPD target, vegetative stage [Pa] */
+#define VPD_BAND_DEFAULT        150                /* Default hysteresis [Pa] */
+#define VPD_LEAF_OFFSET_DEFAULT FIX16_C(-1.0)      /* Default leaf temperature offset under LED lighting [degC] */
+#define VPD_TEMP_MAX_DEFAULT    FIX16_FROM_INT(30) /* Default temperature for full fan speed [degC] */
+
+/***************************************************
+ * @brief Saturation vapor pressure [Pa] from VPD_TEMP_MIN to VPD_TEMP_MAX in 1 degC steps
+ ***************************************************/
+static const uint16_t vpd_svp_lut[VPD_SVP_SIZE] = {
+    286u,  309u,  334u,  361u,  390u,  421u,  454u,  490u,  527u,  568u,  611u,  657u,  706u,  758u,  813u,   872u,   935u,   1002u,  1073u,  1148u, 1228u,
+    1313u, 1403u, 1498u, 1599u, 1705u, 1818u, 1938u, 2064u, 2197u, 2338u, 2487u, 2644u, 2809u, 2984u, 3168u,  3361u,  3565u,  3780u,  4006u,  4243u, 4492u,
+    4755u, 5030u, 5319u, 5622u, 5941u, 6275u, 6625u, 6991u, 7375u, 7778u, 8199u, 8639u, 9100u, 9582u, 10086u, 10612u, 11162u, 11737u, 12336u,
+};
+
+/**
+ * @brief Last reading of a sensor
+ */
+typedef struct
+{
+    q16_t temp;     /**< Air temperature [degC] */
+    int32_t avp_pa; /**< Actual vapor pressure [Pa] */
+    uint32_t tick;  /**< Time of the update */
+    bool updated;   /**< Received at least one reading */
+} VPD_SENSOR;
+
+/**
+ * @brief Data of a zone
+ */
+typedef struct
+{
+    VPD_CONFIG config;                   /**< Climate configuration */
+    VPD_SENSOR sensors[VPD_MAX_SENSORS]; /**< Sensor readings */
+    VPD_OUTPUT out;                      /**< Result of the last evaluation */
+} VPD_ZONE;
+
+/**
+ * @brief Operational data of the VPD module
+ */
+typedef struct
+{
+    CORO coro;                     /**< Evaluation coroutine, first member */
+    VPD_ZONE zones[VPD_MAX_ZONES]; /**< Zones */
+} VPD_DATA;
+
+STATIC VPD_DATA vpd;
+
+/***************************************************
+ * @brief Inputs of the benchmarks, volatile so the compiler can't fold the loops
+ ***************************************************/
+static volatile q16_t vpd_bench_temp[VPD_CHECK_N];
+static volatile float vpd_bench_temp_f[VPD_CHECK_N];
+static volatile int32_t vpd_sink;
+static volatile float vpd_sink_f;
+
+/***************************************************
+ * @brief Actual vapor pressure from the SVP and the relative humidity
+ * @param svp Saturation vapor pressure [Pa]
+ * @param rh Relative humidity [%], 0..100
+ * @return Actual vapor pressure [Pa]
+ ***************************************************/
+STATIC int32_t vpd_avp(int32_t svp, q16_t rh)
+{
+    const int32_t pa_pct = (int32_t)(((int64_t)svp * rh) >> 16); /* < 1.3e6 */
+
+    return pa_pct / 100;
+}
+
+/***************************************************
+ * @brief Saturate the relative humidity to 0..100 %
+ * @param rh Relative humidity [%]
+ * @return Saturated relative humidity [%]
+ ***************************************************/
+STATIC q16_t vpd_rh_sat(q16_t rh)
+{
+    q16_t res = rh;
+
+    if (rh < 0)
+    {
+        res = 0;
+    }
+    else if (rh > VPD_RH_MAX)
+    {
+        res = VPD_RH_MAX;
+    }
+    else
+    {
+        // Do nothing
+    }
+
+    return res;
+}
+
+/***************************************************
+ * @brief Reference SVP with exp(), used by the check
+ * @param temp Temperature [degC]
+ * @return SVP [Pa]
+ ***************************************************/
+STATIC double vpd_svp_ref(double temp)
+{
+    return 610.78 * exp((17.27 * temp) / (temp + 237.3));
+}
+
+/***************************************************
+ * @brief Compute the state and the setpoints of a zone
+ * @param z Zone
+ ***************************************************/
+STATIC void vpd_eval(VPD_ZONE* z)
+{
+    const VPD_CONFIG* cfg = &z->config;
+    VPD_OUTPUT* out = &z->out;
+    int32_t temp_sum = 0;
+    int32_t avp_sum = 0;
+    int32_t n = 0;
+
+    for (uint32_t i = 0u; i < VPD_MAX_SENSORS; i++)
+    {
+        const VPD_SENSOR* s = &z->sensors[i];
+        if (s->updated && (timer_get_elapsed_module_timer(s->tick) < VPD_SENSOR_TIMEOUT))
+        {
+            temp_sum += s->temp;
+            avp_sum += s->avp_pa;
+            n++;
+        }
+    }
+
+    out->valid = (n > 0);
+    if (out->valid)
+    {
+        out->temp = temp_sum / n;
+        out->avp_pa = avp_sum / n;
+        out->vpd_pa = vpd_svp(fix16_add(out->temp, cfg->leaf_offset)) - out->avp_pa;
+
+        if (out->vpd_pa > (cfg->target_pa + cfg->band_pa))
+        {
+            out->humidifier = true;
+        }
+        else if (out->vpd_pa <= cfg->target_pa)
+        {
+            out->humidifier = false;
+        }
+        else
+        {
+            // Do nothing
+        }
+
+        if (out->vpd_pa < (cfg->target_pa - cfg->band_pa))
+        {
+            out->dehumidifier = true;
+        }
+        else if (out->vpd_pa >= cfg->target_pa)
+        {
+            out->dehumidifier = false;
+        }
+        else
+        {
+            // Do nothing
+        }
+
+        const int32_t excess = cfg->target_pa - out->vpd_pa; /* > 0: air too humid */
+        if ((out->temp > cfg->temp_max) || (excess >= VPD_FAN_SPAN))
+        {
+            out->fan_permille = VPD_PERMILLE;
+        }
+        else if (excess <= 0)
+        {
+            out->fan_permille = VPD_FAN_MIN;
+        }
+        else
+        {
+            out->fan_permille = VPD_FAN_MIN + (((VPD_PERMILLE - VPD_FAN_MIN) * (uint32_t)excess) / (uint32_t)VPD_FAN_SPAN);
+        }
+    }
+    else
+    {
+        out->humidifier = false;
+        out->dehumidifier = false;
+        out->fan_permille = VPD_FAN_MIN;
+    }
+}
+
+/***************************************************
+ * @brief Evaluation coroutine, computes the setpoints of all zones every VPD_PERIOD
+ * @param c Control block
+ * @return Coroutine state
+ ***************************************************/
+STATIC CORO_STATE vpd_coro(CORO* c)
+{
+    CORO_BEGIN(c);
+    CORO_SLEEP(c, VPD_PERIOD);
+    for (uint32_t i = 0u; i < VPD_MAX_ZONES; i++)
+    {
+        vpd_eval(&vpd.zones[i]);
+    }
+    CORO_RESTART(c);
+    CORO_END(c);
+}
+
+void vpd_init(void)
+{
+    for (uint32_t i = 0u; i < VPD_MAX_ZONES; i++)
+    {
+        VPD_ZONE* z = &vpd.zones[i];
+        z->config.target_pa = VPD_TARGET_DEFAULT;
+        z->config.band_pa = VPD_BAND_DEFAULT;
+        z->config.leaf_offset = VPD_LEAF_OFFSET_DEFAULT;
+        z->config.temp_max = VPD_TEMP_MAX_DEFAULT;
+        for (uint32_t j = 0u; j < VPD_MAX_SENSORS; j++)
+        {
+            z->sensors[j].updated = false;
+        }
+        vpd_eval(z);
+    }
+
+    coro_start(&vpd.coro, vpd_coro);
+}
+
+int32_t vpd_svp(q16_t temp)
+{
+    const q16_t t = fix16_sub(temp, FIX16_FROM_INT(VPD_TEMP_MIN));
+    uint32_t i;
+    uint32_t frac;
+
+    if (t <= 0)
+    {
+        i = 0u;
+        frac = 0u;
+    }
+    else if (t >= FIX16_FROM_INT(VPD_TEMP_MAX - VPD_TEMP_MIN))
+    {
+        i = VPD_SVP_SIZE - 2u;
+        frac = (uint32_t)FIX16_ONE;
+    }
+    else
+    {
+        i = (uint32_t)t >> 16u;
+        frac = (uint32_t)t & 0xFFFFu;
+    }
+
+    const uint32_t y0 = vpd_svp_lut[i];
+    return (int32_t)(y0 + (((vpd_svp_lut[i + 1u] - y0) * frac) >> 16u));
+}
+
+int32_t vpd_calc(q16_t temp, q16_t rh, q16_t leaf_offset)
+{
+    return vpd_svp(fix16_add(temp, leaf_offset)) - vpd_avp(vpd_svp(temp), vpd_rh_sat(rh));
+}
+
+bool vpd_set_sensor(uint32_t zone, uint32_t sensor, q16_t temp, q16_t rh)
+{
+    const bool ok = (zone < VPD_MAX_ZONES) && (sensor < VPD_MAX_SENSORS);
+
+    if (ok)
+    {
+        VPD_SENSOR* s = &vpd.zones[zone].sensors[sensor];
+        s->temp = temp;
+        s->avp_pa = vpd_avp(vpd_svp(temp), vpd_rh_sat(rh));
+        timer_reset_module_timer(&s->tick);
+        s->updated = true;
+    }
+
+    return ok;
+}
+
+bool vpd_set_config(uint32_t zone, const VPD_CONFIG* config)
+{
+    const bool ok = (zone < VPD_MAX_ZONES);
+
+    if (ok)
+    {
+        vpd.zones[zone].config = *config;
+    }
+
+    return ok;
+}
+
+bool vpd_get_config(uint32_t zone, VPD_CONFIG* config)
+{
+    const bool ok = (zone < VPD_MAX_ZONES);
+
+    if (ok)
+    {
+        *config = vpd.zones[zone].config;
+    }
+
+    return ok;
+}
+
+bool vpd_get_output(uint32_t zone, VPD_OUTPUT* out)
+{
+    bool ok = false;
+
+    if (zone < VPD_MAX_ZONES)
+    {
+        *out = vpd.zones[zone].out;
+        ok = out->valid;
+    }
+
+    return ok;
+}
+
+void vpd_print(void)
+{
+    for (uint32_t i = 0u; i < VPD_MAX_ZONES; i++)
+    {
+        const VPD_ZONE* z = &vpd.zones[i];
+        const VPD_OUTPUT* out = &z->out;
+        const int32_t offset = (int32_t)(((int64_t)z->config.leaf_offset * 10) >> 16);
+
+        printf("Zone %lu: target %ld Pa +-%ld, leaf offset %ld.%ld C", i, z->config.target_pa, z->config.band_pa, offset / 10, labs(offset % 10));
+        if (out->valid)
+        {
+            const int32_t temp = (int32_t)(((int64_t)out->temp * 10) >> 16);
+            const int32_t svp = vpd_svp(out->temp);
+            const int32_t rh = (svp > 0) ? ((out->avp_pa * 1000) / svp) : 0;
+            printf(", %ld.%ld C %ld.%ld %%RH, VPD %ld Pa\r\n", temp / 10, labs(temp % 10), rh / 10, rh % 10, out->vpd_pa);
+            printf("  humidifier %s, dehumidifier %s, fan %lu.%lu%%\r\n", out->humidifier ? "on" : "off", out->dehumidifier ? "on" : "off", out->fan_permille / 10u,
+                   out->fan_permille % 10u);
+        }
+        else
+        {
+            printf(", no sensor data\r\n");
+        }
+    }
+}
+
+bool vpd_check(void)
+{
+    const uint32_t old_primask = __get_PRIMASK();
+    uint32_t err = 0u;
+    uint32_t start;
+    uint32_t cycles;
+
+    for (q16_t t = FIX16_FROM_INT(VPD_TEMP_MIN); t <= FIX16_FROM_INT(VPD_TEMP_MAX); t += 655) /* 0.01 degC steps */
+    {
+        const uint32_t e = (uint32_t)ceil(fabs((double)vpd_svp(t) - vpd_svp_ref((double)t / 65536.0)) - 0.5); /* the table is rounded to 1 Pa */
+        err = (e > err) ? e : err;
+    }
+    printf("SVP max error %lu Pa\r\n", err);
+
+    for (uint32_t i = 0u; i < VPD_CHECK_N; i++)
+    {
+        vpd_bench_temp[i] = FIX16_FROM_INT(15) + (q16_t)(i * 13107u); /* 15 .. 27.6 degC */
+        vpd_bench_temp_f[i] = (float)vpd_bench_temp[i] / 65536.0f;
+    }
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < VPD_CHECK_N; i++)
+    {
+        vpd_sink = vpd_calc(vpd_bench_temp[i], FIX16_FROM_INT(60), FIX16_C(-1.0));
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    printf("vpd table  %4lu.%02lu cycles/op\r\n", cycles / VPD_CHECK_N, ((cycles % VPD_CHECK_N) * 100u) / VPD_CHECK_N);
+
+    (void)__disable_irq();
+    start = bench_get_cycles();
+    for (uint32_t i = 0u; i < VPD_CHECK_N; i++)
+    {
+        const float t = vpd_bench_temp_f[i];
+        const float leaf = t - 1.0f;
+        vpd_sink_f = (610.78f * expf((17.27f * leaf) / (leaf + 237.3f))) - (0.6f * 610.78f * expf((17.27f * t) / (t + 237.3f)));
+    }
+    cycles = bench_get_cycles() - start;
+    __set_PRIMASK(old_primask);
+    printf("vpd expf   %4lu.%02lu cycles/op\r\n", cycles / VPD_CHECK_N, ((cycles % VPD_CHECK_N) * 100u) / VPD_CHECK_N);
+
+    return (err <= VPD_CHECK_MAX_ERROR);
+}
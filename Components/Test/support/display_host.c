@@ -0,0 +1,291 @@
+/**
+ * @file display_host.c
+ * @author PL
+ * @brief Host backend of the display for the unit tests: ST7735 panel model and PNG frames
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * The PNG is not compressed: the zlib stream holds stored blocks of at most 65535 bytes, each with its
+ * length and the one's complement of it. The chunk CRC is the CRC-32 of PNG, the stream ends with the
+ * Adler-32 of the image data.
+ */
+#include "display_host.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DISPLAY_HOST_CASET  0x2Au /* Column address set */
+#define DISPLAY_HOST_RASET  0x2Bu /* Row address set */
+#define DISPLAY_HOST_RAMWR  0x2Cu /* Memory write */
+#define DISPLAY_HOST_DISPON 0x29u /* Display on */
+
+#define DISPLAY_HOST_ROW   (1u + (DISPLAY_WIDTH * 3u))         /* Filter byte and RGB pixels of a PNG row [bytes] */
+#define DISPLAY_HOST_RAW   (DISPLAY_HOST_ROW * DISPLAY_HEIGHT) /* Image data [bytes] */
+#define DISPLAY_HOST_BLOCK 65535u                              /* Largest stored deflate block [bytes] */
+#define DISPLAY_HOST_ZLIB  (2u + DISPLAY_HOST_RAW + (5u * ((DISPLAY_HOST_RAW / DISPLAY_HOST_BLOCK) + 1u)) + 4u) /* Header, stored blocks and Adler-32 [bytes] */
+
+/**
+ * @brief State of the panel model
+ */
+typedef struct
+{
+    const GPIO_TypeDef* dc_port;                  /**< Data/command output, port */
+    uint16_t dc_pin;                              /**< Data/command output, pin */
+    uint8_t cmd;                                  /**< Last command */
+    uint8_t params[4];                            /**< Parameters of CASET/RASET */
+    uint32_t num_params;                          /**< Bytes after the command */
+    uint32_t x0;                                  /**< Window: first column */
+    uint32_t x1;                                  /**< Window: last column */
+    uint32_t y0;                                  /**< Window: first row */
+    uint32_t y1;                                  /**< Window: last row */
+    uint32_t x;                                   /**< Column of the next pixel */
+    uint32_t y;                                   /**< Row of the next pixel */
+    uint8_t hi;                                   /**< First byte of a pixel */
+    uint16_t ram[DISPLAY_WIDTH * DISPLAY_HEIGHT]; /**< Panel memory, RGB565 */
+} DISPLAY_HOST;
+
+uint32_t display_host_windows;
+uint32_t display_host_pixels;
+bool display_host_on;
+
+static DISPLAY_HOST panel;
+static uint8_t display_host_raw[DISPLAY_HOST_RAW];
+static uint8_t display_host_zlib[DISPLAY_HOST_ZLIB];
+
+/***************************************************
+ * @brief Write a pixel at the address counter and advance it within the window
+ * @param color RGB565 color
+ ***************************************************/
+static void display_host_put(uint16_t color)
+{
+    if ((panel.x < DISPLAY_WIDTH) && (panel.y < DISPLAY_HEIGHT))
+    {
+        panel.ram[(panel.y * DISPLAY_WIDTH) + panel.x] = color;
+    }
+    display_host_pixels++;
+    if (panel.x < panel.x1)
+    {
+        panel.x++;
+    }
+    else
+    {
+        panel.x = panel.x0;
+        panel.y = (panel.y < panel.y1) ? (panel.y + 1u) : panel.y0;
+    }
+}
+
+/***************************************************
+ * @brief Decode a byte sent to the panel
+ * @param byte Byte
+ * @param data D/C was high
+ ***************************************************/
+static void display_host_byte(uint8_t byte, bool data)
+{
+    if (!data)
+    {
+        panel.cmd = byte;
+        panel.num_params = 0u;
+        if (byte == DISPLAY_HOST_RAMWR)
+        {
+            panel.x = panel.x0;
+            panel.y = panel.y0;
+            display_host_windows++;
+        }
+        display_host_on = display_host_on || (byte == DISPLAY_HOST_DISPON);
+    }
+    else if (panel.cmd == DISPLAY_HOST_RAMWR)
+    {
+        if ((panel.num_params & 1u) == 0u)
+        {
+            panel.hi = byte;
+        }
+        else
+        {
+            display_host_put((uint16_t)(((uint32_t)panel.hi << 8) | byte));
+        }
+        panel.num_params++;
+    }
+    else if (((panel.cmd == DISPLAY_HOST_CASET) || (panel.cmd == DISPLAY_HOST_RASET)) && (panel.num_params < 4u))
+    {
+        panel.params[panel.num_params] = byte;
+        panel.num_params++;
+        if (panel.num_params == 4u)
+        {
+            const uint32_t start = ((uint32_t)panel.params[0] << 8) | panel.params[1];
+            const uint32_t end = ((uint32_t)panel.params[2] << 8) | panel.params[3];
+            if (panel.cmd == DISPLAY_HOST_CASET)
+            {
+                panel.x0 = start;
+                panel.x1 = end;
+            }
+            else
+            {
+                panel.y0 = start;
+                panel.y1 = end;
+            }
+        }
+    }
+    else
+    {
+        // Do nothing, parameters of the other commands
+    }
+}
+
+/***************************************************
+ * @brief SPI hook: decode a transfer with the level of the D/C output
+ * @param data Data
+ * @param len Number of bytes
+ ***************************************************/
+static void display_host_spi(const uint8_t* data, uint16_t len)
+{
+    const bool dc = ((panel.dc_port->ODR & panel.dc_pin) != 0u);
+
+    for (uint32_t i = 0u; i < len; i++)
+    {
+        display_host_byte(data[i], dc);
+    }
+}
+
+/***************************************************
+ * @brief CRC-32 of PNG (reflected 0xEDB88320), continued over several buffers
+ * @param crc CRC so far, 0 at the start
+ * @param data Data
+ * @param len Number of bytes
+ * @return CRC
+ ***************************************************/
+static uint32_t display_host_crc(uint32_t crc, const uint8_t* data, size_t len)
+{
+    uint32_t c = ~crc;
+
+    for (size_t i = 0u; i < len; i++)
+    {
+        c ^= data[i];
+        for (uint32_t k = 0u; k < 8u; k++)
+        {
+            c = ((c & 1u) != 0u) ? ((c >> 1) ^ 0xEDB88320u) : (c >> 1);
+        }
+    }
+
+    return ~c;
+}
+
+/***************************************************
+ * @brief Store a 32 bit value big endian
+ * @param p Destination
+ * @param v Value
+ ***************************************************/
+static void display_host_be32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/***************************************************
+ * @brief Write a PNG chunk: length, type, data and CRC
+ * @param f File
+ * @param type Chunk type, 4 characters
+ * @param data Data
+ * @param len Number of bytes
+ * @return false on a write error
+ ***************************************************/
+static bool display_host_chunk(FILE* f, const char* type, const uint8_t* data, uint32_t len)
+{
+    uint8_t head[8];
+    uint8_t tail[4];
+
+    display_host_be32(head, len);
+    (void)memcpy(&head[4], type, 4u);
+    display_host_be32(tail, display_host_crc(display_host_crc(0u, &head[4], 4u), data, len));
+
+    return (fwrite(head, 1u, sizeof(head), f) == sizeof(head)) && (fwrite(data, 1u, len, f) == len) && (fwrite(tail, 1u, sizeof(tail), f) == sizeof(tail));
+}
+
+void display_host_attach(const GPIO_TypeDef* dc_port, uint16_t dc_pin)
+{
+    (void)memset(&panel, 0, sizeof(panel));
+    panel.dc_port = dc_port;
+    panel.dc_pin = dc_pin;
+    panel.x1 = DISPLAY_WIDTH - 1u;
+    panel.y1 = DISPLAY_HEIGHT - 1u;
+    display_host_windows = 0u;
+    display_host_pixels = 0u;
+    display_host_on = false;
+    hal_spi_hook = display_host_spi;
+}
+
+uint16_t display_host_pixel(uint32_t x, uint32_t y)
+{
+    return panel.ram[(y * DISPLAY_WIDTH) + x];
+}
+
+bool display_host_write_png(const char* path)
+{
+    static const uint8_t signature[8] = {0x89u, 'P', 'N', 'G', 0x0Du, 0x0Au, 0x1Au, 0x0Au};
+    uint8_t ihdr[13] = {0u};
+    uint32_t a = 1u;
+    uint32_t b = 0u;
+    uint32_t n = 0u;
+    FILE* f;
+    bool ok;
+
+    for (uint32_t y = 0u; y < DISPLAY_HEIGHT; y++)
+    {
+        uint8_t* row = &display_host_raw[y * DISPLAY_HOST_ROW];
+        row[0] = 0u; /* filter: none */
+        for (uint32_t x = 0u; x < DISPLAY_WIDTH; x++)
+        {
+            const uint32_t c = display_host_pixel(x, y);
+            const uint32_t r5 = (c >> 11) & 0x1Fu;
+            const uint32_t g6 = (c >> 5) & 0x3Fu;
+            const uint32_t b5 = c & 0x1Fu;
+            row[1u + (3u * x)] = (uint8_t)((r5 << 3) | (r5 >> 2));
+            row[2u + (3u * x)] = (uint8_t)((g6 << 2) | (g6 >> 4));
+            row[3u + (3u * x)] = (uint8_t)((b5 << 3) | (b5 >> 2));
+        }
+    }
+
+    /* zlib stream of stored blocks */
+    display_host_zlib[n++] = 0x78u;
+    display_host_zlib[n++] = 0x01u;
+    for (uint32_t pos = 0u; pos < DISPLAY_HOST_RAW; pos += DISPLAY_HOST_BLOCK)
+    {
+        const uint32_t len = ((DISPLAY_HOST_RAW - pos) < DISPLAY_HOST_BLOCK) ? (DISPLAY_HOST_RAW - pos) : DISPLAY_HOST_BLOCK;
+        display_host_zlib[n++] = ((pos + len) == DISPLAY_HOST_RAW) ? 1u : 0u; /* BFINAL, BTYPE stored */
+        display_host_zlib[n++] = (uint8_t)len;
+        display_host_zlib[n++] = (uint8_t)(len >> 8);
+        display_host_zlib[n++] = (uint8_t)~len;
+        display_host_zlib[n++] = (uint8_t)(~len >> 8);
+        (void)memcpy(&display_host_zlib[n], &display_host_raw[pos], len);
+        n += len;
+    }
+    for (uint32_t i = 0u; i < DISPLAY_HOST_RAW; i++)
+    {
+        a = (a + display_host_raw[i]) % 65521u;
+        b = (b + a) % 65521u;
+    }
+    display_host_be32(&display_host_zlib[n], (b << 16) | a);
+    n += 4u;
+
+    display_host_be32(&ihdr[0], DISPLAY_WIDTH);
+    display_host_be32(&ihdr[4], DISPLAY_HEIGHT);
+    ihdr[8] = 8u; /* bits per channel */
+    ihdr[9] = 2u; /* RGB */
+
+    f = fopen(path, "wb");
+    ok = (f != NULL);
+    if (ok)
+    {
+        ok = (fwrite(signature, 1u, sizeof(signature), f) == sizeof(signature)) && display_host_chunk(f, "IHDR", ihdr, sizeof(ihdr)) &&
+             display_host_chunk(f, "IDAT", display_host_zlib, n) && display_host_chunk(f, "IEND", NULL, 0u);
+        ok = (fclose(f) == 0) && ok;
+    }
+
+    return ok;
+}
+
+/** @}*/
@@ -0,0 +1,52 @@
+/**
+ * @file display_host.h
+ * @author PL
+ * @brief Host backend of the display for the unit tests: ST7735 panel model and PNG frames
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * The panel model decodes the SPI transfers of display.c like the panel does: a byte with D/C low is a
+ * command, the bytes with D/C high are its parameters or, after RAMWR, pixels written into the address
+ * window of CASET/RASET. A test then sees what the panel shows, not only what the framebuffer holds.
+ * display_host_write_png() writes the panel memory as a PNG (stored deflate blocks, no zlib needed).
+ *
+ * \addtogroup TEST
+ * @{
+ */
+#ifndef DISPLAY_HOST_H
+#define DISPLAY_HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "display.h"
+#include "stm32_hal_host.h"
+
+extern uint32_t display_host_windows; /* RAMWR commands since display_host_attach() */
+extern uint32_t display_host_pixels;  /* Pixels written since display_host_attach() */
+extern bool display_host_on;          /* DISPON received */
+
+/***************************************************
+ * @brief Clear the panel and decode the SPI transfers from now on, sets hal_spi_hook
+ * @param dc_port Data/command output, port
+ * @param dc_pin Data/command output, pin
+ ***************************************************/
+void display_host_attach(const GPIO_TypeDef* dc_port, uint16_t dc_pin);
+
+/***************************************************
+ * @brief Get a pixel of the panel
+ * @param x Column [px]
+ * @param y Row [px]
+ * @return RGB565 color
+ ***************************************************/
+uint16_t display_host_pixel(uint32_t x, uint32_t y);
+
+/***************************************************
+ * @brief Write the panel memory as a PNG file, RGB 8 bit per channel
+ * @param path File
+ * @return false if the file can't be written
+ ***************************************************/
+bool display_host_write_png(const char* path);
+
+#endif /* DISPLAY_HOST_H */
+/** @}*/
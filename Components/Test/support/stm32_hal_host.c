@@ -0,0 +1,114 @@
+/**
+ * @file stm32_hal_host.c
+ * @author PL
+ * @brief Host replacement of the HAL for the unit tests
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * GPIO writes go to the ODR of the port structure, SPI transfers are recorded in hal_spi_calls and
+ * passed to hal_spi_hook while their data is valid. A DMA transfer completes at once:
+ * HAL_SPI_TxCpltCallback() is called before it returns.
+ */
+#include "stm32_hal_host.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+uint32_t SystemCoreClock = 160000000u;
+
+HAL_SPI_CALL hal_spi_calls[HAL_SPI_CALLS_MAX];
+uint32_t hal_spi_num_calls;
+HAL_StatusTypeDef hal_spi_status = HAL_OK;
+void (*hal_spi_hook)(const uint8_t* data, uint16_t len);
+
+/***************************************************
+ * @brief Record an SPI transfer
+ * @param data Data
+ * @param len Number of bytes
+ * @param dma Started with DMA
+ ***************************************************/
+static void hal_spi_record(const uint8_t* data, uint16_t len, bool dma)
+{
+    if (hal_spi_num_calls < HAL_SPI_CALLS_MAX)
+    {
+        hal_spi_calls[hal_spi_num_calls].data = data;
+        hal_spi_calls[hal_spi_num_calls].len = len;
+        hal_spi_calls[hal_spi_num_calls].dma = dma;
+    }
+    hal_spi_num_calls++;
+    if ((hal_spi_hook != NULL) && (hal_spi_status == HAL_OK)) /* a failed transfer sends nothing */
+    {
+        hal_spi_hook(data, len);
+    }
+}
+
+void hal_reset(void)
+{
+    (void)memset(hal_spi_calls, 0, sizeof(hal_spi_calls));
+    hal_spi_num_calls = 0u;
+    hal_spi_status = HAL_OK;
+    hal_spi_hook = NULL;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, const GPIO_InitTypeDef* pGPIO_Init)
+{
+    UNUSED(GPIOx);
+    UNUSED(pGPIO_Init);
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    if (PinState == GPIO_PIN_SET)
+    {
+        GPIOx->ODR |= GPIO_Pin;
+    }
+    else
+    {
+        GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+    }
+}
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef* hspi)
+{
+    UNUSED(hspi);
+    return hal_spi_status;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef* hspi, const uint8_t* pData, uint16_t Size, uint32_t Timeout)
+{
+    UNUSED(hspi);
+    UNUSED(Timeout);
+    hal_spi_record(pData, Size, false);
+    return hal_spi_status;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef* hspi, const uint8_t* pData, uint16_t Size)
+{
+    hal_spi_record(pData, Size, true);
+    if (hal_spi_status == HAL_OK)
+    {
+        HAL_SPI_TxCpltCallback(hspi);
+    }
+    return hal_spi_status;
+}
+
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef* hspi)
+{
+    UNUSED(hspi);
+    return HAL_OK;
+}
+
+/* Weak callbacks as in the HAL, the module under test overrides them */
+__attribute__((weak)) void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef* hspi)
+{
+    UNUSED(hspi);
+}
+
+__attribute__((weak)) void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi)
+{
+    UNUSED(hspi);
+}
+
+/** @}*/
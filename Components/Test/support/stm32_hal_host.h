@@ -0,0 +1,160 @@
+/**
+ * @file stm32_hal_host.h
+ * @author PL
+ * @brief Host replacement of the HAL for the unit tests
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * Components/Inc/stm32_hal.h includes this file instead of the HAL when TEST is defined. It provides
+ * the CMSIS intrinsics used by the modules as portable C and the HAL types and functions of the
+ * peripherals they drive. The functions are implemented by stm32_hal_host.c, which records the calls
+ * so a test can check them. A test which needs them includes stm32_hal_host.h, so Ceedling links it.
+ *
+ * The DSP intrinsics follow the Armv8-M definitions, so the SIMD kernels of dsp.c are compiled with
+ * __ARM_FEATURE_DSP (set in project.yml) and tested bit exact against the reference versions.
+ *
+ * \addtogroup TEST
+ * @{
+ */
+#ifndef STM32_HAL_HOST_H
+#define STM32_HAL_HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+#define __FPU_USED 0U /* No target FPU, the soft-float benchmarks are not compiled */
+
+#define UNUSED(x) ((void)(x))
+
+#define HAL_SPI_CALLS_MAX 64u /* Transfers recorded by stm32_hal_host.c */
+
+extern uint32_t SystemCoreClock;
+
+/* CMSIS intrinsics -----------------------------------------*/
+static inline uint32_t __get_PRIMASK(void)
+{
+    return 0u;
+}
+
+static inline void __set_PRIMASK(uint32_t primask)
+{
+    (void)primask;
+}
+
+static inline void __disable_irq(void)
+{
+}
+
+static inline void __enable_irq(void)
+{
+}
+
+static inline void __DMB(void)
+{
+    __sync_synchronize();
+}
+
+/* Dual 16 bit multiply with 64 bit accumulate */
+static inline uint64_t __SMLALD(uint32_t op1, uint32_t op2, uint64_t acc)
+{
+    const int64_t lo = (int64_t)(int16_t)(op1 & 0xFFFFu) * (int16_t)(op2 & 0xFFFFu);
+    const int64_t hi = (int64_t)(int16_t)(op1 >> 16u) * (int16_t)(op2 >> 16u);
+    return acc + (uint64_t)lo + (uint64_t)hi;
+}
+
+/* Bottom half word of op1, top half word of op2 shifted left */
+#define __PKHBT(ARG1, ARG2, ARG3) ((((uint32_t)(ARG1)) & 0x0000FFFFUL) | ((((uint32_t)(ARG2)) << (ARG3)) & 0xFFFF0000UL))
+
+/* HAL ------------------------------------------------------*/
+typedef enum
+{
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U,
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+    GPIO_PIN_RESET = 0U,
+    GPIO_PIN_SET,
+} GPIO_PinState;
+
+typedef struct
+{
+    uint32_t ODR; /**< Output data register */
+} GPIO_TypeDef;
+
+typedef struct
+{
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_MODE_OUTPUT_PP    0x00000001U
+#define GPIO_NOPULL            0x00000000U
+#define GPIO_SPEED_FREQ_MEDIUM 0x00000001U
+
+typedef struct
+{
+    uint32_t DataSize;
+    uint32_t BaudRatePrescaler;
+    uint32_t NSSPMode;
+} SPI_InitTypeDef;
+
+typedef struct
+{
+    SPI_InitTypeDef Init;
+} SPI_HandleTypeDef;
+
+/* Handles only passed through by the modules, e.g. calib_adc() in calib.h or timer.h */
+typedef struct
+{
+    void* Instance;
+} ADC_HandleTypeDef;
+
+typedef struct
+{
+    void* Instance;
+} TIM_HandleTypeDef;
+
+#define SPI_DATASIZE_8BIT        0x00000007U
+#define SPI_BAUDRATEPRESCALER_16 0x30000000U
+#define SPI_NSS_PULSE_DISABLE    0x00000000U
+
+/**
+ * @brief Recorded SPI transfer
+ */
+typedef struct
+{
+    const uint8_t* data; /**< Data of the transfer */
+    uint16_t len;        /**< Number of bytes */
+    bool dma;            /**< Started with HAL_SPI_Transmit_DMA() */
+} HAL_SPI_CALL;
+
+extern HAL_SPI_CALL hal_spi_calls[HAL_SPI_CALLS_MAX];
+extern uint32_t hal_spi_num_calls;
+extern HAL_StatusTypeDef hal_spi_status;
+extern void (*hal_spi_hook)(const uint8_t* data, uint16_t len); /* Sees the data of every transfer, e.g. a panel model */
+
+/***************************************************
+ * @brief Clear the recorded calls, the HAL functions return HAL_OK again
+ ***************************************************/
+void hal_reset(void);
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, const GPIO_InitTypeDef* pGPIO_Init);
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef* hspi);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef* hspi, const uint8_t* pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef* hspi, const uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef* hspi);
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef* hspi);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi);
+
+#endif /* STM32_HAL_HOST_H */
+/** @}*/
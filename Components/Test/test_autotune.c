@@ -0,0 +1,190 @@
+/**
+ * @file test_autotune.c
+ * @author PL
+ * @brief Host tests of the relay auto-tune against the simulated plant of pid.c
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * The experiment runs sample by sample on the first order plus dead time plant of pid_sim_init(),
+ * without the coroutine scheduler. The ultimate gain and period are checked against the analytic
+ * values of the plant, then the tuned gains close the loop on the same plant.
+ */
+#include "unity.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "autotune.h"
+#include "mock_config.h"
+#include "mock_coroutine.h"
+#include "pid.h"
+
+#define TEST_GAIN    2.0f  /* Static gain of the plant */
+#define TEST_TAU     5.0f  /* Time constant of the plant [s] */
+#define TEST_DEAD    10u   /* Dead time of the plant [samples of 100 ms] */
+#define TEST_DT      0.1f  /* Sample period of the plant [s] */
+#define TEST_BIAS    25.0f /* Relay bias, the plant settles at TEST_GAIN * TEST_BIAS */
+#define TEST_SAMPLES 6000u /* Longest experiment [samples] */
+
+bool autotune_sample(void); /* STATIC in autotune.c */
+
+static CONFIG_DATA test_config;
+
+static CONFIG_DATA* test_config_get(int cmock_num_calls)
+{
+    (void)cmock_num_calls;
+    return &test_config;
+}
+
+/***************************************************
+ * @brief Ultimate frequency of the plant: the phase of the lag and the dead time is -pi
+ * @param dead Dead time [s]
+ * @return Ultimate frequency [rad/s]
+ ***************************************************/
+static double test_ultimate_w(double dead)
+{
+    double lo = 0.01;
+    double hi = 100.0;
+
+    for (uint32_t i = 0u; i < 100u; i++)
+    {
+        const double w = 0.5 * (lo + hi);
+        if (((w * dead) + atan(w * TEST_TAU)) < M_PI)
+        {
+            lo = w;
+        }
+        else
+        {
+            hi = w;
+        }
+    }
+
+    return 0.5 * (lo + hi);
+}
+
+/***************************************************
+ * @brief Settle the plant at the relay bias and run an experiment to its end
+ * @param rule Tuning rule
+ * @return Final state
+ ***************************************************/
+static AUTOTUNE_STATE test_run(AUTOTUNE_RULE rule)
+{
+    const AUTOTUNE_CONFIG cfg = {.setpoint = TEST_GAIN * TEST_BIAS,
+                                 .bias = TEST_BIAS,
+                                 .amplitude = 10.0f,
+                                 .hysteresis = 0.2f,
+                                 .max_excursion = 40.0f,
+                                 .timeout_ms = 600000u,
+                                 .rule = rule};
+    const PID_IO* io = pid_get_io(PID_LOOP_SIM);
+
+    for (uint32_t i = 0u; i < 1000u; i++)
+    {
+        io->write(TEST_BIAS);
+    }
+    TEST_ASSERT_TRUE(autotune_start(PID_LOOP_SIM, &cfg));
+    for (uint32_t i = 0u; (i < TEST_SAMPLES) && !autotune_sample(); i++)
+    {
+    }
+
+    return autotune_get_state();
+}
+
+/***************************************************
+ * @brief Step response of the simulated loop with the gains of the config store
+ * @param overshoot Output: largest process value above the setpoint
+ * @return Error at the end
+ ***************************************************/
+static float test_step_response(float* overshoot)
+{
+    const PID_IO* io = pid_get_io(PID_LOOP_SIM);
+    const float setpoint = (TEST_GAIN * TEST_BIAS) + 10.0f;
+    PID_STATE s;
+    float pv = io->read();
+
+    pid_reset(&s);
+    s.integral = TEST_BIAS; /* bumpless from the settled plant */
+    *overshoot = 0.0f;
+    for (uint32_t i = 0u; i < 1200u; i++) /* 120 s, about 25 time constants */
+    {
+        io->write(pid_step(&s, &test_config.pid[PID_LOOP_SIM], setpoint, pv, TEST_DT, io->out_min, io->out_max));
+        pv = io->read();
+        *overshoot = ((pv - setpoint) > *overshoot) ? (pv - setpoint) : *overshoot;
+    }
+
+    return fabsf(pv - setpoint);
+}
+
+void setUp(void)
+{
+    config_get_StubWithCallback(test_config_get);
+    config_save_IgnoreAndReturn(true);
+    coro_start_Ignore();
+    test_config = (CONFIG_DATA){0};
+    TEST_ASSERT_TRUE(pid_sim_init(TEST_GAIN, TEST_TAU, TEST_DEAD));
+}
+
+void tearDown(void)
+{
+}
+
+void test_unregistered_loop_is_refused(void)
+{
+    const AUTOTUNE_CONFIG cfg = {.setpoint = 1.0f, .bias = 0.5f, .amplitude = 0.5f, .hysteresis = 0.0f, .max_excursion = 1.0f, .timeout_ms = 1000u};
+
+    TEST_ASSERT_NULL(pid_get_io(PID_LOOP_EC));
+    TEST_ASSERT_FALSE(autotune_start(PID_LOOP_EC, &cfg));
+}
+
+void test_relay_outside_the_output_limits_is_refused(void)
+{
+    const AUTOTUNE_CONFIG cfg = {.setpoint = 50.0f, .bias = 95.0f, .amplitude = 10.0f, .hysteresis = 0.2f, .max_excursion = 40.0f, .timeout_ms = 1000u};
+
+    TEST_ASSERT_FALSE(autotune_start(PID_LOOP_SIM, &cfg));
+}
+
+void test_ultimate_gain_and_period_of_the_plant(void)
+{
+    /* The zero order hold of the sampled plant adds half a sample to the dead time */
+    const double w = test_ultimate_w(((double)TEST_DEAD + 0.5) * TEST_DT);
+    const double pu = (2.0 * M_PI) / w;
+    const double ku = sqrt(1.0 + ((w * TEST_TAU) * (w * TEST_TAU))) / TEST_GAIN;
+    AUTOTUNE_RESULT res;
+
+    TEST_ASSERT_EQUAL_INT(AUTOTUNE_DONE, test_run(AUTOTUNE_RULE_ZN));
+    TEST_ASSERT_TRUE(autotune_get_result(&res));
+    TEST_ASSERT_TRUE(fabs(res.pu - pu) < (0.1 * pu));
+    TEST_ASSERT_TRUE(fabs(res.ku - ku) < (0.3 * ku)); /* describing function of the relay, 20 % low measured */
+    TEST_ASSERT_TRUE(fabsf(test_config.pid[PID_LOOP_SIM].kp - (0.6f * res.ku)) < 1e-4f);
+}
+
+void test_ziegler_nichols_gains_control_the_plant(void)
+{
+    float overshoot;
+
+    TEST_ASSERT_EQUAL_INT(AUTOTUNE_DONE, test_run(AUTOTUNE_RULE_ZN));
+    TEST_ASSERT_TRUE(test_step_response(&overshoot) < 0.05f);
+    TEST_ASSERT_TRUE(overshoot < 8.0f); /* Ziegler-Nichols is aggressive, about 60 % of the 10 step measured */
+}
+
+void test_tyreus_luyben_gains_control_the_plant(void)
+{
+    float overshoot;
+
+    TEST_ASSERT_EQUAL_INT(AUTOTUNE_DONE, test_run(AUTOTUNE_RULE_TL));
+    TEST_ASSERT_TRUE(test_step_response(&overshoot) < 0.05f);
+    TEST_ASSERT_TRUE(overshoot < 1.0f); /* below 1 % of the step measured */
+}
+
+void test_excursion_aborts_and_restores_the_loop(void)
+{
+    const AUTOTUNE_CONFIG cfg = {.setpoint = 50.0f, .bias = 25.0f, .amplitude = 10.0f, .hysteresis = 0.2f, .max_excursion = 1.0f, .timeout_ms = 600000u};
+
+    TEST_ASSERT_TRUE(pid_enable(PID_LOOP_SIM, true));
+    TEST_ASSERT_TRUE(autotune_start(PID_LOOP_SIM, &cfg)); /* the plant starts at 0 after pid_sim_init() */
+    TEST_ASSERT_FALSE(pid_is_enabled(PID_LOOP_SIM));
+    TEST_ASSERT_TRUE(autotune_sample());
+    TEST_ASSERT_EQUAL_INT(AUTOTUNE_EXCURSION, autotune_get_state());
+    TEST_ASSERT_TRUE(pid_is_enabled(PID_LOOP_SIM));
+}
@@ -0,0 +1,269 @@
+/**
+ * @file test_display.c
+ * @author PL
+ * @brief Host tests of the display: dirty tiles, partial windows and the picture on the panel
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * The SPI transfers go to the panel model of display_host.c, the memory DMA gathers at once. Each call
+ * of the frame coroutine runs to its next sleep: a frame is drawn and flushed by one call. The PNG
+ * frames are written to _test_build for a look at the page.
+ */
+#include "unity.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "display.h"
+#include "display_host.h"
+#include "mock_bench.h"
+#include "mock_coroutine.h"
+#include "mock_memdma.h"
+#include "mock_timer.h"
+#include "stm32_hal_host.h"
+
+#define TEST_DC_PIN  0x0080u /* PC7 */
+#define TEST_RST_PIN 0x0100u /* PC8 */
+
+extern uint16_t display_fb[DISPLAY_WIDTH * DISPLAY_HEIGHT]; /* STATIC in display.c */
+
+static SPI_HandleTypeDef test_spi;
+static GPIO_TypeDef test_port;
+static const DISPLAY_HW test_hw = {&test_spi, &test_port, TEST_DC_PIN, &test_port, TEST_RST_PIN};
+static CORO* test_coro;
+static bool test_waited;
+static void (*test_page)(void);
+
+static void test_coro_start(CORO* c, CORO_STATE (*func)(CORO* c), int cmock_num_calls)
+{
+    (void)cmock_num_calls;
+    c->func = func;
+    c->lc = 0u;
+    c->events = 0u;
+    c->wait_mask = 0u;
+    test_coro = c;
+}
+
+static void test_coro_post_event(CORO* c, uint16_t events, int cmock_num_calls)
+{
+    (void)cmock_num_calls;
+    c->events |= events;
+}
+
+static uint16_t test_coro_take_events(CORO* c, uint16_t mask, int cmock_num_calls)
+{
+    const uint16_t events = c->events & mask;
+
+    (void)cmock_num_calls;
+    c->events &= (uint16_t)~mask;
+
+    return events;
+}
+
+static void test_coro_arm_wait(CORO* c, uint16_t mask, uint32_t timeout_ms, int cmock_num_calls)
+{
+    (void)timeout_ms;
+    (void)cmock_num_calls;
+    c->wait_mask = mask;
+    test_waited = false;
+}
+
+static void test_coro_disarm(CORO* c, int cmock_num_calls)
+{
+    (void)cmock_num_calls;
+    c->wait_mask = 0u;
+}
+
+/* A wait returns to the caller once, it is over at the next call */
+static bool test_coro_timed_out(const CORO* c, int cmock_num_calls)
+{
+    const bool over = test_waited;
+
+    (void)c;
+    (void)cmock_num_calls;
+    test_waited = true;
+
+    return over;
+}
+
+static bool test_memdma_gather(const MEMDMA_ITEM* items, uint32_t num_items, MEMDMA_CALLBACK cb, void* arg, int cmock_num_calls)
+{
+    (void)cmock_num_calls;
+    for (uint32_t i = 0u; i < num_items; i++)
+    {
+        (void)memcpy(items[i].dst, items[i].src, items[i].len);
+    }
+    if (cb != NULL)
+    {
+        cb(arg, true);
+    }
+
+    return true;
+}
+
+static void test_draw(void)
+{
+    if (test_page != NULL)
+    {
+        test_page();
+    }
+}
+
+/***************************************************
+ * @brief Draw and flush one frame
+ ***************************************************/
+static void test_frame(void)
+{
+    (void)test_coro->func(test_coro);
+}
+
+/***************************************************
+ * @brief Compare the panel with the framebuffer
+ * @return Number of pixels which differ
+ ***************************************************/
+static uint32_t test_panel_diff(void)
+{
+    uint32_t diff = 0u;
+
+    for (uint32_t y = 0u; y < DISPLAY_HEIGHT; y++)
+    {
+        for (uint32_t x = 0u; x < DISPLAY_WIDTH; x++)
+        {
+            const uint16_t fb = display_fb[(y * DISPLAY_WIDTH) + x];
+            diff += (display_host_pixel(x, y) != (uint16_t)((fb >> 8) | (fb << 8))) ? 1u : 0u; /* the framebuffer is byte swapped */
+        }
+    }
+
+    return diff;
+}
+
+/***************************************************
+ * @brief Forget the windows and pixels sent so far
+ ***************************************************/
+static void test_clear_counters(void)
+{
+    display_host_windows = 0u;
+    display_host_pixels = 0u;
+}
+
+static void test_values_page(void)
+{
+    display_printf(4u, 24u, DISPLAY_GREEN, DISPLAY_BLACK, "EC %d.%02d / %d.%02d mS", 1, 78, 1, 80);
+    display_printf(4u, 32u, DISPLAY_GREEN, DISPLAY_BLACK, "pH %d.%02d / %d.%02d", 5, 92, 6, 0);
+}
+
+/* The bars are filled and written over: their tiles are sent every frame */
+static void test_status_page(void)
+{
+    display_fill_rect(0u, 0u, DISPLAY_WIDTH, 16u, DISPLAY_BLUE);
+    display_text(4u, 0u, "HDP", DISPLAY_WHITE, DISPLAY_BLUE, 2u);
+    display_text(48u, 4u, "zone 0 holding", DISPLAY_WHITE, DISPLAY_BLUE, 1u);
+    display_printf(4u, 24u, DISPLAY_GREEN, DISPLAY_BLACK, "EC %d.%02d / %d.%02d mS", 1, 78, 1, 80);
+    display_printf(4u, 32u, DISPLAY_GREEN, DISPLAY_BLACK, "pH %d.%02d / %d.%02d", 5, 92, 6, 0);
+    display_printf(4u, 40u, DISPLAY_YELLOW, DISPLAY_BLACK, "VPD %d.%02d kPa", 1, 5);
+    display_fill_rect(0u, 112u, DISPLAY_WIDTH, 16u, DISPLAY_RED);
+    display_text(4u, 116u, "INTERLOCK: leak 0", DISPLAY_WHITE, DISPLAY_RED, 1u);
+}
+
+void setUp(void)
+{
+    hal_reset();
+    bench_get_cycles_IgnoreAndReturn(0u);
+    timer_reset_module_timer_Ignore();
+    timer_get_elapsed_module_timer_IgnoreAndReturn(0u);
+    coro_start_StubWithCallback(test_coro_start);
+    coro_post_event_StubWithCallback(test_coro_post_event);
+    coro_take_events_StubWithCallback(test_coro_take_events);
+    coro_arm_wait_StubWithCallback(test_coro_arm_wait);
+    coro_disarm_StubWithCallback(test_coro_disarm);
+    coro_timed_out_StubWithCallback(test_coro_timed_out);
+    memdma_gather_StubWithCallback(test_memdma_gather);
+
+    test_page = NULL;
+    display_host_attach(&test_port, TEST_DC_PIN);
+    TEST_ASSERT_TRUE(display_init(&test_hw, test_draw));
+    for (uint32_t i = 0u; i < 3u; i++) /* reset pulse, reset time, sleep out */
+    {
+        test_frame();
+    }
+}
+
+void tearDown(void)
+{
+}
+
+void test_first_frame_sends_the_whole_screen(void)
+{
+    TEST_ASSERT_FALSE(display_host_on);
+    test_frame();
+
+    TEST_ASSERT_TRUE(display_host_on);
+    TEST_ASSERT_EQUAL_UINT32(1u, display_host_windows); /* complete tile rows merge into one window */
+    TEST_ASSERT_EQUAL_UINT32(DISPLAY_WIDTH * DISPLAY_HEIGHT, display_host_pixels);
+    TEST_ASSERT_EQUAL_UINT32(0u, test_panel_diff());
+}
+
+void test_unchanged_page_sends_nothing(void)
+{
+    test_page = test_values_page;
+    test_frame();
+    test_clear_counters();
+    test_frame();
+
+    TEST_ASSERT_EQUAL_UINT32(0u, display_host_windows);
+    TEST_ASSERT_EQUAL_UINT32(0u, display_host_pixels);
+}
+
+void test_text_sends_only_its_tiles(void)
+{
+    test_frame();
+    test_clear_counters();
+    display_text(40u, 16u, "A", DISPLAY_WHITE, DISPLAY_BLACK, 1u); /* tile column 1, tile row 2 */
+    display_text(100u, 16u, "B", DISPLAY_WHITE, DISPLAY_BLACK, 1u); /* tile column 3, same row */
+    test_frame();
+
+    TEST_ASSERT_EQUAL_UINT32(2u, display_host_windows); /* not adjacent, two windows */
+    TEST_ASSERT_EQUAL_UINT32(2u * DISPLAY_TILE_W * DISPLAY_TILE_H, display_host_pixels);
+    TEST_ASSERT_EQUAL_UINT32(0u, test_panel_diff());
+}
+
+void test_adjacent_tiles_form_one_window(void)
+{
+    test_frame();
+    test_clear_counters();
+    display_text(20u, 8u, "wide text", DISPLAY_WHITE, DISPLAY_BLACK, 1u); /* 20 .. 73: tile columns 0 .. 2 */
+    test_frame();
+
+    TEST_ASSERT_EQUAL_UINT32(1u, display_host_windows);
+    TEST_ASSERT_EQUAL_UINT32(3u * DISPLAY_TILE_W * DISPLAY_TILE_H, display_host_pixels);
+    TEST_ASSERT_EQUAL_UINT32(0u, test_panel_diff());
+}
+
+void test_failed_transfer_resends_the_screen(void)
+{
+    test_frame();
+    display_text(40u, 16u, "A", DISPLAY_WHITE, DISPLAY_BLACK, 1u);
+    hal_spi_status = HAL_ERROR;
+    test_frame();
+    hal_spi_status = HAL_OK;
+    test_clear_counters();
+    test_frame();
+
+    TEST_ASSERT_EQUAL_UINT32(DISPLAY_WIDTH * DISPLAY_HEIGHT, display_host_pixels);
+    TEST_ASSERT_EQUAL_UINT32(0u, test_panel_diff());
+}
+
+void test_status_page_png(void)
+{
+    test_page = test_status_page;
+    test_frame();
+    TEST_ASSERT_EQUAL_UINT32(0u, test_panel_diff());
+    TEST_ASSERT_TRUE(display_host_write_png("_test_build/display_status.png"));
+
+    test_page = NULL;
+    display_text(48u, 4u, "zone 0 draining", DISPLAY_WHITE, DISPLAY_BLUE, 1u);
+    test_frame();
+    TEST_ASSERT_EQUAL_UINT32(0u, test_panel_diff());
+    TEST_ASSERT_TRUE(display_host_write_png("_test_build/display_status_2.png"));
+}
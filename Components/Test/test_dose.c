@@ -0,0 +1,196 @@
+/**
+ * @file test_dose.c
+ * @author PL
+ * @brief Host tests of the dose planner on a simulated reservoir with an EC loop
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * The reservoir is registered as PID_LOOP_EC: the dosing pump adds nutrient stock which mixes with the
+ * mixing time constant of the config, the sensor reads the mixed reservoir. The coroutines of the loop
+ * and of the planner are called once per second of simulated time, every wait times out at once.
+ */
+#include "unity.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dose.h"
+#include "mock_config.h"
+#include "mock_coroutine.h"
+#include "mock_handoff.h"
+#include "mock_timer.h"
+#include "pid.h"
+
+#define TEST_AREA     2500.0f   /* Cross section of the reservoir [cm2] */
+#define TEST_VOLUME   100000.0f /* Volume before the top-up [mL] */
+#define TEST_TOP_UP   50000.0f  /* Top-up with plain water [mL] */
+#define TEST_SETPOINT 1.8f      /* EC setpoint [mS/cm] */
+#define TEST_MAX_CORO 4u        /* Coroutines started by the modules */
+
+/**
+ * @brief Simulated reservoir
+ */
+typedef struct
+{
+    float volume; /**< Mixed volume [mL] */
+    float ec;     /**< EC of the mixed volume [mS/cm] */
+    float pocket; /**< Stock dosed and not mixed yet [mL] */
+    float output; /**< Output of the dosing pump [%] */
+} TEST_TANK;
+
+static TEST_TANK test_tank;
+static CONFIG_DATA test_config;
+static CORO* test_coro[TEST_MAX_CORO];
+static uint32_t test_num_coro;
+
+static CONFIG_DATA* test_config_get(int cmock_num_calls)
+{
+    (void)cmock_num_calls;
+    return &test_config;
+}
+
+static void test_coro_start(CORO* c, CORO_STATE (*func)(CORO* c), int cmock_num_calls)
+{
+    (void)cmock_num_calls;
+    c->func = func;
+    c->lc = 0u;
+    if (test_num_coro < TEST_MAX_CORO)
+    {
+        test_coro[test_num_coro] = c;
+        test_num_coro++;
+    }
+}
+
+static float test_read(void)
+{
+    return test_tank.ec;
+}
+
+static void test_write(float output)
+{
+    test_tank.output = output;
+}
+
+/***************************************************
+ * @brief EC sensor and dosing pump of the reservoir
+ ***************************************************/
+static const PID_IO test_io = {
+    .name = "tank",
+    .read = test_read,
+    .write = test_write,
+    .out_min = 0.0f,
+    .out_max = 100.0f,
+    .period_ms = 1000u,
+};
+
+/***************************************************
+ * @brief Advance the reservoir by one second: the pump fills the pocket, the pocket mixes
+ ***************************************************/
+static void test_tank_step(void)
+{
+    const DOSE_CONFIG* cfg = &test_config.dose;
+    const float mixed = test_tank.pocket / cfg->mix_s;
+
+    test_tank.pocket += (test_tank.output * 0.01f) * (cfg->pump_ml_min[DOSE_EC] / 60.0f);
+    test_tank.ec = ((test_tank.volume * test_tank.ec) + (mixed * cfg->ec_stock)) / (test_tank.volume + mixed);
+    test_tank.volume += mixed;
+    test_tank.pocket -= mixed;
+}
+
+/***************************************************
+ * @brief Top up the settled reservoir with plain water and control it for a time
+ * @param seconds Simulated time [s]
+ * @param peak Output: highest EC after the top-up
+ * @param settled Output: time from which the EC stays within 0.02 of the setpoint [s]
+ * @return EC at the end
+ ***************************************************/
+static float test_top_up(uint32_t seconds, float* peak, uint32_t* settled)
+{
+    test_tank.ec = (test_tank.ec * test_tank.volume) / (test_tank.volume + TEST_TOP_UP);
+    test_tank.volume += TEST_TOP_UP;
+    dose_flow(TEST_TOP_UP);
+
+    *peak = test_tank.ec;
+    *settled = 0u;
+    for (uint32_t t = 1u; t <= seconds; t++)
+    {
+        for (uint32_t i = 0u; i < test_num_coro; i++)
+        {
+            (void)test_coro[i]->func(test_coro[i]);
+        }
+        test_tank_step();
+        *peak = (test_tank.ec > *peak) ? test_tank.ec : *peak;
+        *settled = (fabsf(test_tank.ec - TEST_SETPOINT) < 0.02f) ? *settled : t;
+    }
+
+    return test_tank.ec;
+}
+
+void setUp(void)
+{
+    config_get_StubWithCallback(test_config_get);
+    coro_start_StubWithCallback(test_coro_start);
+    coro_arm_wait_Ignore();
+    coro_disarm_Ignore();
+    coro_timed_out_IgnoreAndReturn(true);
+    handoff_get_IgnoreAndReturn(NULL);
+    timer_reset_module_timer_Ignore();
+    timer_get_elapsed_module_timer_IgnoreAndReturn(1000u);
+
+    test_config = (CONFIG_DATA){0};
+    test_config.pid[PID_LOOP_EC] = (PID_GAINS){.kp = 20.0f, .ki = 0.0f, .kd = 0.0f};
+    test_config.dose = (DOSE_CONFIG){.area_cm2 = TEST_AREA, .ec_stock = 100.0f, .pump_ml_min = {[DOSE_EC] = 60.0f}, .mix_s = 120.0f, .horizon_s = 60.0f};
+    test_tank = (TEST_TANK){.volume = TEST_VOLUME, .ec = TEST_SETPOINT};
+    test_num_coro = 0u;
+
+    TEST_ASSERT_TRUE(pid_register(PID_LOOP_EC, &test_io));
+    pid_set_setpoint(PID_LOOP_EC, TEST_SETPOINT);
+    TEST_ASSERT_TRUE(pid_enable(PID_LOOP_EC, true));
+    dose_init();
+    dose_level((TEST_VOLUME * 10.0f) / TEST_AREA); /* mm * cm2 = 0.1 mL */
+}
+
+void tearDown(void)
+{
+}
+
+void test_plan_of_the_stock_models(void)
+{
+    const DOSE_CONFIG cfg = {.ec_stock = 100.0f, .ph_slope = 0.5f};
+
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 100000.0f / 98.0f, dose_plan(DOSE_EC, &cfg, 100000.0f, 1.0f, 2.0f)); /* V * 1 / (100 - 2) */
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 25.0f, dose_plan(DOSE_PH, &cfg, 100000.0f, 6.5f, 6.0f));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, dose_plan(DOSE_EC, &cfg, 100000.0f, 2.0f, 1.8f));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, dose_plan(DOSE_PH, &cfg, 100000.0f, 5.5f, 6.0f));
+}
+
+void test_volume_follows_the_level_and_the_flows(void)
+{
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, TEST_VOLUME, dose_get_volume());
+    dose_flow(-30000.0f);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, TEST_VOLUME - 30000.0f, dose_get_volume());
+    dose_flow(-1e6f);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, dose_get_volume());
+}
+
+void test_feedforward_settles_a_top_up(void)
+{
+    float peak;
+    uint32_t settled;
+    const float ec = test_top_up(3600u, &peak, &settled);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.02f, TEST_SETPOINT, ec);
+    TEST_ASSERT_TRUE(settled < 1200u); /* 1095 s measured, the pump needs 916 s for the 916 mL of stock */
+    TEST_ASSERT_TRUE(peak < (TEST_SETPOINT + 0.02f));
+}
+
+void test_pid_alone_is_still_low_after_an_hour(void)
+{
+    float peak;
+    uint32_t settled;
+
+    test_config.dose.horizon_s = 0.0f; /* no plan, no feed-forward */
+
+    TEST_ASSERT_TRUE(test_top_up(3600u, &peak, &settled) < (TEST_SETPOINT - 0.3f)); /* 1.42 measured */
+}
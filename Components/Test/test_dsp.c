@@ -0,0 +1,331 @@
+/**
+ * @file test_dsp.c
+ * @author PL
+ * @brief Host tests of the DSP kernels: fast versions bit exact against the references and a direct model
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * project.yml sets __ARM_FEATURE_DSP, so the SIMD kernels are built with the intrinsics of the support
+ * stm32_hal_host.h. Lengths and pointers are chosen to hit the tails of the 4 sample loops and unaligned
+ * pairs. The cycles per sample are measured on the target with the "dsp" command.
+ */
+#include "unity.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dsp.h"
+#include "mock_bench.h"
+
+#define TEST_LEN   203u /* Samples, not a multiple of 4 */
+#define TEST_TAPS  31u  /* FIR taps, not a multiple of 4 */
+#define TEST_BLOCK 64u  /* Block size, the input is processed in chunks */
+#define TEST_DECIM 4u   /* Decimation factor */
+
+static q15_t input[TEST_LEN];
+static q15_t out_fast[TEST_LEN];
+static q15_t out_ref[TEST_LEN];
+static q15_t out_model[TEST_LEN];
+static q15_t fir_coeffs[TEST_TAPS];
+static q15_t state_fast[TEST_TAPS + TEST_BLOCK - 1u];
+static q15_t state_ref[TEST_TAPS + TEST_BLOCK - 1u];
+
+/***************************************************
+ * @brief Pseudo random signal with full scale values
+ * @param buf Output
+ * @param n Number of samples
+ * @param seed Seed
+ ***************************************************/
+static void test_signal(q15_t* buf, uint32_t n, uint32_t seed)
+{
+    for (uint32_t i = 0u; i < n; i++)
+    {
+        seed = (seed * 1664525u) + 1013904223u;
+        buf[i] = (q15_t)(int16_t)(seed >> 16u);
+    }
+    buf[0] = INT16_MIN;
+    buf[1] = INT16_MAX;
+    buf[2] = INT16_MAX;
+}
+
+/***************************************************
+ * @brief Direct form FIR, coeffs[0] multiplies the oldest sample, zero history
+ * @param in Input
+ * @param out Output
+ * @param n Number of samples
+ ***************************************************/
+static void test_fir_model(const q15_t* in, q15_t* out, uint32_t n)
+{
+    for (uint32_t i = 0u; i < n; i++)
+    {
+        int64_t acc = 0;
+        for (uint32_t k = 0u; k < TEST_TAPS; k++)
+        {
+            const int32_t j = (int32_t)i - (int32_t)(TEST_TAPS - 1u) + (int32_t)k;
+            acc += (j >= 0) ? ((int32_t)fir_coeffs[k] * in[j]) : 0;
+        }
+        out[i] = dsp_sat_q15(acc >> 15);
+    }
+}
+
+void setUp(void)
+{
+    test_signal(input, TEST_LEN, 0x12345678u);
+    for (uint32_t k = 0u; k < TEST_TAPS; k++)
+    {
+        fir_coeffs[k] = (q15_t)(((k * 7919u) % 4001u) * 4u) - 8000; /* mixed signs, sum of |c| above 1: saturates */
+    }
+    (void)memset(out_fast, 0x55, sizeof(out_fast));
+    (void)memset(out_ref, 0xAA, sizeof(out_ref));
+}
+
+void tearDown(void)
+{
+}
+
+void test_fir_q15_is_bit_exact(void)
+{
+    DSP_FIR_Q15 fast;
+    DSP_FIR_Q15 ref;
+
+    dsp_fir_init_q15(&fast, fir_coeffs, state_fast, TEST_TAPS, TEST_BLOCK);
+    dsp_fir_init_q15(&ref, fir_coeffs, state_ref, TEST_TAPS, TEST_BLOCK);
+    /* uneven calls, the history must carry over */
+    dsp_fir_q15(&fast, input, out_fast, 7u);
+    dsp_fir_q15(&fast, &input[7], &out_fast[7], TEST_LEN - 7u);
+    dsp_fir_q15_ref(&ref, input, out_ref, TEST_LEN);
+    test_fir_model(input, out_model, TEST_LEN);
+
+    TEST_ASSERT_EQUAL_INT16_ARRAY(out_ref, out_fast, TEST_LEN);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(out_model, out_ref, TEST_LEN);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(state_ref, state_fast, TEST_TAPS - 1u);
+}
+
+void test_fir_q15_in_place(void)
+{
+    DSP_FIR_Q15 fast;
+
+    test_fir_model(input, out_model, TEST_LEN);
+    dsp_fir_init_q15(&fast, fir_coeffs, state_fast, TEST_TAPS, TEST_BLOCK);
+    (void)memcpy(out_fast, input, sizeof(input));
+    dsp_fir_q15(&fast, out_fast, out_fast, TEST_LEN);
+
+    TEST_ASSERT_EQUAL_INT16_ARRAY(out_model, out_fast, TEST_LEN);
+}
+
+void test_fir_decimate_q15_is_bit_exact(void)
+{
+    const uint32_t n = TEST_LEN - (TEST_LEN % TEST_DECIM);
+    DSP_FIR_Q15 fast;
+    DSP_FIR_Q15 ref;
+
+    dsp_fir_init_q15(&fast, fir_coeffs, state_fast, TEST_TAPS, TEST_BLOCK);
+    dsp_fir_init_q15(&ref, fir_coeffs, state_ref, TEST_TAPS, TEST_BLOCK);
+    dsp_fir_decimate_q15(&fast, TEST_DECIM, input, out_fast, n);
+    dsp_fir_decimate_q15_ref(&ref, TEST_DECIM, input, out_ref, n);
+    test_fir_model(input, out_model, n);
+
+    TEST_ASSERT_EQUAL_INT16_ARRAY(out_ref, out_fast, n / TEST_DECIM);
+    for (uint32_t i = 0u; i < (n / TEST_DECIM); i++)
+    {
+        TEST_ASSERT_EQUAL_INT16(out_model[(i * TEST_DECIM) + TEST_DECIM - 1u], out_fast[i]);
+    }
+}
+
+void test_biquad_q15_is_bit_exact(void)
+{
+    static const q15_t coeffs[2u * DSP_BIQUAD_COEFFS] = {
+        1106, 2210, 1106, 18727, -6763, /* low pass fc = 0.1 fs */
+        16384, -32768, 16384, 31000, -14800, /* high gain resonance, saturates on the full scale steps */
+    };
+    q15_t st_fast[2u * DSP_BIQUAD_STATE] = {0};
+    q15_t st_ref[2u * DSP_BIQUAD_STATE] = {0};
+    DSP_BIQUAD_Q15 fast = {coeffs, st_fast, 2u};
+    DSP_BIQUAD_Q15 ref = {coeffs, st_ref, 2u};
+
+    dsp_biquad_q15(&fast, input, out_fast, 5u);
+    dsp_biquad_q15(&fast, &input[5], &out_fast[5], TEST_LEN - 5u);
+    dsp_biquad_q15_ref(&ref, input, out_ref, TEST_LEN);
+
+    TEST_ASSERT_EQUAL_INT16_ARRAY(out_ref, out_fast, TEST_LEN);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(st_ref, st_fast, 2u * DSP_BIQUAD_STATE);
+}
+
+void test_biquad_q15_unity_gain_passes_the_input(void)
+{
+    static const q15_t coeffs[DSP_BIQUAD_COEFFS] = {16384, 0, 0, 0, 0}; /* b0 = 1.0 in Q2.14 */
+    q15_t st[DSP_BIQUAD_STATE] = {0};
+    DSP_BIQUAD_Q15 f = {coeffs, st, 1u};
+
+    dsp_biquad_q15(&f, input, out_fast, TEST_LEN);
+
+    TEST_ASSERT_EQUAL_INT16_ARRAY(input, out_fast, TEST_LEN);
+}
+
+void test_dot_q15_all_lengths_and_alignments(void)
+{
+    for (uint32_t offset = 0u; offset < 2u; offset++)
+    {
+        for (uint32_t n = 0u; n < 12u; n++)
+        {
+            int64_t model = 0;
+            for (uint32_t i = 0u; i < n; i++)
+            {
+                model += (int32_t)input[offset + i] * input[TEST_LEN - 1u - n + i];
+            }
+            TEST_ASSERT_EQUAL_INT64(model, dsp_dot_q15_ref(&input[offset], &input[TEST_LEN - 1u - n], n));
+            TEST_ASSERT_EQUAL_INT64(model, dsp_dot_q15(&input[offset], &input[TEST_LEN - 1u - n], n));
+        }
+    }
+}
+
+void test_dot_q15_full_scale_does_not_overflow(void)
+{
+    q15_t a[TEST_LEN];
+
+    for (uint32_t i = 0u; i < TEST_LEN; i++)
+    {
+        a[i] = INT16_MIN;
+    }
+
+    TEST_ASSERT_EQUAL_INT64((int64_t)TEST_LEN << 30, dsp_dot_q15(a, a, TEST_LEN));
+}
+
+void test_rms_q15(void)
+{
+    q15_t a[TEST_LEN];
+
+    for (uint32_t i = 0u; i < TEST_LEN; i++)
+    {
+        a[i] = ((i & 1u) != 0u) ? 16384 : -16384;
+    }
+    TEST_ASSERT_EQUAL_INT16(16384, dsp_rms_q15(a, TEST_LEN));
+
+    for (uint32_t i = 0u; i < TEST_LEN; i++)
+    {
+        a[i] = INT16_MIN;
+    }
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, dsp_rms_q15(a, TEST_LEN)); /* 1.0 saturates */
+
+    TEST_ASSERT_EQUAL_INT16(dsp_rms_q15_ref(input, TEST_LEN), dsp_rms_q15(input, TEST_LEN));
+    TEST_ASSERT_EQUAL_INT16(0, dsp_rms_q15(input, 0u));
+}
+
+void test_fir_q31_against_model(void)
+{
+    static q31_t in[TEST_LEN];
+    static q31_t out[TEST_LEN];
+    static q31_t coeffs[TEST_TAPS];
+    static q31_t state[TEST_TAPS + TEST_BLOCK - 1u];
+    DSP_FIR_Q31 f;
+
+    for (uint32_t i = 0u; i < TEST_LEN; i++)
+    {
+        in[i] = (q31_t)input[i] * 65536;
+    }
+    for (uint32_t k = 0u; k < TEST_TAPS; k++)
+    {
+        coeffs[k] = (q31_t)fir_coeffs[k] * 65536;
+    }
+    dsp_fir_init_q31(&f, coeffs, state, TEST_TAPS, TEST_BLOCK);
+    dsp_fir_q31(&f, in, out, 9u);
+    dsp_fir_q31(&f, &in[9], &out[9], TEST_LEN - 9u);
+
+    for (uint32_t i = 0u; i < TEST_LEN; i++)
+    {
+        int64_t acc = 0;
+        for (uint32_t k = 0u; k < TEST_TAPS; k++)
+        {
+            const int32_t j = (int32_t)i - (int32_t)(TEST_TAPS - 1u) + (int32_t)k;
+            acc += (j >= 0) ? ((int64_t)coeffs[k] * in[j]) : 0;
+        }
+        TEST_ASSERT_EQUAL_INT32(dsp_sat_q31(acc >> 31), out[i]);
+    }
+}
+
+void test_biquad_q31_against_double(void)
+{
+    static const double c[DSP_BIQUAD_COEFFS] = {0.0675, 0.1349, 0.0675, 1.1430, -0.4128}; /* low pass fc = 0.1 fs */
+    q31_t c31[DSP_BIQUAD_COEFFS];
+    q31_t st31[DSP_BIQUAD_STATE] = {0};
+    static q31_t in[TEST_LEN];
+    static q31_t out[TEST_LEN];
+    DSP_BIQUAD_Q31 f = {c31, st31, 1u};
+    double x1 = 0.0;
+    double x2 = 0.0;
+    double y1 = 0.0;
+    double y2 = 0.0;
+
+    for (uint32_t k = 0u; k < DSP_BIQUAD_COEFFS; k++)
+    {
+        c31[k] = (q31_t)lrint(c[k] * 1073741824.0); /* Q2.30 */
+    }
+    for (uint32_t i = 0u; i < TEST_LEN; i++)
+    {
+        in[i] = (q31_t)input[i] * 16384; /* a quarter of full scale, the sum stays below 4 */
+    }
+    dsp_biquad_q31(&f, in, out, 11u);
+    dsp_biquad_q31(&f, &in[11], &out[11], TEST_LEN - 11u);
+
+    for (uint32_t i = 0u; i < TEST_LEN; i++)
+    {
+        const double x0 = (double)in[i];
+        const double y0 = (((double)c31[0] * x0) + ((double)c31[1] * x1) + ((double)c31[2] * x2) + ((double)c31[3] * y1) + ((double)c31[4] * y2)) / 1073741824.0;
+        TEST_ASSERT_DOUBLE_WITHIN(16.0, y0, (double)out[i]); /* truncation of each output, amplified by the feedback */
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+    }
+}
+
+void test_dot_q31(void)
+{
+    const q31_t a[3] = {INT32_MAX, INT32_MIN, 1 << 30};
+    const q31_t b[3] = {INT32_MAX, INT32_MAX, -(1 << 30)};
+    int64_t model = 0;
+
+    for (uint32_t i = 0u; i < 3u; i++)
+    {
+        model += ((int64_t)a[i] * b[i]) >> 14;
+    }
+
+    TEST_ASSERT_EQUAL_INT64(model, dsp_dot_q31(a, b, 3u));
+}
+
+void test_goertzel_finds_the_tone(void)
+{
+    static q15_t tone[200];
+    DSP_GOERTZEL on_bin;
+    DSP_GOERTZEL off_bin;
+
+    for (uint32_t i = 0u; i < 200u; i++)
+    {
+        tone[i] = (q15_t)lrint(10000.0 * sin((6.283185307179586 * 50.0 * (double)i) / 1000.0));
+    }
+    dsp_goertzel_init(&on_bin, 50u, 1000u);
+    dsp_goertzel_init(&off_bin, 120u, 1000u);
+    dsp_goertzel_block_q15(&on_bin, tone, 200u);
+    dsp_goertzel_block_q15(&off_bin, tone, 200u);
+
+    const uint64_t power = dsp_goertzel_power(on_bin.coeff, on_bin.s1, on_bin.s2);
+    TEST_ASSERT_DOUBLE_WITHIN(50.0, 10000.0, (sqrt((double)power) * 2.0) / 200.0);
+    TEST_ASSERT_TRUE(dsp_goertzel_power(off_bin.coeff, off_bin.s1, off_bin.s2) < (power / 1000u));
+}
+
+void test_saturation_and_isqrt(void)
+{
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, dsp_sat_q15(40000));
+    TEST_ASSERT_EQUAL_INT16(INT16_MIN, dsp_sat_q15(-40000));
+    TEST_ASSERT_EQUAL_INT16(-123, dsp_sat_q15(-123));
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, dsp_sat_q31((int64_t)INT32_MAX + 1));
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN, dsp_sat_q31((int64_t)INT32_MIN - 1));
+
+    for (uint32_t v = 0u; v < 70000u; v++)
+    {
+        const uint32_t r = dsp_isqrt(v);
+        TEST_ASSERT_TRUE(((r * r) <= v) && (((r + 1u) * (r + 1u)) > v));
+    }
+    TEST_ASSERT_EQUAL_UINT32(65535u, dsp_isqrt(UINT32_MAX));
+}
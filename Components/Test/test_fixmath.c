@@ -0,0 +1,168 @@
+/**
+ * @file test_fixmath.c
+ * @author PL
+ * @brief Host tests of the fixed point math: the error bounds documented in fixmath.h
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * The references are the double precision functions of the host. The sweeps cover the full input
+ * range in steps of about 0.025 %, too many double evaluations for the console of the target.
+ */
+#include "unity.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#include "dsp.h"
+#include "fixmath.h"
+#include "mock_bench.h"
+
+/***************************************************
+ * @brief Error of a Q16.16 result against the reference
+ * @param res Fixed point result
+ * @param ref Reference value
+ * @return Absolute error [LSB]
+ ***************************************************/
+static double err_lsb(q16_t res, double ref)
+{
+    return fabs(((double)res / 65536.0) - ref) * 65536.0;
+}
+
+/***************************************************
+ * @brief Next input of a logarithmic sweep over the positive range
+ * @param x Current input
+ * @return Next input, about 0.025 % larger, FIX16_MAX ends the sweep
+ ***************************************************/
+static q16_t next_x(q16_t x)
+{
+    return (x < (FIX16_MAX - (FIX16_MAX / 4096) - 1)) ? (x + (x / 4096) + 1) : FIX16_MAX;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_add_sub_saturate(void)
+{
+    TEST_ASSERT_EQUAL_INT32(FIX16_MAX, fix16_add(FIX16_C(30000), FIX16_C(30000)));
+    TEST_ASSERT_EQUAL_INT32(FIX16_MIN, fix16_sub(FIX16_C(-30000), FIX16_C(30000)));
+    TEST_ASSERT_EQUAL_INT32(FIX16_C(1.5), fix16_add(FIX16_ONE, FIX16_C(0.5)));
+    TEST_ASSERT_EQUAL_INT32(Q31_ONE, q31_add(Q31_ONE, 1));
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN, q31_sub(INT32_MIN, 1));
+}
+
+void test_mul_is_rounded_to_nearest(void)
+{
+    for (q16_t a = -FIX16_C(300); a < FIX16_C(300); a += 4099)
+    {
+        for (q16_t b = -FIX16_C(100); b < FIX16_C(100); b += 1237)
+        {
+            const double exact = ((double)a * (double)b) / 65536.0;
+            TEST_ASSERT_EQUAL_INT32((q16_t)floor(exact + 0.5), fix16_mul(a, b));
+        }
+    }
+    TEST_ASSERT_EQUAL_INT32(FIX16_MAX, fix16_mul(FIX16_C(200), FIX16_C(200)));
+    TEST_ASSERT_EQUAL_INT32(FIX16_MIN, fix16_mul(FIX16_C(-200), FIX16_C(200)));
+}
+
+void test_div_is_rounded_half_away_from_zero(void)
+{
+    for (q16_t a = -FIX16_C(300); a < FIX16_C(300); a += 4099)
+    {
+        for (q16_t b = -FIX16_C(100); b < FIX16_C(100); b += 1237)
+        {
+            if (b != 0)
+            {
+                const double exact = ((double)a * 65536.0) / (double)b;
+                const double rounded = (exact >= 0.0) ? floor(exact + 0.5) : ceil(exact - 0.5);
+                TEST_ASSERT_EQUAL_INT32(fix16_sat((int64_t)rounded), fix16_div(a, b));
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_INT32(FIX16_MAX, fix16_div(FIX16_ONE, 0));
+    TEST_ASSERT_EQUAL_INT32(FIX16_MIN, fix16_div(-FIX16_ONE, 0));
+    TEST_ASSERT_EQUAL_INT32(FIX16_MAX, fix16_div(FIX16_C(1000), FIX16_C(0.01)));
+}
+
+void test_recip_within_1_lsb(void)
+{
+    double max_err = 0.0;
+
+    for (q16_t x = 0x10; x < (FIX16_MAX / 2); x = next_x(x))
+    {
+        const double xd = (double)x / 65536.0;
+        max_err = fmax(max_err, err_lsb(fix16_recip(x), 1.0 / xd));
+        max_err = fmax(max_err, err_lsb(fix16_recip(-x), -1.0 / xd));
+    }
+
+    TEST_ASSERT_TRUE(max_err <= 1.0);
+    TEST_ASSERT_EQUAL_INT32(FIX16_MAX, fix16_recip(0));
+    TEST_ASSERT_EQUAL_INT32(FIX16_MAX, fix16_recip(1)); /* 65536.0 saturates */
+}
+
+void test_sqrt_is_rounded_down(void)
+{
+    for (q16_t x = 1; x < FIX16_MAX; x = next_x(x))
+    {
+        const double exact = sqrt((double)x * 65536.0);
+        const q16_t res = fix16_sqrt(x);
+        TEST_ASSERT_TRUE(((double)res <= exact) && (exact < ((double)res + 1.0)));
+    }
+    TEST_ASSERT_EQUAL_INT32(0, fix16_sqrt(-FIX16_ONE));
+    TEST_ASSERT_EQUAL_INT32(FIX16_C(3), fix16_sqrt(FIX16_C(9)));
+}
+
+void test_log2_within_4_lsb(void)
+{
+    double max_err = 0.0;
+
+    for (q16_t x = 1; x < FIX16_MAX; x = next_x(x))
+    {
+        max_err = fmax(max_err, err_lsb(fix16_log2(x), log2((double)x / 65536.0)));
+    }
+
+    TEST_ASSERT_TRUE(max_err <= 4.0);
+    TEST_ASSERT_EQUAL_INT32(FIX16_MIN, fix16_log2(0));
+    TEST_ASSERT_EQUAL_INT32(FIX16_C(10), fix16_log2(FIX16_C(1024)));
+}
+
+void test_exp2_within_relative_bound(void)
+{
+    for (q16_t x = -FIX16_C(17); x < FIX16_C(15); x += 7)
+    {
+        const double ref = exp2((double)x / 65536.0);
+        const double bound = (ref * 65536.0 * 2e-5) + 1.0;
+        const double err = (ref < 32768.0) ? err_lsb(fix16_exp2(x), ref) : 0.0; /* 2^15 saturates */
+        TEST_ASSERT_TRUE(err <= bound);
+    }
+    TEST_ASSERT_EQUAL_INT32(FIX16_MAX, fix16_exp2(FIX16_C(15)));
+    TEST_ASSERT_EQUAL_INT32(0, fix16_exp2(FIX16_C(-18)));
+    TEST_ASSERT_EQUAL_INT32(FIX16_C(8), fix16_exp2(FIX16_C(3)));
+}
+
+void test_ln_and_exp(void)
+{
+    for (q16_t x = 1; x < FIX16_MAX; x = next_x(x))
+    {
+        TEST_ASSERT_TRUE(err_lsb(fix16_ln(x), log((double)x / 65536.0)) <= 5.0);
+    }
+    for (q16_t x = -FIX16_C(11); x < FIX16_C(10); x += 7)
+    {
+        const double ref = exp((double)x / 65536.0);
+        const double bound = (ref * 65536.0 * 6e-5) + 1.0; /* FIX16_LOG2E is 0.46 LSB off, 5e-6 relative */
+        TEST_ASSERT_TRUE(err_lsb(fix16_exp(x), ref) <= bound);
+    }
+}
+
+void test_q31_mul(void)
+{
+    TEST_ASSERT_EQUAL_INT32(Q31_ONE, q31_mul(INT32_MIN, INT32_MIN)); /* -1 * -1 saturates */
+    TEST_ASSERT_EQUAL_INT32(1 << 29, q31_mul(1 << 30, 1 << 30));
+    TEST_ASSERT_EQUAL_INT32(-(1 << 29), q31_mul(-(1 << 30), 1 << 30));
+    TEST_ASSERT_EQUAL_INT32(FIX16_C(1.5), fix16_mul_q31(FIX16_C(3), 1 << 30));
+    TEST_ASSERT_EQUAL_INT32(FIX16_MAX, fix16_mul_q31(FIX16_MIN, INT32_MIN)); /* -32768 * -1 saturates */
+}
@@ -0,0 +1,133 @@
+/**
+ * @file test_snapshot.c
+ * @author PL
+ * @brief Host tests of the snapshot store, with a stress test of a writer and a reader thread
+ * @copyright (c) Copyright Nekoco 2024
+ * @ingroup TEST
+ *
+ * The writer thread only writes the first and the last word of a frame, so it publishes many frames
+ * during one copy of the reader: a copy without the check of the counter is torn within a few reads.
+ * With several cores the threads run in parallel, on one core the writer preempts the reader like the
+ * interrupt on the target. __DMB() is a full barrier on the host (stm32_hal_host.h).
+ */
+#include "unity.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "snapshot.h"
+
+#define TEST_WORDS  1024u    /* Words of a frame */
+#define TEST_FRAMES 2000000u /* Frames published by the writer thread of the stress test */
+
+/**
+ * @brief Frame: the first and the last word hold the frame number, a torn copy mixes two numbers
+ */
+typedef struct
+{
+    uint32_t words[TEST_WORDS]; /**< Words */
+} TEST_FRAME;
+
+static SNAPSHOT test_store;
+static TEST_FRAME test_buf[2];
+static volatile bool test_done;
+
+/***************************************************
+ * @brief Writer thread, publishes the frames 1 .. TEST_FRAMES
+ * @param arg Unused
+ * @return NULL
+ ***************************************************/
+static void* test_writer(void* arg)
+{
+    (void)arg;
+    for (uint32_t n = 1u; n <= TEST_FRAMES; n++)
+    {
+        TEST_FRAME* f = (TEST_FRAME*)snapshot_begin(&test_store);
+        f->words[0] = n;
+        f->words[TEST_WORDS - 1u] = n;
+        snapshot_publish(&test_store);
+    }
+    test_done = true;
+
+    return NULL;
+}
+
+void setUp(void)
+{
+    snapshot_init(&test_store, test_buf, sizeof(TEST_FRAME));
+    test_done = false;
+}
+
+void tearDown(void)
+{
+}
+
+void test_nothing_to_read_before_the_first_frame(void)
+{
+    TEST_FRAME f;
+
+    TEST_ASSERT_FALSE(snapshot_read(&test_store, &f, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0u, test_store.failures);
+}
+
+void test_read_returns_the_last_published_frame(void)
+{
+    TEST_FRAME w = {{0u}};
+    TEST_FRAME r;
+    uint32_t seq;
+
+    for (uint32_t n = 1u; n <= 3u; n++)
+    {
+        w.words[0] = n;
+        snapshot_write(&test_store, &w);
+    }
+    TEST_ASSERT_TRUE(snapshot_read(&test_store, &r, &seq));
+    TEST_ASSERT_EQUAL_UINT32(3u, r.words[0]);
+    TEST_ASSERT_EQUAL_UINT32(3u, seq); /* frames are numbered from 1 */
+}
+
+void test_reader_during_a_write_gets_the_published_frame(void)
+{
+    TEST_FRAME w = {{7u}};
+    TEST_FRAME r;
+    TEST_FRAME* f;
+
+    snapshot_write(&test_store, &w);
+    f = (TEST_FRAME*)snapshot_begin(&test_store);
+    f->words[0] = 8u;
+    TEST_ASSERT_TRUE(snapshot_read(&test_store, &r, NULL)); /* a reader preempting the writer */
+    TEST_ASSERT_EQUAL_UINT32(7u, r.words[0]);
+    snapshot_publish(&test_store);
+    TEST_ASSERT_TRUE(snapshot_read(&test_store, &r, NULL));
+    TEST_ASSERT_EQUAL_UINT32(8u, r.words[0]);
+    TEST_ASSERT_EQUAL_UINT32(0u, test_store.retries);
+}
+
+void test_concurrent_reads_are_never_torn(void)
+{
+    pthread_t writer;
+    TEST_FRAME r;
+    uint32_t torn = 0u;
+    uint32_t last = 0u;
+    uint32_t backwards = 0u;
+
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&writer, NULL, test_writer, NULL));
+    while (!test_done)
+    {
+        uint32_t seq;
+        if (snapshot_read(&test_store, &r, &seq))
+        {
+            torn += ((r.words[0] != seq) || (r.words[TEST_WORDS - 1u] != seq)) ? 1u : 0u;
+            backwards += (seq < last) ? 1u : 0u;
+            last = seq;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(0, pthread_join(writer, NULL));
+
+    TEST_ASSERT_EQUAL_UINT32(0u, torn);
+    TEST_ASSERT_EQUAL_UINT32(0u, backwards);
+    TEST_ASSERT_TRUE(test_store.reads > 0u);
+    TEST_ASSERT_TRUE(snapshot_read(&test_store, &r, NULL));
+    TEST_ASSERT_EQUAL_UINT32(TEST_FRAMES, r.words[0]);
+}
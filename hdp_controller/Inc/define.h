@@ -23,6 +23,7 @@
 #define DISABLE_TEMPERATURE
 #define DISABLE_LED
 #define DISABLE_LOGGING
+#define ENABLE_PWM_TIMER_PERIPHERALS
 
 /**
  * @def CONSOLE_TX_DMA_BUF_LEN
@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+"""Patch the CRC-32 of the firmware image into the .image_crc section of the ELF file.
+
+The image is the flash content from the vector table up to the reference word, the gaps between
+the sections filled with 0xFF as in erased flash. The controller checks it in the background with
+the CRC peripheral (Components/Src/flash_scan.c).
+
+Usage: image_crc.py <objcopy> <elf>
+"""
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+
+def main():
+    objcopy, elf = sys.argv[1], sys.argv[2]
+    with tempfile.TemporaryDirectory() as tmp:
+        image = os.path.join(tmp, "image.bin")
+        subprocess.run([objcopy, "-O", "binary", "-S", "--gap-fill", "0xFF", elf, image], check=True)
+        with open(image, "rb") as f:
+            data = f.read()
+        if (len(data) % 4) != 0:
+            sys.exit("image_crc: image size %u is not a multiple of 4, .image_crc must be the last section in flash" % len(data))
+
+        crc = zlib.crc32(data[:-4]) & 0xFFFFFFFF
+        reference = os.path.join(tmp, "crc.bin")
+        with open(reference, "wb") as f:
+            f.write(struct.pack("<I", crc))
+        subprocess.run([objcopy, "--update-section", ".image_crc=" + reference, elf], check=True)
+
+    print("Image CRC-32 %08X over %u bytes" % (crc, len(data) - 4))
+
+
+if __name__ == "__main__":
+    main()
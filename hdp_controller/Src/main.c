@@ -25,11 +25,31 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include "bench.h"
+#include "calib.h"
 #include "commands.h"
+#include "config.h"
 #include "console.h"
+#include "coroutine.h"
+#include "crc.h"
+#include "display.h"
+#include "dli.h"
+#include "dose.h"
+#include "energy.h"
+#include "fan.h"
+#include "flash_scan.h"
+#include "handoff.h"
+#include "interlock.h"
+#include "irrigation.h"
+#include "memdma.h"
+#include "pid.h"
+#include "pump_monitor.h"
 #include "rtc.h"
+#include "scope.h"
+#include "supervisor.h"
 #include "timer.h"
 #include "uart.h"
+#include "vpd.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -76,6 +96,114 @@ DMA_HandleTypeDef handle_GPDMA1_Channel0;
 HCD_HandleTypeDef hhcd_USB_DRD_FS;
 
 /* USER CODE BEGIN PV */
+/* Raw capture of the internal channels, the analog watchdog is set with the "scope awd" command */
+static const SCOPE_CONFIG scope_config = {
+    .channels = {ADC_CHANNEL_VREFINT, ADC_CHANNEL_TEMPSENSOR, ADC_CHANNEL_VCORE, ADC_CHANNEL_VBAT},
+    .num_channels = 4u,
+    .rate_hz = 1000u,
+    .awd_index = 0u,
+    .awd_low = 0u,
+    .awd_high = 4095u,
+};
+
+/* Fans: 25 kHz PWM on TIM4 CH3 (PB8) and CH4 (PB9), tachometers on TIM15 CH1 (PA2) and TIM8 CH1 (PC6) */
+static TIM_HandleTypeDef htim4 = {.Instance = TIM4};
+static TIM_HandleTypeDef htim8 = {.Instance = TIM8};
+static TIM_HandleTypeDef htim15 = {.Instance = TIM15};
+static const FAN_HW fan_hw[] = {
+    {
+        .name = "intake",
+        .pwm_htim = &htim4,
+        .pwm_channel = TIM_CHANNEL_3,
+        .pwm_port = GPIOB,
+        .pwm_pin = GPIO_PIN_8,
+        .pwm_af = GPIO_AF2_TIM4,
+        .tach_htim = &htim15,
+        .tach_channel = TIM_CHANNEL_1,
+        .tach_port = GPIOA,
+        .tach_pin = GPIO_PIN_2,
+        .tach_af = GPIO_AF14_TIM15,
+    },
+    {
+        .name = "exhaust",
+        .pwm_htim = &htim4,
+        .pwm_channel = TIM_CHANNEL_4,
+        .pwm_port = GPIOB,
+        .pwm_pin = GPIO_PIN_9,
+        .pwm_af = GPIO_AF2_TIM4,
+        .tach_htim = &htim8,
+        .tach_channel = TIM_CHANNEL_1,
+        .tach_port = GPIOC,
+        .tach_pin = GPIO_PIN_6,
+        .tach_af = GPIO_AF3_TIM8,
+    },
+};
+
+/* Ebb and flow zones: pump and drain valve outputs on PB12 .. PB15, float switches on PC0 .. PC3 (EXTI0 .. EXTI3) */
+static const IRRIGATION_HW irrigation_hw[IRRIGATION_MAX_ZONES] = {
+    {
+        .name = "table 1",
+        .fill_port = GPIOB,
+        .fill_pin = GPIO_PIN_12,
+        .drain_port = GPIOB,
+        .drain_pin = GPIO_PIN_13,
+        .full_port = GPIOC,
+        .full_pin = GPIO_PIN_0,
+        .empty_port = GPIOC,
+        .empty_pin = GPIO_PIN_1,
+    },
+    {
+        .name = "table 2",
+        .fill_port = GPIOB,
+        .fill_pin = GPIO_PIN_14,
+        .drain_port = GPIOB,
+        .drain_pin = GPIO_PIN_15,
+        .full_port = GPIOC,
+        .full_pin = GPIO_PIN_2,
+        .empty_port = GPIOC,
+        .empty_pin = GPIO_PIN_3,
+    },
+};
+
+/* Interlock outputs: pump PWM (TIM3 CH1 on PB4) and the fill pumps of the zones */
+static const INTERLOCK_OUTPUT interlock_outputs[] = {
+    {.port = GPIOB, .pin = GPIO_PIN_4},
+    {.port = GPIOB, .pin = GPIO_PIN_12},
+    {.port = GPIOB, .pin = GPIO_PIN_14},
+};
+
+/* Interlock inputs: leak detector on PA8 (EXTI8) stops all pumps, reservoir overflow switch on PB5 (EXTI5) the fill pumps */
+static const INTERLOCK_INPUT interlock_inputs[] = {
+    {.name = "leak", .port = GPIOA, .pin = GPIO_PIN_8, .trip_level = GPIO_PIN_RESET, .outputs = 0x07u},
+    {.name = "overflow", .port = GPIOB, .pin = GPIO_PIN_5, .trip_level = GPIO_PIN_RESET, .outputs = 0x06u},
+};
+
+/* Energy metering: scans triggered by TIM6, 24 V rail on PA3 (IN8) and PB0 (IN15), lighting rail on PB1 (IN16) and PB2 (IN17) */
+static TIM_HandleTypeDef htim6 = {.Instance = TIM6};
+static const ENERGY_RAIL energy_rails[] = {
+    {.name = "24V", .v_channel = ADC_CHANNEL_8, .i_channel = ADC_CHANNEL_15, .uv_per_count = 1611u, .ua_per_count = 610u},
+    {.name = "lighting", .v_channel = ADC_CHANNEL_16, .i_channel = ADC_CHANNEL_17, .uv_per_count = 3223u, .ua_per_count = 1221u},
+};
+static bool energy_pump_active(void);
+static bool energy_fill_active(void);
+static bool energy_drain_active(void);
+static bool energy_fans_active(void);
+static const ENERGY_ACTUATOR energy_actuators[] = {
+    {.name = "pump", .rail = 0u, .is_active = energy_pump_active},
+    {.name = "fill", .rail = 0u, .is_active = energy_fill_active},
+    {.name = "drain", .rail = 0u, .is_active = energy_drain_active},
+    {.name = "fans", .rail = 0u, .is_active = energy_fans_active},
+    {.name = "lights", .rail = 1u, .is_active = NULL},
+};
+
+/* Status display: ST7735 on SPI1 (PA1 SCK, PA4 CS, PA7 MOSI), data/command on PC7, reset on PC8 */
+static const DISPLAY_HW display_hw = {
+    .hspi = &hspi1,
+    .dc_port = GPIOC,
+    .dc_pin = GPIO_PIN_7,
+    .rst_port = GPIOC,
+    .rst_pin = GPIO_PIN_8,
+};
 
 /* USER CODE END PV */
 
@@ -104,6 +232,109 @@ static void MX_HASH_Init(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+/***************************************************
+ * @brief Energy meter: the pump monitor sees the pump current
+ * @return true if the pump runs
+ ***************************************************/
+static bool energy_pump_active(void)
+{
+    const PUMP_MON_STATE state = pump_monitor_get_state();
+
+    return (state == PUMP_MON_RUNNING) || (state == PUMP_MON_DRY) || (state == PUMP_MON_BLOCKED);
+}
+
+/***************************************************
+ * @brief Energy meter: a zone is in a phase
+ * @param phase Phase
+ * @return true if any zone is in the phase
+ ***************************************************/
+static bool energy_irrigation_phase(IRRIGATION_PHASE phase)
+{
+    bool active = false;
+
+    for (uint32_t i = 0u; i < IRRIGATION_MAX_ZONES; i++)
+    {
+        active = active || (irrigation_get_phase(i) == phase);
+    }
+
+    return active;
+}
+
+/***************************************************
+ * @brief Energy meter: the fill pump of a zone is on
+ * @return true if a zone fills
+ ***************************************************/
+static bool energy_fill_active(void)
+{
+    return energy_irrigation_phase(IRRIGATION_FILL);
+}
+
+/***************************************************
+ * @brief Energy meter: the drain valve of a zone is open
+ * @return true if a zone drains
+ ***************************************************/
+static bool energy_drain_active(void)
+{
+    return energy_irrigation_phase(IRRIGATION_DRAIN);
+}
+
+/***************************************************
+ * @brief Energy meter: a fan is driven
+ * @return true if a fan spins up or runs
+ ***************************************************/
+static bool energy_fans_active(void)
+{
+    bool active = false;
+
+    for (uint32_t i = 0u; i < (sizeof(fan_hw) / sizeof(fan_hw[0])); i++)
+    {
+        const FAN_STATE state = fan_get_state(i);
+        active = active || (state == FAN_SPINUP) || (state == FAN_RUNNING);
+    }
+
+    return active;
+}
+
+/***************************************************
+ * @brief Display: status page with the tanks, the alarms and the setpoints, unchanged lines send nothing
+ ***************************************************/
+static void display_status_page(void)
+{
+    static const char* const phases[] = {"idle", "wait pump", "fill", "hold", "drain", "locked"};
+    static const char* const pump_states[] = {"unknown", "off", "running", "dry", "blocked", "no data"};
+    const PUMP_MON_STATE pump = pump_monitor_get_state();
+    const uint32_t tripped = interlock_get_tripped();
+    const int32_t ec = (int32_t)(pid_get_setpoint(PID_LOOP_EC) * 100.0f);
+    const int32_t ph = (int32_t)(pid_get_setpoint(PID_LOOP_PH) * 100.0f);
+    VPD_OUTPUT vpd;
+
+    display_printf(0u, 0u, DISPLAY_WHITE, DISPLAY_BLUE, "Hydroponics %12lu s ", timer_get_uptime());
+    for (uint32_t i = 0u; i < IRRIGATION_MAX_ZONES; i++)
+    {
+        const IRRIGATION_PHASE phase = irrigation_get_phase(i);
+        display_printf(0u, 16u + (i * DISPLAY_FONT_H), (phase == IRRIGATION_LOCKED) ? DISPLAY_RED : DISPLAY_WHITE, DISPLAY_BLACK, "%-9s %-16s", irrigation_hw[i].name, phases[phase]);
+    }
+    display_printf(0u, 40u, ((pump == PUMP_MON_DRY) || (pump == PUMP_MON_BLOCKED)) ? DISPLAY_RED : DISPLAY_WHITE, DISPLAY_BLACK, "Pump %-21s", pump_states[pump]);
+    if (tripped != 0u)
+    {
+        display_printf(0u, 48u, DISPLAY_RED, DISPLAY_BLACK, "Interlock tripped 0x%02lx   ", tripped);
+    }
+    else
+    {
+        display_printf(0u, 48u, DISPLAY_GREEN, DISPLAY_BLACK, "Interlock ok%14s", "");
+    }
+    display_printf(0u, 64u, DISPLAY_YELLOW, DISPLAY_BLACK, "EC setpoint %3ld.%02ld%9s", ec / 100, ec % 100, "");
+    display_printf(0u, 72u, DISPLAY_YELLOW, DISPLAY_BLACK, "pH setpoint %3ld.%02ld%9s", ph / 100, ph % 100, "");
+    if (vpd_get_output(0u, &vpd))
+    {
+        display_printf(0u, 88u, DISPLAY_WHITE, DISPLAY_BLACK, "VPD %6ld Pa%-12s", vpd.vpd_pa, vpd.humidifier ? " humidify" : (vpd.dehumidifier ? " dehumidify" : ""));
+    }
+    else
+    {
+        display_printf(0u, 88u, DISPLAY_GREY, DISPLAY_BLACK, "VPD no data%15s", "");
+    }
+    display_printf(0u, 96u, DISPLAY_WHITE, DISPLAY_BLACK, "Dosed %8lu mL%9s", (uint32_t)dose_get_volume(), "");
+}
 
 /* USER CODE END 0 */
 
@@ -160,6 +391,61 @@ int main(void)
     console_enable_silent_printf(false);
     command_init();
     timer_init();
+    crc_init(&hcrc);
+    if (!config_init())
+    {
+        printf("No stored configuration, defaults loaded\r\n");
+    }
+    (void)handoff_init();
+    handoff_print();
+    bench_init();
+    memdma_init();
+    flash_scan_init();
+    supervisor_init(SUPERVISOR_IWDG_TIMEOUT);
+    supervisor_register(SUPERVISOR_JOB_COMMANDS, 500u, 250u);
+    supervisor_register(SUPERVISOR_JOB_CORO, 500u, 50u);
+    __HAL_RCC_TIM6_CLK_ENABLE();
+    if (!energy_init(&hadc1, &htim6, energy_rails, sizeof(energy_rails) / sizeof(energy_rails[0]), energy_actuators, sizeof(energy_actuators) / sizeof(energy_actuators[0])))
+    {
+        printf("Energy meter init failed\r\n");
+    }
+    if (!pump_monitor_init(&hadc1, ADC_CHANNEL_5, &htim3, TIM_CHANNEL_1))
+    {
+        printf("Pump monitor init failed\r\n");
+    }
+    if (!scope_init(&hadc4, &htim2, &scope_config))
+    {
+        printf("Scope init failed\r\n");
+    }
+    if (!calib_commit())
+    {
+        printf("ADC calibration factors not saved\r\n");
+    }
+    dli_init(rtc_get_seconds());
+    vpd_init();
+    __HAL_RCC_TIM4_CLK_ENABLE();
+    __HAL_RCC_TIM8_CLK_ENABLE();
+    __HAL_RCC_TIM15_CLK_ENABLE();
+    for (uint32_t i = 0u; i < (sizeof(fan_hw) / sizeof(fan_hw[0])); i++)
+    {
+        if (!fan_init(i, &fan_hw[i]))
+        {
+            printf("Fan %lu init failed\r\n", i);
+        }
+    }
+    for (uint32_t i = 0u; i < IRRIGATION_MAX_ZONES; i++)
+    {
+        (void)irrigation_init(i, &irrigation_hw[i]);
+    }
+    if (!interlock_init(interlock_inputs, sizeof(interlock_inputs) / sizeof(interlock_inputs[0]), interlock_outputs, sizeof(interlock_outputs) / sizeof(interlock_outputs[0])))
+    {
+        printf("Interlock init failed\r\n");
+    }
+    dose_init();
+    if (!display_init(&display_hw, display_status_page))
+    {
+        printf("Display init failed\r\n");
+    }
     /* USER CODE END 2 */
 
     /* Init scheduler */
@@ -177,7 +463,13 @@ int main(void)
     /* USER CODE BEGIN WHILE */
     while (true)
     {
+        supervisor_job_start(SUPERVISOR_JOB_COMMANDS);
         commands_proc();
+        supervisor_job_end(SUPERVISOR_JOB_COMMANDS);
+        supervisor_job_start(SUPERVISOR_JOB_CORO);
+        (void)coro_proc();
+        supervisor_job_end(SUPERVISOR_JOB_CORO);
+        (void)supervisor_proc();
         timer_delay(5u);
         /* USER CODE END WHILE */
 
@@ -22,6 +22,13 @@
 #include "stm32u5xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "energy.h"
+#include "interlock.h"
+#include "irrigation.h"
+#include "memdma.h"
+#include "pump_monitor.h"
+#include "scope.h"
+#include "supervisor.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -293,5 +300,117 @@ void USART1_IRQHandler(void)
 }
 
 /* USER CODE BEGIN 1 */
+/**
+  * @brief This function handles ADC1 global interrupt, injected conversions of the pump monitor and overruns of the energy meter.
+  */
+void ADC1_IRQHandler(void)
+{
+  pump_monitor_adc_irq();
+  energy_adc_irq();
+}
+
+/**
+  * @brief This function handles ADC4 global interrupt, used by the scope for the analog watchdog.
+  */
+void ADC4_IRQHandler(void)
+{
+  scope_adc_irq();
+}
+
+/**
+  * @brief This function handles GPDMA1 Channel 4 global interrupt, used by the scope.
+  */
+void GPDMA1_Channel4_IRQHandler(void)
+{
+  scope_dma_irq();
+}
+
+/**
+  * @brief This function handles TIM5 global interrupt, stops the scans of the scope after the trigger.
+  */
+void TIM5_IRQHandler(void)
+{
+  scope_stop_irq();
+}
+
+/**
+  * @brief This function handles GPDMA1 Channel 5 global interrupt, used by the energy meter.
+  */
+void GPDMA1_Channel5_IRQHandler(void)
+{
+  energy_dma_irq();
+}
+
+/**
+  * @brief This function handles GPDMA1 Channel 6 global interrupt, memory copies.
+  */
+void GPDMA1_Channel6_IRQHandler(void)
+{
+  memdma_irq(0u);
+}
+
+/**
+  * @brief This function handles GPDMA1 Channel 7 global interrupt, memory copies.
+  */
+void GPDMA1_Channel7_IRQHandler(void)
+{
+  memdma_irq(1u);
+}
+
+/**
+  * @brief This function handles EXTI Line0 interrupt, float switch of the irrigation.
+  */
+void EXTI0_IRQHandler(void)
+{
+  irrigation_exti_irq(0u);
+}
+
+/**
+  * @brief This function handles EXTI Line1 interrupt, float switch of the irrigation.
+  */
+void EXTI1_IRQHandler(void)
+{
+  irrigation_exti_irq(1u);
+}
+
+/**
+  * @brief This function handles EXTI Line2 interrupt, float switch of the irrigation.
+  */
+void EXTI2_IRQHandler(void)
+{
+  irrigation_exti_irq(2u);
+}
+
+/**
+  * @brief This function handles EXTI Line3 interrupt, float switch of the irrigation.
+  */
+void EXTI3_IRQHandler(void)
+{
+  irrigation_exti_irq(3u);
+}
+
+/**
+  * @brief This function handles EXTI Line5 interrupt, interlock overflow switch.
+  */
+void EXTI5_IRQHandler(void)
+{
+  interlock_exti_irq(5u);
+}
+
+/**
+  * @brief This function handles EXTI Line8 interrupt, interlock leak detector.
+  */
+void EXTI8_IRQHandler(void)
+{
+  interlock_exti_irq(8u);
+}
+
+/**
+  * @brief This function handles IWDG early wakeup interrupt, fault record of the supervisor.
+  */
+void IWDG_IRQHandler(void)
+{
+  supervisor_iwdg_irq();
+}
 
 /* USER CODE END 1 */